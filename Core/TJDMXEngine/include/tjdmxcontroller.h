@@ -17,11 +17,14 @@
 
 #include "tjdmxinternal.h"
 #include "tjdmxdevice.h"
+#include "tjdmxmixer.h"
 
 namespace tj {
 	namespace dmx {
 		using namespace tj::shared;
 
+		class DMXBatch;
+
 		class DMX_EXPORTED DMXMacro {
 			public:
 				enum DMXMacroType {
@@ -33,6 +36,7 @@ namespace tj {
 
 				virtual ~DMXMacro();
 				virtual void Set(float value) = 0;
+				virtual void Set(float value, DMXBatch& batch); // adds the change to the batch instead of applying it
 				virtual float Get() const = 0;
 				virtual std::wstring GetAddress() const = 0;
 				virtual float GetResult() const = 0;
@@ -48,8 +52,46 @@ namespace tj {
 		// DMXSlot's are dmx channels; the first slot is 1.
 		typedef unsigned int DMXSlot;
 
+		/** A DMXBatch collects channel and macro changes, so they can be applied to the controller at once (see
+		DMXController::Apply). This takes the controller lock only once and wakes up the mixer only once, instead of
+		once for every change. A batch is not thread-safe. **/
+		class DMX_EXPORTED DMXBatch {
+			friend class DMXController;
+
+			public:
+				DMXBatch();
+				~DMXBatch();
+				void Set(DMXSlot channel, int value, DMXSource source);
+				void Set(const std::wstring& macro, float value, DMXSource source);
+				void Set(ref<DMXMacro> macro, float value);
+				bool IsEmpty() const;
+				unsigned int GetSize() const;
+				void Clear();
+				void Swap(DMXBatch& other);
+				void Append(const DMXBatch& other);
+
+			protected:
+				struct ChannelChange {
+					DMXSlot _channel;
+					unsigned char _value;
+					DMXSource _source;
+				};
+
+				struct MacroChange {
+					std::wstring _macro;
+					float _value;
+					DMXSource _source;
+				};
+
+				std::vector<ChannelChange> _channels;
+				std::vector<MacroChange> _macros;
+		};
+
+		class DMXMixerThread;
+
 		class DMX_EXPORTED DMXController: public virtual Object {
 			friend class DMXDevice;
+			friend class DMXMixerThread;
 
 			public:
 				DMXController();
@@ -63,6 +105,7 @@ namespace tj {
 				void AddDeviceClass(ref<DMXDeviceClass> dc);
 				void RemoveDeviceClass(ref<DMXDeviceClass> dc);
 				std::set< ref<DMXDeviceClass> >& GetDeviceClasses();
+				void GetOutputStatistics(std::vector<DMXOutputStatistics>& stats);
 
 				/* Macro management */
 				ref<DMXMacro> CreateMacro(std::wstring address, DMXSource src); 
@@ -81,6 +124,7 @@ namespace tj {
 				int GetChannelResultCached(DMXSlot ch);
 				void Set(DMXSlot channel, int value, DMXSource source);
 				void Set(const std::wstring& macro, float value, DMXSource source);
+				void Apply(const DMXBatch& batch);
 				int Get(DMXSlot channel, DMXSource src);
 				int Get(const std::wstring& macro, DMXSource src);
 				bool IsSwitching(DMXSlot channel) const;
@@ -100,6 +144,9 @@ namespace tj {
 				unsigned int GetModificationID() const;		
 				void Process();
 				unsigned char const* GetTransmitBuffer() const;
+				unsigned int GetGeneration() const;
+				unsigned int GetUniverseGeneration(unsigned int universe) const;
+				bool GetLatestFrame(DMXFrame& frame) const;
 
 				/* Saving settings */
 				virtual void Save(TiXmlElement* you);
@@ -115,14 +162,33 @@ namespace tj {
 					float _manual;
 					float _sequence;
 					bool _submix;
+					unsigned int _index; // index into _macroValues, assigned by RebuildMacroIndex
+					std::vector<DMXSlot> _channels;
 
 					inline MacroInfo(float m = 0.0f, float s = 0.0f, bool is = false) {
 						_manual = m;
 						_sequence = s;
 						_submix = is;
+						_index = 0;
 					}
 				};
 
+				/** Compressed channel-to-macro index: the macros touching channel c (zero-based) are
+				_macros[_offsets[c]] up to (but not including) _macros[_offsets[c+1]]. The entries are
+				indices into _macroValues. **/
+				struct MacroChannelIndex {
+					std::vector<unsigned int> _offsets;
+					std::vector<unsigned int> _macros;
+				};
+
+				static void ParseMacroChannels(const std::wstring& address, std::vector<DMXSlot>& channels);
+				void RebuildMacroIndex();
+				void UpdateMacroChannel(DMXSlot ch);
+				bool SetChannelValue(DMXSlot channel, int value, DMXSource source);
+				bool SetMacroValue(const std::wstring& macro, float value, DMXSource source);
+				void UpdateSwitchingPlane();
+				void GetMixerPlanes(DMXMixer::Planes& planes) const;
+
 				struct DMXChannel {
 					DMXChannel() {
 						_sequence = 0;
@@ -135,23 +201,61 @@ namespace tj {
 				};
 				
 				void Transmit();
+				void Publish();
+				void NotifyDevices();
+				void Retire(unsigned char* buffer);
 				
 				// Locks
-				CriticalSection _lock; // locks modification of values
-				CriticalSection _transmitLock; // locks modification of transmit buffer
+				CriticalSection _lock; // locks modification of macros and settings (not needed for setting channel values)
+				CriticalSection _transmitLock; // locks modification of transmit buffer (held by the mixer)
+				CriticalSection _devicesLock; // locks the device set
+				ref<DMXMixerThread> _mixer;
+
+				/* Published frame. This is protected by a sequence lock: Publish (called by the mixer, with _transmitLock
+				held) makes _frameSequence odd while writing, and even again when done. Readers (GetLatestFrame) retry
+				when the sequence number was odd or changed while they were copying. Buffers are never freed while the
+				controller lives (see Retire), so a reader can never touch freed memory. **/
+				volatile long _frameSequence;
+				unsigned char* volatile _frameData;
+				unsigned int* volatile _frameUniverseGenerations;
+				volatile unsigned int _frameChannelCount;
+				volatile unsigned int _frameGeneration;
+				unsigned int _frameCapacity;
+				std::vector<unsigned char*> _retired;
+				std::vector<unsigned int*> _retiredGenerations;
 
 				// Dirty flags
 				volatile unsigned int _modificationID;
 				volatile bool _allDirty;
 				volatile bool _anyDirty;
 
+				// Generations: _generation is incremented every time Process changes the transmit buffer. For each
+				// universe, _universeGenerations contains the generation in which that universe last changed.
+				volatile unsigned int _generation;
+				std::vector<unsigned int> _universeGenerations;
+
 				// Values
 				DMXChannel _grandMaster;
 				DMXChannel _sequenceMaster;
-				volatile DMXChannel* _values;
+
+				/* Channel values, stored as planes (one byte per channel) for the mixer (see DMXMixer). Writers do not
+				lock these; the planes are only reallocated when the channel count grows beyond _planeCapacity, and the
+				old planes are retired instead of freed. **/
+				unsigned char* volatile _manual;
+				unsigned char* volatile _sequence;
+				unsigned char* _switching;
+				unsigned char* volatile _dirty;
+				unsigned int _planeCapacity;
 				std::map<std::wstring, MacroInfo > _macro;
+
+				// Compiled macro index; only rebuilt when macros are created or destroyed
+				std::vector<float> _macroValues; // Util::Max(manual, sequence) for each macro
+				MacroChannelIndex _sceneIndex;
+				MacroChannelIndex _submixIndex;
+				std::vector<float> _channelSceneMaximum; // highest scene macro value for each channel
+				std::vector<float> _channelSubmixRatio; // grand master times all submix macro values for each channel
 				std::set< DMXSlot > _switchingSlots;
-				unsigned char* _transmit;
+				unsigned char* volatile _transmit; // read without a lock by GetChannelResultCached and GetTransmitBuffer; retired like the planes
 				volatile unsigned int _channelCount;
 				
 				std::set< ref<DMXDevice> > _devices;
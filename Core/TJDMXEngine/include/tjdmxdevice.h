@@ -16,6 +16,7 @@
 #define _TJDMXDEVICE_H
 
 #include "tjdmxinternal.h"
+#include "tjdmxoutputclock.h"
 
 namespace tj {
 	namespace dmx {
@@ -23,6 +24,28 @@ namespace tj {
 
 		class DMXController;
 
+		/** A DMXFrame is a private copy of the DMX data published by the controller, obtained through
+		DMXController::GetLatestFrame. Each device thread keeps its own frame, so it never has to lock the
+		controller in order to read DMX data. **/
+		class DMX_EXPORTED DMXFrame {
+			friend class DMXController;
+
+			public:
+				DMXFrame();
+				~DMXFrame();
+				unsigned int GetGeneration() const;
+				unsigned int GetUniverseGeneration(unsigned int universe) const;
+				unsigned int GetUniverseCount() const;
+				unsigned int GetChannelCount() const;
+				const unsigned char* GetData() const;
+
+			protected:
+				bool _valid;
+				unsigned int _generation;
+				std::vector<unsigned int> _universeGenerations;
+				std::vector<unsigned char> _data;
+		};
+
 		#ifdef TJ_DMX_HAS_TJSHAREDUI
 			class DMX_EXPORTED DMXDevice: public Thread, public virtual Serializable, public Inspectable {
 		#else
@@ -44,6 +67,9 @@ namespace tj {
 				void SetController(ref<DMXController> controller);
 				void Transmit(); // signals thread to transmit
 				void SetRetransmitEvery(Time ms);
+				void SetRefreshRate(int hz);
+				void SetOutputMode(DMXOutputMode mode);
+				void GetOutputStatistics(DMXOutputStatistics& stats) const;
 				
 				virtual void Load(TiXmlElement* you);
 				virtual void Save(TiXmlElement* you);
@@ -52,12 +78,26 @@ namespace tj {
 				virtual void OnTransmit(ref<DMXController> controller) = 0;
 				virtual void Connect() = 0;
 				CriticalSection* GetLock();
+				bool ShouldTransmitUniverse(unsigned int universe);
+				void UpdateClock();
+
+				struct UniverseState {
+					UniverseState();
+					bool _transmitted;
+					unsigned int _generation;
+					Timestamp _lastTransmit;
+				};
 
 				Event _update;
 				volatile bool _running;
 				weak<DMXController> _controller;
 				CriticalSection _lock;
 				Time _retransmitTime;
+				int _refreshRate;
+				bool _continuousOutput;
+				DMXOutputClock _clock;
+				std::vector<UniverseState> _universes;
+				DMXFrame _frame; // private copy of the latest frame published by the controller
 		};
 
 		/** A DMXDeviceClass manages a class of devices. For instance, it may support a few
@@ -29,6 +29,7 @@ namespace tj {
 				SimpleDMXMacro(DMXController* controller, int channel, DMXSource src, bool invert = false);
 				virtual ~SimpleDMXMacro();
 				virtual void Set(float value);
+				virtual void Set(float value, DMXBatch& batch);
 				virtual float Get() const;
 				virtual std::wstring GetAddress() const;
 				virtual float GetResult() const;
@@ -49,6 +50,7 @@ namespace tj {
 				NullDMXMacro();
 				virtual ~NullDMXMacro();
 				virtual void Set(float value);
+				virtual void Set(float value, DMXBatch& batch);
 				virtual float Get() const;
 				virtual DMXMacroType GetType() const;
 				virtual std::wstring GetAddress() const;
@@ -65,6 +67,7 @@ namespace tj {
 				PreciseDMXMacro(DMXController* controller, int channel, DMXSource src, bool invert = false);
 				virtual ~PreciseDMXMacro();
 				virtual void Set(float value);
+				virtual void Set(float value, DMXBatch& batch);
 				virtual float Get() const;
 				virtual std::wstring GetAddress() const;
 				virtual float GetResult() const;
@@ -83,6 +86,7 @@ namespace tj {
 				ComplexDMXMacro(DMXController* controller, std::wstring address, DMXSource src, bool invert = false);
 				virtual ~ComplexDMXMacro();
 				virtual void Set(float value);
+				virtual void Set(float value, DMXBatch& batch);
 				virtual float Get() const;
 				virtual DMXMacroType GetType() const;
 				virtual std::wstring GetAddress() const;
@@ -0,0 +1,77 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+ #ifndef _TJDMXMIXER_H
+#define _TJDMXMIXER_H
+
+#include "tjdmxinternal.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define TJ_DMX_MIXER_SSE2 1
+#endif
+
+#if defined(__AVX2__)
+	#define TJ_DMX_MIXER_AVX2 1
+#endif
+
+namespace tj {
+	namespace dmx {
+		using namespace tj::shared;
+
+		/** The DMX mixer computes the transmitted value for a range of channels from structure-of-arrays 'planes'
+		(one byte or float per channel). For each channel, the result is:
+
+		highest = max(manual, max(manual, sequence) * sequenceMaster, sceneMaximum)
+		result = int(submixRatio * highest * 255)
+		result = switching ? (result >= 127 ? 255 : 0) : result
+		transmit = int(result * grandMaster)
+
+		which is exactly what DMXController::GetChannelResult computes (followed by the grand master multiplication
+		in DMXController::Process). The submix ratio is precomputed by the controller as the grand master value
+		multiplied by each submix macro value in turn, so the float operations are performed in the same order as
+		they always were. The vectorized versions process 16 channels per iteration and produce results
+		that are bit-for-bit equal to the scalar version (MixScalar). **/
+		class DMX_EXPORTED DMXMixer {
+			public:
+				struct Planes {
+					const unsigned char* _manual;
+					const unsigned char* _sequence;
+					const float* _sceneMaximum;
+					const float* _submixRatio; // grand master times the submix macro values
+					const unsigned char* _switching; // 0 or 1 for each channel
+				};
+
+				static const unsigned int KBlockSize;
+
+				/** Mixes channels [offset, offset+count) into out[offset, offset+count) using the fastest available
+				implementation. **/
+				static void Mix(const Planes& planes, float grandMaster, float sequenceMaster, unsigned char* out, unsigned int offset, unsigned int count);
+				static void MixScalar(const Planes& planes, float grandMaster, float sequenceMaster, unsigned char* out, unsigned int offset, unsigned int count);
+				static unsigned char MixChannel(const Planes& planes, float grandMaster, float sequenceMaster, unsigned int channel);
+				static const wchar_t* GetImplementationName();
+				static bool Verify(const Planes& planes, float grandMaster, float sequenceMaster, unsigned int offset, unsigned int count);
+
+			protected:
+				#ifdef TJ_DMX_MIXER_SSE2
+					static void MixSSE2(const Planes& planes, float grandMaster, float sequenceMaster, unsigned char* out, unsigned int offset, unsigned int count);
+				#endif
+
+				#ifdef TJ_DMX_MIXER_AVX2
+					static void MixAVX2(const Planes& planes, float grandMaster, float sequenceMaster, unsigned char* out, unsigned int offset, unsigned int count);
+				#endif
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,96 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+ #ifndef _TJDMXOUTPUTCLOCK_H
+#define _TJDMXOUTPUTCLOCK_H
+
+#include "tjdmxinternal.h"
+
+namespace tj {
+	namespace dmx {
+		using namespace tj::shared;
+
+		enum DMXOutputMode {
+			DMXOutputModeContinuous = 0,	// Send a frame on every tick of the clock, whether something changed or not
+			DMXOutputModeOnChange			// Send a frame when something changed, but not more often than the refresh rate
+		};
+
+		struct DMX_EXPORTED DMXOutputStatistics {
+			DMXOutputStatistics();
+
+			std::wstring _device;
+			int _refreshRate;
+			DMXOutputMode _mode;
+			unsigned int _frames;			// Frames sent
+			unsigned int _dropped;			// Frames that could not be sent on time (the device was too slow)
+			unsigned int _coalesced;		// Change notifications that were merged into another frame
+			float _averageJitter;			// Average difference between the scheduled and actual send time (ms)
+			float _maximumJitter;			// Largest difference between the scheduled and actual send time (ms)
+		};
+
+		/** The DMXOutputClock schedules the frames sent by a device at a fixed refresh rate. All clocks use the same
+		monotonic time source (Timestamp); in continuous mode, deadlines are computed from the previous deadline rather
+		than from the previous send time, so the output rate does not drift. Each device thread owns a clock and calls
+		GetWaitTime to find out how long to sleep, and OnFrame after it sent a frame. **/
+		class DMX_EXPORTED DMXOutputClock {
+			public:
+				DMXOutputClock(int refreshRate = KDefaultRefreshRate, DMXOutputMode mode = DMXOutputModeOnChange);
+				~DMXOutputClock();
+
+				void SetRefreshRate(int hz);
+				int GetRefreshRate() const;
+				void SetMode(DMXOutputMode mode);
+				DMXOutputMode GetMode() const;
+
+				/** Returns the number of milliseconds to wait before the next frame is due, or zero if a frame should be
+				sent right now. When the clock is in 'on change' mode and nothing changed, the device only needs to wake
+				up for keep-alive frames; if keepAlive is zero or less, this returns -1 (wait until notified). **/
+				int GetWaitTime(int keepAlive);
+				void Notify();
+				void OnFrame();
+
+				/** Versions of GetWaitTime and OnFrame that take the current time instead of reading the clock, so
+				that a schedule can be replayed exactly (see test/tjdmxoutputclocktest.cpp). **/
+				int GetWaitTime(int keepAlive, const Timestamp& now);
+				void OnFrame(const Timestamp& now);
+				void Reset();
+				void GetStatistics(DMXOutputStatistics& stats) const;
+
+				const static int KDefaultRefreshRate = 44;
+				const static int KMaximumRefreshRate = 1000;
+
+			protected:
+				long double GetPeriod() const;
+
+				mutable CriticalSection _lock;
+				int _refreshRate;
+				DMXOutputMode _mode;
+				bool _started;
+				Timestamp _epoch;				// Time at which the first frame was sent; other times are in ms relative to this
+				bool _deadlineSet;
+				long double _deadline;			// Time at which the next frame is due
+				long double _lastFrame;			// Time at which the last frame was sent
+				unsigned int _notifications;
+
+				unsigned int _frames;
+				unsigned int _dropped;
+				unsigned int _coalesced;
+				unsigned int _jitterSamples;
+				long double _totalJitter;
+				long double _maximumJitter;
+		};
+	}
+}
+
+#endif
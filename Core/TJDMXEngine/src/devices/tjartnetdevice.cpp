@@ -81,6 +81,7 @@ std::wstring DMXArtNetDevice::GetDeviceID() {
 }
 
 void DMXArtNetDevice::Save(TiXmlElement* you) {
+	DMXDevice::Save(you);
 	SaveAttribute(you, "address", _bcastAddress);
 	SaveAttribute(you, "port", _port);
 	SaveAttribute(you, "in-universe", _inUniverse);
@@ -89,6 +90,7 @@ void DMXArtNetDevice::Save(TiXmlElement* you) {
 }
 
 void DMXArtNetDevice::Load(TiXmlElement* you) {
+	DMXDevice::Load(you);
 	_bcastAddress = LoadAttribute(you, "address", _bcastAddress);
 	_port = LoadAttribute(you, "port", _port);
 	_inUniverse = LoadAttribute(you, "in-universe", _inUniverse);
@@ -103,13 +105,15 @@ unsigned int DMXArtNetDevice::GetSupportedUniversesCount() {
 void DMXArtNetDevice::OnTransmit(ref<DMXController> controller) {
 	if(_universeCount>0) {
 		NetworkAddress addr(_bcastAddress);
-		unsigned int universeCount = controller->GetUniverseCount();
+		unsigned int universeCount = _frame.GetUniverseCount();
 		
 		for(int a=0;a<_universeCount;a++) {
 			unsigned int inUniverse = _inUniverse + a;
-			if(inUniverse<universeCount) {
+
+			// Only send universes that have changed (or need to be refreshed)
+			if(inUniverse<universeCount && ShouldTransmitUniverse(inUniverse)) {
 				int in = inUniverse*512;
-				const unsigned char* transmit = controller->GetTransmitBuffer();
+				const unsigned char* transmit = _frame.GetData();
 				ArtDmx packet;
 				packet._universe = (unsigned short)_outUniverse + a;
 
@@ -124,7 +128,6 @@ void DMXArtNetDevice::OnTransmit(ref<DMXController> controller) {
 				_outBytes += (unsigned int)sizeof(ArtDmx);
 			}
 		}
-		Sleep(1000/60); // throttle to 60 packets/sec per universe 
 	}
 }
 
@@ -161,6 +164,9 @@ std::wstring DMXArtNetDevice::GetPort() {
 		prs->Add(GC::Hold(new GenericProperty<int>(TL(dmx_artnet_universe_out), this, &_outUniverse, _outUniverse)));
 		prs->Add(GC::Hold(new GenericProperty<int>(TL(dmx_artnet_port), this, &_port, _port)));
 		prs->Add(GC::Hold(new GenericProperty<std::wstring>(TL(dmx_artnet_address), this, &_bcastAddress, _bcastAddress)));
+		prs->Add(GC::Hold(new GenericProperty<Time>(TL(dmx_keep_alive), this, &_retransmitTime, _retransmitTime)));
+		prs->Add(GC::Hold(new GenericProperty<int>(TL(dmx_refresh_rate), this, &_refreshRate, _refreshRate)));
+		prs->Add(GC::Hold(new GenericProperty<bool>(TL(dmx_continuous_output), this, &_continuousOutput, _continuousOutput)));
 		return prs;
 	}
 #endif
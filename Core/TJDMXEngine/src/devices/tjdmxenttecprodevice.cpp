@@ -34,8 +34,8 @@ DMXEnttecProDevice::~DMXEnttecProDevice() {
 }
 
 void DMXEnttecProDevice::OnTransmit(ref<DMXController> controller) {
-	if(_universe < int(controller->GetUniverseCount())) {
-		const unsigned char* data = controller->GetTransmitBuffer();
+	if(_universe < int(_frame.GetUniverseCount())) {
+		const unsigned char* data = _frame.GetData();
 		_transmitBuffer[0] = 0x0; // Start code
 		unsigned int offset = _universe * 512;
 
@@ -125,12 +125,14 @@ DMXESPDevice::~DMXESPDevice() {
 }
 
 void DMXESPDevice::Save(TiXmlElement* you) {
+	DMXDevice::Save(you);
 	SaveAttribute(you, "address", _bcastAddress);
 	SaveAttribute(you, "port", _port);
 	SaveAttribute(you, "universe", _universe);
 }
 
 void DMXESPDevice::Load(TiXmlElement* you) {
+	DMXDevice::Load(you);
 	_bcastAddress = LoadAttribute(you, "address", _bcastAddress);
 	_port = LoadAttribute(you, "port", _port);
 	_universe = LoadAttribute(you, "universe", _universe);
@@ -141,11 +143,16 @@ std::wstring DMXESPDevice::GetDeviceID() {
 }
 
 void DMXESPDevice::OnTransmit(ref<DMXController> controller) {
+	// ESP always sends the first universe; skip it when it has not changed
+	if(!ShouldTransmitUniverse(0)) {
+		return;
+	}
+
 	NetworkAddress addr(_bcastAddress, false);
 	
 	if(_socket) {
 		ESPDataPacket esp;
-		const unsigned char* transmit = controller->GetTransmitBuffer();
+		const unsigned char* transmit = _frame.GetData();
 		esp.SetData(transmit, _useRLE);
 
 		int ob = esp.GetSize();
@@ -186,6 +193,9 @@ std::wstring DMXESPDevice::GetPort() {
 		prs->Add(GC::Hold(new GenericProperty<int>(TL(dmx_esp_port), this, &_port, _port)));
 		prs->Add(GC::Hold(new GenericProperty<std::wstring>(TL(dmx_esp_address), this, &_bcastAddress, _bcastAddress)));
 		prs->Add(GC::Hold(new GenericProperty<bool>(TL(dmx_esp_use_rle), this, &_useRLE, _useRLE)));
+		prs->Add(GC::Hold(new GenericProperty<Time>(TL(dmx_keep_alive), this, &_retransmitTime, _retransmitTime)));
+		prs->Add(GC::Hold(new GenericProperty<int>(TL(dmx_refresh_rate), this, &_refreshRate, _refreshRate)));
+		prs->Add(GC::Hold(new GenericProperty<bool>(TL(dmx_continuous_output), this, &_continuousOutput, _continuousOutput)));
 		return prs;
 	}
 #endif
@@ -65,6 +65,9 @@ std::wstring DMXLanboxDevice::GetDeviceName() const {
 		prs->Add(GC::Hold(new GenericProperty<unsigned int>(TL(dmx_lanbox_universe_in), this, &_universe, _universe)));
 		prs->Add(GC::Hold(new GenericProperty<int>(TL(dmx_lanbox_port), this, &_port, _port)));
 		prs->Add(GC::Hold(new GenericProperty<std::wstring>(TL(dmx_lanbox_address), this, &_address, _address)));
+		prs->Add(GC::Hold(new GenericProperty<Time>(TL(dmx_keep_alive), this, &_retransmitTime, _retransmitTime)));
+		prs->Add(GC::Hold(new GenericProperty<int>(TL(dmx_refresh_rate), this, &_refreshRate, _refreshRate)));
+		prs->Add(GC::Hold(new GenericProperty<bool>(TL(dmx_continuous_output), this, &_continuousOutput, _continuousOutput)));
 		return prs;
 	}
 #endif
@@ -75,6 +78,7 @@ unsigned int DMXLanboxDevice::GetSupportedUniversesCount() {
 
 void DMXLanboxDevice::Save(TiXmlElement* you) {
 	ThreadLock lock(&_lock);
+	DMXDevice::Save(you);
 	SaveAttribute(you, "address", _address);
 	SaveAttribute(you, "port", _port);
 	SaveAttribute(you, "universe", _universe);
@@ -82,6 +86,7 @@ void DMXLanboxDevice::Save(TiXmlElement* you) {
 
 void DMXLanboxDevice::Load(TiXmlElement* you) {
 	ThreadLock lock(&_lock);
+	DMXDevice::Load(you);
 	_address = LoadAttribute(you, "address", _address);
 	_port = LoadAttribute(you, "port", _port);
 	_universe = LoadAttribute(you, "universe", _universe);
@@ -100,9 +105,9 @@ void DMXLanboxDevice::OnTransmit(ref<DMXController> controller) {
 	const static unsigned int KPacketSize = 4 + 6 + 512; // packet header (4) + message header (6) + DMX values
 
 	ThreadLock lock(&_lock);
-	unsigned int universeCount = controller->GetUniverseCount();
+	unsigned int universeCount = _frame.GetUniverseCount();
 
-	if(_socket->IsValid() && _universe < universeCount) {
+	if(_socket->IsValid() && _universe < universeCount && ShouldTransmitUniverse(_universe)) {
 		NetworkAddress address(_address, false);
 
 		++_sequence;
@@ -122,7 +127,7 @@ void DMXLanboxDevice::OnTransmit(ref<DMXController> controller) {
 		buffer[8] = HighByte(KFirstChannel);
 		buffer[9] = LowByte(KFirstChannel);
 
-		const unsigned char* data = controller->GetTransmitBuffer();
+		const unsigned char* data = _frame.GetData();
 		
 		for(unsigned int a = 0; a < 512; ++a) {
 			buffer[a+10] = data[a + (_universe*512)];
@@ -115,8 +115,8 @@
 
 	void DMXSoundLightDevice::OnTransmit(ref<DMXController> controller) {
 		if(_proc!=0) {
-			const unsigned char* data = controller->GetTransmitBuffer();
-			if((unsigned int)(_universe) < controller->GetUniverseCount()) {
+			const unsigned char* data = _frame.GetData();
+			if((unsigned int)(_universe) < _frame.GetUniverseCount()) {
 				const unsigned char* universeData = &data[_universe * 512];
 
 				// Read the ports to ensure a USB connection and prevent the device from 
@@ -95,27 +95,88 @@ class SequenceMasterMacro: public DMXMacro {
 		bool _invert;
 };
 
+namespace tj {
+	namespace dmx {
+		/** The mixer thread runs DMXController::Process whenever values have changed, publishes the resulting frame
+		and then wakes up the device threads. **/
+		class DMXMixerThread: public Thread {
+			public:
+				DMXMixerThread(DMXController* controller): _controller(controller), _running(true) {
+				}
+
+				virtual ~DMXMixerThread() {
+				}
+
+				void Signal() {
+					_mix.Signal();
+				}
+
+				void Stop() {
+					_running = false;
+					_mix.Signal();
+				}
+
+			protected:
+				virtual void Run() {
+					SetName(L"DMX mixer");
+					while(true) {
+						_mix.Wait();
+						_mix.Reset();
+						if(!_running) {
+							return;
+						}
+
+						_controller->Process();
+					}
+				}
+
+				DMXController* _controller;
+				volatile bool _running;
+				Event _mix;
+		};
+	}
+}
+
+/* DMXController */
 DMXController::DMXController() {
 	_channelCount = 0;
-	_values = 0;
+	_planeCapacity = 0;
+	_manual = 0;
+	_sequence = 0;
+	_switching = 0;
+	_dirty = 0;
+	_transmit = 0;
+	_generation = 0;
+
+	_frameSequence = 0;
+	_frameData = 0;
+	_frameUniverseGenerations = 0;
+	_frameChannelCount = 0;
+	_frameGeneration = 0;
+	_frameCapacity = 0;
 
 	Reset();
+
+	_mixer = GC::Hold(new DMXMixerThread(this));
+	_mixer->Start();
 }
 
 void DMXController::Reset() {
 	ThreadLock lock(&_lock);
 
+	// The masters are set before the channel count, because the macro index includes the grand master value
 	_macro.clear();
-	SetChannelCount(512,true);
 	_grandMaster._manual = 255;
 	_grandMaster._sequence = 0;
 	_sequenceMaster._manual = 255;
 	_sequenceMaster._sequence = 0;
+	SetChannelCount(512,true);
 
 	_allDirty = false;
 	_highestChannelUsed = 1;
 	_modificationID = 0;
 	_switchingSlots.clear();
+	UpdateSwitchingPlane();
 }
 
 unsigned int DMXController::GetUniverseCount() const {
@@ -138,6 +199,7 @@ void DMXController::Load(TiXmlElement* you) {
 			}
 			channel = channel->NextSiblingElement("channel");
 		}
+		UpdateSwitchingPlane();
 	}
 
 	std::map< std::wstring, ref<DMXDevice> > devs;
@@ -227,42 +289,178 @@ void DMXController::SetChannelCount(unsigned int c, bool reset) {
 	ThreadLock lockTransmit(&_transmitLock);
 
 	if(c==_channelCount && !reset) return; // nothing to do...
-	volatile DMXController::DMXChannel* data = new DMXChannel[c];
-
-	if(_channelCount>0) {
-		if(reset) {
-			for(unsigned int a=0;a<c;a++) {
-				data[a]._dirty = true;
-				data[a]._manual = 0;
-				data[a]._sequence = 0;
-			}
+
+	if(c > _planeCapacity) {
+		/* Writers (Set) do not lock, so they may still be using the old planes. Fill the new planes first, then
+		publish the new pointers and only then the new channel count. The old planes are retired, not freed. The same
+		goes for the transmit buffer, which GetChannelResultCached and GetTransmitBuffer read without a lock. */
+		unsigned char* manual = new unsigned char[c];
+		unsigned char* sequence = new unsigned char[c];
+		unsigned char* dirty = new unsigned char[c];
+
+		for(unsigned int a=0;a<c;a++) {
+			bool keep = (!reset && a<_channelCount);
+			dirty[a] = 1;
+			manual[a] = keep ? _manual[a] : 0;
+			sequence[a] = keep ? _sequence[a] : 0;
 		}
-		else {
-			// copy over the old values
-			for(unsigned int a=0;(a<_channelCount && a<c);a++) {
-				data[a]._dirty = _values[a]._dirty;
-				data[a]._manual = _values[a]._manual;
-				data[a]._sequence = _values[a]._sequence;
+
+		if(_planeCapacity>0) {
+			Retire(_manual);
+			Retire(_sequence);
+			Retire(_dirty);
+			Retire(_switching);
+			Retire(_transmit);
+		}
+
+		_manual = manual;
+		_sequence = sequence;
+		_dirty = dirty;
+		_switching = new unsigned char[c];
+		_transmit = new unsigned char[c];
+		_planeCapacity = c;
+	}
+	else {
+		for(unsigned int a=0;a<c;a++) {
+			_dirty[a] = 1;
+			if(reset || a>=_channelCount) {
+				_manual[a] = 0;
+				_sequence[a] = 0;
 			}
 		}
-		delete[] _values;
-		delete[] _transmit;
 	}
-	_values = data;
 
-	// Create new transmit buffer and set dirty flags
-	_transmit = new unsigned char[c];
+	// Clear the transmit buffer
 	for(unsigned int a=0;a<c;a++) {
 		_transmit[a] = 0;
 	}
 
+	Atomic::Fence();
 	_channelCount = c;
 	_allDirty = true;
 	_anyDirty = true;
+	UpdateSwitchingPlane();
+
+	// All universes should be considered changed
+	unsigned int generation = ++_generation;
+	_universeGenerations.assign((c+511)/512, generation);
+
+	// The per-channel macro index depends on the channel count
+	RebuildMacroIndex();
+	Publish();
+	NotifyDevices();
+}
+
+/** Keeps a buffer alive until the controller is destroyed, because lock-free readers or writers may still be using it. Call with _transmitLock held. **/
+void DMXController::Retire(unsigned char* buffer) {
+	_retired.push_back(buffer);
+}
+
+/** Publishes the transmit buffer, so device threads can pick it up through GetLatestFrame. Takes _transmitLock, so
+there is only one writer at a time. **/
+void DMXController::Publish() {
+	ThreadLock lock(&_transmitLock);
+	unsigned int channelCount = _channelCount;
+	unsigned int universeCount = (unsigned int)_universeGenerations.size();
+
+	++_frameSequence; // odd: readers will wait
+	Atomic::Fence();
+
+	if(channelCount > _frameCapacity) {
+		if(_frameData!=0) {
+			Retire(_frameData);
+			_retiredGenerations.push_back((unsigned int*)_frameUniverseGenerations);
+		}
+		_frameData = new unsigned char[channelCount];
+		_frameUniverseGenerations = new unsigned int[(channelCount+511)/512];
+		_frameCapacity = channelCount;
+
+		// Readers load the channel count before the buffer pointers, so the new buffers must be visible first
+		Atomic::Fence();
+	}
+
+	memcpy(_frameData, _transmit, channelCount);
+	for(unsigned int a=0;a<universeCount && a<(channelCount+511)/512;a++) {
+		_frameUniverseGenerations[a] = _universeGenerations[a];
+	}
+	_frameChannelCount = channelCount;
+	_frameGeneration = _generation;
+
+	Atomic::Fence();
+	++_frameSequence; // even: frame is consistent again
+}
+
+/** Copies the most recently published frame into the given frame, unless the given frame is already the most
+recent one. Returns true if the frame was changed. This method never blocks. **/
+bool DMXController::GetLatestFrame(DMXFrame& frame) const {
+	while(true) {
+		long sequence = _frameSequence;
+		Atomic::Fence();
+
+		if((sequence % 2)!=0) {
+			continue; // The mixer is publishing a frame right now
+		}
+
+		unsigned int channelCount = _frameChannelCount;
+		unsigned int generation = _frameGeneration;
+		Atomic::Fence();
+		const unsigned char* data = _frameData;
+		const unsigned int* universeGenerations = _frameUniverseGenerations;
+		bool changed = false;
+
+		if(!frame._valid || frame._generation!=generation || frame._data.size()!=channelCount) {
+			unsigned int universeCount = (channelCount+511)/512;
+			frame._data.resize(channelCount);
+			frame._universeGenerations.resize(universeCount);
+			if(channelCount>0) {
+				memcpy(&(frame._data[0]), data, channelCount);
+				memcpy(&(frame._universeGenerations[0]), universeGenerations, sizeof(unsigned int)*universeCount);
+			}
+			changed = true;
+		}
+
+		Atomic::Fence();
+		if(sequence==_frameSequence) {
+			if(changed) {
+				frame._generation = generation;
+				frame._valid = true;
+			}
+			return changed;
+		}
+		// A new frame was published while we were copying; try again
+	}
+}
+
+void DMXController::UpdateSwitchingPlane() {
+	ThreadLock lock(&_transmitLock);
+	if(_switching==0) {
+		return;
+	}
+
+	for(unsigned int a=0;a<_channelCount;a++) {
+		_switching[a] = 0;
+	}
+
+	std::set<DMXSlot>::const_iterator it = _switchingSlots.begin();
+	while(it!=_switchingSlots.end()) {
+		DMXSlot ch = *it;
+		if(ch > 0 && ch <= _channelCount) {
+			_switching[ch-1] = 1;
+		}
+		++it;
+	}
+}
+
+void DMXController::GetMixerPlanes(DMXMixer::Planes& planes) const {
+	planes._manual = _manual;
+	planes._sequence = _sequence;
+	planes._switching = _switching;
+	planes._sceneMaximum = _channelSceneMaximum.empty() ? 0 : &(_channelSceneMaximum[0]);
+	planes._submixRatio = _channelSubmixRatio.empty() ? 0 : &(_channelSubmixRatio[0]);
 }
 
 void DMXController::AddDevice(ref<DMXDevice> d) {
-	ThreadLock lock(&_lock);
+	ThreadLock lock(&_devicesLock);
 	_devices.insert(d);
 	d->SetController(this);
 	d->Start();
@@ -273,7 +471,7 @@ bool DMXController::IsDeviceEnabled(ref<DMXDevice> d) const {
 }
 
 void DMXController::ToggleDevice(ref<DMXDevice> d) {
-	ThreadLock lock(&_lock);
+	ThreadLock lock(&_devicesLock);
 	std::set< ref<DMXDevice> >::iterator it = _devices.find(d);
 	if(it!=_devices.end()) {
 		_devices.erase(it);
@@ -285,7 +483,7 @@ void DMXController::ToggleDevice(ref<DMXDevice> d) {
 }
 
 void DMXController::RemoveDevice(ref<DMXDevice> d) {
-	ThreadLock lock(&_lock);
+	ThreadLock lock(&_devicesLock);
 
 	std::set< ref<DMXDevice> >::iterator it = _devices.find(d);
 	if(it!=_devices.end()) {
@@ -326,13 +524,20 @@ void DMXController::SetSwitching(DMXSlot channel, bool s) {
 	else {
 		_switchingSlots.erase(channel);
 	}
-	_allDirty = true; // TODO: replace this with _dirty[channel] = true? need bound-checking on channel then!
+
+	if(channel > 0 && channel <= _channelCount) {
+		_switching[channel-1] = s ? 1 : 0;
+		_dirty[channel-1] = 1;
+		_anyDirty = true;
+	}
 }
 
 void DMXController::SetSwitching(const std::set<DMXSlot>& scs) {
 	ThreadLock lock(&_lock);
 	_switchingSlots = scs;
+	UpdateSwitchingPlane();
 	_allDirty = true;
+	_anyDirty = true;
 }
 
 void DMXController::GetSwitching(std::set<DMXSlot>& scs) const {
@@ -396,7 +601,10 @@ ref<DMXMacro> DMXController::CreateMacro(std::wstring address, DMXSource source)
 		macro = GC::Hold(new ComplexDMXMacro(this, original, source, invert));
 		
 		if(_macro.find(original) == _macro.end()) {
-			_macro[original] = MacroInfo(submix?1.0f:0.0f, 0.0f, submix);
+			MacroInfo& mi = _macro[original];
+			mi = MacroInfo(submix?1.0f:0.0f, 0.0f, submix);
+			ParseMacroChannels(original, mi._channels);
+			RebuildMacroIndex();
 		}
 	}
 
@@ -418,12 +626,167 @@ DMXSlot DMXController::ParseChannelNumber(const std::wstring& n) {
 	}
 }
 
+void DMXController::ParseMacroChannels(const std::wstring& original, std::vector<DMXSlot>& channels) {
+	std::wstring address = original;
+	if(address.length()>0 && address.at(0)==L'-') {
+		address = address.substr(1);
+	}
+
+	if(address.length()>0 && (address.at(0)==L'M'||address.at(0)==L'm')) {
+		address = address.substr(1);
+	}
+
+	std::vector<std::wstring> parts = Explode<std::wstring>(address, std::wstring(L","));
+	std::vector<std::wstring>::const_iterator it = parts.begin();
+	while(it!=parts.end()) {
+		DMXSlot channel = ParseChannelNumber(*it);
+		if(channel>0 && std::find(channels.begin(), channels.end(), channel)==channels.end()) {
+			channels.push_back(channel);
+		}
+		++it;
+	}
+}
+
+/** Rebuilds the channel-to-macro index from the _macro map. This is only necessary when macros are created
+or destroyed (or when the channel count changes); changing a macro value only updates the channels it touches
+(see UpdateMacroChannel). **/
+void DMXController::RebuildMacroIndex() {
+	ThreadLock lock(&_lock);
+	ThreadLock lockTransmit(&_transmitLock);
+
+	unsigned int channelCount = _channelCount;
+	_macroValues.resize(_macro.size());
+	_sceneIndex._offsets.assign(channelCount+1, 0);
+	_submixIndex._offsets.assign(channelCount+1, 0);
+
+	// First pass: assign macro indices and count the number of macros touching each channel
+	unsigned int index = 0;
+	std::map<std::wstring, MacroInfo>::iterator it = _macro.begin();
+	while(it!=_macro.end()) {
+		MacroInfo& mi = it->second;
+		mi._index = index;
+		_macroValues[index] = Util::Max(mi._manual, mi._sequence);
+		MacroChannelIndex& mci = mi._submix ? _submixIndex : _sceneIndex;
+
+		std::vector<DMXSlot>::const_iterator cit = mi._channels.begin();
+		while(cit!=mi._channels.end()) {
+			DMXSlot ch = *cit;
+			if(ch > 0 && ch <= channelCount) {
+				++(mci._offsets[ch]);
+			}
+			++cit;
+		}
+		++index;
+		++it;
+	}
+
+	for(unsigned int a=0;a<channelCount;a++) {
+		_sceneIndex._offsets[a+1] += _sceneIndex._offsets[a];
+		_submixIndex._offsets[a+1] += _submixIndex._offsets[a];
+	}
+
+	// Second pass: fill in the macro indices
+	_sceneIndex._macros.resize(_sceneIndex._offsets[channelCount]);
+	_submixIndex._macros.resize(_submixIndex._offsets[channelCount]);
+	std::vector<unsigned int> sceneFill(_sceneIndex._offsets.begin(), _sceneIndex._offsets.end()-1);
+	std::vector<unsigned int> submixFill(_submixIndex._offsets.begin(), _submixIndex._offsets.end()-1);
+
+	it = _macro.begin();
+	while(it!=_macro.end()) {
+		const MacroInfo& mi = it->second;
+		MacroChannelIndex& mci = mi._submix ? _submixIndex : _sceneIndex;
+		std::vector<unsigned int>& fill = mi._submix ? submixFill : sceneFill;
+
+		std::vector<DMXSlot>::const_iterator cit = mi._channels.begin();
+		while(cit!=mi._channels.end()) {
+			DMXSlot ch = *cit;
+			if(ch > 0 && ch <= channelCount) {
+				mci._macros[fill[ch-1]++] = mi._index;
+			}
+			++cit;
+		}
+		++it;
+	}
+
+	_channelSceneMaximum.assign(channelCount, 0.0f);
+	_channelSubmixRatio.assign(channelCount, 1.0f);
+	for(DMXSlot a=1;a<=channelCount;a++) {
+		UpdateMacroChannel(a);
+	}
+
+	_allDirty = true;
+	_anyDirty = true;
+}
+
+/** Recomputes the scene maximum and submix ratio for a single channel from the macro index. Should be called
+with _lock held. The submix ratio starts at the grand master value and is then multiplied by each submix macro
+value in macro order, exactly like the original per-channel loop did, so that the result is bit-for-bit the
+same (float multiplication is not associative). **/
+void DMXController::UpdateMacroChannel(DMXSlot ch) {
+	if(ch<=0 || ch > _channelCount || ch > _channelSceneMaximum.size()) {
+		return;
+	}
+
+	unsigned int c = ch-1;
+	float highest = 0.0f;
+	for(unsigned int a=_sceneIndex._offsets[c];a<_sceneIndex._offsets[c+1];a++) {
+		highest = Util::Max(highest, _macroValues[_sceneIndex._macros[a]]);
+	}
+
+	float submixRatio = 1.0f;
+	submixRatio *= GetGrandMasterValue();
+	for(unsigned int a=_submixIndex._offsets[c];a<_submixIndex._offsets[c+1];a++) {
+		submixRatio *= _macroValues[_submixIndex._macros[a]];
+	}
+
+	_channelSceneMaximum[c] = highest;
+	_channelSubmixRatio[c] = submixRatio;
+	_dirty[c] = 1;
+}
+
 void DMXController::Set(const std::wstring& macro, float value, DMXSource source) {
 	ThreadLock lock(&_lock);
+	if(SetMacroValue(macro, value, source)) {
+		_anyDirty = true;
+		++_modificationID;
+		Transmit();
+	}
+}
+
+/** Applies all changes in the batch while holding the lock once, and then wakes up the mixer once. **/
+void DMXController::Apply(const DMXBatch& batch) {
+	if(batch.IsEmpty()) {
+		return;
+	}
+
+	ThreadLock lock(&_lock);
+	bool changed = false;
+
+	std::vector<DMXBatch::ChannelChange>::const_iterator cit = batch._channels.begin();
+	while(cit!=batch._channels.end()) {
+		changed = SetChannelValue(cit->_channel, cit->_value, cit->_source) || changed;
+		++cit;
+	}
 
+	std::vector<DMXBatch::MacroChange>::const_iterator mit = batch._macros.begin();
+	while(mit!=batch._macros.end()) {
+		changed = SetMacroValue(mit->_macro, mit->_value, mit->_source) || changed;
+		++mit;
+	}
+
+	if(changed) {
+		_anyDirty = true;
+		++_modificationID;
+		Transmit();
+	}
+}
+
+/** Changes the value of a macro and recomputes the channels it touches. Should be called with _lock held; does not
+notify the mixer. Returns false if the macro does not exist. **/
+bool DMXController::SetMacroValue(const std::wstring& macro, float value, DMXSource source) {
 	std::map<std::wstring, MacroInfo>::iterator it = _macro.find(macro);
 	if(it == _macro.end()) {
-		return; // all macros are registered in the _macro map
+		return false; // all macros are registered in the _macro map
 	}
 
 	MacroInfo& mi = it->second;
@@ -437,10 +800,16 @@ void DMXController::Set(const std::wstring& macro, float value, DMXSource source
 			break;
 	}
 
-	_allDirty = true;
-	_anyDirty = true;
-	++_modificationID;
-	Transmit();
+	// Only the channels touched by this macro need to be recomputed
+	if(mi._index < _macroValues.size()) {
+		_macroValues[mi._index] = Util::Max(mi._manual, mi._sequence);
+		std::vector<DMXSlot>::const_iterator cit = mi._channels.begin();
+		while(cit!=mi._channels.end()) {
+			UpdateMacroChannel(*cit);
+			++cit;
+		}
+	}
+	return true;
 }
 
 float DMXController::GetMacroResult(const std::wstring& macro) {
@@ -460,6 +829,7 @@ void DMXController::DestroyMacro(DMXMacro* macroptr) {
 	std::map<std::wstring, MacroInfo>::iterator it = _macro.find(addr);
 	if(it!=_macro.end()) {
 		_macro.erase(it);
+		RebuildMacroIndex();
 	}
 }
 
@@ -490,11 +860,9 @@ int DMXController::Get(const std::wstring& macro, DMXSource src) {
 	return 0;
 }
 
-inline int DMXController::GetChannelResult(DMXSlot ch) {
-	std::wostringstream chss;
-	chss << L"," << int(ch) << L",";
-	std::wstring chs = chss.str();
-
+/** This is the scalar reference for the transmitted value of a channel (before the final multiplication
+with the grand master in Process). Process itself uses DMXMixer, which yields exactly the same results. **/
+int DMXController::GetChannelResult(DMXSlot ch) {
 	float a = float(Get(ch, DMXManual)) / 255.0f;
 	float b = float(Get(ch, DMXSequence)) / 255.0f;
 
@@ -507,33 +875,13 @@ inline int DMXController::GetChannelResult(DMXSlot ch) {
 	float submixRatio = 1.0f;
 
 	if(ch > 0 && ch <= _channelCount) {
-		submixRatio *= GetGrandMasterValue();
-	}
-
-	if(_macro.size()>0) {
-		std::map<std::wstring, MacroInfo>::iterator it = _macro.begin();
-		while(it!=_macro.end()) {
-			std::wstring address = it->first;
-			std::wstring originalAddress = address;
-			if(address.at(0)==L'M'||address.at(0)==L'm') {
-				address = address.substr(1);
-			}
-
-			MacroInfo& mi = it->second;
-			address = L","+address+L",";
-
-			// is our channel in the address?
-			if(address.find(chs)!=std::wstring::npos) {
-				float val = Util::Max(mi._manual, mi._sequence);
-				if(mi._submix) {
-					submixRatio *= val;
-				}
-				else {
-					highest = Util::Max(val, highest);
-				}
-			}
-
-			++it;
+		// process scene and submix macro's (precomputed by UpdateMacroChannel, including the grand master)
+		if(ch <= _channelSceneMaximum.size()) {
+			highest = Util::Max(_channelSceneMaximum[ch-1], highest);
+			submixRatio = _channelSubmixRatio[ch-1];
+		}
+		else {
+			submixRatio *= GetGrandMasterValue();
 		}
 	}
 
@@ -558,36 +906,100 @@ int DMXController::GetChannelResultCached(DMXSlot ch) {
 		return -1;
 	}
 
+	// SetChannelCount publishes a larger transmit buffer before the larger channel count
+	Atomic::Fence();
 	return (int)_transmit[ch-1];
 }
 
+/** Mixes all dirty channels into the transmit buffer and publishes the result. This is normally only called by the
+mixer thread. **/
 void DMXController::Process() {
 	ThreadLock lock(&_transmitLock);
 	if(_anyDirty) {
+		// Writers set _anyDirty after setting the dirty flag of a channel, so clear it before looking at the flags
+		_anyDirty = false;
+		Atomic::Fence();
+
 		float master = GetGrandMasterValue();
+		unsigned int nextGeneration = _generation + 1;
+		bool changed = false;
 
 		if(master<=0.0f) {
 			for(unsigned int a=0;a<_channelCount;a++) {
-				_transmit[a] = 0;
+				if(_transmit[a]!=0) {
+					_transmit[a] = 0;
+					_universeGenerations[a/512] = nextGeneration;
+					changed = true;
+				}
 			}
 		}
 		else {
-			for(DMXSlot a=1;a<_highestChannelUsed+1;a++) {
-				volatile DMXChannel& channel = _values[a-1];
-				if(channel._dirty || _allDirty) {
-					_transmit[a-1] = (unsigned char)(int(float(GetChannelResult(a)) * master));
-					channel._dirty = false;
+			DMXMixer::Planes planes;
+			GetMixerPlanes(planes);
+			float sequenceMaster = GetSequenceMasterValue();
+			unsigned int used = Util::Min((unsigned int)_highestChannelUsed, (unsigned int)_channelCount);
+
+			// Mix all blocks of channels that contain at least one dirty channel
+			for(unsigned int block=0;block<used;block+=DMXMixer::KBlockSize) {
+				unsigned int count = Util::Min(DMXMixer::KBlockSize, used-block);
+				bool dirty = _allDirty;
+				for(unsigned int a=block;a<block+count && !dirty;a++) {
+					dirty = (_dirty[a]!=0);
+				}
+
+				if(dirty) {
+					// Clear the dirty flags before mixing, so that values set while mixing are picked up next time
+					for(unsigned int a=block;a<block+count;a++) {
+						_dirty[a] = 0;
+					}
+					Atomic::Fence();
+
+					unsigned char previous[16];
+					assert(count <= sizeof(previous));
+					memcpy(previous, _transmit+block, count);
+
+					DMXMixer::Mix(planes, master, sequenceMaster, _transmit, block, count);
+					assert(DMXMixer::Verify(planes, master, sequenceMaster, block, count));
+
+					// Blocks never span two universes, since 512 is a multiple of the block size
+					if(memcmp(previous, _transmit+block, count)!=0) {
+						_universeGenerations[block/512] = nextGeneration;
+						changed = true;
+					}
 				}
 			}
 		}
 
 		_allDirty = false;
-		_anyDirty = false;
+
+		if(changed) {
+			_generation = nextGeneration;
+			Publish();
+			NotifyDevices();
+		}
 	}
 }
 
+unsigned int DMXController::GetGeneration() const {
+	return _generation;
+}
+
+unsigned int DMXController::GetUniverseGeneration(unsigned int universe) const {
+	if(universe >= _universeGenerations.size()) {
+		return 0;
+	}
+	return _universeGenerations[universe];
+}
+
+/** Tells the mixer thread that values have changed. This does not block. **/
 void DMXController::Transmit() {
-	ThreadLock lock(&_transmitLock);
+	if(_mixer) {
+		_mixer->Signal();
+	}
+}
+
+void DMXController::NotifyDevices() {
+	ThreadLock lock(&_devicesLock);
 	std::set< ref<DMXDevice> >::iterator it = _devices.begin();
 	while(it!=_devices.end()) {
 		ref<DMXDevice> device = *it;
@@ -596,18 +1008,29 @@ void DMXController::Transmit() {
 	}
 }
 
+/** Returns the refresh rate, jitter and dropped frame statistics of the output clock of each enabled device. **/
+void DMXController::GetOutputStatistics(std::vector<DMXOutputStatistics>& stats) {
+	ThreadLock lock(&_devicesLock);
+	std::set< ref<DMXDevice> >::iterator it = _devices.begin();
+	while(it!=_devices.end()) {
+		ref<DMXDevice> device = *it;
+		DMXOutputStatistics deviceStats;
+		device->GetOutputStatistics(deviceStats);
+		stats.push_back(deviceStats);
+		++it;
+	}
+}
+
 int DMXController::Get(DMXSlot channel, DMXSource src) {
 	if(channel<=0 || channel > int(_channelCount)) {
 		return 0;
 	}
 
-	const volatile DMXChannel& value = _values[channel-1];
-
 	if(src==DMXManual) {
-		return value._manual;
+		return _manual[channel-1];
 	}
 	else {
-		return Util::Max(value._manual, value._sequence);
+		return Util::Max(_manual[channel-1], _sequence[channel-1]);
 	}
 }
 
@@ -631,6 +1054,7 @@ int DMXController::GetSequenceMaster(DMXSource src) {
 
 void DMXController::SetGrandMaster(int value, DMXSource src) {
 	if(value<0 || value>255) return;
+	float previous = GetGrandMasterValue();
 
 	switch(src) {
 		case DMXManual:
@@ -642,6 +1066,14 @@ void DMXController::SetGrandMaster(int value, DMXSource src) {
 			break;
 	}
 
+	// The submix ratio of each channel includes the grand master value
+	if(GetGrandMasterValue()!=previous) {
+		ThreadLock lock(&_lock);
+		for(DMXSlot a=1;a<=_channelCount;a++) {
+			UpdateMacroChannel(a);
+		}
+	}
+
 	_grandMaster._dirty = true;
 	_anyDirty = true;
 	_allDirty = true;
@@ -671,26 +1103,109 @@ void DMXController::SetSequenceMaster(int value, DMXSource src) {
 
 // Channel 0 is Grand Master
 void DMXController::Set(DMXSlot channel, int value, DMXSource src) {
+	if(SetChannelValue(channel, value, src)) {
+		_anyDirty = true;
+		++_modificationID;
+		Transmit();
+	}
+}
+
+/** Writes a channel value to the planes and marks it dirty; does not notify the mixer. No locking is needed here,
+the mixer picks up the value through the dirty flag. Returns false for invalid channels or values. **/
+bool DMXController::SetChannelValue(DMXSlot channel, int value, DMXSource src) {
 	if(channel<=0 || channel > int(_channelCount) || value <0 || value > 255) {
-		return;
+		return false;
 	}
 
 	if(src==DMXManual) {
-		ThreadLock lock(&_lock);
-		_values[channel-1]._manual = (unsigned char)value;
+		_manual[channel-1] = (unsigned char)value;
 	}
 	else {
-		ThreadLock lock(&_lock);
-		_values[channel-1]._sequence = (unsigned char)value;
+		_sequence[channel-1] = (unsigned char)value;
 	}
 
-	_values[channel-1]._dirty = true;
-	_anyDirty = true;
-	++_modificationID;
-	Transmit();
+	_dirty[channel-1] = 1;
+	return true;
+}
+
+/* DMXBatch */
+DMXBatch::DMXBatch() {
+}
+
+DMXBatch::~DMXBatch() {
+}
+
+void DMXBatch::Set(DMXSlot channel, int value, DMXSource source) {
+	ChannelChange cc;
+	cc._channel = channel;
+	cc._value = (unsigned char)Util::Max(0, Util::Min(value, 255));
+	cc._source = source;
+	_channels.push_back(cc);
+}
+
+void DMXBatch::Set(const std::wstring& macro, float value, DMXSource source) {
+	MacroChange mc;
+	mc._macro = macro;
+	mc._value = value;
+	mc._source = source;
+	_macros.push_back(mc);
+}
+
+void DMXBatch::Set(ref<DMXMacro> macro, float value) {
+	if(macro) {
+		macro->Set(value, *this);
+	}
+}
+
+bool DMXBatch::IsEmpty() const {
+	return _channels.empty() && _macros.empty();
+}
+
+unsigned int DMXBatch::GetSize() const {
+	return (unsigned int)(_channels.size() + _macros.size());
+}
+
+/** Removes all changes, but keeps the allocated memory, so a batch can be reused without allocating. **/
+void DMXBatch::Clear() {
+	_channels.clear();
+	_macros.clear();
+}
+
+void DMXBatch::Swap(DMXBatch& other) {
+	_channels.swap(other._channels);
+	_macros.swap(other._macros);
+}
+
+void DMXBatch::Append(const DMXBatch& other) {
+	_channels.insert(_channels.end(), other._channels.begin(), other._channels.end());
+	_macros.insert(_macros.end(), other._macros.begin(), other._macros.end());
 }
 
 DMXController::~DMXController()  {
+	if(_mixer) {
+		_mixer->Stop();
+		_mixer->WaitForCompletion();
+	}
+
+	std::vector<unsigned char*>::iterator it = _retired.begin();
+	while(it!=_retired.end()) {
+		delete[] *it;
+		++it;
+	}
+
+	std::vector<unsigned int*>::iterator git = _retiredGenerations.begin();
+	while(git!=_retiredGenerations.end()) {
+		delete[] *git;
+		++git;
+	}
+
+	delete[] _manual;
+	delete[] _sequence;
+	delete[] _dirty;
+	delete[] _switching;
+	delete[] _transmit;
+	delete[] _frameData;
+	delete[] _frameUniverseGenerations;
 }
 
 unsigned int DMXController::GetModificationID() const {
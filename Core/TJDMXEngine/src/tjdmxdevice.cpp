@@ -16,7 +16,7 @@
 #include "../include/tjdmxcontroller.h"
 using namespace tj::dmx;
 
-DMXDevice::DMXDevice(): _running(false) {
+DMXDevice::DMXDevice(): _running(false), _refreshRate(DMXOutputClock::KDefaultRefreshRate), _continuousOutput(false) {
 }
 
 DMXDevice::~DMXDevice() {
@@ -27,10 +27,42 @@ void DMXDevice::SetRetransmitEvery(Time ms) {
 	_retransmitTime = ms;
 }
 
+void DMXDevice::SetRefreshRate(int hz) {
+	_refreshRate = hz;
+}
+
+void DMXDevice::SetOutputMode(DMXOutputMode mode) {
+	_continuousOutput = (mode==DMXOutputModeContinuous);
+}
+
+void DMXDevice::GetOutputStatistics(DMXOutputStatistics& stats) const {
+	_clock.GetStatistics(stats);
+	stats._device = GetDeviceName();
+}
+
 void DMXDevice::Save(TiXmlElement* you) {
+	SaveAttribute(you, "keep-alive", _retransmitTime.ToInt());
+	SaveAttribute(you, "refresh-rate", _refreshRate);
+	SaveAttribute(you, "output-mode", std::wstring(_continuousOutput ? L"continuous" : L"changes"));
 }
 
 void DMXDevice::Load(TiXmlElement* you) {
+	_retransmitTime = Time(LoadAttribute(you, "keep-alive", _retransmitTime.ToInt()));
+	_refreshRate = LoadAttribute(you, "refresh-rate", _refreshRate);
+	_continuousOutput = LoadAttribute(you, "output-mode", std::wstring(_continuousOutput ? L"continuous" : L"changes"))==L"continuous";
+}
+
+/** Applies the refresh rate and output mode (which may have been changed through the properties) to the output
+clock. Called by the device thread only. **/
+void DMXDevice::UpdateClock() {
+	DMXOutputMode mode = _continuousOutput ? DMXOutputModeContinuous : DMXOutputModeOnChange;
+	if(_clock.GetMode()!=mode) {
+		_clock.SetMode(mode);
+	}
+
+	if(_clock.GetRefreshRate()!=_refreshRate) {
+		_clock.SetRefreshRate(_refreshRate);
+	}
 }
 
 void DMXDevice::Stop() {
@@ -45,19 +77,30 @@ void DMXDevice::Run() {
 	SetName(std::wstring(L"DMXDevice thread: ")+GetDeviceName());
 
 	Connect();
+	_clock.Reset();
+
+	while(true) {
+		/* Wait until the output clock says the next frame is due. Change notifications (in 'on change' mode) and
+		Stop wake the thread up early, after which the wait time is simply computed again. */
+		UpdateClock();
+		int wait = _clock.GetWaitTime(_retransmitTime.ToInt());
+		if(wait!=0 && _running) {
+			_update.Wait(wait);
+			_update.Reset();
+			continue;
+		}
 
-	while(_update.Wait()) {
-		_update.Reset();
 		if(_running) {
 			ThreadLock lock(&_lock);
 			ref<DMXController> controller = _controller;
 			if(controller) {
-				controller->Process(); // make sure we get the latest DMX data
+				controller->GetLatestFrame(_frame); // make sure we have the latest DMX data; does not lock the controller
 				OnTransmit(controller);	
 			}
 			else {
 				Log::Write(L"TJDMX/DMXDevice", L"No controller to transmit data from!");
 			}
+			_clock.OnFrame();
 		}
 		else {
 			Log::Write(L"TJDMX/DMXDevice", L"Thread end");
@@ -69,15 +112,83 @@ void DMXDevice::Run() {
 void DMXDevice::SetController(ref<DMXController> c) {
 	ThreadLock lock(&_lock);
 	_controller = c;
+	_universes.clear();
 }
 
+/** Called by the controller when new DMX data has been published. In continuous mode, the data is picked up on the
+next tick of the output clock, so the thread is not woken up. **/
 void DMXDevice::Transmit() {
-	_update.Signal();
+	_clock.Notify();
+	if(_clock.GetMode()==DMXOutputModeOnChange) {
+		_update.Signal();
+	}
 }
 
 CriticalSection* DMXDevice::GetLock() {
 	return &_lock;
 }
 
+/** Returns true when the specified universe in _frame has changed since this device last transmitted it, or when
+it was last transmitted longer than the retransmit time ago (keep-alive). In continuous output mode, this always
+returns true. When this method returns true, the device is expected to send the universe right away. **/
+bool DMXDevice::ShouldTransmitUniverse(unsigned int universe) {
+	if(universe >= _frame.GetUniverseCount()) {
+		return false;
+	}
+
+	if(universe >= _universes.size()) {
+		_universes.resize(universe+1);
+	}
+
+	UniverseState& us = _universes[universe];
+	unsigned int generation = _frame.GetGeneration();
+	bool send = (_clock.GetMode()==DMXOutputModeContinuous) || !us._transmitted || _frame.GetUniverseGeneration(universe) > us._generation;
+
+	if(!send && _retransmitTime.ToInt() > 0) {
+		Timestamp now(true);
+		send = now.Difference(us._lastTransmit).ToMilliSeconds() >= (long double)_retransmitTime.ToInt();
+	}
+
+	if(send) {
+		us._transmitted = true;
+		us._generation = generation;
+		us._lastTransmit.Now();
+	}
+	return send;
+}
+
+DMXDevice::UniverseState::UniverseState(): _transmitted(false), _generation(0) {
+}
+
+/* DMXFrame */
+DMXFrame::DMXFrame(): _valid(false), _generation(0) {
+}
+
+DMXFrame::~DMXFrame() {
+}
+
+unsigned int DMXFrame::GetGeneration() const {
+	return _generation;
+}
+
+unsigned int DMXFrame::GetUniverseGeneration(unsigned int universe) const {
+	if(universe >= _universeGenerations.size()) {
+		return 0;
+	}
+	return _universeGenerations[universe];
+}
+
+unsigned int DMXFrame::GetUniverseCount() const {
+	return (unsigned int)_data.size() / 512;
+}
+
+unsigned int DMXFrame::GetChannelCount() const {
+	return (unsigned int)_data.size();
+}
+
+const unsigned char* DMXFrame::GetData() const {
+	return _data.empty() ? 0 : &(_data[0]);
+}
+
 DMXDeviceClass::~DMXDeviceClass() {
 }
\ No newline at end of file
@@ -18,6 +18,12 @@ using namespace tj::dmx;
 DMXMacro::~DMXMacro() {
 }
 
+/** The default implementation applies the change right away; macros that map to channels or controller macros
+add the change to the batch instead. **/
+void DMXMacro::Set(float value, DMXBatch& batch) {
+	Set(value);
+}
+
 float DMXMacro::GetResultCached() const {
 	return GetResult();
 }
@@ -40,6 +46,11 @@ void SimpleDMXMacro::Set(float value) {
 	_controller->Set(_channel, int(value*255.0f), _source);
 }
 
+void SimpleDMXMacro::Set(float value, DMXBatch& batch) {
+	if(_invert) value = 1.0f-value;
+	batch.Set(_channel, int(value*255.0f), _source);
+}
+
 float SimpleDMXMacro::Get() const {
 	int v = _controller->Get(_channel, _source);
 	if(_invert) v = 255-v;
@@ -85,6 +96,16 @@ void PreciseDMXMacro::Set(float f) {
 	Set(int(f*65535));
 }
 
+void PreciseDMXMacro::Set(float f, DMXBatch& batch) {
+	if(_invert) f = 1.0f-f;
+	int v = int(f*65535);
+	if(v<0 || v>65535) return;
+
+	int coarse = v / 256;
+	batch.Set(_channel, coarse, _source);
+	batch.Set(_channel+1, v - (coarse*256), _source);
+}
+
 void PreciseDMXMacro::Set(int v) {
 	if(v<0 || v>65535) return;
 
@@ -163,6 +184,11 @@ void ComplexDMXMacro::Set(float value) {
 	_controller->Set(_address, value, _source);
 }
 
+void ComplexDMXMacro::Set(float value, DMXBatch& batch) {
+	if(_invert) value = 1.0f-value;
+	batch.Set(_address, value, _source);
+}
+
 float ComplexDMXMacro::Get() const {
 	int v = _controller->Get(_address, _source);
 	if(_invert) v = 255-v;
@@ -196,6 +222,10 @@ void NullDMXMacro::Set(float value) {
 	_value = value;
 }
 
+void NullDMXMacro::Set(float value, DMXBatch& batch) {
+	_value = value;
+}
+
 float NullDMXMacro::Get() const {
 	return _value;
 }
@@ -0,0 +1,216 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+ #include "../include/tjdmxmixer.h"
+
+#ifdef TJ_DMX_MIXER_SSE2
+	#include <emmintrin.h>
+#endif
+
+#ifdef TJ_DMX_MIXER_AVX2
+	#include <immintrin.h>
+#endif
+
+using namespace tj::dmx;
+
+const unsigned int DMXMixer::KBlockSize = 16;
+
+unsigned char DMXMixer::MixChannel(const Planes& planes, float grandMaster, float sequenceMaster, unsigned int c) {
+	float a = float(planes._manual[c]) / 255.0f;
+	float b = float(Util::Max(planes._manual[c], planes._sequence[c])) / 255.0f;
+
+	// multiply sequence value with sequence master
+	b *= sequenceMaster;
+	float highest = Util::Max(a,b);
+	highest = Util::Max(planes._sceneMaximum[c], highest);
+
+	float submixRatio = planes._submixRatio[c];
+	int result = int(submixRatio*highest*255.0f);
+	if(planes._switching[c]!=0) {
+		result = (result >= 127) ? 255 : 0;
+	}
+
+	return (unsigned char)(int(float(result) * grandMaster));
+}
+
+void DMXMixer::MixScalar(const Planes& planes, float grandMaster, float sequenceMaster, unsigned char* out, unsigned int offset, unsigned int count) {
+	for(unsigned int a=offset;a<offset+count;a++) {
+		out[a] = MixChannel(planes, grandMaster, sequenceMaster, a);
+	}
+}
+
+void DMXMixer::Mix(const Planes& planes, float grandMaster, float sequenceMaster, unsigned char* out, unsigned int offset, unsigned int count) {
+	#if defined(TJ_DMX_MIXER_AVX2)
+		MixAVX2(planes, grandMaster, sequenceMaster, out, offset, count);
+	#elif defined(TJ_DMX_MIXER_SSE2)
+		MixSSE2(planes, grandMaster, sequenceMaster, out, offset, count);
+	#else
+		MixScalar(planes, grandMaster, sequenceMaster, out, offset, count);
+	#endif
+}
+
+/** Checks whether Mix and MixScalar produce the same result for the given range of channels. Because other
+threads may be changing the planes, the range is copied first (at most KBlockSize channels). **/
+bool DMXMixer::Verify(const Planes& planes, float grandMaster, float sequenceMaster, unsigned int offset, unsigned int count) {
+	const static unsigned int KMaxCount = 16;
+	if(count > KMaxCount) {
+		return Verify(planes, grandMaster, sequenceMaster, offset, KMaxCount) && Verify(planes, grandMaster, sequenceMaster, offset+KMaxCount, count-KMaxCount);
+	}
+
+	unsigned char manual[KMaxCount], sequence[KMaxCount], switching[KMaxCount];
+	float sceneMaximum[KMaxCount], submixRatio[KMaxCount];
+	for(unsigned int a=0;a<count;a++) {
+		manual[a] = planes._manual[offset+a];
+		sequence[a] = planes._sequence[offset+a];
+		switching[a] = planes._switching[offset+a];
+		sceneMaximum[a] = planes._sceneMaximum[offset+a];
+		submixRatio[a] = planes._submixRatio[offset+a];
+	}
+
+	Planes copy;
+	copy._manual = manual;
+	copy._sequence = sequence;
+	copy._switching = switching;
+	copy._sceneMaximum = sceneMaximum;
+	copy._submixRatio = submixRatio;
+
+	unsigned char vectorResult[KMaxCount], scalarResult[KMaxCount];
+	Mix(copy, grandMaster, sequenceMaster, vectorResult, 0, count);
+	MixScalar(copy, grandMaster, sequenceMaster, scalarResult, 0, count);
+	return memcmp(vectorResult, scalarResult, count)==0;
+}
+
+const wchar_t* DMXMixer::GetImplementationName() {
+	#if defined(TJ_DMX_MIXER_AVX2)
+		return L"AVX2";
+	#elif defined(TJ_DMX_MIXER_SSE2)
+		return L"SSE2";
+	#else
+		return L"scalar";
+	#endif
+}
+
+#ifdef TJ_DMX_MIXER_SSE2
+	namespace tj {
+		namespace dmx {
+			namespace mixer {
+				/** Mixes four channels; the operations are performed in exactly the same order as in MixChannel, so
+				that the results are identical. Returns the four results as 32-bit integers. **/
+				static inline __m128i Mix4(__m128i manual, __m128i sequence, __m128 sceneMaximum, __m128 submixRatio, __m128i switching, __m128 grandMaster, __m128 sequenceMaster) {
+					const __m128 k255 = _mm_set1_ps(255.0f);
+
+					__m128 a = _mm_div_ps(_mm_cvtepi32_ps(manual), k255);
+					__m128 b = _mm_div_ps(_mm_cvtepi32_ps(sequence), k255);
+					b = _mm_mul_ps(b, sequenceMaster);
+
+					// _mm_max_ps(x,y) returns y when x>y is false, which matches Util::Max
+					__m128 highest = _mm_max_ps(a, b);
+					highest = _mm_max_ps(sceneMaximum, highest);
+
+					__m128i result = _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(submixRatio, highest), k255));
+
+					// Switching channels are either 0 or 255
+					__m128i switchMask = _mm_cmpgt_epi32(switching, _mm_setzero_si128());
+					__m128i switched = _mm_and_si128(_mm_cmpgt_epi32(result, _mm_set1_epi32(126)), _mm_set1_epi32(255));
+					result = _mm_or_si128(_mm_and_si128(switchMask, switched), _mm_andnot_si128(switchMask, result));
+
+					result = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(result), grandMaster));
+					return _mm_and_si128(result, _mm_set1_epi32(0xFF)); // same as the (unsigned char) cast
+				}
+			}
+		}
+	}
+
+	void DMXMixer::MixSSE2(const Planes& planes, float gm, float sm, unsigned char* out, unsigned int offset, unsigned int count) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 grandMaster = _mm_set1_ps(gm);
+		const __m128 sequenceMaster = _mm_set1_ps(sm);
+
+		unsigned int a = offset;
+		unsigned int end = offset + count;
+		for(;a+KBlockSize<=end;a+=KBlockSize) {
+			__m128i manual8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes._manual+a));
+			__m128i sequence8 = _mm_max_epu8(manual8, _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes._sequence+a)));
+			__m128i switching8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes._switching+a));
+
+			__m128i manual16[2] = { _mm_unpacklo_epi8(manual8, zero), _mm_unpackhi_epi8(manual8, zero) };
+			__m128i sequence16[2] = { _mm_unpacklo_epi8(sequence8, zero), _mm_unpackhi_epi8(sequence8, zero) };
+			__m128i switching16[2] = { _mm_unpacklo_epi8(switching8, zero), _mm_unpackhi_epi8(switching8, zero) };
+			__m128i result[4];
+
+			for(unsigned int q=0;q<4;q++) {
+				unsigned int h = q/2;
+				bool high = (q%2)!=0;
+				__m128i manual32 = high ? _mm_unpackhi_epi16(manual16[h], zero) : _mm_unpacklo_epi16(manual16[h], zero);
+				__m128i sequence32 = high ? _mm_unpackhi_epi16(sequence16[h], zero) : _mm_unpacklo_epi16(sequence16[h], zero);
+				__m128i switching32 = high ? _mm_unpackhi_epi16(switching16[h], zero) : _mm_unpacklo_epi16(switching16[h], zero);
+				__m128 scene = _mm_loadu_ps(planes._sceneMaximum+a+q*4);
+				__m128 submix = _mm_loadu_ps(planes._submixRatio+a+q*4);
+				result[q] = mixer::Mix4(manual32, sequence32, scene, submix, switching32, grandMaster, sequenceMaster);
+			}
+
+			__m128i packed = _mm_packus_epi16(_mm_packs_epi32(result[0], result[1]), _mm_packs_epi32(result[2], result[3]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out+a), packed);
+		}
+
+		// Remaining channels
+		MixScalar(planes, gm, sm, out, a, end-a);
+	}
+#endif
+
+#ifdef TJ_DMX_MIXER_AVX2
+	void DMXMixer::MixAVX2(const Planes& planes, float gm, float sm, unsigned char* out, unsigned int offset, unsigned int count) {
+		const __m256 grandMaster = _mm256_set1_ps(gm);
+		const __m256 sequenceMaster = _mm256_set1_ps(sm);
+		const __m256 k255 = _mm256_set1_ps(255.0f);
+		const __m256i k126 = _mm256_set1_epi32(126);
+		const __m256i kFF = _mm256_set1_epi32(0xFF);
+
+		unsigned int a = offset;
+		unsigned int end = offset + count;
+		for(;a+KBlockSize<=end;a+=KBlockSize) {
+			__m128i result[2];
+
+			for(unsigned int h=0;h<2;h++) {
+				unsigned int c = a + h*8;
+				__m128i manual8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(planes._manual+c));
+				__m128i sequence8 = _mm_max_epu8(manual8, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(planes._sequence+c)));
+				__m256i switching = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(planes._switching+c)));
+
+				__m256 av = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(manual8)), k255);
+				__m256 bv = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(sequence8)), k255);
+				bv = _mm256_mul_ps(bv, sequenceMaster);
+
+				__m256 highest = _mm256_max_ps(av, bv);
+				highest = _mm256_max_ps(_mm256_loadu_ps(planes._sceneMaximum+c), highest);
+
+				__m256 submixRatio = _mm256_loadu_ps(planes._submixRatio+c);
+				__m256i r = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(submixRatio, highest), k255));
+
+				__m256i switchMask = _mm256_cmpgt_epi32(switching, _mm256_setzero_si256());
+				__m256i switched = _mm256_and_si256(_mm256_cmpgt_epi32(r, k126), kFF);
+				r = _mm256_blendv_epi8(r, switched, switchMask);
+
+				r = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(r), grandMaster));
+				r = _mm256_and_si256(r, kFF);
+				result[h] = _mm_packs_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+			}
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out+a), _mm_packus_epi16(result[0], result[1]));
+		}
+
+		// Remaining channels
+		MixScalar(planes, gm, sm, out, a, end-a);
+	}
+#endif
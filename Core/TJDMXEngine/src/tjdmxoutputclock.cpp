@@ -0,0 +1,178 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+ #include "../include/tjdmxoutputclock.h"
+#include <math.h>
+using namespace tj::dmx;
+
+namespace tj {
+	namespace dmx {
+		namespace clock {
+			/** Returns (a-b) in milliseconds; Timestamp::Difference only returns the absolute difference. **/
+			static inline long double MilliSecondsBetween(const Timestamp& a, const Timestamp& b) {
+				long double ms = a.Difference(b).ToMilliSeconds();
+				return a.IsEarlierThan(b) ? -ms : ms;
+			}
+		}
+	}
+}
+
+DMXOutputStatistics::DMXOutputStatistics(): _refreshRate(0), _mode(DMXOutputModeOnChange), _frames(0), _dropped(0), _coalesced(0), _averageJitter(0.0f), _maximumJitter(0.0f) {
+}
+
+DMXOutputClock::DMXOutputClock(int refreshRate, DMXOutputMode mode): _refreshRate(KDefaultRefreshRate), _mode(mode) {
+	SetRefreshRate(refreshRate);
+	Reset();
+}
+
+DMXOutputClock::~DMXOutputClock() {
+}
+
+void DMXOutputClock::SetRefreshRate(int hz) {
+	ThreadLock lock(&_lock);
+	_refreshRate = Util::Max(1, Util::Min(hz, KMaximumRefreshRate));
+	_deadlineSet = false;
+}
+
+int DMXOutputClock::GetRefreshRate() const {
+	return _refreshRate;
+}
+
+void DMXOutputClock::SetMode(DMXOutputMode mode) {
+	ThreadLock lock(&_lock);
+	_mode = mode;
+	_deadlineSet = false;
+}
+
+DMXOutputMode DMXOutputClock::GetMode() const {
+	return _mode;
+}
+
+long double DMXOutputClock::GetPeriod() const {
+	return 1000.0 / (long double)_refreshRate;
+}
+
+void DMXOutputClock::Reset() {
+	ThreadLock lock(&_lock);
+	_started = false;
+	_deadlineSet = false;
+	_deadline = 0.0;
+	_lastFrame = 0.0;
+	_notifications = 0;
+	_frames = 0;
+	_dropped = 0;
+	_coalesced = 0;
+	_jitterSamples = 0;
+	_totalJitter = 0.0;
+	_maximumJitter = 0.0;
+}
+
+/** Called (from any thread) when the data to be sent has changed. **/
+void DMXOutputClock::Notify() {
+	ThreadLock lock(&_lock);
+	++_notifications;
+}
+
+int DMXOutputClock::GetWaitTime(int keepAlive) {
+	return GetWaitTime(keepAlive, Timestamp(true));
+}
+
+int DMXOutputClock::GetWaitTime(int keepAlive, const Timestamp& stamp) {
+	ThreadLock lock(&_lock);
+	if(!_started) {
+		return 0; // The first frame is always sent right away
+	}
+
+	long double now = clock::MilliSecondsBetween(stamp, _epoch);
+	long double period = GetPeriod();
+
+	if(!_deadlineSet) {
+		if(_mode==DMXOutputModeOnChange) {
+			if(_notifications==0) {
+				// Nothing to send; only wake up for keep-alive frames
+				if(keepAlive<=0) {
+					return -1;
+				}
+
+				long double remaining = _lastFrame + (long double)keepAlive - now;
+				return (remaining <= 0.0) ? 0 : int(ceil(remaining));
+			}
+
+			if(now >= _lastFrame + period) {
+				return 0; // The change can be sent right away without exceeding the refresh rate
+			}
+		}
+
+		_deadline = _lastFrame + period;
+		_deadlineSet = true;
+	}
+
+	long double remaining = _deadline - now;
+	return (remaining <= 0.0) ? 0 : int(ceil(remaining));
+}
+
+/** Called by the device thread right after it has sent a frame. Updates the deadline for the next frame and the
+jitter and dropped frame statistics. **/
+void DMXOutputClock::OnFrame() {
+	OnFrame(Timestamp(true));
+}
+
+void DMXOutputClock::OnFrame(const Timestamp& stamp) {
+	ThreadLock lock(&_lock);
+
+	if(!_started) {
+		_epoch = stamp;
+		_started = true;
+	}
+
+	long double now = clock::MilliSecondsBetween(stamp, _epoch);
+
+	if(_deadlineSet) {
+		long double period = GetPeriod();
+		long double late = now - _deadline;
+		long double jitter = fabs(late);
+		++_jitterSamples;
+		_totalJitter += jitter;
+		_maximumJitter = Util::Max(_maximumJitter, jitter);
+
+		if(_mode==DMXOutputModeContinuous) {
+			// Skip the ticks we missed instead of sending a burst of frames to catch up
+			unsigned int missed = (late >= period) ? (unsigned int)floor(late / period) : 0;
+			_dropped += missed;
+			_deadline += period * (long double)(missed + 1);
+		}
+		else {
+			_deadlineSet = false;
+		}
+	}
+
+	if(_notifications > 1) {
+		_coalesced += _notifications - 1;
+	}
+	_notifications = 0;
+
+	++_frames;
+	_lastFrame = now;
+}
+
+void DMXOutputClock::GetStatistics(DMXOutputStatistics& stats) const {
+	ThreadLock lock(&_lock);
+	stats._refreshRate = _refreshRate;
+	stats._mode = _mode;
+	stats._frames = _frames;
+	stats._dropped = _dropped;
+	stats._coalesced = _coalesced;
+	stats._averageJitter = (_jitterSamples > 0) ? float(_totalJitter / (long double)_jitterSamples) : 0.0f;
+	stats._maximumJitter = float(_maximumJitter);
+}
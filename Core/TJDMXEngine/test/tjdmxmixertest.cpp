@@ -0,0 +1,268 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Checks that the mixer (DMXController::GetChannelResult, DMXController::Process and the vectorized DMXMixer)
+produces exactly the same values as the original implementation of GetChannelResult, which searched the address
+string of every macro for each channel. Random macro, submix, switching and master configurations are used. */
+#include "../include/tjdmxcontroller.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sstream>
+
+using namespace tj::shared;
+using namespace tj::dmx;
+
+namespace tj {
+	namespace dmx {
+		namespace test {
+			class ReferenceController: public DMXController {
+				public:
+					unsigned int GetSubmixMacroCount(DMXSlot ch) const {
+						return _submixIndex._offsets[ch] - _submixIndex._offsets[ch-1];
+					}
+
+					float GetSubmixRatio(DMXSlot ch) const {
+						return _channelSubmixRatio[ch-1];
+					}
+
+					/** This is DMXController::GetChannelResult as it was before the macro index was introduced. The
+					part that processes the macros is in GetOriginalMacroResult, so the test can also compare the
+					intermediate submix ratio (a difference in the last bit rarely changes the integer result). **/
+					int GetOriginalChannelResult(DMXSlot ch) {
+						float highest, submixRatio;
+						GetOriginalMacroResult(ch, highest, submixRatio);
+
+						if(IsSwitching(ch)) {
+							return (int(submixRatio*highest*255.0f) >= 127) ? 255 : 0;
+						}
+						else {
+							return int(submixRatio*highest*255.0f);
+						}
+					}
+
+					void GetOriginalMacroResult(DMXSlot ch, float& highest, float& submixRatio) {
+						std::wostringstream chss;
+						chss << L"," << int(ch) << L",";
+						std::wstring chs = chss.str();
+
+						float a = float(Get(ch, DMXManual)) / 255.0f;
+						float b = float(Get(ch, DMXSequence)) / 255.0f;
+
+						// multiply sequence value with sequence master
+						b *= GetSequenceMasterValue();
+
+						highest = Util::Max(a,b);
+
+						// process submix macro's
+						submixRatio = 1.0f;
+
+						if(ch > 0 && ch <= _channelCount) {
+							submixRatio *= GetGrandMasterValue();
+						}
+
+						if(_macro.size()>0) {
+							std::map<std::wstring, MacroInfo>::iterator it = _macro.begin();
+							while(it!=_macro.end()) {
+								std::wstring address = it->first;
+								std::wstring originalAddress = address;
+								if(address.at(0)==L'M'||address.at(0)==L'm') {
+									address = address.substr(1);
+								}
+
+								MacroInfo& mi = it->second;
+								address = L","+address+L",";
+
+								// is our channel in the address?
+								if(address.find(chs)!=std::wstring::npos) {
+									float val = Util::Max(mi._manual, mi._sequence);
+									if(mi._submix) {
+										submixRatio *= val;
+									}
+									else {
+										highest = Util::Max(val, highest);
+									}
+								}
+
+								++it;
+							}
+						}
+					}
+			};
+
+			const static DMXSlot KChannels = 64;
+			const static int KConfigurations = 500;
+
+			static float RandomValue() {
+				// Mix values that are multiples of 1/255 (as set from faders) with arbitrary values
+				if(rand()%2==0) {
+					return float(rand()%256)/255.0f;
+				}
+				return float(rand())/float(RAND_MAX);
+			}
+
+			static std::wstring RandomAddress(bool submix) {
+				std::wostringstream wos;
+				if(submix) {
+					wos << ((rand()%2==0) ? L"M" : L"m");
+				}
+
+				// Complex macros always have more than one channel
+				DMXSlot first = 1 + rand()%KChannels;
+				DMXSlot second = 1 + (first + rand()%(KChannels-1)) % KChannels;
+				wos << first << L"," << second;
+
+				int more = rand()%6;
+				for(int a=0;a<more;a++) {
+					wos << L"," << (1 + rand()%KChannels);
+				}
+				return wos.str();
+			}
+
+			static int Compare(ref<ReferenceController> c, int configuration, const char* when) {
+				int failures = 0;
+				for(DMXSlot ch=1;ch<=KChannels;ch++) {
+					float highest, submixRatio;
+					c->GetOriginalMacroResult(ch, highest, submixRatio);
+					if(c->GetSubmixRatio(ch)!=submixRatio) {
+						printf("configuration %d (%s): channel %d submix ratio=%.9g, original=%.9g\n", configuration, when, int(ch), c->GetSubmixRatio(ch), submixRatio);
+						++failures;
+					}
+
+					int expected = c->GetOriginalChannelResult(ch);
+					int result = c->GetChannelResult(ch);
+					if(result!=expected) {
+						printf("configuration %d (%s): channel %d GetChannelResult=%d, original=%d\n", configuration, when, int(ch), result, expected);
+						++failures;
+					}
+				}
+
+				c->Process();
+				float master = c->GetGrandMasterValue();
+				for(DMXSlot ch=1;ch<=KChannels;ch++) {
+					int expected = master<=0.0f ? 0 : int((unsigned char)(int(float(c->GetOriginalChannelResult(ch)) * master)));
+					int result = c->GetChannelResultCached(ch);
+					if(result!=expected) {
+						printf("configuration %d (%s): channel %d transmitted=%d, original=%d\n", configuration, when, int(ch), result, expected);
+						++failures;
+					}
+				}
+				return failures;
+			}
+
+			static int TestController() {
+				int failures = 0;
+				int multipleSubmixChannels = 0;
+
+				for(int configuration=0;configuration<KConfigurations;configuration++) {
+					ref<ReferenceController> c = GC::Hold(new ReferenceController());
+					c->_highestChannelUsed = KChannels;
+					c->SetGrandMaster(rand()%256, DMXManual);
+					c->SetSequenceMaster(rand()%256, DMXManual);
+
+					// Channel values and switching channels
+					for(DMXSlot ch=1;ch<=KChannels;ch++) {
+						c->Set(ch, rand()%256, DMXManual);
+						c->Set(ch, rand()%256, DMXSequence);
+						if(rand()%8==0) {
+							c->SetSwitching(ch, true);
+						}
+					}
+
+					// Macros; about half of them are submix macros
+					std::vector< ref<DMXMacro> > macros;
+					int macroCount = 1 + rand()%16;
+					for(int a=0;a<macroCount;a++) {
+						std::wstring address = RandomAddress(rand()%2==0);
+						macros.push_back(c->CreateMacro(address, DMXManual));
+						c->Set(address, RandomValue(), DMXManual);
+						if(rand()%2==0) {
+							c->Set(address, RandomValue(), DMXSequence);
+						}
+					}
+
+					for(DMXSlot ch=1;ch<=KChannels;ch++) {
+						if(c->GetSubmixMacroCount(ch) >= 2) {
+							++multipleSubmixChannels;
+						}
+					}
+
+					failures += Compare(c, configuration, "after creating macros");
+
+					// Changing the grand master changes the precomputed submix ratio of every channel
+					c->SetGrandMaster(rand()%256, DMXManual);
+					failures += Compare(c, configuration, "after changing the grand master");
+
+					// Changing a macro only updates the channels it touches
+					c->Set(macros.at(rand()%macros.size())->GetAddress(), RandomValue(), DMXManual);
+					failures += Compare(c, configuration, "after changing a macro");
+
+					// Macros refer to the controller, so they must go first
+					macros.clear();
+				}
+
+				printf("controller: %d configurations, %d channels with two or more submix macros, %d failures\n", KConfigurations, multipleSubmixChannels, failures);
+				return failures;
+			}
+
+			/** Compares DMXMixer::Mix with DMXMixer::MixScalar on random planes, using ranges that do not start or end
+			at a block boundary. **/
+			static int TestMixer() {
+				const static unsigned int KCount = 1024;
+				unsigned char manual[KCount], sequence[KCount], switching[KCount], vectorResult[KCount], scalarResult[KCount];
+				float sceneMaximum[KCount], submixRatio[KCount];
+				int failures = 0;
+
+				for(int round=0;round<KConfigurations;round++) {
+					for(unsigned int a=0;a<KCount;a++) {
+						manual[a] = rand()%256;
+						sequence[a] = rand()%256;
+						switching[a] = (rand()%8==0) ? 1 : 0;
+						sceneMaximum[a] = (rand()%2==0) ? 0.0f : RandomValue();
+						submixRatio[a] = RandomValue() * RandomValue();
+					}
+
+					DMXMixer::Planes planes;
+					planes._manual = manual;
+					planes._sequence = sequence;
+					planes._switching = switching;
+					planes._sceneMaximum = sceneMaximum;
+					planes._submixRatio = submixRatio;
+
+					float grandMaster = RandomValue();
+					float sequenceMaster = RandomValue();
+					unsigned int offset = rand()%64;
+					unsigned int count = rand()%(KCount-offset);
+
+					DMXMixer::Mix(planes, grandMaster, sequenceMaster, vectorResult, offset, count);
+					DMXMixer::MixScalar(planes, grandMaster, sequenceMaster, scalarResult, offset, count);
+					for(unsigned int a=offset;a<offset+count;a++) {
+						if(vectorResult[a]!=scalarResult[a]) {
+							printf("mixer round %d: channel %d %ls=%d, scalar=%d\n", round, a, DMXMixer::GetImplementationName(), int(vectorResult[a]), int(scalarResult[a]));
+							++failures;
+						}
+					}
+				}
+
+				printf("mixer (%ls): %d rounds, %d failures\n", DMXMixer::GetImplementationName(), KConfigurations, failures);
+				return failures;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+	int failures = tj::dmx::test::TestController() + tj::dmx::test::TestMixer();
+	return (failures==0) ? 0 : 1;
+}
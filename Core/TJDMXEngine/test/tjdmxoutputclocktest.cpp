@@ -0,0 +1,158 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Replays schedules on the DMXOutputClock with explicit timestamps (milliseconds after an arbitrary start), so that the
+outcome does not depend on how the test is scheduled:
+- continuous mode: deadlines follow from the previous deadline, not from the time a frame was sent; late frames skip the
+  ticks that were missed and count them as dropped; jitter statistics;
+- 'on change' mode: without changes the device waits until notified (-1) or until the next keep-alive frame; changes are
+  sent right away unless that would exceed the refresh rate; notifications between frames are coalesced;
+- switching modes, Reset and the limits of the refresh rate.
+Timestamps are stored as (floating point) seconds, so a wait of n milliseconds may be rounded up to n+1. */
+#include "../include/tjdmxoutputclock.h"
+#include <stdio.h>
+#include <math.h>
+
+using namespace tj::shared;
+using namespace tj::dmx;
+
+namespace tj {
+	namespace dmx {
+		namespace test {
+			static int _failures = 0;
+			static Timestamp _start;
+
+			static void Check(bool ok, const char* what) {
+				if(!ok) {
+					printf("failed: %s\n", what);
+					++_failures;
+				}
+			}
+
+			/** Returns the timestamp ms milliseconds after the start of the schedule **/
+			static Timestamp At(int ms) {
+				return _start.Increment(Time(ms));
+			}
+
+			static void CheckWait(DMXOutputClock& clock, int keepAlive, int ms, int expected, const char* what) {
+				int wait = clock.GetWaitTime(keepAlive, At(ms));
+				bool ok = (expected <= 0) ? (wait==expected) : (wait==expected || wait==expected+1);
+				if(!ok) {
+					printf("at %d ms: waits %d ms, expected %d ms\n", ms, wait, expected);
+				}
+				Check(ok, what);
+			}
+
+			static bool IsAbout(float value, float expected) {
+				return fabs(value - expected) < 0.01f;
+			}
+
+			static void TestContinuous() {
+				DMXOutputClock clock(100, DMXOutputModeContinuous);
+				Check(clock.GetWaitTime(0, At(0))==0, "continuous: first frame is sent right away");
+				clock.OnFrame(At(0));
+
+				CheckWait(clock, 0, 0, 10, "continuous: next frame is due after one period");
+				CheckWait(clock, 0, 4, 6, "continuous: wait shrinks as time passes");
+				CheckWait(clock, 0, 11, 0, "continuous: frame is due at the deadline");
+
+				// Sent 2 ms late; the next deadline is still at 20 ms, not at 22 ms
+				clock.OnFrame(At(12));
+				CheckWait(clock, 0, 12, 8, "continuous: deadline does not drift with late frames");
+				clock.OnFrame(At(20));
+
+				// Without changes or keep-alive, continuous mode still ticks
+				CheckWait(clock, 0, 20, 10, "continuous: ticks without changes");
+
+				// Deadline at 30 ms; sent at 55 ms, so the ticks at 30 and 40 ms are dropped and the next is at 60 ms
+				clock.OnFrame(At(55));
+				CheckWait(clock, 0, 55, 5, "continuous: missed ticks are skipped");
+
+				DMXOutputStatistics stats;
+				clock.GetStatistics(stats);
+				Check(stats._mode==DMXOutputModeContinuous && stats._refreshRate==100, "continuous: statistics show mode and rate");
+				Check(stats._frames==4, "continuous: frames counted");
+				Check(stats._dropped==2, "continuous: missed ticks counted as dropped");
+				Check(IsAbout(stats._maximumJitter, 25.0f), "continuous: maximum jitter");
+				Check(IsAbout(stats._averageJitter, 9.0f), "continuous: average jitter");
+			}
+
+			static void TestOnChange() {
+				DMXOutputClock clock(50, DMXOutputModeOnChange);
+				Check(clock.GetWaitTime(0, At(0))==0, "on change: first frame is sent right away");
+				clock.OnFrame(At(0));
+
+				CheckWait(clock, 0, 5, -1, "on change: waits until notified without changes");
+				CheckWait(clock, 1000, 5, 995, "on change: wakes up for the keep-alive frame");
+				CheckWait(clock, 1000, 1000, 0, "on change: keep-alive frame is due");
+
+				// Two changes 5 ms after a frame: sent as one frame, one period (20 ms) after the previous one
+				clock.Notify();
+				clock.Notify();
+				CheckWait(clock, 0, 5, 15, "on change: refresh rate is not exceeded");
+				CheckWait(clock, 0, 21, 0, "on change: change is sent after one period");
+				clock.OnFrame(At(21));
+				CheckWait(clock, 0, 22, -1, "on change: waits until notified after sending the change");
+
+				// A change long after the last frame is sent right away
+				clock.Notify();
+				CheckWait(clock, 0, 50, 0, "on change: change is sent right away");
+				clock.OnFrame(At(50));
+
+				DMXOutputStatistics stats;
+				clock.GetStatistics(stats);
+				Check(stats._frames==3, "on change: frames counted");
+				Check(stats._coalesced==1, "on change: notifications coalesced");
+				Check(stats._dropped==0, "on change: no frames dropped");
+				Check(IsAbout(stats._maximumJitter, 1.0f), "on change: maximum jitter");
+			}
+
+			static void TestModesAndLimits() {
+				DMXOutputClock clock(100, DMXOutputModeOnChange);
+				clock.OnFrame(At(0));
+				CheckWait(clock, 0, 3, -1, "modes: waits until notified in 'on change' mode");
+				clock.SetMode(DMXOutputModeContinuous);
+				Check(clock.GetMode()==DMXOutputModeContinuous, "modes: mode changed");
+				CheckWait(clock, 0, 3, 7, "modes: ticks after switching to continuous mode");
+				clock.SetMode(DMXOutputModeOnChange);
+				CheckWait(clock, 0, 3, -1, "modes: waits until notified after switching back");
+
+				clock.SetRefreshRate(25);
+				clock.Notify();
+				CheckWait(clock, 0, 3, 37, "modes: new refresh rate applies to the next frame");
+
+				clock.Reset();
+				Check(clock.GetWaitTime(0, At(3))==0, "modes: first frame after Reset is sent right away");
+				DMXOutputStatistics stats;
+				clock.GetStatistics(stats);
+				Check(stats._frames==0 && stats._coalesced==0, "modes: Reset clears the statistics");
+
+				clock.SetRefreshRate(0);
+				Check(clock.GetRefreshRate()==1, "limits: lowest refresh rate");
+				clock.SetRefreshRate(DMXOutputClock::KMaximumRefreshRate*10);
+				Check(clock.GetRefreshRate()==DMXOutputClock::KMaximumRefreshRate, "limits: highest refresh rate");
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::dmx::test;
+	_start = Timestamp(true);
+	TestContinuous();
+	TestOnChange();
+	TestModesAndLimits();
+	printf("%d failures\n", _failures);
+	return (_failures==0) ? 0 : 1;
+}
@@ -0,0 +1,414 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Stress test and benchmark for the frame publication of DMXController. It has three parts:
+- Frames: one thread publishes frames in which every channel has the same value, while reader threads spin on
+  GetLatestFrame and check that they never see a frame that mixes the contents of two publications (a torn frame).
+- Growing: reader threads call GetChannelResultCached and GetTransmitBuffer while the channel count grows, which
+  replaces the planes and the transmit buffer.
+- Mixer: many writer threads call Set while several mock devices pick up frames through their output clocks. After
+  the writers stop, the published frame and the frame last sent by every device must match GetChannelResult.
+Usage: tjdmxstresstest [writers] [devices] [seconds] */
+#include "../include/tjdmxcontroller.h"
+#include "../include/tjdmxdevice.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace tj::shared;
+using namespace tj::dmx;
+
+namespace tj {
+	namespace dmx {
+		namespace test {
+			const static unsigned int KUniverses = 16;
+			static int _failures = 0;
+
+			static void Check(bool ok, const char* what) {
+				if(!ok) {
+					printf("failed: %s\n", what);
+					++_failures;
+				}
+			}
+
+			static void Wait(int ms) {
+				Event wait;
+				wait.Wait(ms);
+			}
+
+			class StressController: public DMXController {
+				public:
+					/** Publishes a frame in which all channels and all universe generations are derived from n **/
+					void PublishPattern(unsigned int n) {
+						ThreadLock lock(&_transmitLock);
+						unsigned char* transmit = _transmit;
+						for(unsigned int a=0;a<_channelCount;a++) {
+							transmit[a] = (unsigned char)(n & 0xFF);
+						}
+						_generation = n;
+						_universeGenerations.assign(_universeGenerations.size(), n);
+						Publish();
+					}
+			};
+
+			/** Spins on GetLatestFrame and checks that every frame it gets is one of the published patterns **/
+			class FrameReader: public Thread {
+				public:
+					FrameReader(ref<StressController> controller): _running(true), _frames(0), _torn(0), _controller(controller) {
+					}
+
+					virtual ~FrameReader() {
+					}
+
+					void Stop() {
+						_running = false;
+					}
+
+					volatile bool _running;
+					unsigned int _frames;
+					unsigned int _torn;
+
+				protected:
+					virtual void Run() {
+						DMXFrame frame;
+						while(_running) {
+							if(_controller->GetLatestFrame(frame)) {
+								++_frames;
+								unsigned char expected = (unsigned char)(frame.GetGeneration() & 0xFF);
+								const unsigned char* data = frame.GetData();
+								bool torn = false;
+								for(unsigned int a=0;a<frame.GetChannelCount();a++) {
+									if(data[a]!=expected) {
+										torn = true;
+										break;
+									}
+								}
+								for(unsigned int u=0;u<frame.GetUniverseCount();u++) {
+									if(frame.GetUniverseGeneration(u)!=frame.GetGeneration()) {
+										torn = true;
+									}
+								}
+								if(torn) {
+									++_torn;
+								}
+							}
+						}
+					}
+
+					ref<StressController> _controller;
+			};
+
+			class FramePublisher: public Thread {
+				public:
+					FramePublisher(ref<StressController> controller): _running(true), _published(0), _controller(controller) {
+					}
+
+					virtual ~FramePublisher() {
+					}
+
+					void Stop() {
+						_running = false;
+					}
+
+					volatile bool _running;
+					unsigned int _published;
+
+				protected:
+					virtual void Run() {
+						while(_running) {
+							_controller->PublishPattern(1000 + (++_published));
+						}
+					}
+
+					ref<StressController> _controller;
+			};
+
+			static void TestFrames(int readerCount, int seconds) {
+				ref<StressController> controller = GC::Hold(new StressController());
+				controller->SetUniverseCount(KUniverses);
+				controller->PublishPattern(1000);
+
+				ref<FramePublisher> publisher = GC::Hold(new FramePublisher(controller));
+				std::vector< ref<FrameReader> > readers;
+				for(int a=0;a<readerCount;a++) {
+					readers.push_back(GC::Hold(new FrameReader(controller)));
+					readers[a]->Start();
+				}
+				publisher->Start();
+
+				Wait(seconds*1000);
+				publisher->Stop();
+				publisher->WaitForCompletion();
+
+				unsigned int frames = 0, torn = 0;
+				for(int a=0;a<readerCount;a++) {
+					readers[a]->Stop();
+					readers[a]->WaitForCompletion();
+					frames += readers[a]->_frames;
+					torn += readers[a]->_torn;
+				}
+
+				printf("frames: %d readers, %d channels: %u frames published, %u frames read, %u torn\n", readerCount, KUniverses*512, publisher->_published, frames, torn);
+				Check(torn==0, "readers never see a torn frame");
+				Check(frames>0, "readers see published frames");
+			}
+
+			/** Reads the transmit buffer without a lock, like DMXMacro::GetResultCached and the device UI do **/
+			class CachedReader: public Thread {
+				public:
+					CachedReader(ref<DMXController> controller): _running(true), _reads(0), _controller(controller), _sum(0) {
+					}
+
+					virtual ~CachedReader() {
+					}
+
+					void Stop() {
+						_running = false;
+					}
+
+					volatile bool _running;
+					unsigned int _reads;
+
+				protected:
+					virtual void Run() {
+						int sum = 0;
+						while(_running) {
+							int count = _controller->GetTotalChannelCount();
+							for(int ch=1;ch<=count;ch+=7) {
+								sum += _controller->GetChannelResultCached(ch);
+							}
+							const unsigned char* transmit = _controller->GetTransmitBuffer();
+							if(transmit!=0) {
+								sum += transmit[0];
+							}
+							++_reads;
+						}
+						_sum = sum;
+					}
+
+					ref<DMXController> _controller;
+					int _sum;
+			};
+
+			static void TestGrowing(int readerCount) {
+				unsigned int reads = 0;
+				for(int round=0;round<20;round++) {
+					ref<DMXController> controller = GC::Hold(new DMXController());
+					std::vector< ref<CachedReader> > readers;
+					for(int a=0;a<readerCount;a++) {
+						readers.push_back(GC::Hold(new CachedReader(controller)));
+						readers[a]->Start();
+					}
+
+					for(unsigned int u=2;u<=KUniverses;u++) {
+						controller->SetUniverseCount(u);
+						controller->Set(DMXSlot(u*512), int(u), DMXManual);
+						Wait(1);
+					}
+
+					for(int a=0;a<readerCount;a++) {
+						readers[a]->Stop();
+						readers[a]->WaitForCompletion();
+						reads += readers[a]->_reads;
+					}
+				}
+				printf("growing: %d readers, 20 rounds of 1 to %u universes, %u passes over the transmit buffer\n", readerCount, KUniverses, reads);
+			}
+
+			/** A device that only counts what it would send **/
+			class MockDevice: public DMXDevice {
+				public:
+					MockDevice(int id, DMXOutputMode mode, int refreshRate): _id(id), _transmits(0), _universesSent(0), _lastGeneration(0) {
+						SetOutputMode(mode);
+						SetRefreshRate(refreshRate);
+					}
+
+					virtual ~MockDevice() {
+					}
+
+					virtual std::wstring GetPort() {
+						return L"";
+					}
+
+					virtual std::wstring GetDeviceID() {
+						return L"mock-"+Stringify(_id);
+					}
+
+					virtual std::wstring GetDeviceName() const {
+						return L"Mock device "+Stringify(_id);
+					}
+
+					virtual std::wstring GetDeviceInfo() {
+						return L"";
+					}
+
+					virtual std::wstring GetDeviceSerial() {
+						return L"";
+					}
+
+					virtual unsigned int GetSupportedUniversesCount() {
+						return KUniverses;
+					}
+
+					/** Returns the frame that was sent last; only call this when the device thread has ended **/
+					const DMXFrame& GetLastFrame() const {
+						return _frame;
+					}
+
+					int _id;
+					unsigned int _transmits;
+					unsigned int _universesSent;
+					unsigned int _lastGeneration;
+
+				protected:
+					virtual void Connect() {
+					}
+
+					virtual void OnTransmit(ref<DMXController> controller) {
+						++_transmits;
+						for(unsigned int u=0;u<_frame.GetUniverseCount();u++) {
+							if(ShouldTransmitUniverse(u)) {
+								++_universesSent;
+							}
+						}
+						_lastGeneration = _frame.GetGeneration();
+					}
+			};
+
+			class ChannelWriter: public Thread {
+				public:
+					ChannelWriter(ref<DMXController> controller, int index, int count): _running(true), _sets(0), _controller(controller), _index(index), _count(count) {
+					}
+
+					virtual ~ChannelWriter() {
+					}
+
+					void Stop() {
+						_running = false;
+					}
+
+					volatile bool _running;
+					unsigned int _sets;
+
+				protected:
+					virtual void Run() {
+						// Each writer owns the channels ch for which (ch-1) % count == index, like a fader owns its channels
+						unsigned int seed = (unsigned int)_index * 7919 + 1;
+						int channels = _controller->GetTotalChannelCount();
+						while(_running) {
+							seed = seed * 1103515245 + 12345;
+							int ch = 1 + _index + int((seed >> 8) % (unsigned int)(channels/_count)) * _count;
+							_controller->Set(DMXSlot(ch), int((seed >> 4) & 0xFF), DMXManual);
+							++_sets;
+						}
+					}
+
+					ref<DMXController> _controller;
+					int _index;
+					int _count;
+			};
+
+			static bool MatchesController(ref<DMXController> controller, const DMXFrame& frame) {
+				if(frame.GetChannelCount()!=(unsigned int)controller->GetTotalChannelCount()) {
+					return false;
+				}
+
+				const unsigned char* data = frame.GetData();
+				for(int ch=1;ch<=controller->GetTotalChannelCount();ch++) {
+					if(int(data[ch-1])!=controller->GetChannelResult(DMXSlot(ch))) {
+						return false;
+					}
+				}
+				return true;
+			}
+
+			static void TestMixer(int writerCount, int deviceCount, int seconds) {
+				ref<DMXController> controller = GC::Hold(new DMXController());
+				controller->SetUniverseCount(KUniverses);
+				controller->_highestChannelUsed = KUniverses*512;
+
+				// Half of the devices send continuously, the other half only on change (both at 100 Hz)
+				std::vector< ref<MockDevice> > devices;
+				for(int a=0;a<deviceCount;a++) {
+					devices.push_back(GC::Hold(new MockDevice(a, (a%2==0) ? DMXOutputModeContinuous : DMXOutputModeOnChange, 100)));
+					controller->AddDevice(devices[a]);
+				}
+
+				std::vector< ref<ChannelWriter> > writers;
+				for(int a=0;a<writerCount;a++) {
+					writers.push_back(GC::Hold(new ChannelWriter(controller, a, writerCount)));
+				}
+
+				unsigned int firstGeneration = controller->GetGeneration();
+				Timestamp start(true);
+				for(int a=0;a<writerCount;a++) {
+					writers[a]->Start();
+				}
+
+				Wait(seconds*1000);
+				unsigned int sets = 0;
+				for(int a=0;a<writerCount;a++) {
+					writers[a]->Stop();
+					writers[a]->WaitForCompletion();
+					sets += writers[a]->_sets;
+				}
+				double ms = double(Timestamp(true).Difference(start).ToMilliSeconds());
+				unsigned int generations = controller->GetGeneration() - firstGeneration;
+
+				// The mixer picks up the last changes asynchronously
+				DMXFrame frame;
+				bool converged = false;
+				for(int a=0;a<200 && !converged;a++) {
+					Wait(10);
+					controller->GetLatestFrame(frame);
+					converged = MatchesController(controller, frame);
+				}
+				Check(converged, "the published frame matches GetChannelResult after the writers stop");
+
+				// Every device sends at least one frame after the last change (on change devices, because they were notified)
+				Wait(100);
+				std::vector<DMXOutputStatistics> stats;
+				controller->GetOutputStatistics(stats);
+
+				printf("mixer: %d writers, %d devices, %u channels: %.0f sets/s, %u frames published (%.0f/s)\n", writerCount, deviceCount,
+					KUniverses*512, double(sets)*1000.0/ms, generations, double(generations)*1000.0/ms);
+
+				for(int a=0;a<deviceCount;a++) {
+					ref<MockDevice> device = devices[a];
+					controller->RemoveDevice(device);
+					device->WaitForCompletion();
+					Check(device->_lastGeneration==controller->GetGeneration(), "every device sent the last frame");
+					Check(MatchesController(controller, device->GetLastFrame()), "the last frame of every device matches GetChannelResult");
+				}
+
+				for(unsigned int a=0;a<stats.size();a++) {
+					const DMXOutputStatistics& ds = stats[a];
+					printf("  %ls (%s): %u frames, %u dropped, %u coalesced, jitter %.2f ms average, %.2f ms maximum\n", ds._device.c_str(),
+						ds._mode==DMXOutputModeContinuous ? "continuous" : "on change", ds._frames, ds._dropped, ds._coalesced, ds._averageJitter, ds._maximumJitter);
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	int writers = (argc > 1) ? atoi(argv[1]) : 16;
+	int devices = (argc > 2) ? atoi(argv[2]) : 4;
+	int seconds = (argc > 3) ? atoi(argv[3]) : 2;
+
+	tj::dmx::test::TestFrames(devices, seconds);
+	tj::dmx::test::TestGrowing(devices);
+	tj::dmx::test::TestMixer(writers, devices, seconds);
+	printf("%d failures\n", tj::dmx::test::_failures);
+	return (tj::dmx::test::_failures==0) ? 0 : 1;
+}
@@ -114,6 +114,8 @@ namespace tj {
 		const static PacketAction ActionAnnounceReply = 19;// Announce reply
 		const static PacketAction ActionOutletChange = 20;	// Sent by a client to the master when it wants to change an outlet value (through Talkback) [ChannelID] [wstring outletID] [unsigned int (Any::Type) valueType] [double|bool|int|wstring value]
 		const static PacketAction ActionResetChannel = 21;	// Sent by server to client to reset a channel
+		const static PacketAction ActionBatch = 22;			// Contains several unreliable packets: [PacketHeader h1] [h1._size bytes] [PacketHeader h2] [h2._size bytes] ...
+		const static PacketAction ActionRequestRedelivery = 23;// Sent with PacketFlagRequestRedelivery or PacketFlagCannotRedeliver for a range of packets; _plugin=instance the packet is meant for, _rpid=first packet, [unsigned int n] n*([ReliablePacketID first] [unsigned int count])
 
 		/** T4 packet header (needs to be in public protocol header file because Stream/code writers use this **/
 		struct PacketHeader {
@@ -131,7 +133,7 @@ namespace tj {
 			unsigned int _size;
 		};
 
-		class Packet {
+		class Packet: public tj::shared::Pooled {
 			public:
 				Packet(const PacketHeader& ph, const char* message, unsigned int size);
 				Packet(char* buf, unsigned int size);
@@ -27,8 +27,48 @@
 
 namespace tj {
 	namespace np {
+		struct NP_EXPORTED ReliableStatistics {
+			ReliableStatistics();
+
+			unsigned int _sent;					// Reliable packets sent
+			unsigned int _retransmitted;		// Packets sent again because another node asked for them
+			unsigned int _retransmitsDropped;	// Requested packets not sent again because of the retransmission rate limit
+			unsigned int _notAvailable;			// Requested packets that were no longer in the retransmit window
+			unsigned int _windowPackets;		// Packets currently in the retransmit window
+			unsigned int _windowBytes;			// Size of the packets currently in the retransmit window
+			unsigned int _missing;				// Reliable packets from other nodes that did not arrive in order
+			unsigned int _recovered;			// Missing packets that arrived later or were sent again
+			unsigned int _lost;					// Missing packets that were given up on
+			unsigned int _waiting;				// Missing packets that are still being waited for
+			unsigned int _requestsSent;			// Redelivery request packets sent
+		};
+
+		/** ShowSocket sends and receives T4 packets. Unreliable updates (ActionUpdate and ActionUpdatePlugin) are not sent
+		right away, but packed together with other updates in an ActionBatch packet. Batches are opened per thread (see
+		ShowSocket::Batch): while the sending thread has a batch open, batch packets are only sent when they are full, when the
+		oldest update has waited for KMaximumBatchDelay ms, or when the last batch of that thread is closed. Updates sent by a
+		thread without an open batch are sent immediately (together with the updates other threads have batched so far). Pending
+		batches that are older than KMaximumBatchDelay ms are also sent when a datagram is received. A batch packet that contains
+		only one update is sent as a normal packet. All other packets are sent right away (after the pending updates, so the
+		order of packets is kept).
+
+		Reliable packets are kept in a retransmit window (limited both in bytes and in age). Receivers keep track of the packets
+		they are missing from each node, and periodically ask for them (SendRedeliveryRequests) with ActionRequestRedelivery
+		packets, each of which can contain many ranges of missing packets. Retransmissions are rate-limited. **/
 		class NP_EXPORTED ShowSocket: public virtual tj::shared::Object, public SocketListener {
 			public:
+				/** The playback engines open a batch while they are ticking players, so that all updates sent by the players in
+				a single tick are sent together. The batch only holds back updates sent by the thread that opened it, and ends on
+				the socket it was begun on, also when an exception is thrown. **/
+				class NP_EXPORTED Batch {
+					public:
+						Batch(tj::shared::ref<ShowSocket> socket);
+						~Batch();
+
+					private:
+						tj::shared::ref<ShowSocket> _socket;
+				};
+
 				ShowSocket(int port, const char* address, tj::shared::ref<Node> main);
 				virtual ~ShowSocket();
 			
@@ -55,43 +95,143 @@ namespace tj {
 
 				void Send(tj::shared::strong<Message> s, bool reliable = false);
 				void Send(tj::shared::strong<Packet> p, bool reliable = false);
+				void BeginBatch();
+				void EndBatch();
+				void Flush();
 				int GetPort() const;
 				std::wstring GetAddress() const;
 				int GetBytesSent() const;
 				int GetBytesReceived() const;
+				int GetPacketsSent() const;
 				unsigned int GetActiveTransactionCount() const;
 				unsigned int GetWishListSize() const;
+				void GetReliableStatistics(ReliableStatistics& stats) const;
 				void CleanTransactions();
 				void SendRedeliveryRequests();
 			
 				// Called by network implementation layer, do not call by yourself
 				virtual void OnReceive(NativeSocket ns);
+
+				// Limits of the retransmit window and of the retransmission rate
+				const static unsigned int KMaximumRetransmitWindowSize = 512*1024;	// bytes
+				const static int KMaximumRetransmitWindowAge = 10000;	// ms
+				const static unsigned int KRetransmitRate = 256*1024;	// bytes per second
+				const static unsigned int KMaximumRetransmitBurst = 64*1024;	// bytes
+
+				// Limits of batches of updates
+				const static unsigned int KMaximumBatchSize = 1472;		// Ethernet MTU (1500) minus IPv4 and UDP headers, so batches are never fragmented
+				const static unsigned int KMaximumPendingBatches = 16;
+				const static int KMaximumBatchDelay = 10;				// ms
 				
 			private:
+				struct ReceivedPacket {
+					ReceivedPacket(tj::shared::ref<Transaction> tx, const PacketHeader& ph, tj::shared::ref<tj::shared::DataReader> code, in_addr from);
+
+					tj::shared::ref<Transaction> _tx;
+					PacketHeader _header;
+					tj::shared::ref<tj::shared::DataReader> _code;
+					in_addr _from;
+				};
+
+				/** Memory for a single received datagram. Received packets are read directly from this memory, so a buffer is
+				only recycled when all packets in it have been handled. **/
+				class ReceiveBuffer: public tj::shared::Recycleable {
+					public:
+						ReceiveBuffer();
+						virtual ~ReceiveBuffer();
+						char* _data;
+				};
+
+				struct PendingBatch {
+					tj::shared::ref<tj::shared::DataWriter> _data;
+					unsigned int _count;
+				};
+
+				/** Ring buffer of the reliable packets sent most recently; packet IDs in the window are consecutive, so looking
+				up a packet is a matter of subtracting the ID of the oldest packet. **/
+				class RetransmitWindow {
+					public:
+						RetransmitWindow();
+						void Add(ReliablePacketID id, tj::shared::strong<Packet> p);
+						tj::shared::ref<Packet> Get(ReliablePacketID id) const;
+						void Trim(unsigned int maxBytes, int maxAge);
+						ReliablePacketID GetFirst() const;
+						unsigned int GetCount() const;
+						unsigned int GetBytes() const;
+
+					private:
+						struct Entry {
+							tj::shared::ref<Packet> _packet;
+							unsigned int _size;
+							tj::shared::Timestamp _sent;
+						};
+
+						Entry& At(unsigned int index);
+						const Entry& At(unsigned int index) const;
+						void RemoveFirst();
+
+						std::vector<Entry> _entries;
+						unsigned int _start;
+						unsigned int _count;
+						unsigned int _bytes;
+						ReliablePacketID _first;
+				};
+
+				/** Reliable packets received from a single node. _missing maps the ID of each packet that is missing to the
+				number of times it has been requested. **/
+				struct ReliableSender {
+					ReliableSender();
+
+					ReliablePacketID _last;
+					std::map<ReliablePacketID, unsigned int> _missing;
+				};
+
+				typedef std::vector< std::pair<ReliablePacketID, unsigned int> > PacketRanges;
+
 				ReliablePacketID RegisterReliablePacket(tj::shared::strong<Packet> p);
+				void OnReceiveDatagram(tj::shared::strong<ReceiveBuffer> buffer, unsigned int size, const sockaddr_in& from, tj::shared::strong<Node> nw, std::vector<ReceivedPacket>& received);
+				void OnReceiveReliable(const PacketHeader& ph);
+				bool OnReceiveRedelivery(const PacketHeader& ph, tj::shared::ref<tj::shared::DataReader> code, InstanceID self);
+				void OnReceiveRedeliveryRequest(const PacketHeader& ph, tj::shared::ref<tj::shared::DataReader> code, InstanceID self);
+				void SendRanges(PacketFlags flags, InstanceID to, const PacketRanges& ranges);
+				bool Retransmit(tj::shared::strong<Packet> p);
+				static void ReadRanges(const PacketHeader& ph, tj::shared::ref<tj::shared::DataReader> code, PacketRanges& ranges);
 				void Send(tj::shared::strong<Packet> p, const sockaddr_in* address, bool reliable);
+				void AddToBatch(tj::shared::strong<Packet> p);
+				bool IsBatchExpired() const;
+				tj::shared::ref<Transaction> GetTransaction(TransactionIdentifier ti, tj::shared::ref<Node> nw);
 				
 				static NetworkInitializer _initializer;
 			
 				tj::shared::ref<SocketListenerThread> _listenerThread;
 				NativeSocket _server;
 				NativeSocket _client;
-				char* _recieveBuffer;
+				std::vector< tj::shared::ref<ReceiveBuffer> > _receiveBuffers;
+				std::vector<ReceivedPacket> _received;
 				char* _bcastAddress;
+				sockaddr_in _bcastSocketAddress;
 				int _port;
 				int _bytesSent;
 				int _bytesReceived;
-				unsigned int _maxReliablePacketCount;
+				int _packetsSent;
+				std::vector<PendingBatch> _batches;
+				std::map<int, unsigned int> _batchDepths;	// Number of batches open on each thread (by thread ID)
+				tj::shared::Timestamp _batchStarted;
 				ReliablePacketID _lastPacketID;
 				TransactionIdentifier _transactionCounter;
 				tj::shared::weak<Node> _network;
 				std::map< TransactionIdentifier, tj::shared::ref<Transaction> > _transactions;
-				std::map< ReliablePacketID, tj::shared::ref<Packet> > _reliableSentPackets;
-				std::deque< std::pair<InstanceID, ReliablePacketID> > _reliableWishList;
-				std::map< InstanceID, ReliablePacketID > _reliableLastReceived;
+				RetransmitWindow _retransmitWindow;
+				std::map< InstanceID, ReliableSender > _reliableSenders;
+				ReliableStatistics _reliableStats;
+				long double _retransmitBudget;
+				tj::shared::Timestamp _retransmitBudgetUpdated;
 				mutable tj::shared::CriticalSection _lock;
 				
-				const static unsigned int KDefaultMaxReliablePacketCount = 50;
+				const static unsigned int KReceiveBatchSize = 16;
+				const static unsigned int KReceiveBufferRecycleBinSize = 64;
+				const static unsigned int KMaximumMissingPackets = 4096;	// per node
+				const static unsigned int KMaximumRedeliveryRequests = 5;	// per packet
 		};
 	}
 }
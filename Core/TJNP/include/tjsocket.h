@@ -78,6 +78,10 @@ namespace tj {
 				virtual void OnReceive(NativeSocket ns) = 0;
 		};
 		
+		/** The SocketListenerThread calls SocketListener::OnReceive whenever one of the sockets it listens to can be read
+		from (or, for listening sockets, when a connection can be accepted). On Linux, it uses epoll, so that the cost of a
+		wake-up does not depend on the number of sockets; sockets can then be added and removed without waking the thread. On
+		other POSIX systems, select is used, which is limited to FD_SETSIZE sockets. **/
 		class NP_EXPORTED SocketListenerThread: public tj::shared::Thread {
 			#ifdef TJ_OS_WIN
 				friend LRESULT CALLBACK SocketListenerWindowProc(HWND, UINT, WPARAM, LPARAM);
@@ -103,7 +107,12 @@ namespace tj {
 				NetworkInitializer _ni;
 				virtual void PostThreadUpdate();
 			
-				#ifdef TJ_OS_POSIX
+				#if defined(TJ_OS_LINUX)
+					int _epoll;
+					int _wakeup;
+					volatile bool _stopping;
+					const static int KMaximumEvents = 64;
+				#elif defined(TJ_OS_POSIX)
 					NativeSocket _controlSocket[2];
 				#endif
 							
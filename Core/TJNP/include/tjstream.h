@@ -29,7 +29,7 @@ namespace tj {
 
 		/** Message represents a message sent from master to client through a Stream. It can contain
 		any data you want. **/
-		class NP_EXPORTED Message: public virtual tj::shared::Object {
+		class NP_EXPORTED Message: public virtual tj::shared::Object, public tj::shared::Pooled {
 			friend class Socket; // for buffer read access
 			friend class Stream;
 
@@ -43,7 +43,8 @@ namespace tj {
 					if(_sent) return;
 					_writer->Add<T>(x);
 
-					// update header
+					// update header (the writer may have moved its buffer to grow it)
+					_header = (PacketHeader*)_writer->_buffer;
 					_header->_size += sizeof(T)/sizeof(char);
 				}
 
@@ -68,7 +69,8 @@ namespace tj {
 			if(_sent) return;
 			_writer->Add(x);
 
-			// update header
+			// update header (the writer may have moved its buffer to grow it)
+			_header = (PacketHeader*)_writer->_buffer;
 			_header->_size += (unsigned short)(((unsigned int)x.length())*sizeof(wchar_t));
 			_header->_size += sizeof(int);
 		}
@@ -28,6 +28,12 @@ namespace tj {
 	namespace np {
 		class WebServer;
 
+		/** A WebServerResponseTask serves the requests on a single connection. Connections are kept open (HTTP/1.1
+		keep-alive) until the client asks to close them, until KMaximumRequestsPerConnection requests have been served or
+		until the connection has been idle for KIdleTimeout ms. Requests that are pipelined by the client are read from
+		the same buffer and answered in order. While waiting for the next request, the task occupies a dispatcher thread;
+		to prevent idle connections from holding up new ones, a connection is closed as soon as the server has more open
+		connections than it has threads to serve them. **/
 		class NP_EXPORTED WebServerResponseTask: public tj::shared::Task {
 			public:
 				WebServerResponseTask(NativeSocket ns, tj::shared::ref<WebServer> ws);
@@ -36,6 +42,13 @@ namespace tj {
 				virtual void ServeRequest(tj::shared::ref<HTTPRequest> hrp);
 				virtual void Run();
 
+				// Limits of connections and requests
+				const static int KIdleTimeout = 5000;		// ms
+				const static int KRequestTimeout = 10000;	// ms
+				const static unsigned int KMaximumRequestsPerConnection = 100;
+				const static unsigned int KMaximumHeaderSize = 16*1024;	// bytes
+				const static tj::shared::int64 KMaximumBodySize = 64*1024*1024;	// bytes
+
 			protected:
 				virtual void SendMultiStatusReply(TiXmlDocument& reply);
 				virtual void ServeRequestWithResolver(tj::shared::ref<HTTPRequest> hrp, tj::shared::ref<WebItem> res);
@@ -49,13 +62,21 @@ namespace tj {
 			
 			private:
 				virtual std::string CreateAllowHeaderFromPermissions(const tj::shared::Flags<WebItem::Permission>& perms);
+				virtual const char* GetConnectionHeader() const;
+				virtual bool Receive(std::string& pending, bool idle);
+				virtual bool IsKeepAliveRequested(tj::shared::ref<HTTPRequest> hrp, const std::string& requestLine);
+				static std::string::size_type FindEndOfHeaders(const std::string& data, std::string::size_type from);
 				
 				const static char* KDAVVersion;
 				const static char* KServerName;
+				const static int KIdlePollInterval = 100;
+				const static unsigned int KReceiveBufferSize = 4096;
 				NativeSocket _client;
 				tj::shared::weak<WebServer> _ws;
 				unsigned int _bytesReceived;
 				unsigned int _bytesSent;
+				bool _keepAlive;
+				bool _headRequest;
 		};
 
 
@@ -73,12 +94,15 @@ namespace tj {
 				virtual void AddResolver(const tj::shared::String& pathPrefix, tj::shared::strong<WebItem> fr);
 
 				const static unsigned short KPortDontCare = 0;
+				const static int KMaximumThreads = 16;
 
 			protected:
 				tj::shared::CriticalSection _lock;
 				virtual void AddTask(tj::shared::strong<tj::shared::Task> t);
+				virtual bool IsBusy() const;
 				unsigned int _bytesReceived;
 				unsigned int _bytesSent;
+				volatile tj::shared::ReferenceCount _connections;
 
 			private:
 				std::map< tj::shared::String, tj::shared::ref<WebItem> > _resolvers;
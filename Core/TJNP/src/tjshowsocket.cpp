@@ -20,6 +20,7 @@
 
 #ifndef TJ_OS_WIN
 	#include <sys/socket.h>
+	#include <sys/uio.h>
 	#include <arpa/inet.h>
 	#define INVALID_SOCKET -1
 	#define SOCKET_ERROR -1
@@ -35,15 +36,130 @@ using namespace tj::np;
 
 NetworkInitializer ShowSocket::_initializer;
 
-ShowSocket::ShowSocket(int port, const char* address, ref<Node> nw): _lastPacketID(0), _bytesSent(0), _bytesReceived(0), _network(nw), _maxReliablePacketCount(KDefaultMaxReliablePacketCount) {
+ShowSocket::ReceivedPacket::ReceivedPacket(ref<Transaction> tx, const PacketHeader& ph, ref<DataReader> code, in_addr from): _tx(tx), _header(ph), _code(code), _from(from) {
+}
+
+ShowSocket::ReceiveBuffer::ReceiveBuffer(): _data(new char[Packet::maximumSize]) {
+}
+
+ShowSocket::ReceiveBuffer::~ReceiveBuffer() {
+	delete[] _data;
+}
+
+ReliableStatistics::ReliableStatistics(): _sent(0), _retransmitted(0), _retransmitsDropped(0), _notAvailable(0), _windowPackets(0), _windowBytes(0), _missing(0), _recovered(0), _lost(0), _waiting(0), _requestsSent(0) {
+}
+
+ShowSocket::ReliableSender::ReliableSender(): _last(0) {
+}
+
+ShowSocket::RetransmitWindow::RetransmitWindow(): _start(0), _count(0), _bytes(0), _first(1) {
+}
+
+ShowSocket::RetransmitWindow::Entry& ShowSocket::RetransmitWindow::At(unsigned int index) {
+	return _entries.at((_start + index) % _entries.size());
+}
+
+const ShowSocket::RetransmitWindow::Entry& ShowSocket::RetransmitWindow::At(unsigned int index) const {
+	return _entries.at((_start + index) % _entries.size());
+}
+
+void ShowSocket::RetransmitWindow::Add(ReliablePacketID id, strong<Packet> p) {
+	// Packet IDs need to be consecutive; if they are not, start over
+	if(_count>0 && id!=_first+_count) {
+		while(_count>0) {
+			RemoveFirst();
+		}
+	}
+
+	if(_count==0) {
+		_first = id;
+	}
+
+	if(_count==(unsigned int)_entries.size()) {
+		std::vector<Entry> entries(Util::Max(16U, _count*2));
+		for(unsigned int a=0;a<_count;a++) {
+			entries[a] = At(a);
+		}
+		_entries.swap(entries);
+		_start = 0;
+	}
+
+	Entry& entry = At(_count);
+	entry._packet = p;
+	entry._size = p->_header->_size + sizeof(PacketHeader);
+	entry._sent.Now();
+	_bytes += entry._size;
+	++_count;
+}
+
+ref<Packet> ShowSocket::RetransmitWindow::Get(ReliablePacketID id) const {
+	unsigned int offset = id - _first;
+	if(offset >= _count) {
+		return 0;
+	}
+	return At(offset)._packet;
+}
+
+/** Removes the oldest packets until the window is at most maxBytes large and contains no packets older than maxAge ms **/
+void ShowSocket::RetransmitWindow::Trim(unsigned int maxBytes, int maxAge) {
+	Timestamp now(true);
+	while(_count>0 && (_bytes > maxBytes || now.Difference(At(0)._sent).ToMilliSeconds() > (long double)maxAge)) {
+		RemoveFirst();
+	}
+}
+
+void ShowSocket::RetransmitWindow::RemoveFirst() {
+	Entry& entry = At(0);
+	_bytes -= entry._size;
+	entry._packet = 0;
+	_start = (_start + 1) % _entries.size();
+	++_first;
+	--_count;
+}
+
+/** Returns the ID of the oldest packet in the window; when the window is empty, this is the ID of the next packet **/
+ReliablePacketID ShowSocket::RetransmitWindow::GetFirst() const {
+	return _first;
+}
+
+unsigned int ShowSocket::RetransmitWindow::GetCount() const {
+	return _count;
+}
+
+unsigned int ShowSocket::RetransmitWindow::GetBytes() const {
+	return _bytes;
+}
+
+ShowSocket::Batch::Batch(ref<ShowSocket> socket): _socket(socket) {
+	if(_socket) {
+		_socket->BeginBatch();
+	}
+}
+
+ShowSocket::Batch::~Batch() {
+	if(_socket) {
+		_socket->EndBatch();
+	}
+}
+
+ShowSocket::ShowSocket(int port, const char* address, ref<Node> nw): _bytesSent(0), _bytesReceived(0), _packetsSent(0), _lastPacketID(0), _network(nw), _retransmitBudget(KMaximumRetransmitBurst) {
 	// Create a random transaction counter id
 	_transactionCounter = rand();
 	assert(address!=0 && port > 0 && port < 65536);
-	_recieveBuffer = new char[Packet::maximumSize];
+	_receiveBuffers.resize(KReceiveBatchSize);
+	_retransmitBudgetUpdated.Now();
+	if(Recycler<ReceiveBuffer>::GetMaximumSize() < KReceiveBufferRecycleBinSize) {
+		Recycler<ReceiveBuffer>::SetMaximumSize(KReceiveBufferRecycleBinSize);
+	}
 
 	_port = port;
 	_bcastAddress = _strdup(address);
 
+	memset(&_bcastSocketAddress, 0, sizeof(sockaddr_in));
+	_bcastSocketAddress.sin_family = AF_INET;
+	_bcastSocketAddress.sin_port = htons((u_short)_port);
+	_bcastSocketAddress.sin_addr.s_addr = inet_addr(_bcastAddress);
+
 	sockaddr_in addr;
 	_client = 0;
 	_server = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -89,6 +205,7 @@ void ShowSocket::OnCreated() {
 }
 
 ShowSocket::~ShowSocket() {
+	Flush();
 	_listenerThread->Stop();
 	
 	#ifdef TJ_OS_WIN
@@ -99,7 +216,6 @@ ShowSocket::~ShowSocket() {
 		close(_server);
 	#endif
 	
-	delete[] _recieveBuffer;
 	delete _bcastAddress;
 }
 
@@ -134,6 +250,9 @@ unsigned int ShowSocket::GetActiveTransactionCount() const {
 	return (unsigned int)_transactions.size();
 }
 
+/** Reads all datagrams that are waiting (on Linux, up to KReceiveBatchSize at a time using recvmmsg). Datagrams are read
+into recycled buffers, and the DataReaders passed to the transactions read directly from these buffers. The lock is not held
+while reading from the socket, nor while the packets are handled by the transactions. **/
 void ShowSocket::OnReceive(NativeSocket ns) {
 	ref<Node> nw = _network;
 	if(!nw) {
@@ -141,172 +260,413 @@ void ShowSocket::OnReceive(NativeSocket ns) {
 		return;
 	}
 
-	ref<DataReader> code = 0;
-	ref<Transaction> tx = 0;
-	sockaddr_in from;
-	PacketHeader ph;
+	// _receiveBuffers and _received are only used by the listener thread, so they do not need to be locked
+	for(unsigned int a=0;a<KReceiveBatchSize;a++) {
+		if(!_receiveBuffers[a]) {
+			_receiveBuffers[a] = Recycler<ReceiveBuffer>::Create();
+		}
+	}
 
-	// Receive stuff
-	{
-		ThreadLock lock(&_lock);
-		memset(_recieveBuffer,0,sizeof(char)*Packet::maximumSize);
-		socklen_t size = (int)sizeof(from);
-		int ret = recvfrom(_server, _recieveBuffer, Packet::maximumSize-1, 0, (sockaddr*)&from, &size);
-		
+	sockaddr_in from[KReceiveBatchSize];
+	unsigned int sizes[KReceiveBatchSize];
+	unsigned int count = 0;
+
+	#ifdef TJ_OS_LINUX
+		mmsghdr messages[KReceiveBatchSize];
+		iovec vectors[KReceiveBatchSize];
+		memset(messages, 0, sizeof(mmsghdr)*KReceiveBatchSize);
+		for(unsigned int a=0;a<KReceiveBatchSize;a++) {
+			vectors[a].iov_base = _receiveBuffers[a]->_data;
+			vectors[a].iov_len = Packet::maximumSize;
+			messages[a].msg_hdr.msg_name = &(from[a]);
+			messages[a].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+			messages[a].msg_hdr.msg_iov = &(vectors[a]);
+			messages[a].msg_hdr.msg_iovlen = 1;
+		}
+
+		int ret = recvmmsg(_server, messages, KReceiveBatchSize, MSG_DONTWAIT, 0);
 		if(ret == SOCKET_ERROR) {
-			// This seems to happen on packets that come from us
 			return;
 		}
-		_bytesReceived += ret;
 
-		// Extract packet header
-		ph = *((PacketHeader*)_recieveBuffer);
+		for(int a=0;a<ret;a++) {
+			sizes[a] = messages[a].msg_len;
+		}
+		count = (unsigned int)ret;
+	#else
+		socklen_t size = (int)sizeof(sockaddr_in);
+		int ret = recvfrom(_server, _receiveBuffers[0]->_data, Packet::maximumSize, 0, (sockaddr*)&(from[0]), &size);
 		
-		// Check if this actually is a T4 packet
-		if(ph._version[0]!='T' || ph._version[1] != '4') {
-			if(ph._version[0]=='T') {
-				Log::Write(L"TJNP/Socket", L"Received a packet which has a different protocol version; cannot process this packet");
-			}
-			else {
-				Log::Write(L"TJNP/Socket", L"Received invalid packets from the network; maybe network link is broken or other applications are running on this port");
-			}
+		if(ret == SOCKET_ERROR) {
+			// This seems to happen on packets that come from us
 			return;
 		}
+		sizes[0] = (unsigned int)ret;
+		count = 1;
+	#endif
 
-		// Check size
-		if(int(ph._size+sizeof(PacketHeader)) > ret) {
-			Log::Write(L"TJNP/Socket", L"Packet smaller than it says it is; ignoring it!");
-			return;
+	_received.clear(); // Not empty when a transaction threw an exception the last time
+	{
+		ThreadLock lock(&_lock);
+		for(unsigned int a=0;a<count;a++) {
+			_bytesReceived += (int)sizes[a];
+			OnReceiveDatagram(_receiveBuffers[a], sizes[a], from[a], nw, _received);
+
+			// The buffer is recycled as soon as all packets read from it have been handled
+			_receiveBuffers[a] = 0;
 		}
-		
-		// Reject loopback messages
-		if(ph._from == nw->GetInstanceID()) {
-			return;
+
+		// Do not wait for the thread that holds a batch to send its next update
+		if(IsBatchExpired()) {
+			Flush();
+		}
+	}
+
+	// Handle the messages
+	std::vector<ReceivedPacket>::iterator it = _received.begin();
+	while(it!=_received.end()) {
+		ref<Transaction> tx = it->_tx;
+		if(tx && !tx->IsExpired()) {
+			tx->OnReceive(it->_header._from, it->_from, it->_header, it->_code);
+		}
+		++it;
+	}
+	_received.clear();
+}
+
+/** Checks a single datagram and adds the packets in it that should be handled to 'received' **/
+void ShowSocket::OnReceiveDatagram(strong<ReceiveBuffer> buffer, unsigned int size, const sockaddr_in& from, strong<Node> nw, std::vector<ReceivedPacket>& received) {
+	ThreadLock lock(&_lock);
+	const char* data = buffer->_data;
+
+	if(size < sizeof(PacketHeader)) {
+		Log::Write(L"TJNP/Socket", L"Received invalid packets from the network; maybe network link is broken or other applications are running on this port");
+		return;
+	}
+
+	// Extract packet header
+	PacketHeader ph = *((const PacketHeader*)data);
+	
+	// Check if this actually is a T4 packet
+	if(ph._version[0]!='T' || ph._version[1] != '4') {
+		if(ph._version[0]=='T') {
+			Log::Write(L"TJNP/Socket", L"Received a packet which has a different protocol version; cannot process this packet");
+		}
+		else {
+			Log::Write(L"TJNP/Socket", L"Received invalid packets from the network; maybe network link is broken or other applications are running on this port");
 		}
+		return;
+	}
+
+	// Check size
+	if(ph._size+sizeof(PacketHeader) > size) {
+		Log::Write(L"TJNP/Socket", L"Packet smaller than it says it is; ignoring it!");
+		return;
+	}
 	
-		// If this is a 'special packet', process the flags
-		if(ph._flags!=0) {
-			// Check if this packet is a re-delivery or a cannot-re-delivery
-			if((ph._flags & (PacketFlagCannotRedeliver|PacketFlagRedelivery))!=0) {
-				if(ph._flags & PacketFlagCannotRedeliver) {
-					///Log::Write(L"TJNP/Socket", L"Packet with rpid="+Stringify(ph._rpid)+L" from "+StringifyHex(ph._from)+L" could not be redelivered; removing from wishlist");
-				}
-				else {
-					///Log::Write(L"TJNP/Socket", L"Packet with rpid="+Stringify(ph._rpid)+L" from "+StringifyHex(ph._from)+L" was redelivered; removing from wishlist");
-				}
-				std::deque< std::pair<InstanceID, ReliablePacketID> >::iterator it = _reliableWishList.begin();
-				bool weRequestedRedelivery = false;
-				while(it!=_reliableWishList.end()) {
-					if(it->first == ph._from && it->second == ph._rpid) {
-						it = _reliableWishList.erase(it);
-						weRequestedRedelivery = true;
-					}
-					else {
-						++it;
-					}
-				}
-
-				if(!weRequestedRedelivery) {
-					return; // Packet was redelivered for a different instance on this pc
-				}
-			}
-			else if((ph._flags & PacketFlagRequestRedelivery)!=0) {
-				// Redeliver packet with ph._rpid to the sending node and return
-				std::map<ReliablePacketID, ref<Packet> >::iterator it = _reliableSentPackets.find(ph._rpid);
-				if(it==_reliableSentPackets.end()) {
-					///Log::Write(L"TJNP/Socket", L"Sending cannot redeliver (rpid requested="+Stringify(ph._rpid)+L")");
-					PacketHeader rph;
-					rph._flags = PacketFlagCannotRedeliver;
-					rph._from = nw->GetInstanceID();
-					rph._transaction = ph._transaction;
-					rph._rpid = ph._rpid;
-					ref<Packet> response = GC::Hold(new Packet(ph, (const char*)0, 0));
-					Send(response, &from, false);
-					// Send 'cannot redeliver'
-				}
-				else {
-					if(!(it->second)) {
-						///Log::Write(L"TJNP/Socket", L"Cannot redeliver, packet is null!");
-					}
-
-					if(ph._plugin==nw->GetInstanceID()) {
-						///Log::Write(L"TJNP/Socket", L"Redelivering (rpid requested="+Stringify(ph._rpid)+L")");
-						// Send packet with extra 'redelivery' flag, and *only* to the requesting computer
-						ref<Packet> packet = it->second;
-						packet->_header->_flags = PacketFlagRedelivery;
-						packet->_header->_from = nw->GetInstanceID();
-						Send(packet, &from, false);
-					}
-				}
-				return;
+	// Reject loopback messages
+	if(ph._from == nw->GetInstanceID()) {
+		return;
+	}
+
+	ref<Object> owner = ref<ReceiveBuffer>(buffer);
+
+	// Handle requests for redelivery, redelivered packets and replies to our requests
+	if((ph._flags & (PacketFlagRequestRedelivery|PacketFlagRedelivery|PacketFlagCannotRedeliver))!=0) {
+		ref<DataReader> code = GC::Hold(new DataReader(owner, data+sizeof(PacketHeader), ph._size));
+		if((ph._flags & PacketFlagRequestRedelivery)!=0) {
+			OnReceiveRedeliveryRequest(ph, code, nw->GetInstanceID());
+			return;
+		}
+		else if(!OnReceiveRedelivery(ph, code, nw->GetInstanceID())) {
+			return; // Packet was redelivered for a different instance on this pc, or this was a 'cannot redeliver' reply
+		}
+	}
+	else if((ph._flags & PacketFlagReliable) != 0) {
+		OnReceiveReliable(ph);
+	}
+
+	// Extract packet contents; the packets in a batch are handled as if they were received separately
+	if(ph._action==ActionBatch) {
+		unsigned int offset = sizeof(PacketHeader);
+		unsigned int end = sizeof(PacketHeader) + ph._size;
+		while(offset+sizeof(PacketHeader) <= end) {
+			const PacketHeader& iph = *((const PacketHeader*)(data+offset));
+			if(iph._version[0]!='T' || iph._version[1]!='4' || offset+sizeof(PacketHeader)+iph._size > end) {
+				Log::Write(L"TJNP/Socket", L"Received a batch packet with an invalid packet in it; ignoring the rest of the batch");
+				break;
 			}
+
+			ref<DataReader> code = GC::Hold(new DataReader(owner, data+offset+sizeof(PacketHeader), iph._size));
+			received.push_back(ReceivedPacket(GetTransaction(iph._transaction, nw), iph, code, from.sin_addr));
+			offset += sizeof(PacketHeader) + iph._size;
+		}
+	}
+	else {
+		ref<DataReader> code = GC::Hold(new DataReader(owner, data+sizeof(PacketHeader), ph._size));
+		received.push_back(ReceivedPacket(GetTransaction(ph._transaction, nw), ph, code, from.sin_addr));
+	}
+}
+
+/** Returns the transaction with the given identifier, or the 'default transaction' (which happens to be the network) when
+the identifier is zero. Returns null when the transaction does not exist (anymore). **/
+ref<Transaction> ShowSocket::GetTransaction(TransactionIdentifier ti, ref<Node> nw) {
+	ThreadLock lock(&_lock);
+	if(ti==0) {
+		return nw;
+	}
+
+	std::map<TransactionIdentifier, ref<Transaction> >::iterator it = _transactions.find(ti);
+	if(it!=_transactions.end()) {
+		return it->second;
+	}
+	return 0;
+}
+
+/** Keeps track of the reliable packets received from other nodes, so missing packets can be requested again **/
+void ShowSocket::OnReceiveReliable(const PacketHeader& ph) {
+	ThreadLock lock(&_lock);
+
+	std::map<InstanceID, ReliableSender>::iterator it = _reliableSenders.find(ph._from);
+	if(it==_reliableSenders.end()) {
+		ReliableSender& sender = _reliableSenders[ph._from];
+		sender._last = ph._rpid;
+		return;
+	}
+
+	ReliableSender& sender = it->second;
+	int distance = int(ph._rpid - sender._last);
+
+	if(distance==1) {
+		sender._last = ph._rpid;
+	}
+	else if(distance > 1) {
+		// Packets _last+1...rpid-1 are missing; when there are too many of them, only the most recent are requested
+		unsigned int gap = (unsigned int)(distance - 1);
+		_reliableStats._missing += gap;
+		if(gap > KMaximumMissingPackets) {
+			_reliableStats._lost += gap - KMaximumMissingPackets;
+			gap = KMaximumMissingPackets;
+		}
+
+		for(ReliablePacketID r = ph._rpid - gap; r != ph._rpid; ++r) {
+			sender._missing.insert(sender._missing.end(), std::pair<ReliablePacketID, unsigned int>(r, 0));
+		}
+
+		while(sender._missing.size() > KMaximumMissingPackets) {
+			sender._missing.erase(sender._missing.begin());
+			++_reliableStats._lost;
+		}
+		sender._last = ph._rpid;
+	}
+	else {
+		std::map<ReliablePacketID, unsigned int>::iterator mit = sender._missing.find(ph._rpid);
+		if(mit!=sender._missing.end()) {
+			// Packet arrived out of order
+			sender._missing.erase(mit);
+			++_reliableStats._recovered;
+		}
+		else if(-distance > int(KMaximumMissingPackets)) {
+			// The other node has probably been restarted
+			sender._missing.clear();
+			sender._last = ph._rpid;
 		}
+	}
+}
+
+/** Handles redelivered packets and 'cannot redeliver' replies. Returns true when the packet was redelivered because this
+node asked for it, and should be handled like any other packet. **/
+bool ShowSocket::OnReceiveRedelivery(const PacketHeader& ph, ref<DataReader> code, InstanceID self) {
+	ThreadLock lock(&_lock);
+
+	std::map<InstanceID, ReliableSender>::iterator it = _reliableSenders.find(ph._from);
+	if(it==_reliableSenders.end()) {
+		return false;
+	}
+	std::map<ReliablePacketID, unsigned int>& missing = it->second._missing;
 
-		// Check reliability properties
-		if((ph._flags & PacketFlagReliable) != 0) {
-			std::map<InstanceID, ReliablePacketID>::iterator it = _reliableLastReceived.find(ph._from);
-			if(it!=_reliableLastReceived.end()) {
-				ReliablePacketID predictedNext = ++(it->second);
-
-				if(predictedNext!=ph._rpid) {
-					/** TODO: if the packet indicates that it may not be delivered out-of-order, then also put ph._rpid on the wishlist **/
-					///Log::Write(L"TJNP/Socket", L"Received packet is out of order (predicted rpid="+Stringify(predictedNext)+L", received rpid="+Stringify(ph._rpid));
-					unsigned int n = 0;
-					for(ReliablePacketID r = predictedNext; r < ph._rpid; ++r) {
-						++n;
-						if(_reliableWishList.size() > _maxReliablePacketCount) {
-							///Log::Write(L"TJNP/Socket", L"Wish list length exceeded; packets are being dropped!");
-							_reliableWishList.pop_front();
-						}
-						else if(n > _maxReliablePacketCount) {
-							///Log::Write(L"TJNP/Socket", L"Wish list length exceeded for this batch; packets are being dropped!");
-							break;
-						}
-						///Log::Write(L"TJNP/Socket", L"Adding reliable packet "+Stringify(r)+L" from "+StringifyHex(ph._from)+L" to receive wish list");
-						_reliableWishList.push_back(std::pair<InstanceID, ReliablePacketID>(ph._from, r));
-					}
-				}
+	if((ph._flags & PacketFlagCannotRedeliver)!=0) {
+		if(ph._action==ActionRequestRedelivery && ph._plugin!=PluginHash(self)) {
+			return false; // Reply to a different instance on this pc
+		}
+
+		// Give up on the packets that cannot be redelivered
+		PacketRanges ranges;
+		ReadRanges(ph, code, ranges);
+		PacketRanges::const_iterator rit = ranges.begin();
+		while(rit!=ranges.end()) {
+			std::map<ReliablePacketID, unsigned int>::iterator mit = missing.lower_bound(rit->first);
+			while(mit!=missing.end() && (mit->first - rit->first) < rit->second) {
+				missing.erase(mit++);
+				++_reliableStats._lost;
 			}
-			_reliableLastReceived[ph._from] = ph._rpid;
+			++rit;
 		}
+		return false;
+	}
+
+	std::map<ReliablePacketID, unsigned int>::iterator mit = missing.find(ph._rpid);
+	if(mit==missing.end()) {
+		return false;
+	}
+	missing.erase(mit);
+	++_reliableStats._recovered;
+	return true;
+}
 
-		// Extract packet contents
-		code = GC::Hold(new DataReader(_recieveBuffer+sizeof(PacketHeader), ph._size));
+/** Sends the requested packets that are still in the retransmit window again, and replies with a 'cannot redeliver' packet
+for those that are not. Packets are sent to all nodes, since other nodes will probably have missed them as well. **/
+void ShowSocket::OnReceiveRedeliveryRequest(const PacketHeader& ph, ref<DataReader> code, InstanceID self) {
+	ThreadLock lock(&_lock);
+	if(ph._plugin!=PluginHash(self)) {
+		return; // Request for a different instance
+	}
 
-		// Find our transaction, if it exists. Otherwise, use the 'default transaction' (which happens to be _network)
-		if(ph._transaction==0) {
-			tx = nw;
+	PacketRanges ranges;
+	PacketRanges unavailable;
+	ReadRanges(ph, code, ranges);
+	_retransmitWindow.Trim(KMaximumRetransmitWindowSize, KMaximumRetransmitWindowAge);
+	ReliablePacketID oldest = _retransmitWindow.GetFirst();
+
+	PacketRanges::const_iterator it = ranges.begin();
+	while(it!=ranges.end()) {
+		ReliablePacketID first = it->first;
+		unsigned int count = it->second;
+
+		// Packets older than the window cannot be redelivered
+		int before = int(oldest - first);
+		if(before > 0) {
+			unsigned int n = Util::Min(count, (unsigned int)before);
+			unavailable.push_back(std::pair<ReliablePacketID, unsigned int>(first, n));
+			_reliableStats._notAvailable += n;
+			first += n;
+			count -= n;
 		}
-		else {
-			if(_transactions.find(ph._transaction)!=_transactions.end()) {
-				tx = _transactions[ph._transaction];
+
+		for(unsigned int a=0;a<count;a++) {
+			ref<Packet> packet = _retransmitWindow.Get(first+a);
+			if(!packet) {
+				break; // Packets that were never sent
 			}
+			Retransmit(packet);
 		}
+		++it;
+	}
+
+	if(unavailable.size()>0) {
+		SendRanges(PacketFlagCannotRedeliver, ph._from, unavailable);
+	}
+}
+
+/** Sends a packet again with the 'redelivery' flag set, unless that would exceed the retransmission rate **/
+bool ShowSocket::Retransmit(strong<Packet> p) {
+	Timestamp now(true);
+	long double refill = now.Difference(_retransmitBudgetUpdated).ToMilliSeconds() * (long double)KRetransmitRate / 1000.0;
+	_retransmitBudget = Util::Min((long double)KMaximumRetransmitBurst, _retransmitBudget + refill);
+	_retransmitBudgetUpdated = now;
+
+	unsigned int size = p->_header->_size + sizeof(PacketHeader);
+	if(_retransmitBudget < (long double)size) {
+		++_reliableStats._retransmitsDropped;
+		return false;
 	}
 
-	// Handle the message
-	if(tx && !tx->IsExpired()) {
-		tx->OnReceive(ph._from, from.sin_addr, ph, code);
+	_retransmitBudget -= (long double)size;
+	p->_header->_flags = PacketFlagRedelivery;
+	Send(p, &_bcastSocketAddress, false);
+	++_reliableStats._retransmitted;
+	return true;
+}
+
+/** Sends ActionRequestRedelivery packets with the given flags for the given ranges of packets. 'to' is the instance the
+packets are meant for. As many ranges as possible are put in each packet. **/
+void ShowSocket::SendRanges(PacketFlags flags, InstanceID to, const PacketRanges& ranges) {
+	const static unsigned int KMaximumRanges = (KMaximumBatchSize - sizeof(PacketHeader) - sizeof(unsigned int)) / (sizeof(ReliablePacketID) + sizeof(unsigned int));
+
+	PacketRanges::const_iterator it = ranges.begin();
+	while(it!=ranges.end()) {
+		unsigned int n = Util::Min(KMaximumRanges, (unsigned int)(ranges.end() - it));
+
+		PacketHeader ph;
+		ph._action = ActionRequestRedelivery;
+		ph._flags = flags;
+		ph._plugin = to;
+		ph._rpid = it->first; // Nodes that do not know about ranges only look at the first packet
+		ph._size = sizeof(unsigned int) + n * (sizeof(ReliablePacketID) + sizeof(unsigned int));
+
+		strong<DataWriter> data = GC::Hold(new DataWriter(ph._size + sizeof(PacketHeader)));
+		data->Add(ph);
+		data->Add<unsigned int>(n);
+		for(unsigned int a=0;a<n;a++) {
+			data->Add<ReliablePacketID>(it->first);
+			data->Add<unsigned int>(it->second);
+			++it;
+		}
+
+		Bytes size = data->GetSize();
+		strong<Packet> packet = GC::Hold(new Packet(data->TakeOverBuffer(true), (unsigned int)size));
+		Send(packet, &_bcastSocketAddress, false);
+
+		if((flags & PacketFlagRequestRedelivery)!=0) {
+			++_reliableStats._requestsSent;
+		}
 	}
 }
 
+/** Reads the ranges of packets in a redelivery request or 'cannot redeliver' reply. Packets without ranges (sent by older
+versions) are about a single packet. **/
+void ShowSocket::ReadRanges(const PacketHeader& ph, ref<DataReader> code, PacketRanges& ranges) {
+	if(ph._action!=ActionRequestRedelivery || !code) {
+		ranges.push_back(std::pair<ReliablePacketID, unsigned int>(ph._rpid, 1));
+		return;
+	}
+
+	unsigned int size = (unsigned int)code->GetSize();
+	if(size < sizeof(unsigned int)) {
+		return;
+	}
+
+	unsigned int position = 0;
+	unsigned int n = code->Get<unsigned int>(position);
+	n = Util::Min(n, (unsigned int)((size - sizeof(unsigned int)) / (sizeof(ReliablePacketID) + sizeof(unsigned int))));
+	for(unsigned int a=0;a<n;a++) {
+		ReliablePacketID first = code->Get<ReliablePacketID>(position);
+		unsigned int count = code->Get<unsigned int>(position);
+		ranges.push_back(std::pair<ReliablePacketID, unsigned int>(first, count));
+	}
+}
+
+/** Asks other nodes to send the reliable packets that are missing again. Packets that have been asked for
+KMaximumRedeliveryRequests times are given up on. **/
 void ShowSocket::SendRedeliveryRequests() {
 	ThreadLock lock(&_lock);
 
-	ref<Node> nw = _network;
-	if(!nw) return;
-	InstanceID iid = nw->GetInstanceID();
-
-	PacketHeader rph;
-	rph._flags = PacketFlagRequestRedelivery;
-	ref<Packet> rp = GC::Hold(new Packet(rph, (const char*)0, 0));
-	std::deque< std::pair<InstanceID, ReliablePacketID> >::iterator it = _reliableWishList.begin();
-	while(it!=_reliableWishList.end()) {
-		rp->_header->_rpid = it->second;
-		rp->_header->_from = iid;
-		rp->_header->_plugin = it->first;
-		///Log::Write(L"TJNP/Socket", L"Requesting redelivery (iid="+StringifyHex(it->first)+L" rpid="+Stringify(it->second)+L")");
-		Send(rp, false);
+	std::map<InstanceID, ReliableSender>::iterator it = _reliableSenders.begin();
+	while(it!=_reliableSenders.end()) {
+		ReliableSender& sender = it->second;
+		PacketRanges ranges;
+
+		std::map<ReliablePacketID, unsigned int>::iterator mit = sender._missing.begin();
+		while(mit!=sender._missing.end()) {
+			if(mit->second >= KMaximumRedeliveryRequests) {
+				sender._missing.erase(mit++);
+				++_reliableStats._lost;
+				continue;
+			}
+
+			++(mit->second);
+			if(ranges.size()>0 && ranges.back().first + ranges.back().second == mit->first) {
+				++(ranges.back().second);
+			}
+			else {
+				ranges.push_back(std::pair<ReliablePacketID, unsigned int>(mit->first, 1));
+			}
+			++mit;
+		}
+
+		if(ranges.size()>0) {
+			SendRanges(PacketFlagRequestRedelivery, it->first, ranges);
+		}
 		++it;
 	}
 }
@@ -513,38 +873,19 @@ void ShowSocket::SendOutletChange(Channel ch, GroupID gid, const std::wstring& o
 }
 
 void ShowSocket::Send(strong<Packet> p, bool reliable) {
-	sockaddr_in addr;
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons((u_short)_port);      
-	u_long dir_bcast_addr = inet_addr(_bcastAddress);
-	addr.sin_addr.s_addr = dir_bcast_addr;
-	Send(p, &addr, reliable);
+	Send(p, &_bcastSocketAddress, reliable);
 }
 
 ReliablePacketID ShowSocket::RegisterReliablePacket(strong<Packet> p) {
 	ThreadLock lock(&_lock);
 	ReliablePacketID next = _lastPacketID + 1;
-
-	if(_reliableSentPackets.size() > _maxReliablePacketCount) {
-		/* Remove the entry with the id next - _maxReliablePacketCount. When next=101, we remove 101-100=1 */
-		std::map<ReliablePacketID, ref<Packet> >::iterator it = _reliableSentPackets.find(next - _maxReliablePacketCount);
-		if(it!=_reliableSentPackets.end()) {
-			_reliableSentPackets.erase(it);
-		}
-		else {
-			Log::Write(L"TJNP/Socket", L"Could not remove sent reliable packet from list; probably causing memory leaks!");
-		}
-	}
-
-	if(_reliableSentPackets.size() > 2*_maxReliablePacketCount) {
-		_reliableSentPackets.clear();
-		Log::Write(L"TJNP/Socket", L"List of sent packets became too large; removed all of them!");
-	}
-
-	_reliableSentPackets[next] = p;
 	p->_header->_flags |= PacketFlagReliable;
 	p->_header->_rpid = next;
 	_lastPacketID = next;
+
+	_retransmitWindow.Add(next, p);
+	_retransmitWindow.Trim(KMaximumRetransmitWindowSize, KMaximumRetransmitWindowAge);
+	++_reliableStats._sent;
 	return next;
 }
 
@@ -553,6 +894,9 @@ void ShowSocket::Send(strong<Packet> p, const sockaddr_in* address, bool reliabl
 	ref<Node> nw = _network;
 	if(!nw) return;
 
+	// Send pending updates first, so packets arrive in the order in which they were sent
+	Flush();
+
 	/* If packet needs to be sent 'reliably', create a ReliablePacketID */
 	if(reliable) {
 		RegisterReliablePacket(p);
@@ -565,28 +909,172 @@ void ShowSocket::Send(strong<Packet> p, const sockaddr_in* address, bool reliabl
 	///	return;
 	///}
 
-	unsigned int size = ((unsigned int)(Packet::maximumSize-sizeof(PacketHeader)), (unsigned int)(p->GetSize() + sizeof(PacketHeader)));
+	unsigned int size = Util::Min((unsigned int)Packet::maximumSize, (unsigned int)(p->_header->_size + sizeof(PacketHeader)));
 	p->_header->_from = nw->GetInstanceID();
 	int ret = sendto(_client, reinterpret_cast<char*>(p->_header), size, 0, (const sockaddr*)address, sizeof(sockaddr_in));
 
 	if(ret != SOCKET_ERROR) {
 		_bytesSent += (int)size;
+		++_packetsSent;
 	}
 }
 
 void ShowSocket::Send(strong<Message> s, bool reliable) {
-	sockaddr_in addr;
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons((u_short)_port);      
-	u_long dir_bcast_addr = inet_addr(_bcastAddress);
-	addr.sin_addr.s_addr = dir_bcast_addr;
-
 	s->SetSent();
-	Send(s->ConvertToPacket(), &addr, reliable);
+	PacketAction action = s->GetHeader()->_action;
+	strong<Packet> packet = s->ConvertToPacket();
+
+	if(!reliable && (action==ActionUpdate || action==ActionUpdatePlugin)) {
+		AddToBatch(packet);
+	}
+	else {
+		Send(packet, &_bcastSocketAddress, reliable);
+	}
+}
+
+void ShowSocket::AddToBatch(strong<Packet> p) {
+	ThreadLock lock(&_lock);
+	ref<Node> nw = _network;
+	if(!nw) return;
+
+	unsigned int size = (unsigned int)(p->_header->_size + sizeof(PacketHeader));
+	if(size+sizeof(PacketHeader) > KMaximumBatchSize) {
+		// Does not fit in a batch
+		Send(p, &_bcastSocketAddress, false);
+		return;
+	}
+
+	p->_header->_from = nw->GetInstanceID();
+	if(_batches.size()==0 || _batches.back()._data->GetSize()+size > KMaximumBatchSize) {
+		if(_batches.size()==0) {
+			_batchStarted.Now();
+		}
+
+		PacketHeader bph;
+		bph._action = ActionBatch;
+		bph._from = p->_header->_from;
+
+		PendingBatch batch;
+		batch._data = GC::Hold(new DataWriter(KMaximumBatchSize));
+		batch._data->Add(bph);
+		batch._count = 0;
+		_batches.push_back(batch);
+	}
+
+	PendingBatch& batch = _batches.back();
+	batch._data->Append(reinterpret_cast<const char*>(p->_header), size);
+	reinterpret_cast<PacketHeader*>(batch._data->_buffer)->_size += size;
+	++batch._count;
+
+	bool open = _batchDepths.find(Thread::GetCurrentThreadID())!=_batchDepths.end();
+	if(!open || _batches.size() > KMaximumPendingBatches || IsBatchExpired()) {
+		Flush();
+	}
+}
+
+/** Returns true if there are pending batches and the oldest update in them has waited for more than KMaximumBatchDelay ms **/
+bool ShowSocket::IsBatchExpired() const {
+	ThreadLock lock(&_lock);
+	return _batches.size()>0 && Timestamp(true).Difference(_batchStarted).ToMilliSeconds() > (long double)KMaximumBatchDelay;
+}
+
+void ShowSocket::BeginBatch() {
+	ThreadLock lock(&_lock);
+	++_batchDepths[Thread::GetCurrentThreadID()];
+}
+
+void ShowSocket::EndBatch() {
+	ThreadLock lock(&_lock);
+	bool closed = true;
+	std::map<int, unsigned int>::iterator it = _batchDepths.find(Thread::GetCurrentThreadID());
+	if(it!=_batchDepths.end()) {
+		if(--(it->second)==0) {
+			_batchDepths.erase(it);
+		}
+		else {
+			closed = false;
+		}
+	}
+
+	if(closed || IsBatchExpired()) {
+		Flush();
+	}
+}
+
+/** Sends all pending batches. On Linux, all batches are sent with a single call to sendmmsg. **/
+void ShowSocket::Flush() {
+	ThreadLock lock(&_lock);
+	unsigned int count = (unsigned int)_batches.size();
+	if(count==0) {
+		return;
+	}
+
+	// A batch that contains a single packet is sent as that packet
+	std::vector<const char*> datagrams(count);
+	std::vector<unsigned int> sizes(count);
+	for(unsigned int a=0;a<count;a++) {
+		const PendingBatch& batch = _batches.at(a);
+		unsigned int offset = (batch._count==1) ? sizeof(PacketHeader) : 0;
+		datagrams[a] = batch._data->GetBuffer() + offset;
+		sizes[a] = (unsigned int)batch._data->GetSize() - offset;
+	}
+
+	#ifdef TJ_OS_LINUX
+		std::vector<mmsghdr> messages(count);
+		std::vector<iovec> vectors(count);
+		for(unsigned int a=0;a<count;a++) {
+			vectors[a].iov_base = const_cast<char*>(datagrams[a]);
+			vectors[a].iov_len = sizes[a];
+			memset(&(messages[a]), 0, sizeof(mmsghdr));
+			messages[a].msg_hdr.msg_name = &_bcastSocketAddress;
+			messages[a].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+			messages[a].msg_hdr.msg_iov = &(vectors[a]);
+			messages[a].msg_hdr.msg_iovlen = 1;
+		}
+
+		unsigned int sent = 0;
+		while(sent<count) {
+			int ret = sendmmsg(_client, &(messages[sent]), count-sent, 0);
+			if(ret<=0) {
+				break;
+			}
+
+			for(int a=0;a<ret;a++) {
+				_bytesSent += (int)sizes[sent+a];
+			}
+			sent += ret;
+			_packetsSent += ret;
+		}
+	#else
+		for(unsigned int a=0;a<count;a++) {
+			int ret = sendto(_client, datagrams[a], sizes[a], 0, (const sockaddr*)&_bcastSocketAddress, sizeof(sockaddr_in));
+			if(ret != SOCKET_ERROR) {
+				_bytesSent += (int)sizes[a];
+				++_packetsSent;
+			}
+		}
+	#endif
+
+	_batches.clear();
 }
 
 unsigned int ShowSocket::GetWishListSize() const {
-	return (unsigned int)_reliableWishList.size();
+	ThreadLock lock(&_lock);
+	unsigned int n = 0;
+	std::map<InstanceID, ReliableSender>::const_iterator it = _reliableSenders.begin();
+	while(it!=_reliableSenders.end()) {
+		n += (unsigned int)it->second._missing.size();
+		++it;
+	}
+	return n;
+}
+
+void ShowSocket::GetReliableStatistics(ReliableStatistics& stats) const {
+	ThreadLock lock(&_lock);
+	stats = _reliableStats;
+	stats._windowPackets = _retransmitWindow.GetCount();
+	stats._windowBytes = _retransmitWindow.GetBytes();
+	stats._waiting = GetWishListSize();
 }
 
 int ShowSocket::GetBytesSent() const {
@@ -597,4 +1085,8 @@ int ShowSocket::GetBytesReceived() const {
 	return _bytesReceived;
 }
 
+int ShowSocket::GetPacketsSent() const {
+	return _packetsSent;
+}
+
 #pragma pack(pop)
\ No newline at end of file
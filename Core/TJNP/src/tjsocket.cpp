@@ -22,6 +22,12 @@
 #ifndef TJ_OS_WIN
 	#include <sys/socket.h>
 	#include <arpa/inet.h>
+
+	#ifdef TJ_OS_LINUX
+		#include <sys/epoll.h>
+		#include <sys/eventfd.h>
+	#endif
+
 	#define INVALID_SOCKET -1
 	#define SOCKET_ERROR -1
 	#define _strdup strdup
@@ -313,7 +319,21 @@ strong<SocketListenerThread> SocketListenerThread::DefaultInstance() {
 }
 
 SocketListenerThread::SocketListenerThread() {
-	#ifdef TJ_OS_POSIX
+	#if defined(TJ_OS_LINUX)
+		_stopping = false;
+		_epoll = epoll_create(KMaximumEvents);
+		_wakeup = eventfd(0, 0);
+		if(_epoll==-1 || _wakeup==-1) {
+			Log::Write(L"TJNP/SocketListenerThread", L"Could not create epoll instance or wake-up event");
+		}
+		else {
+			epoll_event ev;
+			memset(&ev, 0, sizeof(epoll_event));
+			ev.events = EPOLLIN;
+			ev.data.fd = _wakeup;
+			epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &ev);
+		}
+	#elif defined(TJ_OS_POSIX)
 		if(socketpair(AF_UNIX, SOCK_STREAM, 0, _controlSocket)!=0) {
 			Log::Write(L"TJNP/SocketListenerThread", L"Could not create control socket pair");
 		}
@@ -328,7 +348,10 @@ SocketListenerThread::~SocketListenerThread() {
 	
 	WaitForCompletion();
 	
-	#ifdef TJ_OS_POSIX
+	#if defined(TJ_OS_LINUX)
+		close(_epoll);
+		close(_wakeup);
+	#elif defined(TJ_OS_POSIX)
 		close(_controlSocket[0]);
 		close(_controlSocket[1]);
 	#endif
@@ -343,7 +366,7 @@ void SocketListenerThread::PostThreadUpdate() {
 		PostThreadMessage(GetID(), WM_USER, 0, 0);
 	#endif
 		
-	#ifdef TJ_OS_POSIX
+	#if defined(TJ_OS_POSIX) && !defined(TJ_OS_LINUX)
 		char update[1] = {'U'};
 		if(write(_controlSocket[0], update, 1)==-1) {
 			Log::Write(L"TJNP/SocketListenerThread", L"Could not send update message to listener thread");
@@ -357,6 +380,13 @@ void SocketListenerThread::RemoveListener(NativeSocket ns) {
 		std::map<NativeSocket, weak<SocketListener> >::iterator it = _listeners.find(ns);
 		if(it!=_listeners.end()) {
 			_listeners.erase(it);
+
+			#ifdef TJ_OS_LINUX
+				// Fails when the socket was already closed, but then it has already been removed from the epoll set
+				epoll_event ev;
+				memset(&ev, 0, sizeof(epoll_event));
+				epoll_ctl(_epoll, EPOLL_CTL_DEL, ns, &ev);
+			#endif
 		}
 	}
 
@@ -367,6 +397,18 @@ void SocketListenerThread::AddListener(NativeSocket sock, ref<SocketListener> sl
 	{
 		ThreadLock lock(&_lock);
 		_listeners[sock] = sl;
+
+		#ifdef TJ_OS_LINUX
+			/* The listeners only read a single message (or accept a single connection) each time they are called, so
+			the socket is watched level-triggered; an edge-triggered watch would not report the data that is left. */
+			epoll_event ev;
+			memset(&ev, 0, sizeof(epoll_event));
+			ev.events = EPOLLIN;
+			ev.data.fd = sock;
+			if(epoll_ctl(_epoll, EPOLL_CTL_ADD, sock, &ev)!=0 && errno==EEXIST) {
+				epoll_ctl(_epoll, EPOLL_CTL_MOD, sock, &ev);
+			}
+		#endif
 	}
 	PostThreadUpdate();
 }
@@ -376,7 +418,12 @@ void SocketListenerThread::Stop() {
 		PostThreadMessage(GetID(), WM_QUIT, 0, 0);
 	#endif
 		
-	#ifdef TJ_OS_POSIX
+	#if defined(TJ_OS_LINUX)
+		_stopping = true;
+		if(eventfd_write(_wakeup, 1)!=0) {
+			Log::Write(L"TJNP/SocketListenerThread", L"Could not send quit message to listener thread");
+		}
+	#elif defined(TJ_OS_POSIX)
 		char quit[1] = {'Q'};
 		if(write(_controlSocket[0], quit, 1)==-1) {
 			Log::Write(L"TJNP/SocketListenerThread", L"Could not send quit message to listener thread");
@@ -388,7 +435,10 @@ void SocketListenerThread::OnReceive(NativeSocket ns) {
 	ref<SocketListener> sl;
 	{
 		ThreadLock lock(&_lock);
-		sl = _listeners[ns];
+		std::map<NativeSocket, weak<SocketListener> >::iterator it = _listeners.find(ns);
+		if(it!=_listeners.end()) {
+			sl = it->second;
+		}
 	}
 	
 	if(sl) {
@@ -452,7 +502,36 @@ void SocketListenerThread::Run() {
 		DestroyWindow(_window);
 	#endif	
 	
-	#ifdef TJ_OS_POSIX
+	#if defined(TJ_OS_LINUX)
+		epoll_event events[KMaximumEvents];
+
+		while(true) {
+			int n = epoll_wait(_epoll, events, KMaximumEvents, -1);
+			if(n<0) {
+				if(errno==EINTR) {
+					continue;
+				}
+				Log::Write(L"TJNP/SocketListenerThread", L"Wait operation failed (err="+Stringify(errno)+L")");
+				break;
+			}
+
+			for(int a=0;a<n;a++) {
+				NativeSocket ns = events[a].data.fd;
+				if(ns==_wakeup) {
+					eventfd_t value = 0;
+					eventfd_read(_wakeup, &value);
+				}
+				else if(!_stopping) {
+					OnReceive(ns);
+				}
+			}
+
+			if(_stopping) {
+				Log::Write(L"TJNP/SocketListenerThread", L"End thread, quit control message received");
+				return;
+			}
+		}
+	#elif defined(TJ_OS_POSIX)
 		bool controlSocketOnly = false;
 
 		while(true) {
@@ -27,6 +27,8 @@ using namespace tj::shared;
 	#include <sys/socket.h>
 	#include <arpa/inet.h>
 	#include <fcntl.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
 #endif
 
 #ifdef TJ_OS_LINUX
@@ -44,19 +46,35 @@ std::ostream& operator<< (std::ostream& out, const TiXmlNode& doc) {
 }
 
 /** WebServerResponseTask **/
-WebServerResponseTask::WebServerResponseTask(NativeSocket client, ref<WebServer> fs): _ws(fs), _client(client), _bytesSent(0), _bytesReceived(0) {
+WebServerResponseTask::WebServerResponseTask(NativeSocket client, ref<WebServer> fs): _client(client), _ws(fs), _bytesReceived(0), _bytesSent(0), _keepAlive(false), _headRequest(false) {
 }
 
 WebServerResponseTask::~WebServerResponseTask() {
 }
 
 void WebServerResponseTask::SendError(int code, const std::wstring& desc, const std::wstring& extraInfo) {
-	std::ostringstream reply;
-	reply << "HTTP/1.1 " << code << " Not Found\r\nContent-type: text/html\r\n\r\n <b>" << Mbs(desc) << "</b>";
+	std::ostringstream body;
+	body << " <b>" << Mbs(desc) << "</b>";
 	if(extraInfo.length()>0) {
 		std::wstring extraInfoHTML = extraInfo;
 		Util::HTMLEntities(extraInfoHTML);
-		reply << ": " << Mbs(extraInfoHTML);
+		body << ": " << Mbs(extraInfoHTML);
+	}
+	std::string bodyText = body.str();
+
+	// The client needs the length of the body to find the next reply on a kept-alive connection; some replies never have a body
+	bool mayHaveBody = !(code==204 || code==304 || (code>=100 && code<200));
+	std::ostringstream reply;
+	reply << "HTTP/1.1 " << code << " " << Mbs(desc) << "\r\n";
+	reply << GetConnectionHeader();
+	reply << "Server: " << KServerName << "\r\n";
+	if(mayHaveBody) {
+		reply << "Content-type: text/html\r\n";
+		reply << "Content-length: " << int(bodyText.length()) << "\r\n";
+	}
+	reply << "\r\n";
+	if(mayHaveBody && !_headRequest) {
+		reply << bodyText;
 	}
 
 	std::string replyText = reply.str();
@@ -75,7 +93,7 @@ void WebServerResponseTask::SendMultiStatusReply(TiXmlDocument& reply) {
 	os << "Content-type: text/xml; charset=\"utf-8\"\r\n";
 	os << "Content-length: " << int(dataString.length()) << "\r\n";
 	os << "Server: " << KServerName << "\r\n";
-	os << "Connection: close\r\n";
+	os << GetConnectionHeader();
 	os << "DAV: " << KDAVVersion << "\r\n";
 	os << "\r\n";
 	os << dataString;
@@ -209,8 +227,9 @@ void WebServerResponseTask::ServeOptionsRequestWithResolver(ref<HTTPRequest> hrp
 	if(resolver) {
 		std::ostringstream headers;
 		headers << "HTTP/1.1 200 OK\r\n";
-		headers << "Connection: close\r\n";
+		headers << GetConnectionHeader();
 		headers << "Server: " << KServerName << "\r\n";
+		headers << "Content-length: 0\r\n";
 
 		Flags<WebItem::Permission> perms = resolver->GetPermissions();
 		if(perms.IsSet(WebItem::PermissionPropertyRead)) {
@@ -254,6 +273,7 @@ void WebServerResponseTask::ServeGetRequestWithResolver(ref<HTTPRequest> hrp, re
 	}
 	else if(res==ResolutionPermissionDenied) {
 		SendError(403, L"Forbidden", hrp->GetPath());
+		return;
 	}
 	else if(res==ResolutionData) {
 		if(resolvedData==0) {
@@ -271,7 +291,7 @@ void WebServerResponseTask::ServeGetRequestWithResolver(ref<HTTPRequest> hrp, re
 	bool justHeaders = (hrp->GetMethod()==HTTPRequest::MethodHead);
 	std::ostringstream headers;
 	headers << "HTTP/1.1 200 OK\r\n";
-	headers << "Connection: close\r\n";
+	headers << GetConnectionHeader();
 	headers << "Server: " << KServerName << "\r\n";
 
 	std::string contentType = Mbs(resolver->GetContentType());
@@ -279,10 +299,7 @@ void WebServerResponseTask::ServeGetRequestWithResolver(ref<HTTPRequest> hrp, re
 		headers << "Content-type: " << contentType << "\r\n";
 	}
 
-	Bytes contentLength = resolver->GetContentLength();
-	if(contentLength>0) {
-		headers << "Content-length: " << Bytes(contentLength) << "\r\n";
-	}
+	// The Content-length header is written below, from the actual length of the data or file that is sent
 
 	if(perms.IsSet(WebItem::PermissionPropertyRead)) {
 		headers << "DAV: " << KDAVVersion << "\r\n";
@@ -296,7 +313,10 @@ void WebServerResponseTask::ServeGetRequestWithResolver(ref<HTTPRequest> hrp, re
 		int q = send(_client, dataHeaders.c_str(), dataHeaders.length(), 0);
 		int r = 0;
 		if(!justHeaders) {
-			send(_client, resolvedData, (int)resolvedDataLength, 0);
+			r = send(_client, resolvedData, (int)resolvedDataLength, 0);
+			if(r!=(int)resolvedDataLength) {
+				_keepAlive = false;
+			}
 		}
 		if((q+r)>0) {
 			_bytesSent += q+r;
@@ -311,6 +331,7 @@ void WebServerResponseTask::ServeGetRequestWithResolver(ref<HTTPRequest> hrp, re
 			DWORD size = GetFileSize(file, 0);
 			if(size==INVALID_FILE_SIZE) {
 				Log::Write(L"TJNP/WebServer", L"Invalid file size for "+resolvedFile);
+				_keepAlive = false;
 			}
 			else {
 				// Write headers
@@ -325,6 +346,7 @@ void WebServerResponseTask::ServeGetRequestWithResolver(ref<HTTPRequest> hrp, re
 					char buffer[4096];
 					DWORD read = 0;
 
+					DWORD left = size;
 					while(ReadFile(file, buffer, 4096, &read, NULL)!=0) {
 						if(read<=0) {
 							break;
@@ -332,8 +354,14 @@ void WebServerResponseTask::ServeGetRequestWithResolver(ref<HTTPRequest> hrp, re
 						int r = send(_client, buffer, read, 0);
 						if(r>0) {
 							_bytesSent += r;
+							left -= Util::Min((DWORD)r, left);
 						}
 					}
+
+					// The client expects exactly 'size' bytes; if it got less, the connection cannot be reused
+					if(left>0) {
+						_keepAlive = false;
+					}
 				}
 			}
 
@@ -360,20 +388,29 @@ void WebServerResponseTask::ServeGetRequestWithResolver(ref<HTTPRequest> hrp, re
 					#ifdef TJ_OS_MAC
 						if(sendfile(fp, _client, start, &length, NULL, 0)!=0) {
 							Log::Write(L"TJNP/WebServer", L"sendfile() failed, file path was "+resolvedFile);
+							_keepAlive = false;
 						}
+						_bytesSent += (unsigned int)length;
 					#endif
 					
 					#ifdef TJ_OS_LINUX
-						if(sendfile(_client, fp, NULL, length)==-1) {
-							Log::Write(L"TJNP/WebServer", L"sendfile() failed, file path was "+resolvedFile);
+						// sendfile() may send less than requested, so continue until the whole file has been sent
+						while(start<length) {
+							ssize_t r = sendfile(_client, fp, &start, (size_t)(length-start));
+							if(r<=0) {
+								Log::Write(L"TJNP/WebServer", L"sendfile() failed, file path was "+resolvedFile);
+								_keepAlive = false;
+								break;
+							}
+							_bytesSent += (unsigned int)r;
 						}
 					#endif
-						
+					close(fp);
 				}
 				else {
 					Log::Write(L"TJNP/WebServer", L"open() failed, file path was "+resolvedFile);
+					_keepAlive = false;
 				}
-				close(fp);
 			}
 		#endif
 	}
@@ -402,6 +439,7 @@ void WebServerResponseTask::ServeRequestWithResolver(ref<HTTPRequest> hrp, ref<W
 
 			case HTTPRequest::MethodUnlock:
 				SendError(204, L"No content", Stringify(hrp->GetPath()));
+				break;
 
 			default:
 				SendError(501, L"Method not implemented", Stringify(hrp->GetMethod()));
@@ -519,18 +557,22 @@ void WebServerResponseTask::ServeRequest(ref<HTTPRequest> hrp) {
 				
 				if(resolver) {
 					// For all request that have a path that does not exist right now, don't resolve,
-					// and let the request handler fix the problem for us.
+					// and let the request handler fix the problem for us. These handlers send the reply.
 					if(hrp->GetMethod()==HTTPRequest::MethodMakeCollection) {
 						ServeMakeCollectionRequest(hrp, resolver, restOfPath);
+						return;
 					}
 					else if(hrp->GetMethod()==HTTPRequest::MethodDelete) {
 						ServeDeleteRequest(hrp, resolver, restOfPath);
+						return;
 					}
 					else if(hrp->GetMethod()==HTTPRequest::MethodPut) {
 						ServePutRequest(hrp, resolver, restOfPath);
+						return;
 					}
 					else if(hrp->GetMethod()==HTTPRequest::MethodCopy || hrp->GetMethod()==HTTPRequest::MethodMove) {
 						ServeMoveOrCopyRequestWithResolver(hrp,resolver,restOfPath);
+						return;
 					}
 					else {
 						resolver = resolver->Resolve(restOfPath);
@@ -545,91 +587,204 @@ void WebServerResponseTask::ServeRequest(ref<HTTPRequest> hrp) {
 	ServeRequestWithResolver(hrp, resolver);
 }
 
-void WebServerResponseTask::Run() {
-	ref<DataWriter> cwHeaders = GC::Hold(new DataWriter());
-	ref<DataWriter> cwData;
-
-	// get request
-	char buffer[2048];
-	bool readingRequestHeaders = true;
-	int64 requestBytesToRead = 0;
-	bool readCompleteHeaderBlock = false;
-	ref<HTTPRequest> httpRequest;
-	int enterCount = 0;
-
-	// TODO: add time-out in select for very slow clients (maybe only time-out when reading headers)
-	while(readingRequestHeaders || (requestBytesToRead > 0)) {
+const char* WebServerResponseTask::GetConnectionHeader() const {
+	return _keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+}
+
+std::string::size_type WebServerResponseTask::FindEndOfHeaders(const std::string& data, std::string::size_type from) {
+	/* The header block ends with an empty line. Bytes before 'from' were already scanned, but the line break that ends
+	the header block may have started just before it, so the scan is started two bytes earlier. */
+	std::string::size_type a = (from>2) ? (from-2) : 0;
+	while((a = data.find('\n', a))!=std::string::npos) {
+		if((a+1)<data.length() && data[a+1]=='\n') {
+			return a+2;
+		}
+		else if((a+2)<data.length() && data[a+1]=='\r' && data[a+2]=='\n') {
+			return a+3;
+		}
+		++a;
+	}
+	return std::string::npos;
+}
+
+bool WebServerResponseTask::IsKeepAliveRequested(ref<HTTPRequest> hrp, const std::string& requestLine) {
+	String connection = hrp->GetHeader("Connection", L"");
+	std::transform(connection.begin(), connection.end(), connection.begin(), tolower);
+
+	// HTTP/1.1 connections are persistent unless the client says otherwise; HTTP/1.0 clients have to ask for it
+	if(requestLine.find("HTTP/1.1")!=std::string::npos) {
+		return connection.find(L"close")==String::npos;
+	}
+	return connection.find(L"keep-alive")!=String::npos;
+}
+
+bool WebServerResponseTask::Receive(std::string& pending, bool idle) {
+	/* When idle (waiting for a new request), wait in short intervals so that the connection can be closed as soon as the
+	server gets busy. Otherwise, the client is in the middle of sending a request, and is given KRequestTimeout ms. */
+	Timestamp start(true);
+	int interval = idle ? KIdlePollInterval : KRequestTimeout;
+
+	while(true) {
 		fd_set fds;
 		FD_ZERO(&fds);
 		FD_SET(_client, &fds);
+		timeval tv;
+		tv.tv_sec = interval / 1000;
+		tv.tv_usec = (interval % 1000) * 1000;
 
-		if(select(_client+1, &fds, 0, 0, 0)>0) {
-			int r = recv(_client, buffer, 2048, 0);
+		int s = select(_client+1, &fds, 0, 0, &tv);
+		if(s<0) {
+			return false;
+		}
+		else if(s==0) {
+			if(!idle || Timestamp(true).Difference(start).ToMilliSeconds()>KIdleTimeout) {
+				return false;
+			}
+
+			ref<WebServer> ws = _ws;
+			if(!ws || ws->IsBusy()) {
+				return false;
+			}
+		}
+		else {
+			char buffer[KReceiveBufferSize];
+			int r = recv(_client, buffer, KReceiveBufferSize, 0);
 			if(r<=0) {
-				readingRequestHeaders = false;
-				requestBytesToRead = 0;
+				return false;
+			}
+			_bytesReceived += r;
+			pending.append(buffer, r);
+			return true;
+		}
+	}
+}
+
+void WebServerResponseTask::Run() {
+	std::string pending;
+	std::string::size_type scanned = 0;
+	unsigned int requestCount = 0;
+	bool connected = true;
+
+	while(connected) {
+		// Skip line breaks between requests (some clients send these after the request body)
+		std::string::size_type start = pending.find_first_not_of("\r\n");
+		if(start==std::string::npos) {
+			pending.clear();
+			scanned = 0;
+		}
+		else if(start>0) {
+			pending.erase(0, start);
+			scanned = 0;
+		}
+
+		// Look for the end of the header block in the data received so far; if there is none, receive more
+		std::string::size_type headerEnd = FindEndOfHeaders(pending, scanned);
+		if(headerEnd==std::string::npos) {
+			scanned = pending.length();
+			if(pending.length()>KMaximumHeaderSize) {
+				_keepAlive = false;
+				_headRequest = false;
+				SendError(400, L"Bad request", L"Request header too large");
 				break;
 			}
-			else {
-				_bytesReceived += r;
 
-				if(readingRequestHeaders) {
-					for(int a=0;a<r;a++) {
-						if(buffer[a]==L'\r' || buffer[a]==L'\n') {
-							enterCount++;
-						}
-						else {
-							enterCount = 0;
-						}
+			if(!Receive(pending, pending.empty())) {
+				break;
+			}
+			continue;
+		}
 
-						cwHeaders->Append(&(buffer[a]), 1);
-
-						if(enterCount>=4) {
-							readCompleteHeaderBlock = true;
-							readingRequestHeaders = false;
-
-							// A complete header block was read; let's see if there's additional data
-							httpRequest = GC::Hold(new HTTPRequest(cwHeaders,null));
-							String contentLength = httpRequest->GetHeader("Content-Length", L"");
-							if(contentLength.length()>0) {
-								requestBytesToRead = StringTo<int64>(contentLength,0);
-								// TODO: limit the maximum number of bytes that can be sent; otherwise, this
-								// could crash the server
-								if(requestBytesToRead>0) {
-									cwData = GC::Hold(new DataWriter(requestBytesToRead));
-								}
-							}
+		// Parse the request
+		ref<DataWriter> cwHeaders = GC::Hold(new DataWriter((unsigned int)headerEnd));
+		cwHeaders->Append(pending.data(), (unsigned int)headerEnd);
+		std::string requestLine = pending.substr(0, pending.find('\n'));
+
+		// Header names are case-insensitive; the headers that determine where the request ends are looked up in a lower-case copy
+		std::string lowerHeaders = pending.substr(0, headerEnd);
+		std::transform(lowerHeaders.begin(), lowerHeaders.end(), lowerHeaders.begin(), tolower);
+		pending.erase(0, headerEnd);
+		scanned = 0;
+		++requestCount;
+
+		ref<HTTPRequest> httpRequest;
+		try {
+			httpRequest = GC::Hold(new HTTPRequest(cwHeaders, null));
+		}
+		catch(...) {
+			break;
+		}
 
-							// Throw the rest of this block's data in the data buffer
-							if(requestBytesToRead>0) {
-								int64 dataLeft = r-a-1;
-								cwData->Append(&(buffer[a+1]), Util::Min(dataLeft,requestBytesToRead));
-								httpRequest->SetAdditionalData(cwData);
-								requestBytesToRead -= dataLeft;
-							}
-						}
-					}
-				}
-				else if(requestBytesToRead>0) {
-					cwData->Append(buffer, (unsigned int)Util::Min((int64)r,requestBytesToRead));
-					requestBytesToRead -= r;
+		/* Only bodies delimited by Content-Length are supported. Any other framing (such as a chunked body) cannot be
+		told apart from the next request, so the request is refused and the connection is closed. */
+		if(lowerHeaders.find("\ntransfer-encoding:")!=std::string::npos) {
+			_keepAlive = false;
+			_headRequest = false;
+			SendError(501, L"Not implemented", L"Transfer-Encoding");
+			break;
+		}
+
+		// Read the request body; data that is received after it belongs to the next request
+		int64 requestBytesToRead = 0;
+		std::string::size_type contentLength = lowerHeaders.find("\ncontent-length:");
+		if(contentLength!=std::string::npos) {
+			contentLength += 16;
+			requestBytesToRead = StringTo<int64>(lowerHeaders.substr(contentLength, lowerHeaders.find('\n', contentLength)-contentLength), -1);
+		}
+		if(requestBytesToRead<0) {
+			_keepAlive = false;
+			_headRequest = false;
+			SendError(400, L"Bad request", L"Invalid Content-Length");
+			break;
+		}
+		else if(requestBytesToRead>KMaximumBodySize) {
+			_keepAlive = false;
+			_headRequest = false;
+			SendError(413, L"Request entity too large", httpRequest->GetPath());
+			break;
+		}
+		else if(requestBytesToRead>0) {
+			ref<DataWriter> cwData = GC::Hold(new DataWriter((unsigned int)requestBytesToRead));
+			while(requestBytesToRead>0) {
+				if(pending.empty() && !Receive(pending, false)) {
+					break;
 				}
+
+				std::string::size_type n = (std::string::size_type)Util::Min((int64)pending.length(), requestBytesToRead);
+				cwData->Append(pending.data(), (unsigned int)n);
+				pending.erase(0, n);
+				requestBytesToRead -= n;
 			}
+
+			if(requestBytesToRead>0) {
+				break;
+			}
+			httpRequest->SetAdditionalData(cwData);
 		}
-		else {
-			// bail
-			break;
+
+		ref<WebServer> ws = _ws;
+		_keepAlive = ws && !ws->IsBusy() && requestCount<KMaximumRequestsPerConnection && IsKeepAliveRequested(httpRequest, requestLine);
+		_headRequest = (httpRequest->GetMethod()==HTTPRequest::MethodHead);
+
+		try {
+			ServeRequest(httpRequest);
+		}
+		catch(const Exception& e) {
+			Log::Write(L"TJNP/WebServerResponseTask", L"Error occurred when processing request: "+e.GetMsg());
+			_keepAlive = false;
+		}
+		catch(...) {
+			Log::Write(L"TJNP/WebServerResponseTask", L"Unknown error occurred when processing request");
+			_keepAlive = false;
 		}
-	}
 
-	try {
-		ServeRequest(httpRequest);
-	}
-	catch(const Exception& e) {
-		Log::Write(L"TJNP/WebServerResponseTask", L"Error occurred when processing request: "+e.GetMsg());
-	}
-	catch(...) {
-		Log::Write(L"TJNP/WebServerResponseTask", L"Unknown error occurred when processing request");
+		connected = _keepAlive;
+
+		if(ws) {
+			ws->_bytesReceived += _bytesReceived;
+			ws->_bytesSent += _bytesSent;
+			_bytesSent = 0;
+			_bytesReceived = 0;
+		}
 	}
 
 	#ifdef TJ_OS_POSIX
@@ -640,12 +795,10 @@ void WebServerResponseTask::Run() {
 		shutdown(_client, SD_SEND);
 	#endif
 
-	while(true) {
-		int r = recv(_client, buffer, 1023, 0);
-		if(r<=0) {
-			// Socket error or graceful close
-			break;
-		}
+	// Wait for the client to close the connection (but do not wait forever)
+	std::string rest;
+	while(Receive(rest, false)) {
+		rest.clear();
 	}
 
 	#ifdef TJ_OS_WIN
@@ -662,11 +815,12 @@ void WebServerResponseTask::Run() {
 		ws->_bytesSent += _bytesSent;
 		_bytesSent = 0;
 		_bytesReceived = 0;
+		Atomic::Decrement(&(ws->_connections));
 	}
 }
 
 /** WebServer **/
-WebServer::WebServer(unsigned short port, ref<WebItem> defaultResolver): _bytesSent(0), _bytesReceived(0), _defaultResolver(defaultResolver), _port(port), _server4(Socket::KInvalidSocket), _server6(Socket::KInvalidSocket) {
+WebServer::WebServer(unsigned short port, ref<WebItem> defaultResolver): _bytesReceived(0), _bytesSent(0), _connections(0), _defaultResolver(defaultResolver), _port(port), _server4(Socket::KInvalidSocket), _server6(Socket::KInvalidSocket) {
 }
 
 WebServer::~WebServer() {
@@ -695,7 +849,7 @@ void WebServer::AddTask(strong<Task> t) {
 	{
 		ThreadLock lock(&_lock);
 		if(!_dispatcher) {
-			_dispatcher = GC::Hold(new Dispatcher());
+			_dispatcher = GC::Hold(new Dispatcher(KMaximumThreads));
 		}
 	}
 
@@ -706,7 +860,12 @@ void WebServer::OnReceive(NativeSocket ns) {
 	NativeSocket client = accept(ns, 0, 0);
 	
 	if(client!=-1) {
+		// Responses are usually sent in more than one send(); do not let the second one wait for the ACK of the first
+		int on = 1;
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(int));
+
 		// handle request
+		Atomic::Increment(&_connections);
 		ref<WebServerResponseTask> wt = GC::Hold(new WebServerResponseTask(client, this));
 		AddTask(ref<Task>(wt));
 	}
@@ -825,6 +984,11 @@ void WebServer::OnCreated() {
 	}
 }
 
+bool WebServer::IsBusy() const {
+	// Each connection occupies a thread while it is open; when there are more connections than threads, new ones have to wait
+	return _connections > KMaximumThreads;
+}
+
 void WebServer::AddResolver(const std::wstring& pathPrefix, strong<WebItem> frq) {
 	ThreadLock lock(&_lock);
 	_resolvers[pathPrefix] = frq;
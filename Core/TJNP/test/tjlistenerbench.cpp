@@ -0,0 +1,170 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Measures the SocketListenerThread with thousands of registered sockets, like a master with many OSC and Art-Net
+endpoints and web clients of which only a few are busy at any time. For a growing number of idle UDP sockets, KActive
+other sockets receive datagrams in turn; reported are the time to register (and later remove) all sockets, the datagrams
+handled per second and the CPU time of the listener thread per datagram, which should not grow with the number of idle
+sockets. The open file limit is raised to the hard limit; counts that do not fit are skipped. Output goes to stderr (the
+log of the listener thread makes stdout wide-oriented). Usage: tjlistenerbench [datagrams] */
+#include <TJNP/include/tjsocket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+
+using namespace tj::shared;
+using namespace tj::np;
+
+namespace tj {
+	namespace np {
+		namespace test {
+			const static int KActive = 16;
+			const static int KBurst = 32;
+
+			static void Wait(int ms) {
+				Event wait;
+				wait.Wait(ms);
+			}
+
+			/** Reads one datagram each time it is called and counts it **/
+			class CountingListener: public SocketListener {
+				public:
+					CountingListener(): _count(0) {
+					}
+
+					virtual ~CountingListener() {
+					}
+
+					virtual void OnReceive(NativeSocket ns) {
+						char buffer[2048];
+						if(recv(ns, buffer, sizeof(buffer), 0) > 0) {
+							Atomic::Increment(&_count);
+						}
+					}
+
+					int GetCount() const {
+						return _count;
+					}
+
+				private:
+					volatile ReferenceCount _count;
+			};
+
+			static NativeSocket CreateSocket() {
+				NativeSocket s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+				sockaddr_in address;
+				memset(&address, 0, sizeof(sockaddr_in));
+				address.sin_family = AF_INET;
+				address.sin_port = 0;
+				address.sin_addr.s_addr = inet_addr("127.0.0.1");
+				bind(s, (sockaddr*)&address, sizeof(sockaddr_in));
+				return s;
+			}
+
+			/** Returns the CPU time (ms) used by all threads except this (the main) thread, which is the time used by the
+			listener thread **/
+			static double GetListenerTime() {
+				timespec process, thread;
+				clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &process);
+				clock_gettime(CLOCK_THREAD_CPUTIME_ID, &thread);
+				return double(process.tv_sec - thread.tv_sec)*1000.0 + double(process.tv_nsec - thread.tv_nsec)/1000000.0;
+			}
+
+			static void Run(int idle, int datagrams) {
+				strong<SocketListenerThread> listenerThread = GC::Hold(new SocketListenerThread());
+				listenerThread->Start();
+				ref<CountingListener> listener = GC::Hold(new CountingListener());
+
+				std::vector<NativeSocket> sockets;
+				std::vector<sockaddr_in> targets;
+				for(int a=0;a<idle+KActive;a++) {
+					sockets.push_back(CreateSocket());
+				}
+				for(int a=idle;a<idle+KActive;a++) {
+					sockaddr_in address;
+					socklen_t length = sizeof(sockaddr_in);
+					getsockname(sockets[a], (sockaddr*)&address, &length);
+					targets.push_back(address);
+				}
+
+				Timestamp registrationStart(true);
+				for(unsigned int a=0;a<sockets.size();a++) {
+					listenerThread->AddListener(sockets[a], listener);
+				}
+				double registrationMs = double(Timestamp(true).Difference(registrationStart).ToMilliSeconds());
+				Wait(100);
+
+				// Datagrams go to the active sockets in turn; the sender pauses after each burst so that few are dropped
+				NativeSocket out = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+				char payload[64];
+				memset(payload, 1, sizeof(payload));
+				double cpuBefore = GetListenerTime();
+				Timestamp start(true);
+				for(int a=0;a<datagrams;a++) {
+					sendto(out, payload, sizeof(payload), 0, (const sockaddr*)&(targets[a%KActive]), sizeof(sockaddr_in));
+					if(a%KBurst==KBurst-1) {
+						usleep(100);
+					}
+				}
+
+				int received = -1;
+				while(received!=listener->GetCount()) {
+					received = listener->GetCount();
+					Wait(200);
+				}
+				double ms = double(Timestamp(true).Difference(start).ToMilliSeconds()) - 200.0;
+				double cpu = GetListenerTime() - cpuBefore;
+
+				Timestamp removalStart(true);
+				for(unsigned int a=0;a<sockets.size();a++) {
+					listenerThread->RemoveListener(sockets[a]);
+				}
+				double removalMs = double(Timestamp(true).Difference(removalStart).ToMilliSeconds());
+				listenerThread->Stop();
+
+				close(out);
+				for(unsigned int a=0;a<sockets.size();a++) {
+					close(sockets[a]);
+				}
+
+				fprintf(stderr, "%d idle + %d active sockets: registration %.1f ms, removal %.1f ms, %d of %d datagrams in %.0f ms (%.0f/s), listener %.0f ms cpu (%.2f us/datagram)\n",
+					idle, KActive, registrationMs, removalMs, received, datagrams, ms, double(received)*1000.0/ms, cpu, cpu*1000.0/double(received));
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::np::test;
+	int datagrams = (argc > 1) ? atoi(argv[1]) : 100000;
+
+	rlimit limit;
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+
+	const int idle[] = {0, 100, 1000, 4000, 10000};
+	for(unsigned int a=0;a<sizeof(idle)/sizeof(idle[0]);a++) {
+		if(rlim_t(idle[a] + KActive + 64) > limit.rlim_cur) {
+			fprintf(stderr, "%d idle sockets: skipped, the open file limit is %lu\n", idle[a], (unsigned long)limit.rlim_cur);
+			continue;
+		}
+		Run(idle[a], datagrams);
+	}
+	return 0;
+}
@@ -0,0 +1,204 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Measures the receive path of ShowSocket (OnReceive) over the loopback multicast group. A plain socket sends prebuilt
+100-byte packets in bursts of KBurst datagrams (sendmmsg), so that the sender costs as little as possible; the ShowSocket
+hands every packet to a Node that reads it. Reported are the packets received per second, the CPU time of the listener
+thread per packet, the number of datagrams read per receive call (recvmmsg) and the number of allocations per packet,
+both from the heap (operator new) and from the Pool. The test is linked with -Wl,--wrap=recvmmsg,--wrap=recvfrom to count the receive calls. Output goes to stderr
+(the log of the listener thread makes stdout wide-oriented). Usage: tjreceivebench [packets] [pause between bursts in us] */
+#include <TJNP/include/tjshowsocket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <new>
+
+using namespace tj::shared;
+using namespace tj::np;
+
+static volatile ReferenceCount _allocations = 0;
+static volatile ReferenceCount _receiveCalls = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+	Atomic::Increment(&_allocations);
+	void* p = malloc(size);
+	if(p==0) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc) {
+	return operator new(size);
+}
+
+void operator delete(void* p) throw() {
+	free(p);
+}
+
+void operator delete[](void* p) throw() {
+	free(p);
+}
+
+extern "C" int __real_recvmmsg(int fd, struct mmsghdr* messages, unsigned int count, int flags, struct timespec* timeout);
+extern "C" ssize_t __real_recvfrom(int fd, void* buffer, size_t length, int flags, struct sockaddr* from, socklen_t* fromLength);
+
+extern "C" int __wrap_recvmmsg(int fd, struct mmsghdr* messages, unsigned int count, int flags, struct timespec* timeout) {
+	Atomic::Increment(&_receiveCalls);
+	return __real_recvmmsg(fd, messages, count, flags, timeout);
+}
+
+extern "C" ssize_t __wrap_recvfrom(int fd, void* buffer, size_t length, int flags, struct sockaddr* from, socklen_t* fromLength) {
+	Atomic::Increment(&_receiveCalls);
+	return __real_recvfrom(fd, buffer, length, flags, from, fromLength);
+}
+
+namespace tj {
+	namespace np {
+		namespace test {
+			const static char* KGroupAddress = "239.255.10.13";
+			const static int KPort = 17341;
+			const static int KBurst = 32;
+			const static int KFloats = 24;
+
+			static void Wait(int ms) {
+				Event wait;
+				wait.Wait(ms);
+			}
+
+			/** Reads the sequence number and the values of every ActionResetAll packet **/
+			class ReadingNode: public Node {
+				public:
+					ReadingNode(InstanceID id): _id(id), _count(0), _sum(0.0f) {
+					}
+
+					virtual ~ReadingNode() {
+					}
+
+					virtual InstanceID GetInstanceID() const {
+						return _id;
+					}
+
+					virtual bool IsExpired() const {
+						return false;
+					}
+
+					virtual void OnReceive(int instance, in_addr from, const PacketHeader& ph, ref<DataReader> code) {
+						if(ph._action==ActionResetAll) {
+							unsigned int position = 0;
+							code->Get<int>(position);
+							for(int a=0;a<KFloats;a++) {
+								_sum += code->Get<float>(position);
+							}
+							Atomic::Increment(&_count);
+						}
+					}
+
+					int GetCount() const {
+						return _count;
+					}
+
+				private:
+					InstanceID _id;
+					volatile ReferenceCount _count;
+					float _sum;
+			};
+
+			/** Returns the CPU time (ms) used by all threads except this (the main) thread, which is the time used by the
+			listener thread **/
+			static double GetListenerTime() {
+				timespec process, thread;
+				clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &process);
+				clock_gettime(CLOCK_THREAD_CPUTIME_ID, &thread);
+				return double(process.tv_sec - thread.tv_sec)*1000.0 + double(process.tv_nsec - thread.tv_nsec)/1000000.0;
+			}
+
+			static void Run(int n, int pause) {
+				ref<ReadingNode> node = GC::Hold(new ReadingNode(2));
+				ref<ShowSocket> receiver = GC::Hold(new ShowSocket(KPort, KGroupAddress, node));
+				receiver->OnCreated();
+				Wait(100);
+
+				// The packets are built before measuring, so that the measurement only includes sending and receiving them
+				std::vector< ref<Packet> > packets;
+				for(int a=0;a<n;a++) {
+					ref<Message> m = GC::Hold(new Message(ActionResetAll));
+					m->Add<int>(a);
+					for(int b=0;b<KFloats;b++) {
+						m->Add<float>(1.0f);
+					}
+					ref<Packet> packet = m->ConvertToPacket();
+					packet->_header->_from = 1;
+					packets.push_back(packet);
+				}
+
+				int out = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+				sockaddr_in to;
+				memset(&to, 0, sizeof(sockaddr_in));
+				to.sin_family = AF_INET;
+				to.sin_port = htons((u_short)KPort);
+				to.sin_addr.s_addr = inet_addr(KGroupAddress);
+
+				double cpuBefore = GetListenerTime();
+				ReferenceCount allocations = _allocations;
+				long poolAllocations = Pool::GetAllocationCount();
+				ReferenceCount receiveCalls = _receiveCalls;
+				Timestamp start(true);
+				for(int a=0;a<n;a+=KBurst) {
+					mmsghdr messages[KBurst];
+					iovec vectors[KBurst];
+					memset(messages, 0, sizeof(mmsghdr)*KBurst);
+					for(int b=0;b<KBurst;b++) {
+						PacketHeader* ph = packets[a+b]->_header;
+						vectors[b].iov_base = ph;
+						vectors[b].iov_len = ph->_size + sizeof(PacketHeader);
+						messages[b].msg_hdr.msg_name = &to;
+						messages[b].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+						messages[b].msg_hdr.msg_iov = &(vectors[b]);
+						messages[b].msg_hdr.msg_iovlen = 1;
+					}
+					sendmmsg(out, messages, KBurst, 0);
+					if(pause > 0) {
+						usleep(pause);
+					}
+				}
+
+				// Wait until the receiver has read everything that is waiting in its socket
+				int received = -1;
+				while(received!=node->GetCount()) {
+					received = node->GetCount();
+					Wait(200);
+				}
+				double ms = double(Timestamp(true).Difference(start).ToMilliSeconds()) - 200.0;
+				double cpu = GetListenerTime() - cpuBefore;
+				close(out);
+
+				fprintf(stderr, "%d of %d packets received (%.1f%%) in %.0f ms, %.0f packets/s\n", received, n, double(received)*100.0/double(n), ms, double(received)*1000.0/ms);
+				fprintf(stderr, "listener thread: %.0f ms cpu (%.2f us/packet), %.2f datagrams per receive call, %.2f heap and %.2f pool allocations per packet\n", cpu, cpu*1000.0/double(received),
+					double(received)/double(_receiveCalls-receiveCalls), double(_allocations-allocations)/double(received), double(Pool::GetAllocationCount()-poolAllocations)/double(received));
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::np::test;
+	int n = (argc > 1) ? atoi(argv[1]) : 200000;
+	int pause = (argc > 2) ? atoi(argv[2]) : 100;
+	Run(n - n % KBurst, pause);
+	return 0;
+}
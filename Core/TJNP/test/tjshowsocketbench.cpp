@@ -0,0 +1,127 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Measures how many updates (ActionUpdate) per second a ShowSocket sends over the loopback multicast group, and how many
+datagrams and bytes that takes, for a few update sizes:
+- unbatched: every update is sent as a datagram of its own;
+- batched: updates are sent in ticks of 100, each inside a ShowSocket::Batch, like the playback engines do.
+A second socket on the same group counts the updates it receives. Output goes to stderr (the log of the listener threads
+makes stdout wide-oriented). Usage: tjshowsocketbench [updates] */
+#include <TJNP/include/tjshowsocket.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace tj::shared;
+using namespace tj::np;
+
+namespace tj {
+	namespace np {
+		namespace test {
+			const static char* KGroupAddress = "239.255.10.12";
+			const static int KPort = 17340;
+			const static int KTickSize = 100;
+
+			static void Wait(int ms) {
+				Event wait;
+				wait.Wait(ms);
+			}
+
+			/** Counts the updates it receives **/
+			class CountingNode: public Node {
+				public:
+					CountingNode(InstanceID id): _id(id), _updates(0) {
+					}
+
+					virtual ~CountingNode() {
+					}
+
+					virtual InstanceID GetInstanceID() const {
+						return _id;
+					}
+
+					virtual bool IsExpired() const {
+						return false;
+					}
+
+					virtual void OnReceive(int instance, in_addr from, const PacketHeader& ph, ref<DataReader> code) {
+						if(ph._action==ActionUpdate) {
+							Atomic::Increment(&_updates);
+						}
+					}
+
+					int GetUpdateCount() const {
+						return _updates;
+					}
+
+				private:
+					InstanceID _id;
+					volatile ReferenceCount _updates;
+			};
+
+			static void Run(bool batched, int updates, unsigned int payload) {
+				ref<CountingNode> receiverNode = GC::Hold(new CountingNode(2));
+				ref<CountingNode> senderNode = GC::Hold(new CountingNode(1));
+				ref<ShowSocket> receiver = GC::Hold(new ShowSocket(KPort, KGroupAddress, receiverNode));
+				receiver->OnCreated();
+				ref<ShowSocket> sender = GC::Hold(new ShowSocket(KPort, KGroupAddress, senderNode));
+				sender->OnCreated();
+				Wait(100);
+
+				std::vector<float> values(payload/sizeof(float), 0.5f);
+				Timestamp start(true);
+				for(int a=0;a<updates;a+=KTickSize) {
+					ShowSocket::Batch batch(batched ? sender : ref<ShowSocket>());
+					for(int b=a;b<a+KTickSize && b<updates;b++) {
+						ref<Message> m = GC::Hold(new Message(ActionUpdate));
+						m->Add<int>(b);
+						for(unsigned int c=0;c<values.size();c++) {
+							m->Add<float>(values[c]);
+						}
+						sender->Send(m, false);
+					}
+				}
+				double ms = double(Timestamp(true).Difference(start).ToMilliSeconds());
+
+				// Give the receiver some time to read what is still waiting in its socket
+				int received = receiverNode->GetUpdateCount();
+				for(int a=0;a<50;a++) {
+					Wait(20);
+					int now = receiverNode->GetUpdateCount();
+					if(now==received && now > 0) {
+						break;
+					}
+					received = now;
+				}
+
+				int packets = sender->GetPacketsSent();
+				int bytes = sender->GetBytesSent();
+				fprintf(stderr, "%s, %u-byte updates: %d updates in %.1f ms (%.0f updates/s), %d datagrams (%.0f/s, %.1f updates each), %.1f MB/s, %d received (%.1f%%)\n",
+					batched ? "batched" : "unbatched", (unsigned int)(sizeof(int)+values.size()*sizeof(float)), updates, ms, double(updates)*1000.0/ms,
+					packets, double(packets)*1000.0/ms, double(updates)/double(packets), double(bytes)/ms/1000.0, received, double(received)*100.0/double(updates));
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::np::test;
+	int updates = (argc > 1) ? atoi(argv[1]) : 200000;
+	const unsigned int payloads[] = {4, 32, 256};
+
+	for(unsigned int a=0;a<sizeof(payloads)/sizeof(payloads[0]);a++) {
+		Run(false, updates, payloads[a]);
+		Run(true, updates, payloads[a]);
+	}
+	return 0;
+}
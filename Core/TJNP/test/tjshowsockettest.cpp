@@ -0,0 +1,341 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Tests the reliable packets of ShowSocket over a lossy network. The test is linked with -Wl,--wrap=sendto, so that all
+datagrams sent by the sockets go through __wrap_sendto, which drops a fixed share of the reliable packets that are sent for
+the first time (retransmissions and redelivery requests always get through). Each part uses a sending and a receiving
+socket on the loopback multicast group:
+- Recovery: a few thousand small packets, one in five dropped; all of them must be recovered with redelivery requests.
+- Window: more than KMaximumRetransmitWindowSize of packets is sent after the dropped ones, so that the sender can no
+  longer send them again; the receiver must be told that they are not available and count them as lost.
+- Rate: so many packets are requested at once that the retransmit rate limit (token bucket) must drop some of them;
+  the number of bytes sent again may not exceed the burst size plus the rate, and all packets must arrive eventually.
+- Batches: an open batch only holds back the updates of the thread that opened it, and a batch that is older than
+  KMaximumBatchDelay is sent as soon as the socket receives a datagram, also when no more updates are sent.
+The results are written to stderr, because the log of the listener threads makes stdout wide-oriented.
+Usage: tjshowsockettest */
+#include <TJNP/include/tjshowsocket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <set>
+
+using namespace tj::shared;
+using namespace tj::np;
+
+/** Drops one in _dropInterval reliable packets (0 means: drop nothing) **/
+static volatile unsigned int _dropInterval = 0;
+static volatile unsigned int _reliableSent = 0;
+static volatile unsigned int _dropped = 0;
+
+extern "C" ssize_t __real_sendto(int fd, const void* buffer, size_t length, int flags, const struct sockaddr* to, socklen_t toLength);
+
+extern "C" ssize_t __wrap_sendto(int fd, const void* buffer, size_t length, int flags, const struct sockaddr* to, socklen_t toLength) {
+	const PacketHeader* ph = (const PacketHeader*)buffer;
+	if(length >= sizeof(PacketHeader) && ph->_flags==PacketFlagReliable) {
+		++_reliableSent;
+		if(_dropInterval!=0 && (_reliableSent % _dropInterval)==0) {
+			++_dropped;
+			return (ssize_t)length;
+		}
+	}
+	return __real_sendto(fd, buffer, length, flags, to, toLength);
+}
+
+namespace tj {
+	namespace np {
+		namespace test {
+			const static char* KGroupAddress = "239.255.10.11";
+			const static unsigned int KLargePayload = 250; // characters; 1000 bytes with a four-byte wchar_t
+			static int _failures = 0;
+
+			static void Check(bool ok, const char* what) {
+				if(!ok) {
+					fprintf(stderr, "failed: %s\n", what);
+					++_failures;
+				}
+			}
+
+			static void Wait(int ms) {
+				Event wait;
+				wait.Wait(ms);
+			}
+
+			/** Remembers the sequence numbers of all ActionResetAll and ActionUpdate messages it receives **/
+			class TestNode: public Node {
+				public:
+					TestNode(InstanceID id): _id(id) {
+					}
+
+					virtual ~TestNode() {
+					}
+
+					virtual InstanceID GetInstanceID() const {
+						return _id;
+					}
+
+					virtual bool IsExpired() const {
+						return false;
+					}
+
+					virtual void OnReceive(int instance, in_addr from, const PacketHeader& ph, ref<DataReader> code) {
+						if(ph._action==ActionResetAll || ph._action==ActionUpdate) {
+							unsigned int position = 0;
+							int n = code->Get<int>(position);
+							ThreadLock lock(&_lock);
+							if(ph._action==ActionResetAll) {
+								_seen.insert(n);
+							}
+							else {
+								_updates.insert(n);
+							}
+						}
+					}
+
+					unsigned int GetSeenCount() const {
+						ThreadLock lock(&_lock);
+						return (unsigned int)_seen.size();
+					}
+
+					unsigned int GetUpdateCount() const {
+						ThreadLock lock(&_lock);
+						return (unsigned int)_updates.size();
+					}
+
+				private:
+					InstanceID _id;
+					std::set<int> _seen;
+					std::set<int> _updates;
+					mutable CriticalSection _lock;
+			};
+
+			class Pair {
+				public:
+					Pair(int port) {
+						_receiverNode = GC::Hold(new TestNode(2));
+						_senderNode = GC::Hold(new TestNode(1));
+						_receiver = GC::Hold(new ShowSocket(port, KGroupAddress, _receiverNode));
+						_receiver->OnCreated();
+						_sender = GC::Hold(new ShowSocket(port, KGroupAddress, _senderNode));
+						_sender->OnCreated();
+						Wait(100);
+					}
+
+					/** Sends messages [first, first+count) reliably; every 50 packets the receiver gets some time to keep up,
+					so that the only packets that are lost are the ones dropped on purpose. **/
+					void Send(int first, int count, unsigned int payload) {
+						std::wstring data(payload, L'x');
+						for(int a=first;a<first+count;a++) {
+							ref<Message> m = GC::Hold(new Message(ActionResetAll));
+							m->Add<int>(a);
+							if(payload > 0) {
+								m->Add(data);
+							}
+							_sender->Send(m, true);
+							if(a%50==0) {
+								Wait(2);
+							}
+						}
+					}
+
+					/** Requests the missing packets until all have arrived (or have been given up on) **/
+					void Recover(unsigned int expected, int rounds) {
+						for(int a=0;a<rounds;a++) {
+							ReliableStatistics rs;
+							_receiver->GetReliableStatistics(rs);
+							if(_receiverNode->GetSeenCount() + rs._lost >= expected && rs._waiting==0) {
+								break;
+							}
+							_receiver->SendRedeliveryRequests();
+							Wait(300);
+						}
+					}
+
+					void Print(const char* name) {
+						ReliableStatistics ts, rs;
+						_sender->GetReliableStatistics(ts);
+						_receiver->GetReliableStatistics(rs);
+						fprintf(stderr, "%s: sender: sent=%u retransmitted=%u rate-limited=%u not available=%u window=%u packets/%u bytes\n", name, ts._sent, ts._retransmitted, ts._retransmitsDropped, ts._notAvailable, ts._windowPackets, ts._windowBytes);
+						fprintf(stderr, "%s: receiver: seen=%u missing=%u recovered=%u lost=%u waiting=%u requests=%u\n", name, _receiverNode->GetSeenCount(), rs._missing, rs._recovered, rs._lost, rs._waiting, rs._requestsSent);
+					}
+
+					ref<TestNode> _receiverNode;
+					ref<TestNode> _senderNode;
+					ref<ShowSocket> _receiver;
+					ref<ShowSocket> _sender;
+			};
+
+			/** Drops every fifth packet except the last one (a missing packet is only noticed when a later one arrives) **/
+			static void TestRecovery() {
+				const int n = 2000;
+				Pair p(17332);
+				_dropped = 0;
+				_reliableSent = 0;
+				_dropInterval = 5;
+				p.Send(0, n-1, 0);
+				_dropInterval = 0;
+				p.Send(n-1, 1, 0);
+				unsigned int dropped = _dropped;
+				Wait(200);
+				p.Recover(n, 10);
+				p.Print("recovery");
+
+				ReliableStatistics rs;
+				p._receiver->GetReliableStatistics(rs);
+				Check(dropped > 0, "recovery: packets were dropped");
+				Check(p._receiverNode->GetSeenCount()==(unsigned int)n, "recovery: all packets arrived");
+				Check(rs._missing==dropped, "recovery: every dropped packet was noticed as missing");
+				Check(rs._recovered==dropped, "recovery: every dropped packet was recovered");
+				Check(rs._lost==0 && rs._waiting==0, "recovery: no packets lost or still waited for");
+			}
+
+			/** Drops packets from the first part, then sends more than the retransmit window can hold **/
+			static void TestWindowOverflow() {
+				const int early = 100;
+				const int n = early + 2*ShowSocket::KMaximumRetransmitWindowSize/(KLargePayload*sizeof(wchar_t));
+				Pair p(17333);
+				_dropped = 0;
+				_reliableSent = 0;
+				_dropInterval = 5;
+				p.Send(0, early, KLargePayload);
+				_dropInterval = 0;
+				unsigned int dropped = _dropped;
+				p.Send(early, n-early, KLargePayload);
+				Wait(200);
+				p.Recover(n, 10);
+				p.Print("window");
+
+				ReliableStatistics ts, rs;
+				p._sender->GetReliableStatistics(ts);
+				p._receiver->GetReliableStatistics(rs);
+				Check(dropped > 0, "window: packets were dropped");
+				Check(ts._windowBytes <= ShowSocket::KMaximumRetransmitWindowSize, "window: retransmit window stays within its size limit");
+				Check(ts._notAvailable >= dropped, "window: sender reports the dropped packets as not available");
+				Check(rs._lost >= dropped, "window: receiver gives up on the packets that are not available");
+				Check(p._receiverNode->GetSeenCount() + rs._lost == (unsigned int)n, "window: every packet either arrived or was lost");
+				Check(rs._waiting==0, "window: no packets still waited for");
+			}
+
+			/** Drops two in three packets, so that a single redelivery request asks for far more than the burst size **/
+			static void TestRateLimit() {
+				const int n = 300;
+				Pair p(17334);
+				_dropped = 0;
+				_reliableSent = 0;
+				_dropInterval = 0;
+
+				// An interval of one drops every packet; the first and last packet must arrive for the others to be noticed as missing
+				std::wstring data(KLargePayload, L'x');
+				for(int a=0;a<n;a++) {
+					_dropInterval = (a%3==2 || a==0 || a==n-1) ? 0 : 1;
+					ref<Message> m = GC::Hold(new Message(ActionResetAll));
+					m->Add<int>(a);
+					m->Add(data);
+					p._sender->Send(m, true);
+					if(a%50==0) {
+						Wait(2);
+					}
+				}
+				_dropInterval = 0;
+				unsigned int dropped = _dropped;
+				Wait(200);
+
+				// One request for all missing packets; the bucket holds at most the burst size when it is sent
+				Timestamp start(true);
+				p._receiver->SendRedeliveryRequests();
+				Wait(200);
+				double seconds = double(Timestamp(true).Difference(start).ToMilliSeconds()) / 1000.0;
+
+				ReliableStatistics ts;
+				p._sender->GetReliableStatistics(ts);
+				double packetBytes = double(sizeof(PacketHeader) + sizeof(int) + KLargePayload*sizeof(wchar_t));
+				double allowed = double(ShowSocket::KMaximumRetransmitBurst) + double(ShowSocket::KRetransmitRate)*seconds;
+				fprintf(stderr, "rate: %u dropped, %u sent again in %.0f ms (%.0f bytes, at most %.0f allowed), %u rate-limited\n", dropped, ts._retransmitted, seconds*1000.0, ts._retransmitted*packetBytes, allowed, ts._retransmitsDropped);
+				Check(dropped*packetBytes > double(ShowSocket::KMaximumRetransmitBurst), "rate: more bytes missing than the burst size");
+				Check(ts._retransmitsDropped > 0, "rate: retransmissions were rate-limited");
+				Check(ts._retransmitted*packetBytes <= allowed, "rate: retransmitted bytes stay within burst plus rate");
+
+				// The packets that were not sent again are requested again
+				p.Recover(n, 10);
+				p.Print("rate");
+				Check(p._receiverNode->GetSeenCount()==(unsigned int)n, "rate: all packets arrived eventually");
+			}
+
+			static void SendUpdate(ref<ShowSocket> socket, int n) {
+				ref<Message> m = GC::Hold(new Message(ActionUpdate));
+				m->Add<int>(n);
+				socket->Send(m, false);
+			}
+
+			/** Sends a single update without opening a batch **/
+			class UpdatingThread: public Thread {
+				public:
+					UpdatingThread(ref<ShowSocket> socket, int n): _socket(socket), _n(n) {
+					}
+
+					virtual ~UpdatingThread() {
+					}
+
+				protected:
+					virtual void Run() {
+						SendUpdate(_socket, _n);
+					}
+
+					ref<ShowSocket> _socket;
+					int _n;
+			};
+
+			static void TestBatches() {
+				Pair p(17335);
+				{
+					ShowSocket::Batch batch(p._sender);
+					SendUpdate(p._sender, 0);
+					Wait(50);
+					unsigned int held = p._receiverNode->GetUpdateCount();
+
+					// Another thread without a batch sends right away, together with what this thread has batched so far
+					ref<UpdatingThread> other = GC::Hold(new UpdatingThread(p._sender, 1));
+					other->Start();
+					other->WaitForCompletion();
+					Wait(50);
+					unsigned int afterOther = p._receiverNode->GetUpdateCount();
+
+					// An expired batch is not sent before the socket receives something (nothing else happens on the socket)
+					SendUpdate(p._sender, 2);
+					Wait(ShowSocket::KMaximumBatchDelay*5);
+					unsigned int idle = p._receiverNode->GetUpdateCount();
+					SendUpdate(p._receiver, 100);
+					Wait(50);
+					unsigned int afterReceive = p._receiverNode->GetUpdateCount();
+
+					fprintf(stderr, "batches: %u update(s) arrived while batched, %u after an update from another thread, %u while idle, %u after receiving\n", held, afterOther, idle, afterReceive);
+					Check(held==0, "batches: an open batch holds back updates of its own thread");
+					Check(afterOther==2, "batches: an open batch does not hold back updates of other threads");
+					Check(idle==2, "batches: an idle batch is held until the socket is used");
+					Check(afterReceive==3, "batches: an expired batch is sent when a datagram is received");
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::np::test;
+	TestRecovery();
+	TestWindowOverflow();
+	TestRateLimit();
+	TestBatches();
+	fprintf(stderr, "%d failures\n", _failures);
+	return (_failures==0) ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Measures how many requests per second the WebServer answers for a small (512-byte) resource, with a few client threads
+that each send a number of requests:
+- close: a new connection for every request ('Connection: close');
+- keep-alive: one request at a time over a persistent connection;
+- pipelined: KPipelineDepth requests at a time over a persistent connection.
+Clients reconnect when the server closes a persistent connection (after KMaximumRequestsPerConnection requests). Replies
+that are not '200 OK' are counted as failures. Output goes to stderr (the log of the server threads makes stdout
+wide-oriented). Usage: tjwebserverbench [requests per client] [clients] */
+#include <TJNP/include/tjwebserver.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace tj::shared;
+using namespace tj::np;
+
+namespace tj {
+	namespace np {
+		namespace test {
+			const static unsigned int KResourceSize = 512;
+			const static int KPipelineDepth = 16;
+
+			enum Mode {
+				ModeClose = 0,
+				ModeKeepAlive,
+				ModePipelined
+			};
+
+			/** Sends requests to the server and counts the replies that are not '200 OK' **/
+			class ClientThread: public Thread {
+				public:
+					ClientThread(unsigned short port, Mode mode, int requests): _port(port), _mode(mode), _requests(requests), _failures(0) {
+					}
+
+					virtual ~ClientThread() {
+					}
+
+					int GetFailures() const {
+						return _failures;
+					}
+
+				protected:
+					virtual void Run() {
+						const char* request = (_mode==ModeClose) ? "GET /data HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n" : "GET /data HTTP/1.1\r\nHost: localhost\r\n\r\n";
+						if(_mode==ModeClose) {
+							for(int a=0;a<_requests;a++) {
+								NativeSocket s = Connect();
+								std::string buffer;
+								send(s, request, strlen(request), 0);
+								if(!ReadReply(s, buffer)) {
+									++_failures;
+								}
+								close(s);
+							}
+						}
+						else {
+							int depth = (_mode==ModePipelined) ? KPipelineDepth : 1;
+							std::string requests;
+							for(int a=0;a<depth;a++) {
+								requests += request;
+							}
+
+							NativeSocket s = Connect();
+							std::string buffer;
+							int done = 0;
+							while(done < _requests) {
+								send(s, requests.data(), requests.length(), 0);
+								for(int a=0;a<depth;a++) {
+									if(!ReadReply(s, buffer)) {
+										// The server closed the connection; requests that were not answered are sent again
+										close(s);
+										s = Connect();
+										buffer.clear();
+										break;
+									}
+									++done;
+								}
+							}
+							close(s);
+						}
+					}
+
+					NativeSocket Connect() {
+						NativeSocket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+						sockaddr_in address;
+						memset(&address, 0, sizeof(sockaddr_in));
+						address.sin_family = AF_INET;
+						address.sin_port = htons(_port);
+						address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+						connect(s, (const sockaddr*)&address, sizeof(sockaddr_in));
+						int on = 1;
+						setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+						return s;
+					}
+
+					/** Reads one reply; returns false when the connection was closed first. Replies other than '200 OK' are
+					counted as failures. **/
+					bool ReadReply(NativeSocket s, std::string& buffer) {
+						std::string::size_type headerEnd;
+						while((headerEnd = buffer.find("\r\n\r\n"))==std::string::npos) {
+							if(!Receive(s, buffer)) {
+								return false;
+							}
+						}
+
+						unsigned int length = 0;
+						for(std::string::size_type line = buffer.find('\n'); line < headerEnd; line = buffer.find('\n', line+1)) {
+							if(strncasecmp(buffer.c_str()+line+1, "content-length:", 15)==0) {
+								length = (unsigned int)atoi(buffer.c_str()+line+16);
+								break;
+							}
+						}
+
+						while(buffer.length() < headerEnd+4+length) {
+							if(!Receive(s, buffer)) {
+								return false;
+							}
+						}
+
+						if(buffer.compare(0, 12, "HTTP/1.1 200")!=0 || length!=KResourceSize) {
+							++_failures;
+						}
+						buffer.erase(0, headerEnd+4+length);
+						return true;
+					}
+
+					static bool Receive(NativeSocket s, std::string& buffer) {
+						char data[8192];
+						int r = recv(s, data, sizeof(data), 0);
+						if(r<=0) {
+							return false;
+						}
+						buffer.append(data, r);
+						return true;
+					}
+
+					unsigned short _port;
+					Mode _mode;
+					int _requests;
+					int _failures;
+			};
+
+			static void Run(unsigned short port, Mode mode, int requests, int clients) {
+				std::vector< ref<ClientThread> > threads;
+				for(int a=0;a<clients;a++) {
+					threads.push_back(GC::Hold(new ClientThread(port, mode, requests)));
+				}
+
+				Timestamp start(true);
+				for(int a=0;a<clients;a++) {
+					threads[a]->Start();
+				}
+
+				int failures = 0;
+				for(int a=0;a<clients;a++) {
+					threads[a]->WaitForCompletion();
+					failures += threads[a]->GetFailures();
+				}
+				double ms = double(Timestamp(true).Difference(start).ToMilliSeconds());
+
+				const char* names[] = {"close", "keep-alive", "pipelined"};
+				fprintf(stderr, "%s, %d clients: %d requests in %.0f ms (%.0f requests/s), %d failures\n", names[mode], clients, requests*clients, ms, double(requests*clients)*1000.0/ms, failures);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::np::test;
+	int requests = (argc > 1) ? atoi(argv[1]) : 5000;
+	int clients = (argc > 2) ? atoi(argv[2]) : 4;
+
+	ref<DataWriter> data = GC::Hold(new DataWriter(KResourceSize));
+	std::string contents(KResourceSize, 'x');
+	data->Append(contents.data(), KResourceSize);
+
+	ref<WebServer> server = GC::Hold(new WebServer(WebServer::KPortDontCare));
+	server->OnCreated();
+	ref<WebItem> item = GC::Hold(new WebItemDataResource(L"data", L"data", L"text/plain", strong<Data>(data)));
+	server->AddResolver(L"/data", item);
+	unsigned short port = server->GetActualPort();
+	Event wait;
+	wait.Wait(100);
+
+	// New connections are much slower, so fewer requests are sent in that mode
+	Run(port, ModeClose, requests/10, clients);
+	Run(port, ModeKeepAlive, requests, clients);
+	Run(port, ModePipelined, requests, clients);
+	return 0;
+}
@@ -0,0 +1,313 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Tests persistent connections of the WebServer with a local HTTP client:
+- Pipelining: several requests sent at once (the last one split over two sends) are answered in order on one connection,
+  including an error reply and a HEAD reply without a body.
+- Keep-alive: HTTP/1.1 connections stay open until the client sends 'Connection: close'; HTTP/1.0 connections only stay
+  open when the client asks for it; connections are closed after KMaximumRequestsPerConnection requests and after being
+  idle for KIdleTimeout ms.
+- Bodies: a body delimited by Content-Length is not mistaken for the next request, even when it looks like one; bodies
+  larger than KMaximumBodySize, invalid lengths, chunked bodies and oversized headers are refused and the connection is
+  closed.
+Output goes to stderr (the log of the server threads makes stdout wide-oriented). Usage: tjwebservertest */
+#include <TJNP/include/tjwebserver.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace tj::shared;
+using namespace tj::np;
+
+namespace tj {
+	namespace np {
+		namespace test {
+			static int _failures = 0;
+
+			static void Check(bool ok, const char* what) {
+				if(!ok) {
+					fprintf(stderr, "failed: %s\n", what);
+					++_failures;
+				}
+			}
+
+			struct Response {
+				int _status;
+				bool _close;
+				std::string _body;
+			};
+
+			/** A client connection that reads replies from the server one by one **/
+			class Client {
+				public:
+					Client(unsigned short port): _closed(false) {
+						_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+						sockaddr_in address;
+						memset(&address, 0, sizeof(sockaddr_in));
+						address.sin_family = AF_INET;
+						address.sin_port = htons(port);
+						address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+						if(connect(_socket, (const sockaddr*)&address, sizeof(sockaddr_in))!=0) {
+							_closed = true;
+						}
+					}
+
+					~Client() {
+						close(_socket);
+					}
+
+					void Send(const std::string& data) {
+						send(_socket, data.data(), data.length(), 0);
+					}
+
+					/** Reads the next reply (without a body when head is true); returns false when there is no complete reply
+					within ms milliseconds **/
+					bool Read(Response& response, bool head = false, int ms = 2000) {
+						std::string::size_type headerEnd;
+						while((headerEnd = _buffer.find("\r\n\r\n"))==std::string::npos) {
+							if(!Receive(ms)) {
+								return false;
+							}
+						}
+
+						std::string headers = _buffer.substr(0, headerEnd+2);
+						response._status = atoi(headers.c_str() + headers.find(' ') + 1);
+						response._close = FindHeader(headers, "connection")=="close";
+						std::string length = FindHeader(headers, "content-length");
+						unsigned int bodyLength = (head || length.empty()) ? 0 : (unsigned int)atoi(length.c_str());
+
+						while(_buffer.length() < headerEnd+4+bodyLength) {
+							if(!Receive(ms)) {
+								return false;
+							}
+						}
+						response._body = _buffer.substr(headerEnd+4, bodyLength);
+						_buffer.erase(0, headerEnd+4+bodyLength);
+						return true;
+					}
+
+					/** Returns true if the server closes the connection within ms milliseconds (without sending more data) **/
+					bool IsClosedWithin(int ms) {
+						while(!_closed) {
+							if(!Receive(ms)) {
+								return _closed;
+							}
+						}
+						return true;
+					}
+
+					bool HasUnreadData() const {
+						return !_buffer.empty();
+					}
+
+				private:
+					bool Receive(int ms) {
+						if(_closed) {
+							return false;
+						}
+
+						pollfd fd;
+						fd.fd = _socket;
+						fd.events = POLLIN;
+						fd.revents = 0;
+						if(poll(&fd, 1, ms)<=0) {
+							return false;
+						}
+
+						char data[4096];
+						int r = recv(_socket, data, sizeof(data), 0);
+						if(r<=0) {
+							_closed = true;
+							return false;
+						}
+						_buffer.append(data, r);
+						return true;
+					}
+
+					static std::string FindHeader(const std::string& headers, const char* name) {
+						std::string::size_type line = 0;
+						while((line = headers.find("\r\n", line))!=std::string::npos) {
+							line += 2;
+							if(strncasecmp(headers.c_str()+line, name, strlen(name))==0 && headers[line+strlen(name)]==':') {
+								std::string::size_type start = headers.find_first_not_of(' ', line+strlen(name)+1);
+								std::string value = headers.substr(start, headers.find("\r\n", start)-start);
+								for(unsigned int a=0;a<value.length();a++) {
+									value[a] = (char)tolower(value[a]);
+								}
+								return value;
+							}
+						}
+						return "";
+					}
+
+					NativeSocket _socket;
+					std::string _buffer;
+					bool _closed;
+			};
+
+			static ref<WebItem> CreateItem(const char* contents) {
+				ref<DataWriter> data = GC::Hold(new DataWriter((unsigned int)strlen(contents)));
+				data->Append(contents, (unsigned int)strlen(contents));
+				return GC::Hold(new WebItemDataResource(L"item", L"item", L"text/plain", strong<Data>(data)));
+			}
+
+			static void TestPipelining(unsigned short port) {
+				Client c(port);
+				c.Send("GET /a HTTP/1.1\r\nHost: localhost\r\n\r\nGET /missing HTTP/1.1\r\nHost: localhost\r\n\r\nHEAD /b HTTP/1.1\r\nHost: localhost\r\n\r\nGET /b HTTP/1.1\r\nHost: ");
+				Event wait;
+				wait.Wait(50);
+				c.Send("localhost\r\n\r\n");
+
+				Response a, missing, head, b;
+				bool all = c.Read(a) && c.Read(missing) && c.Read(head, true) && c.Read(b);
+				Check(all, "pipelining: all pipelined requests are answered");
+				Check(all && a._status==200 && a._body=="AAAA", "pipelining: first reply");
+				Check(all && missing._status==404, "pipelining: error reply in between");
+				Check(all && head._status==200, "pipelining: HEAD reply");
+				Check(all && b._status==200 && b._body=="BBBB", "pipelining: request split over two sends");
+				Check(all && !b._close && !c.IsClosedWithin(200), "pipelining: connection stays open");
+			}
+
+			static void TestKeepAlive(unsigned short port) {
+				{
+					Client c(port);
+					bool ok = true;
+					for(int a=0;a<5;a++) {
+						Response r;
+						c.Send("GET /a HTTP/1.1\r\n\r\n");
+						ok = ok && c.Read(r) && r._status==200 && r._body=="AAAA" && !r._close;
+					}
+					Check(ok, "keep-alive: sequential requests on one connection");
+
+					Response r;
+					c.Send("GET /b HTTP/1.1\r\nConnection: close\r\n\r\n");
+					Check(c.Read(r) && r._body=="BBBB" && r._close && c.IsClosedWithin(1000), "keep-alive: 'Connection: close' closes the connection");
+				}
+
+				{
+					Client c(port);
+					Response r;
+					c.Send("GET /a HTTP/1.0\r\n\r\n");
+					Check(c.Read(r) && r._close && c.IsClosedWithin(1000), "keep-alive: HTTP/1.0 connections are closed by default");
+				}
+
+				{
+					Client c(port);
+					Response r;
+					c.Send("GET /a HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n");
+					Check(c.Read(r) && !r._close && !c.IsClosedWithin(200), "keep-alive: HTTP/1.0 connections stay open on request");
+				}
+
+				// All requests at once; the reply to the last one closes the connection, and the rest is not answered
+				{
+					Client c(port);
+					const unsigned int limit = WebServerResponseTask::KMaximumRequestsPerConnection;
+					std::string requests;
+					for(unsigned int a=0;a<limit+5;a++) {
+						requests += "GET /a HTTP/1.1\r\n\r\n";
+					}
+					c.Send(requests);
+
+					unsigned int answered = 0;
+					bool closedByLast = false;
+					Response r;
+					while(c.Read(r)) {
+						++answered;
+						closedByLast = r._close;
+					}
+					fprintf(stderr, "keep-alive: %u of %u requests answered on one connection\n", answered, limit+5);
+					Check(answered==limit && closedByLast && c.IsClosedWithin(1000), "keep-alive: connection closed after the maximum number of requests");
+				}
+
+				{
+					Client c(port);
+					Response r;
+					c.Send("GET /a HTTP/1.1\r\n\r\n");
+					c.Read(r);
+					Timestamp start(true);
+					bool closed = c.IsClosedWithin(WebServerResponseTask::KIdleTimeout*2);
+					double ms = double(Timestamp(true).Difference(start).ToMilliSeconds());
+					fprintf(stderr, "keep-alive: idle connection closed after %.0f ms\n", ms);
+					Check(closed && ms >= WebServerResponseTask::KIdleTimeout*0.9, "keep-alive: idle connection closed after the idle timeout");
+				}
+			}
+
+			static void TestBodies(unsigned short port) {
+				// The body looks like a request, but is part of the POST; exactly two replies follow
+				{
+					Client c(port);
+					c.Send("POST /a HTTP/1.1\r\nContent-Length: 20\r\n\r\nGET /b HTTP/1.1\r\n\r\n\r\nGET /a HTTP/1.1\r\n\r\n");
+					Response post, a, extra;
+					bool both = c.Read(post) && c.Read(a);
+					Check(both && post._status!=400 && post._status!=200, "bodies: request with a body is answered");
+					Check(both && a._status==200 && a._body=="AAAA", "bodies: request after a body is answered");
+					Check(!c.Read(extra, false, 300) && !c.HasUnreadData(), "bodies: a body is not read as a request");
+				}
+
+				{
+					Client c(port);
+					Response r;
+					char request[128];
+					snprintf(request, sizeof(request), "PUT /a HTTP/1.1\r\nContent-Length: %lld\r\n\r\n", (long long)WebServerResponseTask::KMaximumBodySize+1);
+					c.Send(request);
+					Check(c.Read(r) && r._status==413 && r._close && c.IsClosedWithin(1000), "bodies: body larger than the maximum is refused");
+				}
+
+				{
+					Client c(port);
+					Response r;
+					c.Send("PUT /a HTTP/1.1\r\nContent-Length: -5\r\n\r\nGET /a HTTP/1.1\r\n\r\n");
+					Check(c.Read(r) && r._status==400 && r._close && c.IsClosedWithin(1000), "bodies: invalid Content-Length is refused");
+				}
+
+				{
+					Client c(port);
+					Response r;
+					c.Send("POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nGET \r\n0\r\n\r\n");
+					Check(c.Read(r) && r._status==501 && r._close && c.IsClosedWithin(1000), "bodies: chunked body is refused");
+				}
+
+				{
+					Client c(port);
+					Response r;
+					c.Send("GET /a HTTP/1.1\r\nX-Filler: " + std::string(WebServerResponseTask::KMaximumHeaderSize, 'x'));
+					Check(c.Read(r) && r._status==400 && r._close && c.IsClosedWithin(1000), "bodies: oversized header is refused");
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::np::test;
+	ref<WebServer> server = GC::Hold(new WebServer(WebServer::KPortDontCare));
+	server->OnCreated();
+	server->AddResolver(L"/a", CreateItem("AAAA"));
+	server->AddResolver(L"/b", CreateItem("BBBB"));
+	unsigned short port = server->GetActualPort();
+	Event wait;
+	wait.Wait(100);
+
+	TestPipelining(port);
+	TestKeepAlive(port);
+	TestBodies(port);
+	fprintf(stderr, "%d failures\n", _failures);
+	return (_failures==0) ? 0 : 1;
+}
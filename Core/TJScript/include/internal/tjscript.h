@@ -17,8 +17,9 @@
 
 #include "../tjscript.h"
 #include "tjscriptops.h"
-#include "tjscriptlet.h"
 #include "tjscriptstack.h"
+#include "tjscriptlet.h"
+#include "tjscriptoptimizer.h"
 #include "tjscriptvm.h"
 #include "tjscriptletstack.h"
 #include "tjscriptfunction.h"
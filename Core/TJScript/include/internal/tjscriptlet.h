@@ -18,16 +18,36 @@
 namespace tj {
 	namespace script {
 		class VM;
+		class ScriptOptimizer;
+		class ScriptCache;
 		typedef unsigned int LiteralIdentifier;
 
 		class Scriptlet {
 			friend class VM;
+			friend class ScriptOptimizer;
+			friend class ScriptCache;
 			static const int KInitialScriptletSize = 256;
 
 			public:
+				/** An instruction in the translated form of a scriptlet. Operands are decoded and literals are looked
+				up in advance, and some common sequences of instructions are replaced by a single instruction (see
+				Ops::TranslatedCode). Instructions are addressed by the position of their first op in the byte code,
+				so the stack frame's program counter works the same for both forms. **/
+				struct Instruction {
+					int _op;
+					unsigned int _operands;			// Position of the operands in the byte code
+					unsigned int _next;				// Position of the next instruction in the byte code
+					ref<Scriptable> _literal;
+					ScriptStackValue _value;			// The literal as stack value (unboxed if it is a number)
+					std::wstring _name;				// Identifier (for OpLoadVariable etc.)
+					ScriptSymbol _symbol;			// Symbol for _name
+				};
+
 				inline Scriptlet(ScriptletType type) {
 					_type = type;
 					_used = 0;
+					_translated = false;
+					_verified = false;
 					Enlarge(KInitialScriptletSize);
 				}
 
@@ -60,6 +80,8 @@ namespace tj {
 					T* tp = (T*)&(_code[_used]);
 					*tp = x;
 					_used += size;
+					_translated = false;
+					_verified = false;
 					return *this;
 				}
 
@@ -94,6 +116,32 @@ namespace tj {
 					return ((unsigned int)_literals.size())-1;
 				}
 
+				void Translate();
+
+				inline bool IsTranslated() const {
+					return _translated;
+				}
+
+				/** Returns true if the byte code was checked by ScriptOptimizer::Verify: all instructions and their
+				operands are valid, the scriptlet ends with an instruction that leaves it and the stack is balanced. **/
+				inline bool IsVerified() const {
+					return _verified;
+				}
+
+				/** Returns the translated instruction at the given position in the byte code, or 0 if this scriptlet is
+				not translated (or pc is past the end of the code). **/
+				inline const Instruction* GetInstruction(unsigned int pc) const {
+					if(!_translated || pc>=_used) {
+						return 0;
+					}
+
+					int index = _entries[pc];
+					if(index<0) {
+						Throw(L"Program counter does not point to the start of an instruction", tj::shared::ExceptionTypeError);
+					}
+					return &(_instructions[index]);
+				}
+
 			protected:
 				inline void Enlarge(unsigned int to) {
 					assert(to>=_used);
@@ -118,6 +166,10 @@ namespace tj {
 				unsigned int _used; // used number of bytes
 				ScriptletType _type;
 				std::vector< ref<Scriptable> > _literals;
+				bool _translated;
+				bool _verified;
+				std::vector<Instruction> _instructions;
+				std::vector<int> _entries; // For each position in the byte code: index of the instruction that starts there, or -1
 		};
 
 		template<> Scriptlet& Scriptlet::Add(const std::wstring& x);
@@ -69,7 +69,30 @@ namespace tj {
 					_OpLast,				// Should always be the last op
 				};
 
+				/* Instructions that only exist in the translated form of a scriptlet (see Scriptlet::Translate). Most
+				replace a common sequence of the instructions above. */
+				enum TranslatedCode {
+					OpPushLiteral = _OpLast,	// OpPushString/Double/Int/Delegate with the literal already looked up
+					OpLoadVariable,				// OpPushString <name>, OpCallGlobal (without parameters)
+					OpCallGlobalNoArguments,	// OpPushString <name>, OpPushParameter, OpCallGlobal
+					OpCallNoArguments,			// OpPushString <name>, OpPushParameter, OpCall
+					OpAddLiteral,				// OpPush* <literal>, OpAdd
+					OpSubLiteral,				// OpPush* <literal>, OpSub
+					OpMulLiteral,				// OpPush* <literal>, OpMul
+					OpDivLiteral,				// OpPush* <literal>, OpDiv
+					OpGreaterThanLiteral,		// OpPush* <literal>, OpGreaterThan
+					OpLessThanLiteral,			// OpPush* <literal>, OpLessThan
+					OpEqualsLiteral,			// OpPush* <literal>, OpEquals
+					_OpLastTranslated,
+				};
+
+				static const wchar_t* GetName(int code);
+
+				/** Returns the size (in bytes) of the operands that follow the op in the byte code **/
+				static unsigned int GetOperandSize(int code);
+
 				static const wchar_t* Names[_OpLast];
+				static const wchar_t* TranslatedNames[_OpLastTranslated - _OpLast];
 				static OpHandler Handlers[_OpLast];
 		};
 	}
@@ -0,0 +1,67 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #ifndef _TJSCRIPTOPTIMIZER_H
+#define _TJSCRIPTOPTIMIZER_H
+
+namespace tj {
+	namespace script {
+		/** The optimizer rewrites the byte code of a compiled script (see CompiledScript::Optimize). Scriptlets only
+		refer to other scriptlets by index and there are no jumps within a scriptlet, so instructions can be removed or
+		replaced without fixing up any addresses. The following passes are repeated until none of them changes anything:
+
+		- Constant folding: operations on literals are replaced by their result (OpPushInt #1, OpPushInt #2, OpAdd
+		  becomes OpPushInt #3).
+		- Branch elimination: an if-statement with a constant condition is replaced by the branch that is taken (if
+		  any), and branches to scriptlets that do nothing are removed.
+		- Peephole: values that are popped right after they are pushed are not pushed at all.
+
+		Scriptlets that are no longer used after this are removed, and all scriptlets are checked by Verify. **/
+		class ScriptOptimizer {
+			public:
+				ScriptOptimizer(CompiledScript* script, ScriptOptimizationStatistics& stats);
+				~ScriptOptimizer();
+				void Optimize();
+
+				/** Checks that all instructions and operands in the scriptlet are valid, that it ends with an
+				instruction that leaves the scriptlet and that it leaves the stack as it found it (functions leave
+				their return value). The VM skips some checks when running verified scriptlets. **/
+				static bool Verify(const Scriptlet& scriptlet, unsigned int scriptletCount);
+
+			protected:
+				struct Instruction {
+					Instruction(int op = Ops::OpNop, int operand = 0);
+					int _op;
+					int _operand; // Literal identifier or scriptlet index, for ops that have an operand
+				};
+				typedef std::vector<Instruction> Code;
+
+				void Decode();
+				void Encode();
+				bool FoldConstants(unsigned int s);
+				bool EliminateBranches(unsigned int s);
+				bool RemovePushPop(unsigned int s);
+				void RemoveUnusedScriptlets();
+				bool GetConstant(unsigned int s, const Instruction& ins, tj::shared::ref<Scriptable>& value);
+				Instruction PushConstant(unsigned int s, tj::shared::ref<Scriptable> value);
+				bool IsEmptyScriptlet(int index) const;
+
+				CompiledScript* _script;
+				ScriptOptimizationStatistics& _stats;
+				std::vector<Code> _code;
+		};
+	}
+}
+
+#endif
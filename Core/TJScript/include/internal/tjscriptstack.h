@@ -17,13 +17,58 @@
 
 namespace tj {
 	namespace script {
+		/** A value on the VM stack. Integers, doubles and booleans can be kept unboxed ('tagged'), so that the
+		arithmetic ops do not have to allocate a script object for each intermediate result. A tagged value is only
+		boxed (see Box) when it leaves the stack, i.e. when it is saved in a scope or passed to an object. If the value
+		was boxed before (or was pushed as a literal), _reference holds the boxed value, so it is not boxed again. **/
+		struct ScriptStackValue {
+			enum Kind {
+				KindReference = 0,		// Only _reference is valid
+				KindInteger,
+				KindDouble,
+				KindBool,
+			};
+
+			inline ScriptStackValue(): _kind(KindReference), _double(0.0) {
+			}
+
+			inline void Clear() {
+				_kind = KindReference;
+				_reference = 0;
+			}
+
+			inline bool IsTagged() const {
+				return _kind!=KindReference;
+			}
+
+			/** Tries to unbox the referenced value (if it is an integer, double or boolean). Returns true if the
+			value is tagged afterwards. **/
+			bool Unbox();
+			tj::shared::ref<Scriptable> Box();
+
+			/** Converts a tagged value to a boolean in the same way tj::shared::Any does **/
+			bool ToBool() const;
+
+			/** Performs a binary operation (OpAdd, OpSub, OpMul, OpDiv, OpGreaterThan, OpLessThan or OpEquals) on two
+			tagged values and stores the result in left. The result is the same as that of the operation on Any.
+			Returns false (and leaves left untouched) if the operation cannot be performed on tagged values. **/
+			static bool Apply(int op, ScriptStackValue& left, const ScriptStackValue& right);
+
+			Kind _kind;
+			union {
+				int _int;
+				double _double;
+				bool _bool;
+			};
+			tj::shared::ref<Scriptable> _reference;
+		};
 		
 		class ScriptStack {
 			friend class VM;
 
 			public:	
 				inline ScriptStack(int stackLimit=512) {
-					_stack = new tj::shared::ref<Scriptable>[stackLimit];
+					_stack = new ScriptStackValue[stackLimit];
 					_limit = stackLimit-2;
 					_sp = -1;
 				}
@@ -35,7 +80,16 @@ namespace tj {
 					if(_sp>_limit) {
 						throw ScriptException(L"Stack overflow!");
 					}
-					_stack[_sp] = sc;
+					_stack[_sp]._kind = ScriptStackValue::KindReference;
+					_stack[_sp]._reference = sc;
+				}
+
+				inline void Push(const ScriptStackValue& value) {
+					_sp++;
+					if(_sp>_limit) {
+						throw ScriptException(L"Stack overflow!");
+					}
+					_stack[_sp] = value;
 				}
 
 				inline bool IsEmpty() const {
@@ -46,20 +100,45 @@ namespace tj {
 					return (unsigned int)_sp+1;
 				}
 
+				/** Returns the value on top of the stack; tagged values are boxed **/
 				inline tj::shared::ref<Scriptable> Top() {
+					return TopValue().Box();
+				}
+
+				inline ScriptStackValue& TopValue() {
 					if(_sp<0) {
 						throw ScriptException(L"Stack underflow!");
 					}
 					return _stack[_sp];
 				}
 
+				/** Removes the value on top of the stack without boxing it **/
+				inline void Drop() {
+					if(_sp<0) {
+						throw ScriptException(L"Stack underflow!");
+					}
+					_stack[_sp].Clear();
+					_sp--;
+				}
+
+				/** Fast paths for the arithmetic ops. These perform the operation on the tagged values on the stack and
+				return true, or return false (leaving the stack untouched) if the values cannot be unboxed. The right-hand
+				operand is either on top of the stack (left below it), or given (left on top of the stack). **/
+				bool Calculate(int op);
+				bool Calculate(int op, const ScriptStackValue& right);
+				bool Negate();
+
+				/** Converts the value on top of the stack to a boolean (like ScriptContext::GetValue<bool>) **/
+				bool TopBool();
+				bool PopBool();
+
 				void Pop(int size);
 				void Clear();
 				tj::shared::ref<Scriptable> Pop();
 				std::wstring Dump();
 
 			protected:
-				tj::shared::ref<Scriptable>* _stack;
+				ScriptStackValue* _stack;
 				int _limit;
 				int _sp;
 
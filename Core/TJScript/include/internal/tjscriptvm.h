@@ -35,12 +35,31 @@ namespace tj {
 				StackFrame* _previous;
 		};
 
+		/** State of a VM that is profiling (see ScriptProfiler) **/
+		struct VMProfile {
+			VMProfile();
+			void Reset(tj::shared::ref<ScriptProfiler> profiler);
+
+			ScriptProfileData _data;
+			std::map<const Scriptlet*, ScriptProfileEntry> _scriptlets;
+			std::map<const Scriptlet*, std::wstring> _names;
+			std::map<const std::type_info*, std::wstring> _types;
+			const StackFrame* _frame;			// Frame that was active when _switched was set
+			const Scriptlet* _scriptlet;		// Scriptlet of _frame
+			tj::shared::Timestamp _switched;	// Time at which the VM last entered or left a scriptlet
+			tj::shared::Timestamp _sampled;		// Time at which the last sample was taken
+			long double _sampleInterval;
+			long double _pending;				// Execution time since the last sample (carried over to the next execution)
+			unsigned int _ops;					// Ops executed since the clock was last checked
+		};
+
 		class VM: public virtual tj::shared::Object {
 			public:
 				VM(int stackLimit=512);
 				virtual ~VM();
 				ref<Scriptable> Execute(tj::shared::ref<ScriptContext> c, tj::shared::ref<CompiledScript> script, tj::shared::ref<ScriptScope> global);
-				void SetDebug(bool d);				
+				void SetDebug(bool d);
+				void SetProfiler(tj::shared::ref<ScriptProfiler> p);
 
 				// to be called by ops or vm during execution
 				void Call(tj::shared::ref<Scriptlet> s, tj::shared::ref<ScriptParameterList> sc=0);
@@ -49,6 +68,15 @@ namespace tj {
 				void ReturnFromScriptlet();
 				void Break();
 
+				/** Calls a member of a (native) object; when profiling, the time spent in the call is recorded. If a
+				symbol is given, the member is called through Scriptable::ExecuteSymbol. **/
+				inline tj::shared::ref<Scriptable> Invoke(tj::shared::ref<Scriptable> target, Command name, tj::shared::ref<ParameterList> list, ScriptSymbol symbol = ScriptSymbols::KNoSymbol) {
+					if(_profiler) {
+						return InvokeProfiled(target, name, list, symbol);
+					}
+					return (symbol==ScriptSymbols::KNoSymbol) ? target->Execute(name, list) : target->ExecuteSymbol(symbol, name, list);
+				}
+
 				// Inlines
 				inline tj::shared::ref<ScriptScope> GetCurrentScope() {
 					return _scope;
@@ -73,12 +101,33 @@ namespace tj {
 				}
 				
 			protected:
+				void RunTranslated(int& opCode);
+				tj::shared::ref<Scriptable> InvokeProfiled(tj::shared::ref<Scriptable> target, Command name, tj::shared::ref<ParameterList> list, ScriptSymbol symbol);
+				void ProfileSwitch(const tj::shared::Timestamp& now);
+				void ProfileSample(const tj::shared::Timestamp& now, const std::wstring* native);
+				void ProfileFinish();
+				const std::wstring& GetProfileName(const Scriptlet* scriptlet);
+
+				inline const Scriptlet::Instruction* FetchTranslated(int& opCode) {
+					if(_frame==0) {
+						return 0;
+					}
+
+					const Scriptlet::Instruction* ins = _frame->_scriptlet->GetInstruction(_frame->_pc);
+					if(ins!=0) {
+						opCode = ins->_op;
+					}
+					return ins;
+				}
+
 				ScriptStack _stack;
 				tj::shared::ref<ScriptScope> _scope;
 				tj::shared::ref<CompiledScript> _script;
 				tj::shared::weak<ScriptContext> _context;
 				StackFrame* _frame;
 				bool _debug;
+				tj::shared::ref<ScriptProfiler> _profiler;
+				VMProfile _profile;
 		};
 	}
 }
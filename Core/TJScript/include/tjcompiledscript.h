@@ -26,16 +26,41 @@ namespace tj {
 		};
 
 		class ScriptContext;
+		class ScriptOptimizer;
+		class ScriptCache;
 
+		/** Statistics of CompiledScript::Optimize; the numbers include the scripts of delegates **/
+		struct SCRIPT_EXPORTED ScriptOptimizationStatistics {
+			ScriptOptimizationStatistics();
+			void Add(const ScriptOptimizationStatistics& other);
+
+			unsigned int _instructionsBefore;
+			unsigned int _instructionsAfter;
+			unsigned int _scriptletsBefore;
+			unsigned int _scriptletsAfter;
+			unsigned int _foldedConstants;		// Operations on literals that were replaced by their result
+			unsigned int _eliminatedBranches;	// Branches removed because their condition is constant or their scriptlet empty
+			unsigned int _removedInstructions;	// Instructions removed by the peephole pass (push/pop pairs etc.)
+			unsigned int _verifiedScriptlets;
+			long double _time;					// Time spent optimizing (ms)
+		};
+
+		/** A compiled script is not bound to a context and is not changed after it has been compiled (and optimized),
+		so it can be executed by any context, and by several threads at the same time. **/
 		class SCRIPT_EXPORTED CompiledScript: public virtual tj::shared::Object {
-			friend class ScriptContext;
+			friend class ScriptOptimizer;
+			friend class ScriptCache;
 
 			public:
-				// If creatingContext == 0, it cannot be executed by any context (only as delegate)
-				// if creatingContext != 0, it can only be executed by the creatingContext
-				CompiledScript(ScriptContext* creatingContext);
+				CompiledScript();
 				virtual ~CompiledScript();
 				void Optimize();
+				const ScriptOptimizationStatistics& GetOptimizationStatistics() const;
+
+				/** The name is used to identify the script in profiles (see ScriptProfiler); scripts compiled from a
+				file are named after the file **/
+				void SetName(const std::wstring& name);
+				const std::wstring& GetName() const;
 				
 				// for internal use
 				tj::shared::ref<Scriptlet> CreateScriptlet(ScriptletType type);
@@ -43,10 +68,16 @@ namespace tj {
 				int GetScriptletIndex(tj::shared::ref<Scriptlet> s);
 				tj::shared::ref<Scriptlet> GetMainScriptlet();
 				int GetScriptletCount() const;
+
+				/** Returns the literal for an identifier (name of a variable or member); all occurrences of the same
+				identifier in this script share one literal **/
+				tj::shared::ref<Scriptable> GetIdentifier(const std::wstring& name);
 				
 			protected:
 				std::vector< tj::shared::ref<Scriptlet> > _scriptlets;
-				ScriptContext* _creatingContext;
+				std::map< std::wstring, tj::shared::ref<Scriptable> > _identifiers;
+				ScriptOptimizationStatistics _statistics;
+				std::wstring _name;
 		};
 	}
 }
@@ -41,11 +41,15 @@
 #include <stack>
 #include <vector>
 #include <deque>
+#include <typeinfo>
 
 #include "tjscriptexception.h"
+#include "tjscriptsymbol.h"
 #include "tjscriptable.h"
 #include "tjscriptvalue.h"
 #include "tjcompiledscript.h"
+#include "tjscriptcache.h"
+#include "tjscriptprofiler.h"
 #include "tjscripttype.h"
 #include "tjscriptcontext.h"
 #include "tjscriptthread.h"
@@ -36,6 +36,10 @@ namespace tj {
 				return a ScriptNull instance. */
 				virtual tj::shared::ref<Scriptable> Execute(Command command, tj::shared::ref<ParameterList> params) = 0;
 
+				/* Same as Execute, but the command is also given as a symbol (see ScriptSymbols), so that objects that
+				store their members by symbol do not need to look up the name. The default implementation calls Execute. */
+				virtual tj::shared::ref<Scriptable> ExecuteSymbol(ScriptSymbol symbol, Command command, tj::shared::ref<ParameterList> params);
+
 				/* Sets a field; return false if you are not mutable */
 				virtual bool Set(Field field, tj::shared::ref<Scriptable> value);
 		};
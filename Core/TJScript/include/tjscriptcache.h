@@ -0,0 +1,90 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #ifndef _TJSCRIPTCACHE_H
+#define _TJSCRIPTCACHE_H
+
+namespace tj {
+	namespace script {
+		class CompiledScript;
+
+		struct SCRIPT_EXPORTED ScriptCacheStatistics {
+			ScriptCacheStatistics();
+			float GetHitRate() const;
+
+			unsigned int _lookups;
+			unsigned int _memoryHits;
+			unsigned int _diskHits;
+			unsigned int _misses;
+			unsigned int _diskWrites;
+			unsigned int _diskErrors;			// Cache files that could not be written or were rejected when loading
+			long double _compileTime;			// Time spent compiling scripts that were not in the cache (ms)
+			long double _loadTime;				// Time spent loading scripts from disk (ms)
+		};
+
+		/** The script cache keeps compiled scripts, so that a script that was compiled before does not need to be parsed
+		again. Scripts are looked up by a key, which is a hash of the source, the compiler version and the compiler
+		settings (see GetKey). Compiled scripts do not change after compilation and are not bound to a context, so
+		the same script can be returned to any context that compiles the same source.
+
+		If a directory is set, scripts are also written to (and read from) a file in that directory, in a compact
+		binary form (the byte code and literals of each scriptlet). Symbols are not stored; they are interned again
+		when a loaded script is translated. Loaded scripts are verified before they are used. **/
+		class SCRIPT_EXPORTED ScriptCache: public virtual tj::shared::Object {
+			public:
+				ScriptCache(const std::wstring& directory = L"");
+				virtual ~ScriptCache();
+				static tj::shared::strong<ScriptCache> DefaultInstance();
+
+				/** Returns the version of the compiler (the cache format and the instruction set), which is part of every key **/
+				static std::wstring GetCompilerVersion();
+				static std::string GetKey(const std::wstring& source, bool optimize);
+				static std::string GetKey(const std::wstring& source, bool optimize, const std::wstring& compilerVersion);
+				static std::string GetFileKey(const std::wstring& path, bool optimize);
+
+				/** Returns the cached script for a key, or null if there is none (from memory or from disk) **/
+				tj::shared::ref<CompiledScript> Get(const std::string& key);
+				void Put(const std::string& key, tj::shared::ref<CompiledScript> script, long double compileTime);
+				void Clear();
+
+				/** Scripts are stored on disk if a directory is set (an empty string disables the disk cache) **/
+				void SetDirectory(const std::wstring& directory);
+				std::wstring GetDirectory() const;
+
+				ScriptCacheStatistics GetStatistics() const;
+				void ResetStatistics();
+				void LogStatistics() const;
+
+				const static unsigned int KFormatVersion;
+				const static unsigned int KMaximumEntries = 512;
+
+			protected:
+				void Remember(const std::string& key, tj::shared::ref<CompiledScript> script);
+				std::wstring GetPath(const std::string& key) const;
+				tj::shared::ref<CompiledScript> Load(const std::string& key);
+				bool Save(const std::string& key, tj::shared::ref<CompiledScript> script);
+				static bool Write(tj::shared::DataWriter& dw, tj::shared::ref<CompiledScript> script);
+				static tj::shared::ref<CompiledScript> Read(tj::shared::DataReader& dr, unsigned int& position, unsigned int depth);
+
+				mutable tj::shared::CriticalSection _lock;
+				std::map< std::string, tj::shared::ref<CompiledScript> > _scripts;
+				std::deque<std::string> _order; // Keys in the order they were added, to remove the oldest scripts first
+				std::wstring _directory;
+				ScriptCacheStatistics _stats;
+				static tj::shared::ref<ScriptCache> _instance;
+		};
+	}
+}
+
+#endif
@@ -23,9 +23,12 @@ namespace tj {
 		class VM;
 		class ScriptThread;
 
+		/** A script context compiles and executes scripts. Compiled scripts are not bound to the context that compiled
+		them and do not change after compilation, so they can be shared between contexts and threads. Each execution
+		gets a VM (with its own stack and frames) from a pool kept by the context, so that several scripts can run at
+		the same time on different threads. The global scope of the context is shared by all executions and is
+		synchronized (see ScriptScope). **/
 		class SCRIPT_EXPORTED ScriptContext: public virtual tj::shared::Object {
-			friend class ScriptThread;
-
 			public:
 				ScriptContext(ref<Scriptable> global);
 				virtual ~ScriptContext();
@@ -36,6 +39,16 @@ namespace tj {
 				virtual ref<Scriptable> GetGlobal();
 				void SetDebug(bool d);
 				void SetOptimize(bool o);
+
+				/** Compiled scripts are looked up in (and added to) the cache before compiling. By default, the shared
+				in-memory cache (ScriptCache::DefaultInstance) is used; set to null to always compile. **/
+				void SetCache(ref<ScriptCache> cache);
+				ref<ScriptCache> GetCache();
+
+				/** When a profiler is set, all scripts executed by this context are profiled (see ScriptProfiler); set
+				to null to stop profiling **/
+				void SetProfiler(ref<ScriptProfiler> profiler);
+				ref<ScriptProfiler> GetProfiler();
 				virtual void SetDispatcher(ref<tj::shared::Dispatcher> d);
 				virtual tj::shared::strong<tj::shared::Dispatcher> GetDispatcher();
 
@@ -46,13 +59,22 @@ namespace tj {
 				void AddType(const std::wstring& type, ref<ScriptType> stype);
 				ref<ScriptType> GetType(const std::wstring& type);
 
+				const static unsigned int KValueRecycleBinSize = 64;
+				const static unsigned int KMaximumIdleVMs = 16;
+
 			protected:
-				ref<VM> _vm;
+				ref<VM> AcquireVM();
+				void ReleaseVM(ref<VM> vm);
+
+				std::deque< ref<VM> > _idleVMs;
+				tj::shared::CriticalSection _vmLock;
 				ref<tj::shared::Dispatcher> _dispatcher;
 				ref<ScriptScope> _global;
+				ref<ScriptCache> _cache;
+				ref<ScriptProfiler> _profiler;
 				std::map< std::wstring, ref<ScriptType> > _types;
 				bool _optimize;
-				tj::shared::CriticalSection _running;
+				bool _debug;
 		};
 
 		// Converting to some other type, either the object we want to convert is of the type desired
@@ -28,16 +28,19 @@ namespace tj {
 			protected:
 				typedef tj::shared::ref<Scriptable> (T::*Member)(tj::shared::ref<ParameterList>);
 				typedef std::map<CommandType, Member> MemberMap;
+				typedef std::map<ScriptSymbol, Member> SymbolMemberMap;
 
 				ScriptObject();
 				static void Bind(Command c, Member p);
 
 				static typename ScriptObject<T>::MemberMap _members;
+				static typename ScriptObject<T>::SymbolMemberMap _memberSymbols; // Same members as _members, by symbol
 				static volatile long _initialized;
 
 			public:
 				// Scriptable
 				virtual tj::shared::ref<Scriptable> Execute(Command c, tj::shared::ref<ParameterList> p);
+				virtual tj::shared::ref<Scriptable> ExecuteSymbol(ScriptSymbol s, Command c, tj::shared::ref<ParameterList> p);
 				virtual ~ScriptObject();
 		};
 
@@ -85,6 +88,7 @@ namespace tj {
 
 		template<typename T> void ScriptObject<T>::Bind(Command c, Member p) {
 			ScriptObject<T>::_members[c] = p;
+			ScriptObject<T>::_memberSymbols[ScriptSymbols::Intern(c)] = p;
 		}
 
 		template<typename T> tj::shared::ref<Scriptable> ScriptObject<T>::Execute(Command c, tj::shared::ref<ParameterList> p) {
@@ -104,7 +108,20 @@ namespace tj {
 			}
 		}
 
+		/** Members that are not found by symbol are looked up through Execute, because classes may override it to
+		provide members that are not bound (these overrides normally call ScriptObject<T>::Execute first, so looking
+		up bound members by symbol does not change which member is called). **/
+		template<typename T> tj::shared::ref<Scriptable> ScriptObject<T>::ExecuteSymbol(ScriptSymbol s, Command c, tj::shared::ref<ParameterList> p) {
+			typename SymbolMemberMap::const_iterator it = _memberSymbols.find(s);
+			if(it!=_memberSymbols.end()) {
+				Member m = it->second;
+				return (static_cast<T*>(this)->*m)(p);
+			}
+			return Execute(c, p);
+		}
+
 		template<typename T> typename ScriptObject<T>::MemberMap ScriptObject<T>::_members = typename ScriptObject<T>::MemberMap();
+		template<typename T> typename ScriptObject<T>::SymbolMemberMap ScriptObject<T>::_memberSymbols = typename ScriptObject<T>::SymbolMemberMap();
 		template<typename T> volatile long ScriptObject<T>::_initialized = 0;
 	}
 }
@@ -0,0 +1,88 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #ifndef _TJSCRIPTPROFILER_H
+#define _TJSCRIPTPROFILER_H
+
+namespace tj {
+	namespace script {
+		class CompiledScript;
+
+		struct SCRIPT_EXPORTED ScriptProfileEntry {
+			ScriptProfileEntry();
+			void Add(const ScriptProfileEntry& other);
+
+			unsigned int _calls;
+			long double _time;			// Time spent (ms)
+		};
+
+		/** Profile data gathered by a single VM during one execution; the VM merges it into its profiler when it is done
+		(see ScriptProfiler::Merge), so that nothing needs to be locked while the script runs. **/
+		struct SCRIPT_EXPORTED ScriptProfileData {
+			ScriptProfileData();
+			void Clear();
+
+			std::vector<unsigned int> _ops;									// Execution count for each op
+			std::map< std::wstring, ScriptProfileEntry > _scriptlets;			// By scriptlet name (see ScriptProfiler::GetScriptletName)
+			std::map< std::wstring, ScriptProfileEntry > _natives;				// By 'type.member'
+			std::map< std::wstring, unsigned int > _samples;					// Number of samples for each call stack (folded)
+		};
+
+		/** The script profiler records, for all scripts executed by a context (see ScriptContext::SetProfiler), how
+		often each op is executed, how much time is spent in each scriptlet and in each native member called by
+		scripts (Scriptable::Execute), and samples the call stack of the scripts at a fixed interval. VMs only check
+		the clock when a scriptlet is entered or left, after a native call and once every KSampleCheckInterval ops,
+		so the overhead is small enough to use on a running show.
+
+		Scripts are run op-by-op while profiling (like in debug mode); the counts are for the ops in the byte code,
+		not for the instructions these are combined into when a scriptlet is translated. Time spent in a scriptlet
+		does not include time spent in the scriptlets it calls, but does include time spent in native members.
+
+		Scripts are named with CompiledScript::SetName; unnamed scripts are shown as 'script'. The call stacks can be
+		written in the 'folded' format that is used by flame graph tools (one line per stack; frames separated
+		by ';', followed by the number of samples). **/
+		class SCRIPT_EXPORTED ScriptProfiler: public virtual tj::shared::Object {
+			public:
+				ScriptProfiler(int sampleInterval = KDefaultSampleInterval);
+				virtual ~ScriptProfiler();
+
+				void SetSampleInterval(int ms);
+				int GetSampleInterval() const;
+				void Reset();
+
+				// Called by VMs when they are done executing
+				void Merge(const ScriptProfileData& data);
+
+				std::wstring GetFoldedStacks() const;
+				bool WriteFoldedStacks(const std::wstring& path) const;
+				std::wstring GetReport(unsigned int maximumLines = KDefaultReportLines) const;
+				void LogReport() const;
+
+				static std::wstring GetScriptletName(tj::shared::ref<CompiledScript> script, int scriptlet);
+				static std::wstring GetNativeName(tj::shared::ref<Scriptable> target, const std::wstring& member);
+
+				const static int KDefaultSampleInterval = 1; // ms
+				const static unsigned int KSampleCheckInterval = 64; // ops
+				const static unsigned int KDefaultReportLines = 20;
+
+			protected:
+				mutable tj::shared::CriticalSection _lock;
+				int _sampleInterval;
+				ScriptProfileData _data;
+				tj::shared::Timestamp _started;
+		};
+	}
+}
+
+#endif
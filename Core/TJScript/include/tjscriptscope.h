@@ -20,22 +20,33 @@
 
 namespace tj {
 	namespace script {
+		/** A scope holds variables by symbol (see ScriptSymbols). Variables that are not found in a scope are looked up
+		in the previous (enclosing) scope; the chain of scopes usually ends with the global object of the script context.
+		A synchronized scope can be read and written by several threads at the same time (the global scope of a context
+		is synchronized, because scripts may run in parallel). **/
 		class SCRIPT_EXPORTED ScriptScope: public Scriptable {
 			public:
-				ScriptScope();
+				ScriptScope(bool synchronized = false);
 				virtual ~ScriptScope();
 				tj::shared::ref<Scriptable> GetPrevious();
 				void SetPrevious(tj::shared::ref<Scriptable> r);
 				
 				virtual tj::shared::ref<Scriptable> Execute(Command command, tj::shared::ref<ParameterList> params);
+				virtual tj::shared::ref<Scriptable> ExecuteSymbol(ScriptSymbol symbol, Command command, tj::shared::ref<ParameterList> params);
 				virtual bool Set(Field field, tj::shared::ref<Scriptable> var);
+				bool Set(ScriptSymbol symbol, Command name, tj::shared::ref<Scriptable> var);
 				tj::shared::ref<Scriptable> Get(const std::wstring& key);
+				tj::shared::ref<Scriptable> Get(ScriptSymbol symbol);
 				bool Exists(const std::wstring& key);
 
-				std::map< std::wstring, tj::shared::ref<Scriptable> > _vars;
+				std::map< ScriptSymbol, tj::shared::ref<Scriptable> > _vars;
 				
 			protected:
+				tj::shared::ref<Scriptable> Lookup(ScriptSymbol symbol, Command name, tj::shared::ref<ParameterList> params);
+				bool IsDefined(ScriptSymbol symbol, Command name);
 				tj::shared::ref<Scriptable> _previous;
+				ScriptScope* _previousScope; // Same as _previous if it is a scope, 0 otherwise
+				tj::shared::CriticalSection* _lock; // Only set for synchronized scopes
 		};
 
 	}
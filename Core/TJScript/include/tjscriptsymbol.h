@@ -0,0 +1,41 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #ifndef _TJSCRIPTSYMBOL_H
+#define _TJSCRIPTSYMBOL_H
+
+namespace tj {
+	namespace script {
+		typedef unsigned int ScriptSymbol;
+
+		/** Names of variables and members are interned: each distinct name is given a number (its symbol), which stays
+		the same for as long as the process runs. Scopes and script objects store their members by symbol, and the
+		VM resolves the identifiers in a script to symbols when it is translated, so that looking up a variable does
+		not require any string comparisons. **/
+		class SCRIPT_EXPORTED ScriptSymbols {
+			public:
+				/** Returns the symbol for the given name, creating a new one if the name was not seen before **/
+				static ScriptSymbol Intern(const std::wstring& name);
+
+				/** Returns the symbol for the given name, or KNoSymbol if it was never interned (in which case no scope
+				or object can have a member with this name) **/
+				static ScriptSymbol Find(const std::wstring& name);
+				static const std::wstring& GetName(ScriptSymbol symbol);
+
+				const static ScriptSymbol KNoSymbol = 0;
+		};
+	}
+}
+
+#endif
@@ -16,8 +16,7 @@
 using namespace tj::script;
 using namespace tj::shared;
 
-CompiledScript::CompiledScript(ScriptContext* cc) {
-	_creatingContext = cc;
+CompiledScript::CompiledScript() {
 }
 
 CompiledScript::~CompiledScript() {
@@ -48,27 +47,160 @@ int CompiledScript::GetScriptletIndex(ref<Scriptlet> scriptlet) {
 	throw ScriptException(L"Scriptlet not found in compiled script");
 }
 
+void CompiledScript::SetName(const std::wstring& name) {
+	_name = name;
+}
+
+const std::wstring& CompiledScript::GetName() const {
+	return _name;
+}
+
 int CompiledScript::GetScriptletCount() const {
 	return (int)_scriptlets.size();
 }
 
-void CompiledScript::Optimize() {
-	/* possible optimizations that can be done at compile-time (which means here):
-	- Removal of empty scriptlets, and the calls referring to them (OpBranchIf should probably be
-	  replaced with a few OpPops)
+ref<Scriptable> CompiledScript::GetIdentifier(const std::wstring& name) {
+	std::map<std::wstring, ref<Scriptable> >::iterator it = _identifiers.find(name);
+	if(it!=_identifiers.end()) {
+		return it->second;
+	}
+
+	ref<Scriptable> literal = GC::Hold(new ScriptString(name));
+	_identifiers[name] = literal;
+	return literal;
+}
 
-	- Removal of OpPush, OpPushGlobal at the end of a scriptlet after the last OpCall/OpBranchIf/OpSave/...
+/** Optimizes the byte code (see ScriptOptimizer) and then translates all scriptlets for faster execution (see
+Scriptlet::Translate). The script should not be changed anymore after this. **/
+void CompiledScript::Optimize() {
+	ScriptOptimizer optimizer(this, _statistics);
+	optimizer.Optimize();
 
-	- (Advanced) evaluation of static expressions
+	std::vector< ref<Scriptlet> >::iterator it = _scriptlets.begin();
+	while(it!=_scriptlets.end()) {
+		ref<Scriptlet> scriptlet = *it;
+		if(scriptlet) {
+			scriptlet->Translate();
+		}
+		++it;
+	}
+}
 
-	- (Advanced) evaluation and elimination of if/else expressions which are static
-	*/
+const ScriptOptimizationStatistics& CompiledScript::GetOptimizationStatistics() const {
+	return _statistics;
 }
 
 ref<Scriptlet> CompiledScript::GetMainScriptlet() {
 	return _scriptlets.at(0);
 }
 
+namespace tj {
+	namespace script {
+		namespace translate {
+			struct Decoded {
+				int _op;
+				unsigned int _pc;
+				unsigned int _operands;
+				unsigned int _next;
+			};
+
+			static inline bool IsLiteral(int op) {
+				// OpPushDelegate is not included, because its handler binds the delegate to the executing context
+				return op==Ops::OpPushString || op==Ops::OpPushDouble || op==Ops::OpPushInt;
+			}
+
+			/** Returns the instruction that performs op with a literal as its right-hand operand, or -1 if there is none **/
+			static inline int GetLiteralOperation(int op) {
+				switch(op) {
+					case Ops::OpAdd: return Ops::OpAddLiteral;
+					case Ops::OpSub: return Ops::OpSubLiteral;
+					case Ops::OpMul: return Ops::OpMulLiteral;
+					case Ops::OpDiv: return Ops::OpDivLiteral;
+					case Ops::OpGreaterThan: return Ops::OpGreaterThanLiteral;
+					case Ops::OpLessThan: return Ops::OpLessThanLiteral;
+					case Ops::OpEquals: return Ops::OpEqualsLiteral;
+					default: return -1;
+				}
+			}
+		}
+	}
+}
+
+/** Builds the translated form of this scriptlet, which is executed by the VM instead of the byte code when it is
+available. Control never jumps into the middle of a sequence of instructions that is replaced by a single
+instruction: scriptlets are only entered at the start, and execution only resumes after an instruction that calls
+another scriptlet (OpCall, OpCallGlobal, OpBranchIf, OpIterate), which always ends a sequence. **/
+void Scriptlet::Translate() {
+	std::vector<translate::Decoded> decoded;
+	unsigned int pc = 0;
+	while(pc < _used) {
+		translate::Decoded d;
+		d._pc = pc;
+		d._op = Get<int>(pc);
+		if(d._op<0 || d._op>=Ops::_OpLast) {
+			Throw(L"Invalid instruction found while translating scriptlet", ExceptionTypeError);
+		}
+		d._operands = pc;
+		pc += Ops::GetOperandSize(d._op);
+		d._next = pc;
+		decoded.push_back(d);
+	}
+
+	_instructions.clear();
+	_entries.assign(_used, -1);
+
+	unsigned int n = (unsigned int)decoded.size();
+	for(unsigned int a=0;a<n;a++) {
+		const translate::Decoded& d = decoded[a];
+		Instruction ins;
+		ins._op = d._op;
+		ins._operands = d._operands;
+		ins._next = d._next;
+		ins._symbol = ScriptSymbols::KNoSymbol;
+
+		if(translate::IsLiteral(d._op)) {
+			unsigned int operands = d._operands;
+			ins._literal = GetLiteral(Get<LiteralIdentifier>(operands));
+			ins._op = Ops::OpPushLiteral;
+			ins._value._reference = ins._literal;
+			ins._value.Unbox();
+
+			int following = (a+1<n) ? decoded[a+1]._op : -1;
+			int afterFollowing = (a+2<n) ? decoded[a+2]._op : -1;
+			int literalOperation = translate::GetLiteralOperation(following);
+
+			if(d._op==Ops::OpPushString && ins._literal.IsCastableTo<ScriptString>()) {
+				if(following==Ops::OpCallGlobal) {
+					ins._op = Ops::OpLoadVariable;
+					ins._next = decoded[a+1]._next;
+					a += 1;
+				}
+				else if(following==Ops::OpPushParameter && (afterFollowing==Ops::OpCallGlobal || afterFollowing==Ops::OpCall)) {
+					ins._op = (afterFollowing==Ops::OpCallGlobal) ? Ops::OpCallGlobalNoArguments : Ops::OpCallNoArguments;
+					ins._next = decoded[a+2]._next;
+					a += 2;
+				}
+
+				if(ins._op!=Ops::OpPushLiteral) {
+					ins._name = ref<ScriptString>(ins._literal)->GetValue();
+					ins._symbol = ScriptSymbols::Intern(ins._name);
+				}
+			}
+
+			if(ins._op==Ops::OpPushLiteral && d._op!=Ops::OpPushDelegate && literalOperation>=0 && ins._literal.IsCastableTo<ScriptAny>()) {
+				ins._op = literalOperation;
+				ins._next = decoded[a+1]._next;
+				a += 1;
+			}
+		}
+
+		_entries[d._pc] = (int)_instructions.size();
+		_instructions.push_back(ins);
+	}
+
+	_translated = true;
+}
+
 template<> Scriptlet& Scriptlet::Add(const std::wstring& x) {
 	Add<unsigned int>((unsigned int)x.length());
 	std::wstring::const_iterator it = x.begin();
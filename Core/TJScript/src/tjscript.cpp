@@ -34,5 +34,9 @@ bool Scriptable::Set(Field field, tj::shared::ref<Scriptable> value) {
 	return false;
 }
 
+ref<Scriptable> Scriptable::ExecuteSymbol(ScriptSymbol symbol, Command command, ref<ParameterList> params) {
+	return Execute(command, params);
+}
+
 ScriptletStack::~ScriptletStack() {
 }
\ No newline at end of file
@@ -0,0 +1,507 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #include "../include/internal/tjscript.h"
+#include <stdio.h>
+using namespace tj::shared;
+using namespace tj::script;
+
+namespace tj {
+	namespace script {
+		namespace cache {
+			const static unsigned int KMagic = 0x4353544A; // 'TJSC'
+			const static unsigned int KMaximumDepth = 32; // Maximum nesting of delegates in a cache file
+			const static wchar_t* KExtension = L".tjsc";
+
+			enum LiteralKind {
+				LiteralString = 1,
+				LiteralInt,
+				LiteralDouble,
+				LiteralBool,
+				LiteralAny,
+				LiteralDelegate,
+			};
+
+			static FILE* OpenFile(const std::wstring& path, bool write) {
+				#ifdef TJ_OS_WIN
+					return _wfopen(path.c_str(), write ? L"wb" : L"rb");
+				#else
+					return fopen(Mbs(path).c_str(), write ? "wb" : "rb");
+				#endif
+			}
+
+			static bool WriteAny(DataWriter& dw, const Any& value) {
+				Any::Type type = value.GetType();
+				switch(type) {
+					case Any::TypeNull:
+						dw.Add<int>(type);
+						return true;
+
+					case Any::TypeInteger:
+						dw.Add<int>(type);
+						dw.Add<int>((int)value);
+						return true;
+
+					case Any::TypeDouble:
+						dw.Add<int>(type);
+						dw.Add<double>((double)value);
+						return true;
+
+					case Any::TypeBool:
+						dw.Add<int>(type);
+						dw.Add<unsigned char>((bool)value ? 1 : 0);
+						return true;
+
+					case Any::TypeString:
+						dw.Add<int>(type);
+						dw.Add<std::wstring>((std::wstring)value);
+						return true;
+
+					default:
+						return false; // Objects cannot be stored
+				}
+			}
+
+			static Any ReadAny(DataReader& dr, unsigned int& position) {
+				int type = dr.Get<int>(position);
+				switch(type) {
+					case Any::TypeNull:
+						return Any();
+
+					case Any::TypeInteger:
+						return Any(dr.Get<int>(position));
+
+					case Any::TypeDouble:
+						return Any(dr.Get<double>(position));
+
+					case Any::TypeBool:
+						return Any(dr.Get<unsigned char>(position)!=0);
+
+					case Any::TypeString:
+						return Any(dr.Get<std::wstring>(position));
+
+					default:
+						Throw(L"Invalid value type in script cache file", ExceptionTypeError);
+				}
+			}
+		}
+	}
+}
+
+const unsigned int ScriptCache::KFormatVersion = 2;
+ref<ScriptCache> ScriptCache::_instance;
+
+/** ScriptCacheStatistics **/
+ScriptCacheStatistics::ScriptCacheStatistics(): _lookups(0), _memoryHits(0), _diskHits(0), _misses(0), _diskWrites(0), _diskErrors(0), _compileTime(0.0), _loadTime(0.0) {
+}
+
+float ScriptCacheStatistics::GetHitRate() const {
+	if(_lookups==0) {
+		return 0.0f;
+	}
+	return float(_memoryHits + _diskHits) / float(_lookups);
+}
+
+/** ScriptCache **/
+ScriptCache::ScriptCache(const std::wstring& directory) {
+	SetDirectory(directory);
+}
+
+ScriptCache::~ScriptCache() {
+}
+
+strong<ScriptCache> ScriptCache::DefaultInstance() {
+	if(!_instance) {
+		_instance = GC::Hold(new ScriptCache());
+	}
+	return _instance;
+}
+
+std::wstring ScriptCache::GetCompilerVersion() {
+	return L"TJScript/" + Stringify(KFormatVersion) + L"/" + Stringify((int)Ops::_OpLast);
+}
+
+std::string ScriptCache::GetKey(const std::wstring& source, bool optimize) {
+	return GetKey(source, optimize, GetCompilerVersion());
+}
+
+std::string ScriptCache::GetKey(const std::wstring& source, bool optimize, const std::wstring& compilerVersion) {
+	std::wstring version = compilerVersion + (optimize ? L"/optimized" : L"/plain");
+	SecureHash sh;
+	sh.AddData(version.c_str(), version.length()*sizeof(wchar_t));
+	sh.AddData(source.c_str(), source.length()*sizeof(wchar_t));
+	return sh.GetHashAsString();
+}
+
+/** Returns the key for a script file (based on its contents), or an empty string if the file does not exist **/
+std::string ScriptCache::GetFileKey(const std::wstring& path, bool optimize) {
+	if(!File::Exists(path)) {
+		return "";
+	}
+
+	std::wstring version = GetCompilerVersion() + (optimize ? L"/optimized/file" : L"/plain/file");
+	SecureHash sh;
+	sh.AddData(version.c_str(), version.length()*sizeof(wchar_t));
+	sh.AddFile(path);
+	return sh.GetHashAsString();
+}
+
+void ScriptCache::SetDirectory(const std::wstring& directory) {
+	if(directory.length()>0 && !File::Exists(directory)) {
+		if(!File::CreateDirectoryAtPath(directory, true)) {
+			Log::Write(L"TJScript/ScriptCache", L"Could not create cache directory "+directory+L"; scripts will only be cached in memory");
+			ThreadLock lock(&_lock);
+			_directory = L"";
+			return;
+		}
+	}
+
+	ThreadLock lock(&_lock);
+	_directory = directory;
+}
+
+std::wstring ScriptCache::GetDirectory() const {
+	ThreadLock lock(&_lock);
+	return _directory;
+}
+
+std::wstring ScriptCache::GetPath(const std::string& key) const {
+	ThreadLock lock(&_lock);
+	if(_directory.length()==0) {
+		return L"";
+	}
+	return _directory + File::GetPathSeparator() + Wcs(key) + cache::KExtension;
+}
+
+ref<CompiledScript> ScriptCache::Get(const std::string& key) {
+	if(key.length()==0) {
+		return null;
+	}
+
+	{
+		ThreadLock lock(&_lock);
+		++(_stats._lookups);
+		std::map< std::string, ref<CompiledScript> >::iterator it = _scripts.find(key);
+		if(it!=_scripts.end()) {
+			++(_stats._memoryHits);
+			return it->second;
+		}
+	}
+
+	Timestamp start(true);
+	ref<CompiledScript> script = Load(key);
+
+	ThreadLock lock(&_lock);
+	if(script) {
+		++(_stats._diskHits);
+		_stats._loadTime += Timestamp(true).Difference(start).ToMilliSeconds();
+		Remember(key, script);
+	}
+	else {
+		++(_stats._misses);
+	}
+	return script;
+}
+
+void ScriptCache::Put(const std::string& key, ref<CompiledScript> script, long double compileTime) {
+	if(key.length()==0 || !script) {
+		return;
+	}
+
+	{
+		ThreadLock lock(&_lock);
+		_stats._compileTime += compileTime;
+		Remember(key, script);
+	}
+
+	if(GetPath(key).length()>0) {
+		bool saved = Save(key, script);
+		ThreadLock lock(&_lock);
+		if(saved) {
+			++(_stats._diskWrites);
+		}
+		else {
+			++(_stats._diskErrors);
+		}
+	}
+}
+
+/** Adds a script to the in-memory cache; if the cache is full, the oldest script is removed. Call with _lock held. **/
+void ScriptCache::Remember(const std::string& key, ref<CompiledScript> script) {
+	if(_scripts.find(key)==_scripts.end()) {
+		_order.push_back(key);
+		while(_order.size() > KMaximumEntries) {
+			_scripts.erase(_order.front());
+			_order.pop_front();
+		}
+	}
+	_scripts[key] = script;
+}
+
+void ScriptCache::Clear() {
+	ThreadLock lock(&_lock);
+	_scripts.clear();
+	_order.clear();
+}
+
+ScriptCacheStatistics ScriptCache::GetStatistics() const {
+	ThreadLock lock(&_lock);
+	return _stats;
+}
+
+void ScriptCache::ResetStatistics() {
+	ThreadLock lock(&_lock);
+	_stats = ScriptCacheStatistics();
+}
+
+void ScriptCache::LogStatistics() const {
+	ScriptCacheStatistics stats = GetStatistics();
+	std::wostringstream wos;
+	wos << L"Lookups: " << stats._lookups << L", hits: " << stats._memoryHits << L" (memory) " << stats._diskHits << L" (disk), misses: " << stats._misses;
+	wos << L", hit rate: " << int(stats.GetHitRate()*100.0f) << L"%, compile time: " << double(stats._compileTime) << L"ms, load time: " << double(stats._loadTime) << L"ms";
+	wos << L", files written: " << stats._diskWrites << L", errors: " << stats._diskErrors;
+	Log::Write(L"TJScript/ScriptCache", wos.str());
+}
+
+ref<CompiledScript> ScriptCache::Load(const std::string& key) {
+	std::wstring path = GetPath(key);
+	if(path.length()==0) {
+		return null;
+	}
+
+	FILE* fp = cache::OpenFile(path, false);
+	if(fp==NULL) {
+		return null;
+	}
+
+	std::string data;
+	char buffer[4096];
+	size_t read = 0;
+	while((read = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+		data.append(buffer, read);
+	}
+	fclose(fp);
+
+	try {
+		DataReader dr(data.c_str(), (Bytes)data.length());
+		unsigned int position = 0;
+		if(dr.Get<unsigned int>(position)!=cache::KMagic || dr.Get<unsigned int>(position)!=KFormatVersion) {
+			Throw(L"Invalid header", ExceptionTypeError);
+		}
+
+		ref<CompiledScript> script = Read(dr, position, 0);
+		if(dr.Get<unsigned int>(position)!=cache::KMagic || position!=data.length()) {
+			Throw(L"Invalid trailer", ExceptionTypeError);
+		}
+		return script;
+	}
+	catch(Exception& e) {
+		Log::Write(L"TJScript/ScriptCache", L"Cache file "+path+L" was rejected: "+e.GetMsg());
+	}
+	catch(...) {
+		Log::Write(L"TJScript/ScriptCache", L"Cache file "+path+L" was rejected");
+	}
+
+	ThreadLock lock(&_lock);
+	++(_stats._diskErrors);
+	return null;
+}
+
+bool ScriptCache::Save(const std::string& key, ref<CompiledScript> script) {
+	DataWriter dw;
+	dw.Add<unsigned int>(cache::KMagic);
+	dw.Add<unsigned int>(KFormatVersion);
+	if(!Write(dw, script)) {
+		return false;
+	}
+	dw.Add<unsigned int>(cache::KMagic);
+
+	std::wstring path = GetPath(key);
+	FILE* fp = cache::OpenFile(path, true);
+	if(fp==NULL) {
+		return false;
+	}
+
+	size_t size = (size_t)dw.GetSize();
+	bool ok = fwrite(dw.GetBuffer(), 1, size, fp)==size;
+	ok = (fclose(fp)==0) && ok;
+	return ok;
+}
+
+/** Writes a compiled script (and the scripts of its delegates). Returns false if the script contains a literal
+that cannot be stored. **/
+bool ScriptCache::Write(DataWriter& dw, ref<CompiledScript> script) {
+	const ScriptOptimizationStatistics& st = script->_statistics;
+	dw.Add<unsigned int>(st._instructionsBefore);
+	dw.Add<unsigned int>(st._instructionsAfter);
+	dw.Add<unsigned int>(st._scriptletsBefore);
+	dw.Add<unsigned int>(st._scriptletsAfter);
+	dw.Add<unsigned int>(st._foldedConstants);
+	dw.Add<unsigned int>(st._eliminatedBranches);
+	dw.Add<unsigned int>(st._removedInstructions);
+	dw.Add<unsigned int>(st._verifiedScriptlets);
+	dw.Add<double>((double)st._time);
+	dw.Add<std::wstring>(script->_name);
+
+	dw.Add<unsigned int>((unsigned int)script->_scriptlets.size());
+	std::vector< ref<Scriptlet> >::const_iterator it = script->_scriptlets.begin();
+	while(it!=script->_scriptlets.end()) {
+		ref<Scriptlet> scriptlet = *it;
+		dw.Add<int>((int)scriptlet->_type);
+		dw.Add<unsigned char>(scriptlet->_translated ? 1 : 0);
+		dw.Add<unsigned char>(scriptlet->_verified ? 1 : 0);
+		dw.Add<unsigned int>(scriptlet->_used);
+		dw.Append(scriptlet->_code, scriptlet->_used);
+
+		dw.Add<unsigned int>((unsigned int)scriptlet->_literals.size());
+		std::vector< ref<Scriptable> >::const_iterator lit = scriptlet->_literals.begin();
+		while(lit!=scriptlet->_literals.end()) {
+			ref<Scriptable> literal = *lit;
+			if(literal.IsCastableTo<ScriptString>()) {
+				dw.Add<unsigned char>(cache::LiteralString);
+				dw.Add<std::wstring>(ref<ScriptString>(literal)->GetValue());
+			}
+			else if(literal.IsCastableTo<ScriptInt>()) {
+				dw.Add<unsigned char>(cache::LiteralInt);
+				dw.Add<int>(ref<ScriptInt>(literal)->GetValue());
+			}
+			else if(literal.IsCastableTo<ScriptDouble>()) {
+				dw.Add<unsigned char>(cache::LiteralDouble);
+				dw.Add<double>(ref<ScriptDouble>(literal)->GetValue());
+			}
+			else if(literal.IsCastableTo<ScriptBool>()) {
+				dw.Add<unsigned char>(cache::LiteralBool);
+				dw.Add<unsigned char>(ref<ScriptBool>(literal)->GetValue() ? 1 : 0);
+			}
+			else if(literal.IsCastableTo<ScriptAnyValue>()) {
+				dw.Add<unsigned char>(cache::LiteralAny);
+				if(!cache::WriteAny(dw, ref<ScriptAnyValue>(literal)->GetValue())) {
+					return false;
+				}
+			}
+			else if(literal.IsCastableTo<ScriptDelegate>()) {
+				dw.Add<unsigned char>(cache::LiteralDelegate);
+				if(!Write(dw, ref<ScriptDelegate>(literal)->GetScript())) {
+					return false;
+				}
+			}
+			else {
+				return false;
+			}
+			++lit;
+		}
+		++it;
+	}
+	return true;
+}
+
+ref<CompiledScript> ScriptCache::Read(DataReader& dr, unsigned int& position, unsigned int depth) {
+	if(depth > cache::KMaximumDepth) {
+		Throw(L"Delegates nested too deeply", ExceptionTypeError);
+	}
+
+	ref<CompiledScript> script = GC::Hold(new CompiledScript());
+	ScriptOptimizationStatistics& st = script->_statistics;
+	st._instructionsBefore = dr.Get<unsigned int>(position);
+	st._instructionsAfter = dr.Get<unsigned int>(position);
+	st._scriptletsBefore = dr.Get<unsigned int>(position);
+	st._scriptletsAfter = dr.Get<unsigned int>(position);
+	st._foldedConstants = dr.Get<unsigned int>(position);
+	st._eliminatedBranches = dr.Get<unsigned int>(position);
+	st._removedInstructions = dr.Get<unsigned int>(position);
+	st._verifiedScriptlets = dr.Get<unsigned int>(position);
+	st._time = dr.Get<double>(position);
+	script->_name = dr.Get<std::wstring>(position);
+
+	unsigned int scriptletCount = dr.Get<unsigned int>(position);
+	if(scriptletCount==0 || scriptletCount > dr.GetSize()) {
+		Throw(L"Invalid number of scriptlets", ExceptionTypeError);
+	}
+
+	std::vector<bool> translated, verified;
+	for(unsigned int a=0;a<scriptletCount;a++) {
+		int type = dr.Get<int>(position);
+		if(type<ScriptletAny || type>ScriptletLoop) {
+			Throw(L"Invalid scriptlet type", ExceptionTypeError);
+		}
+
+		ref<Scriptlet> scriptlet = script->CreateScriptlet((ScriptletType)type);
+		translated.push_back(dr.Get<unsigned char>(position)!=0);
+		verified.push_back(dr.Get<unsigned char>(position)!=0);
+
+		unsigned int used = dr.Get<unsigned int>(position);
+		if(used > dr.GetSize() || position+used > dr.GetSize()) {
+			Throw(L"Invalid scriptlet size", ExceptionTypeError);
+		}
+
+		if(used > scriptlet->_size) {
+			scriptlet->Enlarge(used);
+		}
+		memcpy(scriptlet->_code, dr.GetBuffer()+position, used);
+		scriptlet->_used = used;
+		position += used;
+
+		unsigned int literalCount = dr.Get<unsigned int>(position);
+		if(literalCount > dr.GetSize()) {
+			Throw(L"Invalid number of literals", ExceptionTypeError);
+		}
+
+		for(unsigned int b=0;b<literalCount;b++) {
+			unsigned char kind = dr.Get<unsigned char>(position);
+			switch(kind) {
+				case cache::LiteralString:
+					scriptlet->StoreLiteral(GC::Hold(new ScriptString(dr.Get<std::wstring>(position))));
+					break;
+
+				case cache::LiteralInt:
+					scriptlet->StoreLiteral(GC::Hold(new ScriptInt(dr.Get<int>(position))));
+					break;
+
+				case cache::LiteralDouble:
+					scriptlet->StoreLiteral(GC::Hold(new ScriptDouble(dr.Get<double>(position))));
+					break;
+
+				case cache::LiteralBool:
+					scriptlet->StoreLiteral(GC::Hold(new ScriptBool(dr.Get<unsigned char>(position)!=0)));
+					break;
+
+				case cache::LiteralAny:
+					scriptlet->StoreLiteral(GC::Hold(new ScriptAnyValue(cache::ReadAny(dr, position))));
+					break;
+
+				case cache::LiteralDelegate:
+					scriptlet->StoreLiteral(GC::Hold(new ScriptDelegate(Read(dr, position, depth+1), null)));
+					break;
+
+				default:
+					Throw(L"Invalid literal", ExceptionTypeError);
+			}
+		}
+	}
+
+	// A scriptlet that was verified when it was stored has to pass verification again before it is used
+	for(unsigned int a=0;a<scriptletCount;a++) {
+		ref<Scriptlet> scriptlet = script->_scriptlets[a];
+		scriptlet->_verified = ScriptOptimizer::Verify(*(scriptlet.GetPointer()), scriptletCount);
+		if(verified[a] && !scriptlet->_verified) {
+			Throw(L"Scriptlet failed verification", ExceptionTypeError);
+		}
+
+		if(translated[a]) {
+			scriptlet->Translate();
+		}
+	}
+
+	return script;
+}
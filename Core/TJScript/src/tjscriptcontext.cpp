@@ -18,10 +18,14 @@ using namespace tj::shared;
 using namespace tj::script;
 
 ScriptContext::ScriptContext(ref<Scriptable> global) {
-	_vm = GC::Hold(new VM());
-	_global = GC::Hold(new ScriptScope());
+	_global = GC::Hold(new ScriptScope(true));
 	_global->SetPrevious(global);
 	_optimize = true;
+	_debug = false;
+	_cache = ScriptCache::DefaultInstance();
+
+	// Arithmetic creates a value object for each operation; keep more of them around for re-use
+	Recycler<ScriptAnyValue>::SetMaximumSize(KValueRecycleBinSize);
 }
 
 ScriptContext::~ScriptContext() {
@@ -57,52 +61,110 @@ void ScriptContext::SetOptimize(bool o) {
 	_optimize = o;
 }
 
+void ScriptContext::SetCache(ref<ScriptCache> cache) {
+	_cache = cache;
+}
+
+ref<ScriptCache> ScriptContext::GetCache() {
+	return _cache;
+}
+
+void ScriptContext::SetProfiler(ref<ScriptProfiler> profiler) {
+	_profiler = profiler;
+}
+
+ref<ScriptProfiler> ScriptContext::GetProfiler() {
+	return _profiler;
+}
+
 ref<Scriptable> ScriptContext::GetGlobal() {
 	return _global;
 }
 
-ref<Scriptable> ScriptContext::Execute(ref<CompiledScript> scr, ref<ScriptScope> scope) {
-	ThreadLock lock(&_running);
-	assert(scr);
+/** Returns an idle VM from the pool, or a new VM if all VMs are in use **/
+ref<VM> ScriptContext::AcquireVM() {
+	ref<VM> vm;
+	{
+		ThreadLock lock(&_vmLock);
+		if(!_idleVMs.empty()) {
+			vm = _idleVMs.back();
+			_idleVMs.pop_back();
+		}
+	}
 
-	if(scr->_creatingContext!=0 && scr->_creatingContext!=this) {
-		throw ScriptException(L"Script cannot be executed, because it was not created by this context");
+	if(!vm) {
+		vm = GC::Hold(new VM());
 	}
+	vm->SetDebug(_debug);
+	vm->SetProfiler(_profiler);
+	return vm;
+}
 
-	if(scope) {
-		// Get the scope at the very end of the chain and set the previous scope of that scope to _global
-		ref<ScriptScope> last = scope;
-		while(true) {
-			ref<ScriptScope> sc = last->GetPrevious();
-			if(sc) {
-				last = sc;
+void ScriptContext::ReleaseVM(ref<VM> vm) {
+	ThreadLock lock(&_vmLock);
+	if(_idleVMs.size() < KMaximumIdleVMs) {
+		_idleVMs.push_back(vm);
+	}
+}
+
+ref<Scriptable> ScriptContext::Execute(ref<CompiledScript> scr, ref<ScriptScope> scope) {
+	assert(scr);
+	ref<VM> vm = AcquireVM();
+	ref<Scriptable> val;
+
+	try {
+		if(scope) {
+			// Get the scope at the very end of the chain and set the previous scope of that scope to _global
+			ref<ScriptScope> last = scope;
+			while(true) {
+				ref<ScriptScope> sc = last->GetPrevious();
+				if(sc) {
+					last = sc;
+				}
+				else {
+					break;
+				}
+			}
+			
+			last->SetPrevious(_global);
+			try {
+				val = vm->Execute(this, scr, scope);
 			}
-			else {
-				break;
+			catch(...) {
+				last->SetPrevious(null);
+				throw;
 			}
+			last->SetPrevious(null);
+		}
+		else {
+			val = vm->Execute(this, scr, _global);
 		}
-		
-		last->SetPrevious(_global);
-		ref<Scriptable> val = _vm->Execute(this, scr, scope);
-		last->SetPrevious(null);
-		return val;
 	}
-	else {
-		return _vm->Execute(this, scr, _global);
+	catch(...) {
+		// The VM cleans up its state when an exception occurs, so it can be re-used
+		ReleaseVM(vm);
+		throw;
 	}
+
+	ReleaseVM(vm);
+	return val;
 }
 
 ref<ScriptThread> ScriptContext::CreateExecutionThread(ref<CompiledScript> scr) {
-	if(scr->_creatingContext!=this) {
-		throw ScriptException(L"Cannot create execution thread for this script, because it was not created by this context");
-	}
 	ref<ScriptThread> thread = GC::Hold(new ScriptThread(this));
 	thread->SetScript(scr);
 	return thread;
 }
 
 void ScriptContext::SetDebug(bool d) {
-	_vm->SetDebug(d);
+	ThreadLock lock(&_vmLock);
+	_debug = d;
+
+	std::deque< ref<VM> >::iterator it = _idleVMs.begin();
+	while(it!=_idleVMs.end()) {
+		(*it)->SetDebug(d);
+		++it;
+	}
 }
 
 void ScriptContext::AddType(const std::wstring& type, ref<ScriptType> stype) {
@@ -101,14 +101,10 @@ void ScriptFuture::AddVariable(Field field, strong<Scriptable> s) {
 void ScriptFuture::Run() {
 	ThreadLock lock(&_lock);
 	if(!IsConcrete()) {
-		// TODO: some kind of context stacking is necessary, because the original context now contains
-		// type definitions (_types) that the new context does not have.
-		ref<ScriptContext> ctx = GC::Hold(new ScriptContext(_originalContext->GetGlobal()));
-		ctx->SetDispatcher(ctx->GetDispatcher());
-
-		// ctx->Execute can throw exceptions; they are caught in Task::Run and set the task's state to TaskFailed.
+		// The original context can execute the delegate while it is running other scripts (it uses a VM from its pool)
+		// Execute can throw exceptions; they are caught in Task::Run and set the task's state to TaskFailed.
 		// The value() script function (in ScriptScope::Execute) will throw an exception again if a task failed.
-		_returnValue = ctx->Execute(_cs, _scope);
+		_returnValue = _originalContext->Execute(_cs, _scope);
 
 		_isConcrete = true;
 		_finished.Signal();
@@ -112,32 +112,18 @@ namespace tj {
 				mutable ref<ScriptletStack> _stack;
 			};
 
+			/** Writes an identifier; all occurrences of the same identifier in a script share one literal (see
+			CompiledScript::GetIdentifier). **/
 			struct ScriptWriteString {
-				ScriptWriteString(ScriptGrammar const* gram);
-
-				template<typename T> inline void operator()(const T start, const T end) const {
-					std::wstring value(start,end);
-					ReplaceAll(value, L"\\\"", L"\"");
-					ReplaceAll(value, L"\\r", L"\r");
-					ReplaceAll(value, L"\\n", L"\n");
-					ReplaceAll(value, L"\\t", L"\t");
-
-					int li = _stack->Top()->StoreLiteral(GC::Hold(new ScriptString(value)));
-					_stack->Top()->Add(li);
+				inline ScriptWriteString(ScriptGrammar const* gram) {
+					_grammar = gram;
 				}
 
-				template<typename T> inline void operator()(const T v) const {	
-					std::wstring value(v);
-					ReplaceAll(value, L"\\\"", L"\"");
-					ReplaceAll(value, L"\\r", L"\r");
-					ReplaceAll(value, L"\\n", L"\n");
-					ReplaceAll(value, L"\\t", L"\t");
-
-					int li = _stack->Top()->StoreLiteral(GC::Hold(new ScriptString(value)));
-					_stack->Top()->Add(li);
-				}
+				template<typename T> void operator()(const T start, const T end) const;
+				template<typename T> void operator()(const T v) const;
+				void Write(std::wstring value) const;
 
-				mutable ref<ScriptletStack> _stack;
+				mutable ScriptGrammar const* _grammar;
 			};
 
 			struct ScriptWriteHash {
@@ -532,7 +518,7 @@ namespace tj {
 			};
 
 			void ScriptBeginDelegate::operator()(char x) const {
-				ref<CompiledScript> dlg = GC::Hold(new CompiledScript(0));
+				ref<CompiledScript> dlg = GC::Hold(new CompiledScript());
 				_grammar->_delegateStack.push_back(_grammar->_script);
 				_grammar->_script = dlg;
 
@@ -551,7 +537,7 @@ namespace tj {
 				}
 				
 				ref<Scriptlet> current = _grammar->_stack->Top();
-				ref<ScriptDelegate> scriptDelegate = GC::Hold(new ScriptDelegate(dlg, _grammar->_context));
+				ref<ScriptDelegate> scriptDelegate = GC::Hold(new ScriptDelegate(dlg, null)); // bound to a context by OpPushDelegate
 				LiteralIdentifier li = current->StoreLiteral(scriptDelegate);
 				current->AddInstruction(Ops::OpPushDelegate);
 				current->Add<LiteralIdentifier>(li);
@@ -574,8 +560,23 @@ namespace tj {
 				_value = i;
 			}
 
-			ScriptWriteString::ScriptWriteString(const ScriptGrammar *gram) {
-				_stack = gram->_stack;
+			void ScriptWriteString::Write(std::wstring value) const {
+				ReplaceAll(value, L"\\\"", L"\"");
+				ReplaceAll(value, L"\\r", L"\r");
+				ReplaceAll(value, L"\\n", L"\n");
+				ReplaceAll(value, L"\\t", L"\t");
+
+				ref<Scriptlet> scriptlet = _grammar->_stack->Top();
+				int li = scriptlet->StoreLiteral(_grammar->_script->GetIdentifier(value));
+				scriptlet->Add(li);
+			}
+
+			template<typename T> void ScriptWriteString::operator()(const T start, const T end) const {
+				Write(std::wstring(start,end));
+			}
+
+			template<typename T> void ScriptWriteString::operator()(const T v) const {
+				Write(std::wstring(v));
 			}
 		
 			template<typename T> void ScriptPushScriptlet::operator()(T str, T end) const {
@@ -644,39 +645,72 @@ namespace tj {
 }
 
 ref<CompiledScript> ScriptContext::Compile(std::wstring source) {
-	ref<CompiledScript> script = GC::Hold(new CompiledScript(this));
+	ref<ScriptCache> cache = _cache;
+	std::string key;
+	if(cache) {
+		key = ScriptCache::GetKey(source, _optimize);
+		ref<CompiledScript> cached = cache->Get(key);
+		if(cached) {
+			return cached;
+		}
+	}
 
-	parser::ScriptGrammar sparser(script, this);
-	std::string mSource = Mbs(source);
-	parse_info<> info = parse(mSource.c_str(), sparser, space_p);
-	if(!info.full) {
-		throw ParserException(std::wstring(L"Parsing stopped at ")+Wcs(info.stop));
-		
+	Timestamp start(true);
+	ref<CompiledScript> script = GC::Hold(new CompiledScript());
+
+	{
+		// The grammar finishes the main scriptlet when it is destroyed, which has to happen before optimizing
+		parser::ScriptGrammar sparser(script, this);
+		std::string mSource = Mbs(source);
+		parse_info<> info = parse(mSource.c_str(), sparser, space_p);
+		if(!info.full) {
+			throw ParserException(std::wstring(L"Parsing stopped at ")+Wcs(info.stop));
+		}
 	}
 
 	if(_optimize) {
 		script->Optimize();
 	}
 
+	if(cache) {
+		cache->Put(key, script, Timestamp(true).Difference(start).ToMilliSeconds());
+	}
 	return script;
 }
 
 ref<CompiledScript> ScriptContext::CompileFile(std::wstring fn) {
-	ref<CompiledScript> script = GC::Hold(new CompiledScript(this));
+	ref<ScriptCache> cache = _cache;
+	std::string key;
+	if(cache) {
+		key = ScriptCache::GetFileKey(fn, _optimize);
+		ref<CompiledScript> cached = cache->Get(key);
+		if(cached) {
+			return cached;
+		}
+	}
+
+	Timestamp start(true);
+	ref<CompiledScript> script = GC::Hold(new CompiledScript());
 
-	std::string fns = Mbs(fn);
-	parser::ScriptGrammar sparser(script, this);
-	file_iterator<char> begin(fns.c_str());
-	file_iterator<char> end = begin.make_end();
+	{
+		std::string fns = Mbs(fn);
+		parser::ScriptGrammar sparser(script, this);
+		file_iterator<char> begin(fns.c_str());
+		file_iterator<char> end = begin.make_end();
 
-	parse_info< file_iterator<char> > info = parse(begin,end, sparser, space_p);
-	if(!info.full) {
-		throw ParserException(std::wstring(L"Parsing stopped"));
+		parse_info< file_iterator<char> > info = parse(begin,end, sparser, space_p);
+		if(!info.full) {
+			throw ParserException(std::wstring(L"Parsing stopped"));
+		}
 	}
 
+	script->SetName(fn);
 	if(_optimize) {
 		script->Optimize();
 	}
 
+	if(cache) {
+		cache->Put(key, script, Timestamp(true).Difference(start).ToMilliSeconds());
+	}
 	return script;
 }
\ No newline at end of file
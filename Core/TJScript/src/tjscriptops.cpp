@@ -37,7 +37,17 @@ void OpPushDoubleHandler(VM* vm) {
 void OpPushDelegateHandler(VM* vm) {
 	StackFrame* sf = vm->GetStackFrame();
 	LiteralIdentifier id = sf->_scriptlet->Get<LiteralIdentifier>(sf->_pc);
-	vm->GetStack().Push(sf->_scriptlet->GetLiteral(id));
+	ref<Scriptable> literal = sf->_scriptlet->GetLiteral(id);
+
+	// Compiled scripts are not bound to a context, so bind the delegate to the context that executes it
+	if(literal.IsCastableTo<ScriptDelegate>()) {
+		ref<ScriptDelegate> dlg = literal;
+		if(!dlg->GetContext()) {
+			vm->GetStack().Push(GC::Hold(new ScriptDelegate(dlg->GetScript(), vm->GetContext())));
+			return;
+		}
+	}
+	vm->GetStack().Push(literal);
 }
 
 void OpPushTrueHandler(VM* vm) {
@@ -59,7 +69,7 @@ void OpPushNullHandler(VM* vm) {
 }
 
 void OpPopHandler(VM* vm) {
-	vm->GetStack().Pop();
+	vm->GetStack().Drop();
 }
 
 void OpCallHandler(VM* vm) {
@@ -76,7 +86,7 @@ void OpCallHandler(VM* vm) {
 	ref< ScriptValue<std::wstring> > funcName = stack.Pop();
 	ref<Scriptable> target = stack.Pop();
 
-	ref<Scriptable> result = target->Execute(funcName->GetValue(), list);
+	ref<Scriptable> result = vm->Invoke(target, funcName->GetValue(), list);
 	if(!result) {
 		throw ScriptException(L"Variable does not exist on object or scope: '"+funcName->GetValue()+L"'");
 	}
@@ -111,7 +121,7 @@ void OpCallGlobalHandler(VM* vm) {
 	ref< ScriptValue<std::wstring> > funcName = stack.Pop();
 	ref<Scriptable> target = vm->GetCurrentScope();
 
-	ref<Scriptable> result = target->Execute(funcName->GetValue(), list);
+	ref<Scriptable> result = vm->Invoke(target, funcName->GetValue(), list);
 	if(!result) {
 		throw ScriptException(L"Variable does not exist on object or scope: '"+funcName->GetValue()+L"'");
 	}
@@ -152,6 +162,10 @@ void OpSaveHandler(VM* vm) {
 
 void OpEqualsHandler(VM* vm) {
 	ScriptStack& stack = vm->GetStack();
+	if(stack.Calculate(Ops::OpEquals)) {
+		return;
+	}
+
 	ref<Scriptable> a = stack.Pop();
 	ref<Scriptable> b = stack.Pop();
 	
@@ -167,6 +181,10 @@ void OpEqualsHandler(VM* vm) {
 
 void OpNegateHandler(VM* vm) {
 	ScriptStack& stack = vm->GetStack();
+	if(stack.Negate()) {
+		return;
+	}
+
 	ref<Scriptable> a = stack.Pop();
 	
 	if(a.IsCastableTo<ScriptAny>()) {
@@ -182,6 +200,10 @@ void OpNegateHandler(VM* vm) {
 
 void OpAddHandler(VM* vm) {
 	ScriptStack& stack = vm->GetStack();
+	if(stack.Calculate(Ops::OpAdd)) {
+		return;
+	}
+
 	ref<Scriptable> a = stack.Pop();
 	ref<Scriptable> b = stack.Pop();
 
@@ -199,6 +221,10 @@ void OpAddHandler(VM* vm) {
 
 void OpSubHandler(VM* vm) {
 	ScriptStack& stack = vm->GetStack();
+	if(stack.Calculate(Ops::OpSub)) {
+		return;
+	}
+
 	ref<Scriptable> a = stack.Pop();
 	ref<Scriptable> b = stack.Pop();
 	
@@ -216,6 +242,10 @@ void OpSubHandler(VM* vm) {
 
 void OpMulHandler(VM* vm) {
 	ScriptStack& stack = vm->GetStack();
+	if(stack.Calculate(Ops::OpMul)) {
+		return;
+	}
+
 	ref<Scriptable> a = stack.Pop();
 	ref<Scriptable> b = stack.Pop();
 	
@@ -233,6 +263,10 @@ void OpMulHandler(VM* vm) {
 
 void OpDivHandler(VM* vm) {
 	ScriptStack& stack = vm->GetStack();
+	if(stack.Calculate(Ops::OpDiv)) {
+		return;
+	}
+
 	ref<Scriptable> a = stack.Pop();
 	ref<Scriptable> b = stack.Pop();
 	
@@ -249,21 +283,15 @@ void OpDivHandler(VM* vm) {
 }
 
 void OpAndHandler(VM* vm) {
-	ref<Scriptable> a = vm->GetStack().Pop();
-	ref<Scriptable> b = vm->GetStack().Pop();
-
-	bool ba = ScriptContext::GetValue<bool>(a, false);
-	bool bb = ScriptContext::GetValue<bool>(b, false);
+	bool ba = vm->GetStack().PopBool();
+	bool bb = vm->GetStack().PopBool();
 
 	vm->GetStack().Push((ba&&bb) ? ScriptConstants::True : ScriptConstants::False);
 }
 
 void OpOrHandler(VM* vm) {
-	ref<Scriptable> a = vm->GetStack().Pop();
-	ref<Scriptable> b = vm->GetStack().Pop();
-
-	bool ba = ScriptContext::GetValue<bool>(a, false);
-	bool bb = ScriptContext::GetValue<bool>(b, false);
+	bool ba = vm->GetStack().PopBool();
+	bool bb = vm->GetStack().PopBool();
 
 	vm->GetStack().Push((ba||bb) ? ScriptConstants::True : ScriptConstants::False);
 }
@@ -272,9 +300,8 @@ void OpBranchIfHandler(VM* vm) {
 	ScriptStack& stack = vm->GetStack();
 	StackFrame* frame = vm->GetStackFrame();
 	int  scriptlet = frame->_scriptlet->Get<int>(frame->_pc);
-	ref<Scriptable> top = stack.Top();
 	
-	bool r = ScriptContext::GetValue<bool>(top, false);
+	bool r = stack.TopBool();
 	if(r) {
 		vm->Call(scriptlet);
 	}
@@ -322,6 +349,10 @@ void OpEndScriptletHandler(VM* vm) {
 
 void OpGreaterThanHandler(VM* vm) {
 	ScriptStack& stack = vm->GetStack();
+	if(stack.Calculate(Ops::OpGreaterThan)) {
+		return;
+	}
+
 	ref<Scriptable> a = stack.Pop();
 	ref<Scriptable> b = stack.Pop();
 	
@@ -339,6 +370,10 @@ void OpGreaterThanHandler(VM* vm) {
 
 void OpLessThanHandler(VM* vm) {
 	ScriptStack& stack = vm->GetStack();
+	if(stack.Calculate(Ops::OpLessThan)) {
+		return;
+	}
+
 	ref<Scriptable> a = stack.Pop();
 	ref<Scriptable> b = stack.Pop();
 	
@@ -355,11 +390,8 @@ void OpLessThanHandler(VM* vm) {
 }
 
 void OpXorHandler(VM* vm) {
-	ref<Scriptable> a = vm->GetStack().Pop();
-	ref<Scriptable> b = vm->GetStack().Pop();
-
-	bool ba = ScriptContext::GetValue<bool>(a, false);
-	bool bb = ScriptContext::GetValue<bool>(b, false);
+	bool ba = vm->GetStack().PopBool();
+	bool bb = vm->GetStack().PopBool();
 	bool result = ((ba||bb) && !(ba==bb));
 	vm->GetStack().Push(result ? ScriptConstants::True : ScriptConstants::False);
 }
@@ -375,7 +407,7 @@ void OpIndexHandler(VM* vm) {
 
 	ref<ParameterList> pl = GC::Hold(new ParameterList());
 	pl->Set(L"key", index);
-	ref<Scriptable> result = object->Execute(L"get", pl);
+	ref<Scriptable> result = vm->Invoke(object, L"get", pl);
 	if(result==0) {
 		throw ScriptException(L"Object does not support get(key=...) method, array index cannot be used");
 	}
@@ -392,7 +424,7 @@ void OpIterateHandler(VM* vm) {
 	int mypc = frame->_pc; // previous instruction
 	int scriptlet = frame->_scriptlet->Get<int>(frame->_pc);
 	
-	ref<Scriptable> value = iterable->Execute(L"next", 0);
+	ref<Scriptable> value = vm->Invoke(iterable, L"next", 0);
 	if(value==0) {
 		throw ScriptException(L"Object does not support iteration");
 	}
@@ -453,6 +485,37 @@ L"OpMul", L"OpDiv", L"OpAnd",L"OpOr", L"OpBranchIf", L"OpParameter", L"OpNameles
 L"OpLoadScriptlet", L"OpReturn", L"OpReturnValue", L"OpGreaterThan", L"OpLessThan", L"OpXor",
 L"OpBreak", L"OpIndex", L"OpIterate", L"OpPushDelegate", L"OpSetField", L"OpAddToArray", L"OpPushArray", L"OpType", L"OpEndScriptlet" };
 
+const wchar_t* Ops::TranslatedNames[Ops::_OpLastTranslated - Ops::_OpLast] = {L"OpPushLiteral", L"OpLoadVariable", L"OpCallGlobalNoArguments",
+L"OpCallNoArguments", L"OpAddLiteral", L"OpSubLiteral", L"OpMulLiteral", L"OpDivLiteral", L"OpGreaterThanLiteral", L"OpLessThanLiteral", L"OpEqualsLiteral" };
+
+const wchar_t* Ops::GetName(int code) {
+	if(code>=0 && code<_OpLast) {
+		return Names[code];
+	}
+	else if(code>=_OpLast && code<_OpLastTranslated) {
+		return TranslatedNames[code - _OpLast];
+	}
+	return L"(invalid)";
+}
+
+unsigned int Ops::GetOperandSize(int code) {
+	switch(code) {
+		case OpPushString:
+		case OpPushDouble:
+		case OpPushInt:
+		case OpPushDelegate:
+			return sizeof(LiteralIdentifier);
+
+		case OpBranchIf:
+		case OpLoadScriptlet:
+		case OpIterate:
+			return sizeof(int);
+
+		default:
+			return 0;
+	}
+}
+
 Ops::OpHandler Ops::Handlers[Ops::_OpLast] = {OpNopHandler,OpPushStringHandler,OpPushDoubleHandler,
 OpPushTrueHandler, OpPushFalseHandler,OpPushIntHandler, OpPushNullHandler, OpPopHandler,OpCallHandler,OpCallGlobalHandler,OpNewHandler,
 OpSaveHandler,OpEqualsHandler,OpNegateHandler,OpAddHandler,OpSubHandler,
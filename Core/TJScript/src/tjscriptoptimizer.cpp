@@ -0,0 +1,658 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #include "../include/internal/tjscript.h"
+using namespace tj::shared;
+using namespace tj::script;
+
+namespace tj {
+	namespace script {
+		namespace optimizer {
+			const static unsigned int KMaximumPasses = 16;
+
+			static inline bool IsBinaryOperation(int op) {
+				switch(op) {
+					case Ops::OpEquals:
+					case Ops::OpAdd:
+					case Ops::OpSub:
+					case Ops::OpMul:
+					case Ops::OpDiv:
+					case Ops::OpAnd:
+					case Ops::OpOr:
+					case Ops::OpGreaterThan:
+					case Ops::OpLessThan:
+					case Ops::OpXor:
+						return true;
+
+					default:
+						return false;
+				}
+			}
+
+			/** Returns true if the op only pushes a value, without any other effects **/
+			static inline bool IsPush(int op) {
+				switch(op) {
+					case Ops::OpPushString:
+					case Ops::OpPushDouble:
+					case Ops::OpPushInt:
+					case Ops::OpPushTrue:
+					case Ops::OpPushFalse:
+					case Ops::OpPushNull:
+					case Ops::OpPushDelegate:
+					case Ops::OpPushParameter:
+					case Ops::OpPushArray:
+					case Ops::OpLoadScriptlet:
+						return true;
+
+					default:
+						return false;
+				}
+			}
+
+			static inline bool IsLiteral(int op) {
+				return op==Ops::OpPushString || op==Ops::OpPushDouble || op==Ops::OpPushInt || op==Ops::OpPushDelegate;
+			}
+
+			static inline bool IsScriptletReference(int op) {
+				return op==Ops::OpBranchIf || op==Ops::OpIterate || op==Ops::OpLoadScriptlet;
+			}
+
+			static inline bool GetBool(ref<Scriptable> value) {
+				return ScriptContext::GetValue<bool>(value, false);
+			}
+
+			/** Does what OpNegateHandler does **/
+			static ref<Scriptable> Negate(ref<Scriptable> a) {
+				if(a.IsCastableTo<ScriptAny>()) {
+					return GC::Hold(new ScriptAnyValue(-(ref<ScriptAny>(a)->Unbox())));
+				}
+				return ScriptConstants::Null;
+			}
+
+			/** Does what the handler of the given binary operation does (b is the left-hand operand). Returns null if
+			the operation should be left to run time. **/
+			static ref<Scriptable> Evaluate(int op, ref<Scriptable> b, ref<Scriptable> a) {
+				if(op==Ops::OpAnd || op==Ops::OpOr || op==Ops::OpXor) {
+					bool ba = GetBool(a);
+					bool bb = GetBool(b);
+					bool result = false;
+					switch(op) {
+						case Ops::OpAnd:
+							result = ba && bb;
+							break;
+
+						case Ops::OpOr:
+							result = ba || bb;
+							break;
+
+						default:
+							result = (ba||bb) && !(ba==bb);
+							break;
+					}
+					return result ? ScriptConstants::True : ScriptConstants::False;
+				}
+
+				if(!a.IsCastableTo<ScriptAny>() || !b.IsCastableTo<ScriptAny>()) {
+					return ScriptConstants::Null;
+				}
+
+				Any aa = ref<ScriptAny>(a)->Unbox();
+				Any ab = ref<ScriptAny>(b)->Unbox();
+				Any result;
+				switch(op) {
+					case Ops::OpEquals:
+						return (aa==ab) ? ScriptConstants::True : ScriptConstants::False;
+
+					case Ops::OpGreaterThan:
+						return (ab > aa) ? ScriptConstants::True : ScriptConstants::False;
+
+					case Ops::OpLessThan:
+						return (ab < aa) ? ScriptConstants::True : ScriptConstants::False;
+
+					case Ops::OpAdd:
+						result = ab+aa;
+						break;
+
+					case Ops::OpSub:
+						result = ab-aa;
+						break;
+
+					case Ops::OpMul:
+						result = aa*ab;
+						break;
+
+					case Ops::OpDiv:
+						// Integer division by zero (or of the smallest integer by -1) is left to fail at run time
+						if(aa.GetType()==Any::TypeInteger && (int(aa)==0 || int(aa)==-1)) {
+							return null;
+						}
+						result = ab/aa;
+						break;
+
+					default:
+						return null;
+				}
+
+				return GC::Hold(new ScriptAnyValue(result));
+			}
+
+			/** Stack used by ScriptOptimizer::Verify to keep track of the number of values on the stack, and which of
+			them are parameter lists (OpCall, OpCallGlobal and OpNew only pop a parameter list if there is one) **/
+			class VerifierStack {
+				public:
+					inline bool Pop(unsigned int n = 1) {
+						if(_values.size() < n) {
+							return false;
+						}
+						_values.resize(_values.size()-n);
+						return true;
+					}
+
+					inline void Push(bool isParameterList = false) {
+						_values.push_back(isParameterList);
+					}
+
+					inline bool PopParameterList() {
+						if(!_values.empty() && _values.back()) {
+							_values.pop_back();
+						}
+						return true;
+					}
+
+					inline unsigned int GetSize() const {
+						return (unsigned int)_values.size();
+					}
+
+				protected:
+					std::vector<bool> _values;
+			};
+		}
+	}
+}
+
+ScriptOptimizationStatistics::ScriptOptimizationStatistics(): _instructionsBefore(0), _instructionsAfter(0), _scriptletsBefore(0), _scriptletsAfter(0), _foldedConstants(0), _eliminatedBranches(0), _removedInstructions(0), _verifiedScriptlets(0), _time(0.0) {
+}
+
+void ScriptOptimizationStatistics::Add(const ScriptOptimizationStatistics& other) {
+	_instructionsBefore += other._instructionsBefore;
+	_instructionsAfter += other._instructionsAfter;
+	_scriptletsBefore += other._scriptletsBefore;
+	_scriptletsAfter += other._scriptletsAfter;
+	_foldedConstants += other._foldedConstants;
+	_eliminatedBranches += other._eliminatedBranches;
+	_removedInstructions += other._removedInstructions;
+	_verifiedScriptlets += other._verifiedScriptlets;
+	_time += other._time;
+}
+
+ScriptOptimizer::Instruction::Instruction(int op, int operand): _op(op), _operand(operand) {
+}
+
+ScriptOptimizer::ScriptOptimizer(CompiledScript* script, ScriptOptimizationStatistics& stats): _script(script), _stats(stats) {
+}
+
+ScriptOptimizer::~ScriptOptimizer() {
+}
+
+void ScriptOptimizer::Optimize() {
+	Timestamp start(true);
+	_stats = ScriptOptimizationStatistics();
+
+	Decode();
+	for(unsigned int pass=0;pass<optimizer::KMaximumPasses;pass++) {
+		bool changed = false;
+		for(unsigned int s=0;s<_code.size();s++) {
+			changed = FoldConstants(s) || changed;
+			changed = EliminateBranches(s) || changed;
+			changed = RemovePushPop(s) || changed;
+		}
+
+		if(!changed) {
+			break;
+		}
+	}
+	RemoveUnusedScriptlets();
+	Encode();
+
+	// Verify the result, and optimize the scripts of delegates
+	unsigned int scriptletCount = (unsigned int)_script->_scriptlets.size();
+	for(unsigned int s=0;s<scriptletCount;s++) {
+		ref<Scriptlet> scriptlet = _script->_scriptlets[s];
+		scriptlet->_verified = Verify(*(scriptlet.GetPointer()), scriptletCount);
+		if(scriptlet->_verified) {
+			++(_stats._verifiedScriptlets);
+		}
+		else {
+			Log::Write(L"TJScript/Optimizer", L"Scriptlet "+Stringify(s)+L" could not be verified");
+		}
+
+		const Code& code = _code[s];
+		for(unsigned int a=0;a<code.size();a++) {
+			if(code[a]._op==Ops::OpPushDelegate) {
+				ref<Scriptable> literal = scriptlet->GetLiteral(code[a]._operand);
+				if(literal.IsCastableTo<ScriptDelegate>()) {
+					ref<CompiledScript> delegateScript = ref<ScriptDelegate>(literal)->GetScript();
+					if(delegateScript) {
+						delegateScript->Optimize();
+						_stats.Add(delegateScript->GetOptimizationStatistics());
+					}
+				}
+			}
+		}
+	}
+
+	_stats._time = Timestamp(true).Difference(start).ToMilliSeconds();
+}
+
+void ScriptOptimizer::Decode() {
+	_code.clear();
+	_code.resize(_script->_scriptlets.size());
+	_stats._scriptletsBefore += (unsigned int)_code.size();
+
+	for(unsigned int s=0;s<_code.size();s++) {
+		ref<Scriptlet> scriptlet = _script->_scriptlets[s];
+		Code& code = _code[s];
+		unsigned int pc = 0;
+		while(pc < scriptlet->_used) {
+			Instruction ins(scriptlet->Get<int>(pc));
+			if(ins._op<0 || ins._op>=Ops::_OpLast) {
+				Throw(L"Invalid instruction found while optimizing scriptlet", ExceptionTypeError);
+			}
+
+			if(Ops::GetOperandSize(ins._op)>0) {
+				ins._operand = scriptlet->Get<int>(pc);
+			}
+			code.push_back(ins);
+		}
+		_stats._instructionsBefore += (unsigned int)code.size();
+	}
+}
+
+void ScriptOptimizer::Encode() {
+	_stats._scriptletsAfter += (unsigned int)_code.size();
+
+	for(unsigned int s=0;s<_code.size();s++) {
+		ref<Scriptlet> scriptlet = _script->_scriptlets[s];
+		const Code& code = _code[s];
+		scriptlet->_used = 0;
+
+		for(unsigned int a=0;a<code.size();a++) {
+			scriptlet->Add<int>(code[a]._op);
+			if(Ops::GetOperandSize(code[a]._op)>0) {
+				scriptlet->Add<int>(code[a]._operand);
+			}
+		}
+		_stats._instructionsAfter += (unsigned int)code.size();
+	}
+}
+
+bool ScriptOptimizer::GetConstant(unsigned int s, const Instruction& ins, ref<Scriptable>& value) {
+	switch(ins._op) {
+		case Ops::OpPushTrue:
+			value = ScriptConstants::True;
+			return true;
+
+		case Ops::OpPushFalse:
+			value = ScriptConstants::False;
+			return true;
+
+		case Ops::OpPushNull:
+			value = ScriptConstants::Null;
+			return true;
+
+		case Ops::OpPushString:
+		case Ops::OpPushDouble:
+		case Ops::OpPushInt:
+			value = _script->_scriptlets[s]->GetLiteral(ins._operand);
+			return value.IsCastableTo<ScriptAny>();
+
+		default:
+			return false;
+	}
+}
+
+/** Returns an instruction that pushes the given value. Literals are stored in the scriptlet; OpPushInt and
+OpPushDouble push any literal, the op is only chosen to make the byte code easier to read. **/
+ScriptOptimizer::Instruction ScriptOptimizer::PushConstant(unsigned int s, ref<Scriptable> value) {
+	if(value==ScriptConstants::True) {
+		return Instruction(Ops::OpPushTrue);
+	}
+	else if(value==ScriptConstants::False) {
+		return Instruction(Ops::OpPushFalse);
+	}
+	else if(value==ScriptConstants::Null) {
+		return Instruction(Ops::OpPushNull);
+	}
+
+	bool isInteger = ref<ScriptAny>(value)->Unbox().GetType()==Any::TypeInteger;
+	LiteralIdentifier li = _script->_scriptlets[s]->StoreLiteral(value);
+	return Instruction(isInteger ? Ops::OpPushInt : Ops::OpPushDouble, (int)li);
+}
+
+bool ScriptOptimizer::FoldConstants(unsigned int s) {
+	Code& code = _code[s];
+	Code result;
+	bool changed = false;
+
+	for(unsigned int a=0;a<code.size();a++) {
+		result.push_back(code[a]);
+
+		// Fold as long as the end of the result is an operation on constants, so that 1+2+3 is folded in one go
+		while(true) {
+			unsigned int n = (unsigned int)result.size();
+			ref<Scriptable> left, right, folded;
+
+			if(n>=3 && optimizer::IsBinaryOperation(result[n-1]._op) && GetConstant(s, result[n-3], left) && GetConstant(s, result[n-2], right)) {
+				folded = optimizer::Evaluate(result[n-1]._op, left, right);
+				if(folded) {
+					result.resize(n-3);
+				}
+			}
+			else if(n>=2 && result[n-1]._op==Ops::OpNegate && GetConstant(s, result[n-2], right)) {
+				folded = optimizer::Negate(right);
+				result.resize(n-2);
+			}
+
+			if(!folded) {
+				break;
+			}
+
+			result.push_back(PushConstant(s, folded));
+			++(_stats._foldedConstants);
+			changed = true;
+		}
+	}
+
+	if(changed) {
+		code = result;
+	}
+	return changed;
+}
+
+bool ScriptOptimizer::IsEmptyScriptlet(int index) const {
+	if(index<0 || index>=(int)_code.size()) {
+		return false;
+	}
+
+	ref<Scriptlet> scriptlet = _script->_scriptlets[index];
+	const Code& code = _code[index];
+	return !scriptlet->IsFunction() && !scriptlet->IsLoop() && code.size()==1 && code[0]._op==Ops::OpEndScriptlet;
+}
+
+/** An if-statement is compiled to [condition] OpBranchIf <if> (OpNegate OpBranchIf <else>) OpPop; the condition stays on
+the stack while the branches run. **/
+bool ScriptOptimizer::EliminateBranches(unsigned int s) {
+	Code& code = _code[s];
+	Code result;
+	bool changed = false;
+	unsigned int n = (unsigned int)code.size();
+
+	for(unsigned int a=0;a<n;a++) {
+		const Instruction& ins = code[a];
+
+		// Branches to scriptlets that do nothing can be removed (OpBranchIf does not pop the condition)
+		if(ins._op==Ops::OpBranchIf && IsEmptyScriptlet(ins._operand)) {
+			++(_stats._eliminatedBranches);
+			changed = true;
+			continue;
+		}
+
+		ref<Scriptable> condition;
+		if(a+2<n && code[a+1]._op==Ops::OpBranchIf && GetConstant(s, ins, condition)) {
+			bool hasElse = (a+4<n) && code[a+2]._op==Ops::OpNegate && code[a+3]._op==Ops::OpBranchIf;
+			unsigned int end = hasElse ? (a+4) : (a+2);
+
+			if(code[end]._op==Ops::OpPop) {
+				bool runIf = optimizer::GetBool(condition);
+				bool runElse = hasElse && optimizer::GetBool(optimizer::Negate(condition));
+				unsigned int eliminated = (runIf ? 0 : 1) + ((hasElse && !runElse) ? 1 : 0);
+
+				if(eliminated>0 || ins._op!=Ops::OpPushTrue) {
+					if(runIf || runElse) {
+						result.push_back(Instruction(Ops::OpPushTrue));
+						if(runIf) {
+							result.push_back(code[a+1]);
+						}
+						if(runElse) {
+							result.push_back(code[a+3]);
+						}
+						result.push_back(Instruction(Ops::OpPop));
+					}
+
+					_stats._eliminatedBranches += eliminated;
+					changed = true;
+					a = end;
+					continue;
+				}
+			}
+		}
+
+		result.push_back(ins);
+	}
+
+	if(changed) {
+		code = result;
+	}
+	return changed;
+}
+
+bool ScriptOptimizer::RemovePushPop(unsigned int s) {
+	Code& code = _code[s];
+	Code result;
+	bool changed = false;
+
+	for(unsigned int a=0;a<code.size();a++) {
+		if(code[a]._op==Ops::OpNop) {
+			++(_stats._removedInstructions);
+			changed = true;
+			continue;
+		}
+
+		result.push_back(code[a]);
+
+		while(result.size()>=2 && result.back()._op==Ops::OpPop) {
+			int previous = result[result.size()-2]._op;
+			if(optimizer::IsPush(previous)) {
+				// [value] OpPop => nothing
+				result.resize(result.size()-2);
+				_stats._removedInstructions += 2;
+			}
+			else if(previous==Ops::OpNegate) {
+				// OpNegate OpPop => OpPop
+				result.erase(result.end()-2);
+				++(_stats._removedInstructions);
+			}
+			else {
+				break;
+			}
+			changed = true;
+		}
+	}
+
+	if(changed) {
+		code = result;
+	}
+	return changed;
+}
+
+void ScriptOptimizer::RemoveUnusedScriptlets() {
+	if(_code.empty()) {
+		return;
+	}
+
+	// Find the scriptlets that can be reached from the main scriptlet
+	std::vector<bool> used(_code.size(), false);
+	std::deque<unsigned int> todo;
+	used[0] = true;
+	todo.push_back(0);
+
+	while(!todo.empty()) {
+		const Code& code = _code[todo.front()];
+		todo.pop_front();
+
+		for(unsigned int a=0;a<code.size();a++) {
+			int target = code[a]._operand;
+			if(optimizer::IsScriptletReference(code[a]._op) && target>=0 && target<(int)_code.size() && !used[target]) {
+				used[target] = true;
+				todo.push_back((unsigned int)target);
+			}
+		}
+	}
+
+	std::vector<int> newIndex(_code.size(), -1);
+	std::vector< ref<Scriptlet> > scriptlets;
+	std::vector<Code> codes;
+	for(unsigned int s=0;s<_code.size();s++) {
+		if(used[s]) {
+			newIndex[s] = (int)scriptlets.size();
+			scriptlets.push_back(_script->_scriptlets[s]);
+			codes.push_back(_code[s]);
+		}
+	}
+
+	if(scriptlets.size()==_code.size()) {
+		return;
+	}
+
+	for(unsigned int s=0;s<codes.size();s++) {
+		Code& code = codes[s];
+		for(unsigned int a=0;a<code.size();a++) {
+			if(optimizer::IsScriptletReference(code[a]._op)) {
+				code[a]._operand = newIndex[code[a]._operand];
+			}
+		}
+	}
+
+	_script->_scriptlets = scriptlets;
+	_code = codes;
+}
+
+bool ScriptOptimizer::Verify(const Scriptlet& scriptlet, unsigned int scriptletCount) {
+	optimizer::VerifierStack stack;
+	unsigned int pc = 0;
+	int op = Ops::OpNop;
+
+	while(pc < scriptlet._used) {
+		if(pc+sizeof(int) > scriptlet._used) {
+			return false;
+		}
+
+		op = scriptlet.Get<int>(pc);
+		if(op<0 || op>=Ops::_OpLast) {
+			return false;
+		}
+
+		unsigned int operandSize = Ops::GetOperandSize(op);
+		if(pc+operandSize > scriptlet._used) {
+			return false;
+		}
+
+		if(operandSize>0) {
+			int operand = scriptlet.Get<int>(pc);
+			if(optimizer::IsLiteral(op) && (operand<0 || operand>=(int)scriptlet._literals.size())) {
+				return false;
+			}
+			else if(optimizer::IsScriptletReference(op) && (operand<0 || operand>=(int)scriptletCount)) {
+				return false;
+			}
+		}
+
+		bool ok = true;
+		switch(op) {
+			case Ops::OpNop:
+			case Ops::OpReturn:
+			case Ops::OpBreak:
+				break;
+
+			case Ops::OpPushString:
+			case Ops::OpPushDouble:
+			case Ops::OpPushTrue:
+			case Ops::OpPushFalse:
+			case Ops::OpPushInt:
+			case Ops::OpPushNull:
+			case Ops::OpLoadScriptlet:
+			case Ops::OpPushDelegate:
+			case Ops::OpPushArray:
+				stack.Push();
+				break;
+
+			case Ops::OpPushParameter:
+				stack.Push(true);
+				break;
+
+			case Ops::OpPop:
+			case Ops::OpReturnValue:
+				ok = stack.Pop(1);
+				break;
+
+			case Ops::OpCall:
+				ok = stack.PopParameterList() && stack.Pop(2);
+				stack.Push();
+				break;
+
+			case Ops::OpCallGlobal:
+			case Ops::OpNew:
+				ok = stack.PopParameterList() && stack.Pop(1);
+				stack.Push();
+				break;
+
+			case Ops::OpSave:
+			case Ops::OpIterate:
+				ok = stack.Pop(2);
+				break;
+
+			case Ops::OpNegate:
+			case Ops::OpType:
+				ok = stack.Pop(1);
+				stack.Push();
+				break;
+
+			case Ops::OpBranchIf:
+				ok = stack.GetSize()>=1;
+				break;
+
+			case Ops::OpParameter:
+				ok = stack.Pop(3);
+				stack.Push(true);
+				break;
+
+			case Ops::OpNamelessParameter:
+				ok = stack.Pop(2);
+				stack.Push(true);
+				break;
+
+			case Ops::OpSetField:
+				ok = stack.Pop(3);
+				stack.Push();
+				break;
+
+			case Ops::OpEndScriptlet:
+				ok = stack.GetSize()==0;
+				break;
+
+			default:
+				// Binary operations, OpIndex and OpAddToArray
+				ok = stack.Pop(2);
+				stack.Push();
+				break;
+		}
+
+		if(!ok) {
+			return false;
+		}
+	}
+
+	// The last instruction has to leave the scriptlet, otherwise the VM would run past its end
+	return op==Ops::OpEndScriptlet || op==Ops::OpReturn || op==Ops::OpReturnValue;
+}
@@ -0,0 +1,236 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #include "../include/internal/tjscript.h"
+#include <algorithm>
+#include <typeinfo>
+#include <stdio.h>
+
+#ifdef __GNUC__
+	#include <cxxabi.h>
+	#include <stdlib.h>
+#endif
+
+using namespace tj::shared;
+using namespace tj::script;
+
+namespace tj {
+	namespace script {
+		namespace profiler {
+			typedef std::pair<std::wstring, ScriptProfileEntry> NamedEntry;
+
+			static bool IsMoreExpensive(const NamedEntry& a, const NamedEntry& b) {
+				return a.second._time > b.second._time;
+			}
+
+			static bool IsMoreFrequent(const std::pair<std::wstring, unsigned int>& a, const std::pair<std::wstring, unsigned int>& b) {
+				return a.second > b.second;
+			}
+
+			/** Returns a readable name for a type (type_info::name returns a mangled name under GCC) **/
+			static std::wstring GetTypeName(const std::type_info& type) {
+				#ifdef __GNUC__
+					int status = 0;
+					char* demangled = abi::__cxa_demangle(type.name(), 0, 0, &status);
+					if(demangled!=0) {
+						std::wstring name = Wcs(std::string(demangled));
+						free(demangled);
+						return name;
+					}
+					return Wcs(std::string(type.name()));
+				#else
+					std::wstring name = Wcs(std::string(type.name()));
+					if(name.compare(0, 6, L"class ")==0) {
+						return name.substr(6);
+					}
+					else if(name.compare(0, 7, L"struct ")==0) {
+						return name.substr(7);
+					}
+					return name;
+				#endif
+			}
+
+			static void AddEntries(std::wostringstream& wos, const std::wstring& title, const std::map<std::wstring, ScriptProfileEntry>& entries, unsigned int maximumLines) {
+				std::vector<NamedEntry> sorted(entries.begin(), entries.end());
+				std::sort(sorted.begin(), sorted.end(), IsMoreExpensive);
+
+				wos << title << L" (" << (unsigned int)sorted.size() << L"):\r\n";
+				for(unsigned int a=0;a<sorted.size() && a<maximumLines;a++) {
+					const NamedEntry& entry = sorted[a];
+					wos << L"\t" << double(entry.second._time) << L"ms\t" << entry.second._calls << L" calls\t" << entry.first << L"\r\n";
+				}
+			}
+		}
+	}
+}
+
+/** ScriptProfileEntry **/
+ScriptProfileEntry::ScriptProfileEntry(): _calls(0), _time(0.0) {
+}
+
+void ScriptProfileEntry::Add(const ScriptProfileEntry& other) {
+	_calls += other._calls;
+	_time += other._time;
+}
+
+/** ScriptProfileData **/
+ScriptProfileData::ScriptProfileData() {
+	Clear();
+}
+
+void ScriptProfileData::Clear() {
+	_ops.assign(Ops::_OpLast, 0);
+	_scriptlets.clear();
+	_natives.clear();
+	_samples.clear();
+}
+
+/** ScriptProfiler **/
+ScriptProfiler::ScriptProfiler(int sampleInterval): _sampleInterval(KDefaultSampleInterval), _started(true) {
+	SetSampleInterval(sampleInterval);
+}
+
+ScriptProfiler::~ScriptProfiler() {
+}
+
+void ScriptProfiler::SetSampleInterval(int ms) {
+	ThreadLock lock(&_lock);
+	_sampleInterval = Util::Max(1, ms);
+}
+
+int ScriptProfiler::GetSampleInterval() const {
+	ThreadLock lock(&_lock);
+	return _sampleInterval;
+}
+
+void ScriptProfiler::Reset() {
+	ThreadLock lock(&_lock);
+	_data.Clear();
+	_started = Timestamp(true);
+}
+
+void ScriptProfiler::Merge(const ScriptProfileData& data) {
+	ThreadLock lock(&_lock);
+	for(unsigned int a=0;a<data._ops.size() && a<_data._ops.size();a++) {
+		_data._ops[a] += data._ops[a];
+	}
+
+	std::map<std::wstring, ScriptProfileEntry>::const_iterator it = data._scriptlets.begin();
+	while(it!=data._scriptlets.end()) {
+		_data._scriptlets[it->first].Add(it->second);
+		++it;
+	}
+
+	it = data._natives.begin();
+	while(it!=data._natives.end()) {
+		_data._natives[it->first].Add(it->second);
+		++it;
+	}
+
+	std::map<std::wstring, unsigned int>::const_iterator sit = data._samples.begin();
+	while(sit!=data._samples.end()) {
+		_data._samples[sit->first] += sit->second;
+		++sit;
+	}
+}
+
+std::wstring ScriptProfiler::GetScriptletName(ref<CompiledScript> script, int scriptlet) {
+	std::wstring name = L"script";
+	if(script && script->GetName().length()>0) {
+		name = script->GetName();
+	}
+
+	// Frames are separated by ';' in the folded stack format
+	std::replace(name.begin(), name.end(), L';', L',');
+
+	if(scriptlet==0) {
+		return name;
+	}
+
+	ref<Scriptlet> s = script->GetScriptlet(scriptlet);
+	if(s->IsFunction()) {
+		return name + L"/function " + Stringify(scriptlet);
+	}
+	else if(s->IsLoop()) {
+		return name + L"/loop " + Stringify(scriptlet);
+	}
+	return name + L"/block " + Stringify(scriptlet);
+}
+
+/** Returns the name under which calls to a native member are recorded. Calls on a scope are shown as
+'scope.member' (the scope does not tell which object in the chain handled the call). **/
+std::wstring ScriptProfiler::GetNativeName(ref<Scriptable> target, const std::wstring& member) {
+	if(!target) {
+		return L"null." + member;
+	}
+	else if(target.IsCastableTo<ScriptScope>()) {
+		return L"scope." + member;
+	}
+	return profiler::GetTypeName(typeid(*(target.GetPointer()))) + L"." + member;
+}
+
+std::wstring ScriptProfiler::GetFoldedStacks() const {
+	ThreadLock lock(&_lock);
+	std::wostringstream wos;
+	std::map<std::wstring, unsigned int>::const_iterator it = _data._samples.begin();
+	while(it!=_data._samples.end()) {
+		wos << it->first << L" " << it->second << L"\n";
+		++it;
+	}
+	return wos.str();
+}
+
+bool ScriptProfiler::WriteFoldedStacks(const std::wstring& path) const {
+	std::string data = Mbs(GetFoldedStacks());
+
+	#ifdef TJ_OS_WIN
+		FILE* fp = _wfopen(path.c_str(), L"wb");
+	#else
+		FILE* fp = fopen(Mbs(path).c_str(), "wb");
+	#endif
+
+	if(fp==NULL) {
+		return false;
+	}
+
+	bool ok = fwrite(data.c_str(), 1, data.length(), fp)==data.length();
+	ok = (fclose(fp)==0) && ok;
+	return ok;
+}
+
+std::wstring ScriptProfiler::GetReport(unsigned int maximumLines) const {
+	ThreadLock lock(&_lock);
+	std::wostringstream wos;
+	wos << L"Profile of " << double(Timestamp(true).Difference(_started).ToMilliSeconds()) << L"ms\r\n";
+	profiler::AddEntries(wos, L"Scriptlets", _data._scriptlets, maximumLines);
+	profiler::AddEntries(wos, L"Native calls", _data._natives, maximumLines);
+
+	std::vector< std::pair<std::wstring, unsigned int> > ops;
+	for(unsigned int a=0;a<_data._ops.size();a++) {
+		if(_data._ops[a]>0) {
+			ops.push_back(std::pair<std::wstring, unsigned int>(Ops::GetName(a), _data._ops[a]));
+		}
+	}
+	std::sort(ops.begin(), ops.end(), profiler::IsMoreFrequent);
+
+	wos << L"Ops (" << (unsigned int)ops.size() << L"):\r\n";
+	for(unsigned int a=0;a<ops.size() && a<maximumLines;a++) {
+		wos << L"\t" << ops[a].second << L"\t" << ops[a].first << L"\r\n";
+	}
+	return wos.str();
+}
+
+void ScriptProfiler::LogReport() const {
+	Log::Write(L"TJScript/ScriptProfiler", GetReport());
+}
@@ -16,14 +16,34 @@
 using namespace tj::shared;
 using namespace tj::script;
 
-ScriptScope::ScriptScope() {
+namespace tj {
+	namespace script {
+		namespace scope {
+			// Commands that a scope handles itself, instead of looking up a variable with that name
+			static const ScriptSymbol KExistsSymbol = ScriptSymbols::Intern(L"exists");
+			static const ScriptSymbol KValueSymbol = ScriptSymbols::Intern(L"value");
+			static const ScriptSymbol KFutureSymbol = ScriptSymbols::Intern(L"future");
+
+			static inline bool IsCommand(ScriptSymbol s) {
+				return s==KExistsSymbol || s==KValueSymbol || s==KFutureSymbol;
+			}
+		}
+	}
+}
+
+ScriptScope::ScriptScope(bool synchronized): _previousScope(0), _lock(0) {
+	if(synchronized) {
+		_lock = new CriticalSection();
+	}
 }
 
 ScriptScope::~ScriptScope() {
+	delete _lock;
 }
 
 void ScriptScope::SetPrevious(ref<Scriptable> p) {
 	_previous = p;
+	_previousScope = p ? dynamic_cast<ScriptScope*>(p.GetPointer()) : 0;
 }
 
 ref<Scriptable> ScriptScope::GetPrevious() {
@@ -31,24 +51,108 @@ ref<Scriptable> ScriptScope::GetPrevious() {
 }
 
 bool ScriptScope::Exists(const std::wstring& key) {
-	return _vars.find(key)!=_vars.end();
+	ScriptSymbol symbol = ScriptSymbols::Find(key);
+	if(symbol==ScriptSymbols::KNoSymbol) {
+		return false;
+	}
+
+	if(_lock!=0) {
+		ThreadLock lock(_lock);
+		return _vars.find(symbol)!=_vars.end();
+	}
+	return _vars.find(symbol)!=_vars.end();
 }
 
 ref<Scriptable> ScriptScope::Get(const std::wstring& key) {
-	std::map<std::wstring, ref<Scriptable> >::iterator it = _vars.find(key);
+	return Get(ScriptSymbols::Find(key));
+}
+
+ref<Scriptable> ScriptScope::Get(ScriptSymbol symbol) {
+	if(_lock!=0) {
+		ThreadLock lock(_lock);
+		std::map<ScriptSymbol, ref<Scriptable> >::iterator it = _vars.find(symbol);
+		if(it!=_vars.end()) {
+			return it->second;
+		}
+		return 0;
+	}
+
+	std::map<ScriptSymbol, ref<Scriptable> >::iterator it = _vars.find(symbol);
 	if(it!=_vars.end()) {
 		return it->second;
 	}
 	return 0;
 }
 
+/** Looks up a variable in this scope and the scopes before it. This does the same as Execute (for names that are not
+one of the commands handled by the scope), but walks the chain of scopes without any virtual calls. The first object
+in the chain that is not a scope is asked for the variable through ExecuteSymbol. **/
+ref<Scriptable> ScriptScope::Lookup(ScriptSymbol symbol, Command name, ref<ParameterList> params) {
+	ScriptScope* scope = this;
+	while(true) {
+		if(symbol!=ScriptSymbols::KNoSymbol) {
+			if(scope->_lock!=0) {
+				ref<Scriptable> value = scope->Get(symbol);
+				if(value) {
+					return value;
+				}
+			}
+			else {
+				std::map<ScriptSymbol, ref<Scriptable> >::iterator it = scope->_vars.find(symbol);
+				if(it!=scope->_vars.end() && it->second) {
+					return it->second;
+				}
+			}
+		}
+
+		if(scope->_previousScope!=0) {
+			scope = scope->_previousScope;
+		}
+		else if(scope->_previous) {
+			return scope->_previous->ExecuteSymbol(symbol, name, params);
+		}
+		else {
+			return ScriptConstants::Null;
+		}
+	}
+}
+
+/** Returns true if a variable is defined in this scope or the scopes (or object) before it. Unlike Lookup, this
+returns false when the chain of scopes ends without an object; otherwise, variables in a context without global
+object would all end up in the (shared) global scope. **/
+bool ScriptScope::IsDefined(ScriptSymbol symbol, Command name) {
+	ScriptScope* scope = this;
+	while(true) {
+		if(symbol!=ScriptSymbols::KNoSymbol && scope->Get(symbol)) {
+			return true;
+		}
+
+		if(scope->_previousScope!=0) {
+			scope = scope->_previousScope;
+		}
+		else if(scope->_previous) {
+			return bool(scope->_previous->ExecuteSymbol(symbol, name, 0));
+		}
+		else {
+			return false;
+		}
+	}
+}
+
+ref<Scriptable> ScriptScope::ExecuteSymbol(ScriptSymbol symbol, Command command, ref<ParameterList> params) {
+	if(scope::IsCommand(symbol)) {
+		return Execute(command, params);
+	}
+	return Lookup(symbol, command, params);
+}
+
 ref<Scriptable> ScriptScope::Execute(Command command, ref<ParameterList> params) {
 	static const Parameter<std::wstring> PVar(L"var",0);
 
 	if(command==L"exists") {
 		std::wstring name = PVar.Require(params,L"");
 
-		bool exists = _vars.find(name)!=_vars.end();
+		bool exists = Exists(name);
 		if(!exists) {
 			if(_previous) {
 				ref<Scriptable> ret = _previous->Execute(command, params);
@@ -94,15 +198,16 @@ ref<Scriptable> ScriptScope::Execute(Command command, ref<ParameterList> params)
 		ref<ScriptFuture> sft = GC::Hold(new ScriptFuture(dlg->GetScript(), dlg->GetContext()));
 
 		// Add variables (possibly as dependencies)
-		std::map<std::wstring, ref<Scriptable> >::iterator it = params->_vars.begin();
+		std::map<ScriptSymbol, ref<Scriptable> >::iterator it = params->_vars.begin();
 		while(it!=params->_vars.end()) {
 			ref<Scriptable> value = it->second;
-			if(value && it->first!=L"0") {
+			const std::wstring& name = ScriptSymbols::GetName(it->first);
+			if(value && name!=L"0") {
 				if(value.IsCastableTo<ScriptFuture>()) {
-					sft->AddDependency(it->first, ref<ScriptFuture>(value));
+					sft->AddDependency(name, ref<ScriptFuture>(value));
 				}
 				else {
-					sft->AddVariable(it->first, it->second);
+					sft->AddVariable(name, it->second);
 				}
 			}
 			++it;
@@ -114,27 +219,25 @@ ref<Scriptable> ScriptScope::Execute(Command command, ref<ParameterList> params)
 		return sft;
 	}
 	else {
-		ref<Scriptable> val = Get(command);
-		if(val) {
-			return val;
-		}
-		else if(_previous) {
-			return _previous->Execute(command, params);
-		}
-		else {
-			return ScriptConstants::Null;
-		}
-
+		return Lookup(ScriptSymbols::Find(command), command, params);
 	}
 }
 
 bool ScriptScope::Set(Field key, ref<Scriptable> value) {
+	return Set(ScriptSymbols::Intern(key), key, value);
+}
+
+bool ScriptScope::Set(ScriptSymbol symbol, Command name, ref<Scriptable> value) {
 	/** If the variable is already defined in the outer scope, update it there */
-	if(_previous && _previous.IsCastableTo<ScriptScope>() && _previous->Execute(key,0)) {
-		ref<ScriptScope>(_previous)->Set(key,value);
+	if(_previousScope!=0 && _previousScope->IsDefined(symbol, name)) {
+		_previousScope->Set(symbol, name, value);
+	}
+	else if(_lock!=0) {
+		ThreadLock lock(_lock);
+		_vars[symbol] = value;
 	}
 	else {
-		_vars[key] = value;
+		_vars[symbol] = value;
 	}
 	return true;
 }
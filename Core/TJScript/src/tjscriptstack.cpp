@@ -16,6 +16,186 @@
 using namespace tj::script;
 using namespace tj::shared;
 
+bool ScriptStackValue::Unbox() {
+	if(_kind!=KindReference) {
+		return true;
+	}
+
+	ScriptAny* any = dynamic_cast<ScriptAny*>(_reference.GetPointer());
+	if(any==0) {
+		return false;
+	}
+
+	Any value = any->Unbox();
+	switch(value.GetType()) {
+		case Any::TypeInteger:
+			_kind = KindInteger;
+			_int = (int)value;
+			return true;
+
+		case Any::TypeDouble:
+			_kind = KindDouble;
+			_double = (double)value;
+			return true;
+
+		case Any::TypeBool:
+			_kind = KindBool;
+			_bool = (bool)value;
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+ref<Scriptable> ScriptStackValue::Box() {
+	if(_kind==KindReference || _reference) {
+		return _reference;
+	}
+
+	if(_kind==KindBool) {
+		_reference = _bool ? ScriptConstants::True : ScriptConstants::False;
+	}
+	else {
+		strong<ScriptAnyValue> sav = Recycler<ScriptAnyValue>::Create();
+		if(_kind==KindInteger) {
+			sav->SetValue(Any(_int));
+		}
+		else {
+			sav->SetValue(Any(_double));
+		}
+		_reference = sav;
+	}
+	return _reference;
+}
+
+bool ScriptStackValue::ToBool() const {
+	switch(_kind) {
+		case KindInteger:
+			return _int==1;
+
+		case KindDouble:
+			return _double!=0.0;
+
+		case KindBool:
+			return _bool;
+
+		default:
+			return false;
+	}
+}
+
+bool ScriptStackValue::Apply(int op, ScriptStackValue& left, const ScriptStackValue& right) {
+	if(op==Ops::OpEquals) {
+		bool equal = false;
+		if(left._kind==right._kind) {
+			switch(left._kind) {
+				case KindInteger:
+					equal = (left._int==right._int);
+					break;
+
+				case KindDouble:
+					equal = (left._double==right._double);
+					break;
+
+				case KindBool:
+					equal = (left._bool==right._bool);
+					break;
+
+				default:
+					return false;
+			}
+		}
+
+		left._kind = KindBool;
+		left._bool = equal;
+		left._reference = 0;
+		return true;
+	}
+
+	// Booleans are not numbers; Any has its own rules for these
+	if(left._kind==KindBool || right._kind==KindBool || left._kind==KindReference || right._kind==KindReference) {
+		return false;
+	}
+
+	if(left._kind==KindInteger && right._kind==KindInteger) {
+		int a = left._int;
+		int b = right._int;
+		switch(op) {
+			case Ops::OpAdd:
+				left._int = a + b;
+				break;
+
+			case Ops::OpSub:
+				left._int = a - b;
+				break;
+
+			case Ops::OpMul:
+				left._int = a * b;
+				break;
+
+			case Ops::OpDiv:
+				left._int = a / b;
+				break;
+
+			case Ops::OpGreaterThan:
+				left._kind = KindBool;
+				left._bool = a > b;
+				break;
+
+			case Ops::OpLessThan:
+				left._kind = KindBool;
+				left._bool = a < b;
+				break;
+
+			default:
+				return false;
+		}
+	}
+	else {
+		// Mixed integer/double operations have a double result
+		double a = (left._kind==KindInteger) ? double(left._int) : left._double;
+		double b = (right._kind==KindInteger) ? double(right._int) : right._double;
+		switch(op) {
+			case Ops::OpAdd:
+				left._kind = KindDouble;
+				left._double = a + b;
+				break;
+
+			case Ops::OpSub:
+				left._kind = KindDouble;
+				left._double = a - b;
+				break;
+
+			case Ops::OpMul:
+				left._kind = KindDouble;
+				left._double = a * b;
+				break;
+
+			case Ops::OpDiv:
+				left._kind = KindDouble;
+				left._double = a / b;
+				break;
+
+			case Ops::OpGreaterThan:
+				left._kind = KindBool;
+				left._bool = a > b;
+				break;
+
+			case Ops::OpLessThan:
+				left._kind = KindBool;
+				left._bool = a < b;
+				break;
+
+			default:
+				return false;
+		}
+	}
+
+	left._reference = 0;
+	return true;
+}
+
 ScriptStack::~ScriptStack() {
 	delete[] _stack;
 }
@@ -25,8 +205,8 @@ ref<Scriptable> ScriptStack::Pop() {
 		throw ScriptException(L"Stack underflow");
 	}
 	
-	ref<Scriptable> last = _stack[_sp];
-	_stack[_sp] = 0;
+	ref<Scriptable> last = _stack[_sp].Box();
+	_stack[_sp].Clear();
 	_sp--;
 	return last;
 }
@@ -38,23 +218,87 @@ void ScriptStack::Pop(int size) {
 		throw ScriptException(L"Stack underflow");
 	}
 
-	_stack[_sp] = 0;
+	_stack[_sp].Clear();
 	_sp = size-1;
 }
 
 void ScriptStack::Clear() {
 	while(_sp>-1) {
-		_stack[_sp] = 0;
+		_stack[_sp].Clear();
 		_sp--;
 	}
 }
 
+bool ScriptStack::Calculate(int op) {
+	if(_sp<1) {
+		throw ScriptException(L"Stack underflow");
+	}
+
+	ScriptStackValue& right = _stack[_sp];
+	ScriptStackValue& left = _stack[_sp-1];
+	if(right.Unbox() && left.Unbox() && ScriptStackValue::Apply(op, left, right)) {
+		Drop();
+		return true;
+	}
+	return false;
+}
+
+bool ScriptStack::Calculate(int op, const ScriptStackValue& right) {
+	if(!right.IsTagged()) {
+		return false;
+	}
+
+	ScriptStackValue& left = TopValue();
+	return left.Unbox() && ScriptStackValue::Apply(op, left, right);
+}
+
+bool ScriptStack::Negate() {
+	ScriptStackValue& value = TopValue();
+	if(!value.Unbox()) {
+		return false;
+	}
+
+	switch(value._kind) {
+		case ScriptStackValue::KindInteger:
+			value._int = -value._int;
+			break;
+
+		case ScriptStackValue::KindDouble:
+			value._double = -value._double;
+			break;
+
+		case ScriptStackValue::KindBool:
+			value._bool = !value._bool;
+			break;
+
+		default:
+			return false;
+	}
+
+	value._reference = 0;
+	return true;
+}
+
+bool ScriptStack::TopBool() {
+	ScriptStackValue& value = TopValue();
+	if(value.IsTagged()) {
+		return value.ToBool();
+	}
+	return ScriptContext::GetValue<bool>(value._reference, false);
+}
+
+bool ScriptStack::PopBool() {
+	bool result = TopBool();
+	Drop();
+	return result;
+}
+
 std::wstring ScriptStack::Dump() {
 	std::wostringstream wos;
 	
 	int msp = _sp;
 	for(;msp>0;msp--) {
-		ref<Scriptable> s = _stack[msp];
+		ref<Scriptable> s = _stack[msp].Box();
 		if(!s) {
 			wos << L"[Nothing]; ";
 		}
@@ -64,4 +308,4 @@ std::wstring ScriptStack::Dump() {
 	}
 
 	return wos.str();
-}
\ No newline at end of file
+}
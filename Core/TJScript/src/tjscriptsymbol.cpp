@@ -0,0 +1,79 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #include "../include/internal/tjscript.h"
+using namespace tj::shared;
+using namespace tj::script;
+
+namespace tj {
+	namespace script {
+		namespace symbols {
+			/** The symbol table is allocated on first use and never deleted, because scopes may still be destroyed
+			(and look up names) while static objects are being destroyed. **/
+			struct Table {
+				Table() {
+					_names.push_back(L""); // KNoSymbol
+				}
+
+				CriticalSection _lock;
+				std::map<std::wstring, ScriptSymbol> _symbols;
+				std::deque<std::wstring> _names; // Indexed by symbol; a deque never moves its elements when it grows
+			};
+
+			static Table& GetTable() {
+				static Table* table = new Table();
+				return *table;
+			}
+
+			// Makes sure the table is created before main is entered (and before there are any other threads)
+			static Table& _table = GetTable();
+		}
+	}
+}
+
+ScriptSymbol ScriptSymbols::Intern(const std::wstring& name) {
+	symbols::Table& table = symbols::GetTable();
+	ThreadLock lock(&(table._lock));
+
+	std::map<std::wstring, ScriptSymbol>::const_iterator it = table._symbols.find(name);
+	if(it!=table._symbols.end()) {
+		return it->second;
+	}
+
+	ScriptSymbol symbol = (ScriptSymbol)table._names.size();
+	table._names.push_back(name);
+	table._symbols[name] = symbol;
+	return symbol;
+}
+
+ScriptSymbol ScriptSymbols::Find(const std::wstring& name) {
+	symbols::Table& table = symbols::GetTable();
+	ThreadLock lock(&(table._lock));
+
+	std::map<std::wstring, ScriptSymbol>::const_iterator it = table._symbols.find(name);
+	if(it!=table._symbols.end()) {
+		return it->second;
+	}
+	return KNoSymbol;
+}
+
+const std::wstring& ScriptSymbols::GetName(ScriptSymbol symbol) {
+	symbols::Table& table = symbols::GetTable();
+	ThreadLock lock(&(table._lock));
+
+	if(symbol>=table._names.size()) {
+		Throw(L"Invalid script symbol", ExceptionTypeError);
+	}
+	return table._names[symbol];
+}
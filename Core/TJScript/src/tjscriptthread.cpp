@@ -38,7 +38,6 @@ void ScriptThread::Run() {
 			return;
 		}
 
-		ThreadLock lock(&(ctx->_running));
 		try {
 			ctx->Execute(_script);
 		}
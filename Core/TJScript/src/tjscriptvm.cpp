@@ -16,6 +16,28 @@
 using namespace tj::shared;
 using namespace tj::script;
 
+// Use direct threading ('labels as values') when the compiler supports it
+#if defined(__GNUC__) && !defined(TJSCRIPT_NO_COMPUTED_GOTO)
+	#define TJSCRIPT_COMPUTED_GOTO
+#endif
+
+/** VMProfile **/
+VMProfile::VMProfile(): _frame(0), _scriptlet(0), _sampleInterval(ScriptProfiler::KDefaultSampleInterval), _pending(0.0), _ops(0) {
+}
+
+void VMProfile::Reset(ref<ScriptProfiler> profiler) {
+	_data.Clear();
+	_scriptlets.clear();
+	_names.clear();
+	_frame = 0;
+	_scriptlet = 0;
+	_switched = Timestamp(true);
+	_sampled = _switched;
+	_sampleInterval = profiler ? profiler->GetSampleInterval() : ScriptProfiler::KDefaultSampleInterval;
+	_ops = 0;
+}
+
+/** VM **/
 VM::VM(int stackLimit): _stack(stackLimit) {
 	_scope = 0;
 	_debug = false;
@@ -30,6 +52,10 @@ void VM::SetDebug(bool d) {
 	_debug = d;
 }
 
+void VM::SetProfiler(ref<ScriptProfiler> p) {
+	_profiler = p;
+}
+
 void VM::Call(ref<Scriptlet> s, ref<ScriptParameterList> p) {
 	if(s->IsEmpty()) {
 		return;
@@ -40,6 +66,10 @@ void VM::Call(ref<Scriptlet> s, ref<ScriptParameterList> p) {
 		_frame->_stackSize = _stack.GetSize();
 	}
 
+	if(_profiler) {
+		++(_profile._scriptlets[s.GetPointer()]._calls);
+	}
+
 	StackFrame* newFrame = new StackFrame(s, 0, (bool)p);
 	newFrame->_previous = _frame;
 	_frame = newFrame;
@@ -94,9 +124,10 @@ void VM::Return(bool returnValue) {
 	}
 
 	if(_frame!=0) {
-		ref<Scriptable> returnedValue = _stack.Top();
+		// The returned value is copied as-is, so numbers are not boxed when they are returned from a function
+		ScriptStackValue returnedValue = _stack.TopValue();
 		while(_stack.GetSize() > _frame->_stackSize) {
-			_stack.Pop();
+			_stack.Drop();
 		}
 
 		if(returnValue) {
@@ -159,10 +190,26 @@ ref<Scriptable> VM::Execute(ref<ScriptContext> c, ref<CompiledScript> script, re
 	_frame = new StackFrame(main,0);
 	int opCode = 0;
 
+	bool profiling = _profiler;
+	if(profiling) {
+		_profile.Reset(_profiler);
+		++(_profile._scriptlets[ref<Scriptlet>(main).GetPointer()]._calls);
+		ProfileSwitch(_profile._switched);
+	}
+
 	try {
 		while(_frame!=0) {
+			// Scriptlets that were translated are run by RunTranslated (except in debug mode, which logs each op, and
+			// when profiling, which counts each op)
+			if(!_debug && !profiling && _frame->_scriptlet->IsTranslated()) {
+				RunTranslated(opCode);
+				continue;
+			}
+
+			// Verified scriptlets (see ScriptOptimizer::Verify) cannot run past their end or contain invalid instructions
 			#ifndef NDEBUG
-			if(_frame->_pc>=_frame->_scriptlet->GetCodeSize()) {
+			bool verified = _frame->_scriptlet->IsVerified();
+			if(!verified && _frame->_pc>=_frame->_scriptlet->GetCodeSize()) {
 				Throw(L"Ran past the end of a scriptlet's end!", ExceptionTypeError);
 			}
 			#endif
@@ -170,7 +217,7 @@ ref<Scriptable> VM::Execute(ref<ScriptContext> c, ref<CompiledScript> script, re
 			opCode = _frame->_scriptlet->Get<int>(_frame->_pc);
 
 			#ifndef NDEBUG
-				if(opCode>=Ops::_OpLast) Throw(L"Invalid instruction detected", ExceptionTypeError);
+				if(!verified && opCode>=Ops::_OpLast) Throw(L"Invalid instruction detected", ExceptionTypeError);
 			#endif
 
 			Ops::OpHandler opHandler = Ops::Handlers[opCode];
@@ -179,6 +226,17 @@ ref<Scriptable> VM::Execute(ref<ScriptContext> c, ref<CompiledScript> script, re
 			if(_debug) {
 				Log::Write(L"TJScript/VM/Execute",Ops::Names[opCode]);
 			}
+
+			if(profiling) {
+				++(_profile._data._ops[opCode]);
+				if(_frame!=_profile._frame) {
+					ProfileSwitch(Timestamp(true));
+				}
+
+				if(++(_profile._ops) >= ScriptProfiler::KSampleCheckInterval) {
+					ProfileSample(Timestamp(true), 0);
+				}
+			}
 		}
 	}
 	catch(BreakpointException&) {
@@ -188,8 +246,12 @@ ref<Scriptable> VM::Execute(ref<ScriptContext> c, ref<CompiledScript> script, re
 		throw;
 	}
 	catch(Exception& e) {
+		if(profiling) {
+			ProfileFinish();
+		}
+
 		if(_frame!=0) {
-			Log::Write(L"TJScript/VM",L"Error in scriptlet "+Stringify(_script->GetScriptletIndex(_frame->_scriptlet))+L": "+Ops::Names[opCode]);
+			Log::Write(L"TJScript/VM",L"Error in scriptlet "+Stringify(_script->GetScriptletIndex(_frame->_scriptlet))+L": "+Ops::GetName(opCode));
 			Log::Write(L"TJScript/VM", std::wstring(L"Stack dump: ")+_stack.Dump());
 			Log::Write(L"TJScript/VM", Wcs(e.GetFile())+L"/"+Stringify(e.GetLine())+L": "+e.GetMsg());
 		}
@@ -209,6 +271,10 @@ ref<Scriptable> VM::Execute(ref<ScriptContext> c, ref<CompiledScript> script, re
 		throw;
 	}
 
+	if(profiling) {
+		ProfileFinish();
+	}
+
 	_script = 0;
 	//_context = null;
 	_scope = 0;
@@ -228,4 +294,339 @@ ref<Scriptable> VM::Execute(ref<ScriptContext> c, ref<CompiledScript> script, re
 	}
 
 	return ret;
-}
\ No newline at end of file
+}
+
+/** Attributes the time since the last switch to the scriptlet that was running, and starts timing the scriptlet
+of the current frame. **/
+void VM::ProfileSwitch(const Timestamp& now) {
+	if(_profile._scriptlet!=0) {
+		_profile._scriptlets[_profile._scriptlet]._time += now.Difference(_profile._switched).ToMilliSeconds();
+	}
+
+	_profile._switched = now;
+	_profile._frame = _frame;
+	_profile._scriptlet = (_frame!=0) ? ref<Scriptlet>(_frame->_scriptlet).GetPointer() : 0;
+}
+
+/** Takes a sample of the call stack when the VM has been executing for at least the sample interval since the last
+sample. Only time spent executing counts (the remainder is kept between executions), so that short scripts are
+sampled too. A long native call (or a long time between checks) is counted as several samples. If native is set,
+the sample is attributed to that native call. **/
+void VM::ProfileSample(const Timestamp& now, const std::wstring* native) {
+	_profile._ops = 0;
+	_profile._pending += now.Difference(_profile._sampled).ToMilliSeconds();
+	_profile._sampled = now;
+	if(_profile._pending < _profile._sampleInterval || _frame==0) {
+		return;
+	}
+
+	unsigned int samples = (unsigned int)(_profile._pending / _profile._sampleInterval);
+	_profile._pending -= (long double)samples * _profile._sampleInterval;
+
+	std::vector<const Scriptlet*> frames;
+	StackFrame* frame = _frame;
+	while(frame!=0) {
+		frames.push_back(ref<Scriptlet>(frame->_scriptlet).GetPointer());
+		frame = frame->_previous;
+	}
+
+	std::wstring stack;
+	std::vector<const Scriptlet*>::const_reverse_iterator it = frames.rbegin();
+	while(it!=frames.rend()) {
+		if(stack.length()>0) {
+			stack += L';';
+		}
+		stack += GetProfileName(*it);
+		++it;
+	}
+
+	if(native!=0) {
+		stack += L';';
+		stack += *native;
+	}
+	_profile._data._samples[stack] += samples;
+}
+
+const std::wstring& VM::GetProfileName(const Scriptlet* scriptlet) {
+	std::map<const Scriptlet*, std::wstring>::iterator it = _profile._names.find(scriptlet);
+	if(it!=_profile._names.end()) {
+		return it->second;
+	}
+
+	int index = -1;
+	for(int a=0;a<_script->GetScriptletCount();a++) {
+		if(_script->GetScriptlet(a).GetPointer()==scriptlet) {
+			index = a;
+			break;
+		}
+	}
+
+	std::wstring& name = _profile._names[scriptlet];
+	name = (index>=0) ? ScriptProfiler::GetScriptletName(_script, index) : std::wstring(L"unknown");
+	return name;
+}
+
+/** Called when the VM is done executing (or an exception occurred); hands the profile data to the profiler **/
+void VM::ProfileFinish() {
+	Timestamp now(true);
+	if(_profile._scriptlet!=0) {
+		_profile._scriptlets[_profile._scriptlet]._time += now.Difference(_profile._switched).ToMilliSeconds();
+		_profile._scriptlet = 0;
+	}
+	_profile._frame = 0;
+	_profile._pending += now.Difference(_profile._sampled).ToMilliSeconds();
+	_profile._sampled = now;
+
+	std::map<const Scriptlet*, ScriptProfileEntry>::const_iterator it = _profile._scriptlets.begin();
+	while(it!=_profile._scriptlets.end()) {
+		_profile._data._scriptlets[GetProfileName(it->first)].Add(it->second);
+		++it;
+	}
+
+	_profiler->Merge(_profile._data);
+	_profile.Reset(_profiler);
+}
+
+ref<Scriptable> VM::InvokeProfiled(ref<Scriptable> target, Command name, ref<ParameterList> list, ScriptSymbol symbol) {
+	Timestamp start(true);
+	ProfileSample(start, 0);
+
+	ref<Scriptable> result = (symbol==ScriptSymbols::KNoSymbol) ? target->Execute(name, list) : target->ExecuteSymbol(symbol, name, list);
+
+	// Reading a variable from a scope or calling a script function is not a native call
+	if(target.IsCastableTo<ScriptScope>() && (!list || !result || result.IsCastableTo<ScriptFunction>())) {
+		return result;
+	}
+	else if(result.IsCastableTo<ScriptFunction>()) {
+		return result;
+	}
+
+	const std::type_info* type = &typeid(*(target.GetPointer()));
+	std::map<const std::type_info*, std::wstring>::iterator it = _profile._types.find(type);
+	if(it==_profile._types.end()) {
+		it = _profile._types.insert(std::pair<const std::type_info*, std::wstring>(type, ScriptProfiler::GetNativeName(target, L""))).first;
+	}
+
+	std::wstring nativeName = it->second + name;
+	Timestamp end(true);
+	ScriptProfileEntry& entry = _profile._data._natives[nativeName];
+	++(entry._calls);
+	entry._time += end.Difference(start).ToMilliSeconds();
+	ProfileSample(end, &nativeName);
+	return result;
+}
+
+namespace tj {
+	namespace script {
+		namespace vm {
+			/** Returns the op that an OpAddLiteral-like instruction performs on the value on the stack and the literal **/
+			static inline int GetLiteralOperation(int op) {
+				switch(op) {
+					case Ops::OpAddLiteral:
+						return Ops::OpAdd;
+
+					case Ops::OpSubLiteral:
+						return Ops::OpSub;
+
+					case Ops::OpMulLiteral:
+						return Ops::OpMul;
+
+					case Ops::OpDivLiteral:
+						return Ops::OpDiv;
+
+					case Ops::OpGreaterThanLiteral:
+						return Ops::OpGreaterThan;
+
+					case Ops::OpLessThanLiteral:
+						return Ops::OpLessThan;
+
+					default:
+						return Ops::OpEquals;
+				}
+			}
+
+			/** Calls a function (or reads a variable, if there is no parameter list) on target, like OpCall and
+			OpCallGlobal do. The name is looked up by its symbol. **/
+			static inline void Call(VM* vm, ref<Scriptable> target, ScriptSymbol symbol, const std::wstring& name, ref<ScriptParameterList> list) {
+				ref<Scriptable> result = vm->Invoke(target, name, list, symbol);
+				if(!result) {
+					throw ScriptException(L"Variable does not exist on object or scope: '"+name+L"'");
+				}
+
+				// only call functions when there is a parameter list given
+				if(list && result.IsCastableTo<ScriptFunction>()) {
+					vm->Call(ref<ScriptFunction>(result)->_scriptlet, list);
+				}
+				else {
+					vm->GetStack().Push(result);
+				}
+			}
+		}
+	}
+}
+
+#ifdef TJSCRIPT_COMPUTED_GOTO
+	#define TJSCRIPT_OP(x) op_##x:
+	#define TJSCRIPT_DISPATCH() goto *targets[ins->_op]
+#else
+	#define TJSCRIPT_OP(x) case Ops::x:
+	#define TJSCRIPT_DISPATCH() continue
+#endif
+
+#define TJSCRIPT_NEXT() ins = FetchTranslated(opCode); if(ins==0) return; TJSCRIPT_DISPATCH()
+
+/** Runs translated scriptlets (see Scriptlet::Translate) until the VM is done or a frame is entered that has not been
+translated. Instructions that were not replaced in the translation are performed by their normal handler. **/
+void VM::RunTranslated(int& opCode) {
+	const Scriptlet::Instruction* ins = FetchTranslated(opCode);
+	if(ins==0) {
+		return;
+	}
+
+	#ifdef TJSCRIPT_COMPUTED_GOTO
+		/* Jump table indexed by op code. It is constant-initialized, so VMs on different threads can share it without
+		any locking. Ops that have no dedicated label go to the generic handler. */
+		static void* const targets[] = {
+			&&op_OpNop,				// OpNop
+			&&op_Handler,			// OpPushString
+			&&op_Handler,			// OpPushDouble
+			&&op_OpPushTrue,			// OpPushTrue
+			&&op_OpPushFalse,		// OpPushFalse
+			&&op_Handler,			// OpPushInt
+			&&op_OpPushNull,			// OpPushNull
+			&&op_OpPop,				// OpPop
+			&&op_Handler,			// OpCall
+			&&op_Handler,			// OpCallGlobal
+			&&op_Handler,			// OpNew
+			&&op_Handler,			// OpSave
+			&&op_Handler,			// OpEquals
+			&&op_Handler,			// OpNegate
+			&&op_Handler,			// OpAdd
+			&&op_Handler,			// OpSub
+			&&op_Handler,			// OpMul
+			&&op_Handler,			// OpDiv
+			&&op_Handler,			// OpAnd
+			&&op_Handler,			// OpOr
+			&&op_Handler,			// OpBranchIf
+			&&op_Handler,			// OpParameter
+			&&op_Handler,			// OpNamelessParameter
+			&&op_Handler,			// OpPushParameter
+			&&op_Handler,			// OpLoadScriptlet
+			&&op_Handler,			// OpReturn
+			&&op_Handler,			// OpReturnValue
+			&&op_Handler,			// OpGreaterThan
+			&&op_Handler,			// OpLessThan
+			&&op_Handler,			// OpXor
+			&&op_Handler,			// OpBreak
+			&&op_Handler,			// OpIndex
+			&&op_Handler,			// OpIterate
+			&&op_Handler,			// OpPushDelegate
+			&&op_Handler,			// OpSetField
+			&&op_Handler,			// OpAddToArray
+			&&op_Handler,			// OpPushArray
+			&&op_Handler,			// OpType
+			&&op_Handler,			// OpEndScriptlet
+			&&op_OpPushLiteral,		// OpPushLiteral
+			&&op_OpLoadVariable,		// OpLoadVariable
+			&&op_OpCallGlobalNoArguments,	// OpCallGlobalNoArguments
+			&&op_OpCallNoArguments,	// OpCallNoArguments
+			&&op_OpAddLiteral,		// OpAddLiteral
+			&&op_OpAddLiteral,		// OpSubLiteral
+			&&op_OpAddLiteral,		// OpMulLiteral
+			&&op_OpAddLiteral,		// OpDivLiteral
+			&&op_OpAddLiteral,		// OpGreaterThanLiteral
+			&&op_OpAddLiteral,		// OpLessThanLiteral
+			&&op_OpAddLiteral		// OpEqualsLiteral
+		};
+		// Does not compile when the table does not have exactly one entry for each op
+		enum { KTargetsCoverAllOps = sizeof(char[(sizeof(targets)/sizeof(targets[0]))==Ops::_OpLastTranslated ? 1 : -1]) };
+
+		TJSCRIPT_DISPATCH();
+		{
+	#else
+		while(true) {
+			switch(ins->_op) {
+	#endif
+
+		TJSCRIPT_OP(OpNop)
+			_frame->_pc = ins->_next;
+			TJSCRIPT_NEXT();
+
+		TJSCRIPT_OP(OpPop)
+			_frame->_pc = ins->_next;
+			_stack.Drop();
+			TJSCRIPT_NEXT();
+
+		TJSCRIPT_OP(OpPushTrue)
+			_frame->_pc = ins->_next;
+			_stack.Push(ScriptConstants::True);
+			TJSCRIPT_NEXT();
+
+		TJSCRIPT_OP(OpPushFalse)
+			_frame->_pc = ins->_next;
+			_stack.Push(ScriptConstants::False);
+			TJSCRIPT_NEXT();
+
+		TJSCRIPT_OP(OpPushNull)
+			_frame->_pc = ins->_next;
+			_stack.Push(ScriptConstants::Null);
+			TJSCRIPT_NEXT();
+
+		TJSCRIPT_OP(OpPushLiteral)
+			_frame->_pc = ins->_next;
+			_stack.Push(ins->_value);
+			TJSCRIPT_NEXT();
+
+		TJSCRIPT_OP(OpLoadVariable)
+			_frame->_pc = ins->_next;
+			vm::Call(this, GetCurrentScope(), ins->_symbol, ins->_name, null);
+			TJSCRIPT_NEXT();
+
+		TJSCRIPT_OP(OpCallGlobalNoArguments)
+			_frame->_pc = ins->_next;
+			vm::Call(this, GetCurrentScope(), ins->_symbol, ins->_name, GC::Hold(new ScriptParameterList()));
+			TJSCRIPT_NEXT();
+
+		TJSCRIPT_OP(OpCallNoArguments)
+			_frame->_pc = ins->_next;
+			vm::Call(this, _stack.Pop(), ins->_symbol, ins->_name, GC::Hold(new ScriptParameterList()));
+			TJSCRIPT_NEXT();
+
+		#ifndef TJSCRIPT_COMPUTED_GOTO
+			case Ops::OpSubLiteral:
+			case Ops::OpMulLiteral:
+			case Ops::OpDivLiteral:
+			case Ops::OpGreaterThanLiteral:
+			case Ops::OpLessThanLiteral:
+			case Ops::OpEqualsLiteral:
+		#endif
+		TJSCRIPT_OP(OpAddLiteral)
+			_frame->_pc = ins->_next;
+			if(!_stack.Calculate(vm::GetLiteralOperation(ins->_op), ins->_value)) {
+				// Not a number; perform the original sequence (OpPush*, OpAdd)
+				_stack.Push(ins->_value);
+				Ops::Handlers[vm::GetLiteralOperation(ins->_op)](this);
+			}
+			TJSCRIPT_NEXT();
+
+		#ifdef TJSCRIPT_COMPUTED_GOTO
+			op_Handler:
+		#else
+			default:
+		#endif
+			// The handler reads the operands from the byte code
+			_frame->_pc = ins->_operands;
+			Ops::Handlers[ins->_op](this);
+			TJSCRIPT_NEXT();
+
+	#ifdef TJSCRIPT_COMPUTED_GOTO
+		}
+	#else
+			}
+		}
+	#endif
+}
+
+#undef TJSCRIPT_NEXT
+#undef TJSCRIPT_DISPATCH
+#undef TJSCRIPT_OP
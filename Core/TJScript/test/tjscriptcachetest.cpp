@@ -0,0 +1,237 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Tests the ScriptCache:
+- Hits: a script from the cache gives the same results as a script compiled without a cache, also when executed again;
+  the optimize setting is part of the key.
+- Misses: changing the source (of a string or of a file), or the compiler version, gives a different key, and the script
+  is compiled again.
+- Disk: scripts written to the cache directory are loaded by another cache, give the same results and are written back
+  byte for byte the same. Files of another cache format version, truncated files and files with trailing data are rejected
+  and the script is compiled again.
+Output goes to stderr (rejected files are logged, which makes stdout wide-oriented). Usage: tjscriptcachetest */
+#include <TJScript/include/tjscript.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+
+using namespace tj::shared;
+using namespace tj::script;
+
+namespace tj {
+	namespace script {
+		namespace test {
+			const static wchar_t* KScripts[] = {
+				L"return 1+2;",
+				L"var x = 0; for(var k : new Range(0,100)) { x = x + k; } return x;",
+				L"var total = 0; var level = 0.5; for(var c : new Range(1,100)) { level = level * 2 / 2; total += level + 1; } return total;",
+				L"function f(a) { return a * 2; } var s = 0; for(var c : new Range(0,100)) { s = s + f(a = c); } return s;",
+				L"var n = 0; var t = true; for(var k : new Range(0,300)) { n = n + 1; if(n == 10 || n == 20) { t = -t; } } var r = n; if(t) { r = r + 100000; } return \"\" + r + \"/\" + (7 / 2) + \"/\" + (7.0 / 2) + \"/\" + -n;",
+				L"var d = delegate { return \"inner\"; }; return d.toString();",
+			};
+			const static unsigned int KScriptCount = sizeof(KScripts)/sizeof(KScripts[0]);
+
+			static int _failures = 0;
+
+			static void Check(bool ok, const char* what) {
+				if(!ok) {
+					fprintf(stderr, "failed: %s\n", what);
+					++_failures;
+				}
+			}
+
+			static std::wstring Run(ref<ScriptContext> context, ref<CompiledScript> script) {
+				try {
+					return ScriptContext::GetValue(context->Execute(script)).ToString();
+				}
+				catch(const Exception& e) {
+					return L"exception: " + e.GetMsg();
+				}
+			}
+
+			static std::string GetCacheFile(ref<ScriptCache> cache, const std::string& key) {
+				return Mbs(cache->GetDirectory()) + std::string(1, (char)File::GetPathSeparator()) + key + ".tjsc";
+			}
+
+			static std::string ReadFile(const std::string& path) {
+				std::string data;
+				FILE* fp = fopen(path.c_str(), "rb");
+				if(fp!=0) {
+					char buffer[4096];
+					size_t read = 0;
+					while((read = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+						data.append(buffer, read);
+					}
+					fclose(fp);
+				}
+				return data;
+			}
+
+			static void WriteFile(const std::string& path, const std::string& data) {
+				FILE* fp = fopen(path.c_str(), "wb");
+				if(fp!=0) {
+					fwrite(data.data(), 1, data.length(), fp);
+					fclose(fp);
+				}
+			}
+
+			static std::wstring CreateDirectory() {
+				char path[] = "/tmp/tjscriptcachetestXXXXXX";
+				return Wcs(std::string(mkdtemp(path)));
+			}
+
+			static void RemoveDirectory(const std::wstring& path) {
+				std::string directory = Mbs(path);
+				DIR* dir = opendir(directory.c_str());
+				if(dir!=0) {
+					dirent* entry = 0;
+					while((entry = readdir(dir))!=0) {
+						std::string name = entry->d_name;
+						if(name!="." && name!="..") {
+							unlink((directory + "/" + name).c_str());
+						}
+					}
+					closedir(dir);
+				}
+				rmdir(directory.c_str());
+			}
+
+			static ref<ScriptContext> CreateContext(ref<ScriptCache> cache) {
+				ref<ScriptContext> context = GC::Hold(new ScriptContext(null));
+				context->SetCache(cache);
+				return context;
+			}
+
+			static void TestHits() {
+				ref<ScriptContext> uncached = CreateContext(null);
+				ref<ScriptCache> cache = GC::Hold(new ScriptCache());
+				ref<ScriptContext> context = CreateContext(cache);
+
+				for(unsigned int a=0;a<KScriptCount;a++) {
+					std::wstring expected = Run(uncached, uncached->Compile(KScripts[a]));
+					Check(expected.find(L"exception")!=0, "hits: script runs without a cache");
+					ref<CompiledScript> first = context->Compile(KScripts[a]);
+					ref<CompiledScript> second = context->Compile(KScripts[a]);
+					Check(first==second, "hits: the cached script is returned");
+					Check(Run(context, first)==expected, "hits: same result as an uncached script");
+					Check(Run(context, second)==expected, "hits: same result when executed again");
+					Check(Run(uncached, second)==expected, "hits: same result in another context");
+				}
+
+				ScriptCacheStatistics stats = cache->GetStatistics();
+				Check(stats._lookups==KScriptCount*2 && stats._memoryHits==KScriptCount && stats._misses==KScriptCount && stats._diskHits==0, "hits: statistics");
+
+				// The optimize setting is part of the key
+				context->SetOptimize(false);
+				ref<CompiledScript> plain = context->Compile(KScripts[0]);
+				Check(cache->GetStatistics()._misses==KScriptCount+1, "hits: other optimize setting misses");
+				Check(Run(context, plain)==Run(uncached, uncached->Compile(KScripts[0])), "hits: unoptimized script gives the same result");
+			}
+
+			static void TestMisses() {
+				std::wstring source = L"return 1+2;";
+				std::wstring changed = L"return 1+3;";
+				Check(ScriptCache::GetKey(source, true)==ScriptCache::GetKey(source, true), "misses: keys are stable");
+				Check(ScriptCache::GetKey(source, true)!=ScriptCache::GetKey(changed, true), "misses: changed source gives another key");
+				Check(ScriptCache::GetKey(source, true)==ScriptCache::GetKey(source, true, ScriptCache::GetCompilerVersion()), "misses: key includes the compiler version");
+				Check(ScriptCache::GetKey(source, true)!=ScriptCache::GetKey(source, true, ScriptCache::GetCompilerVersion()+L".1"), "misses: other compiler version gives another key");
+				Check(ScriptCache::GetKey(source, true)!=ScriptCache::GetKey(source, false), "misses: optimize setting gives another key");
+
+				ref<ScriptCache> cache = GC::Hold(new ScriptCache());
+				ref<ScriptContext> context = CreateContext(cache);
+				Check(Run(context, context->Compile(source))==L"3", "misses: first script");
+				Check(Run(context, context->Compile(changed))==L"4", "misses: changed script is compiled again");
+				Check(cache->GetStatistics()._misses==2 && cache->GetStatistics()._memoryHits==0, "misses: statistics");
+
+				// Script files are looked up by their contents
+				std::wstring directory = CreateDirectory();
+				std::string path = Mbs(directory) + "/script.tjs";
+				WriteFile(path, "return 5*5;");
+				ref<CompiledScript> file = context->CompileFile(Wcs(path));
+				Check(context->CompileFile(Wcs(path))==file, "misses: same file is a hit");
+				Check(Run(context, file)==L"25", "misses: file script");
+				WriteFile(path, "return 5*6;");
+				Check(Run(context, context->CompileFile(Wcs(path)))==L"30", "misses: changed file is compiled again");
+				Check(cache->GetStatistics()._misses==4 && cache->GetStatistics()._memoryHits==1, "misses: file statistics");
+				RemoveDirectory(directory);
+			}
+
+			static void TestDisk() {
+				std::wstring directory = CreateDirectory();
+				std::wstring otherDirectory = CreateDirectory();
+				ref<ScriptContext> uncached = CreateContext(null);
+
+				// Compile all scripts once, which writes them to the directory
+				{
+					ref<ScriptCache> cache = GC::Hold(new ScriptCache(directory));
+					ref<ScriptContext> context = CreateContext(cache);
+					for(unsigned int a=0;a<KScriptCount;a++) {
+						context->Compile(KScripts[a]);
+					}
+					Check(cache->GetStatistics()._diskWrites==KScriptCount && cache->GetStatistics()._diskErrors==0, "disk: scripts written");
+				}
+
+				// Another cache loads them from disk; writing a loaded script again gives exactly the same file
+				ref<ScriptCache> cache = GC::Hold(new ScriptCache(directory));
+				ref<ScriptCache> other = GC::Hold(new ScriptCache(otherDirectory));
+				ref<ScriptContext> context = CreateContext(cache);
+				for(unsigned int a=0;a<KScriptCount;a++) {
+					ref<CompiledScript> script = context->Compile(KScripts[a]);
+					Check(Run(context, script)==Run(uncached, uncached->Compile(KScripts[a])), "disk: loaded script gives the same result");
+
+					std::string key = ScriptCache::GetKey(KScripts[a], true);
+					other->Put(key, script, 0.0);
+					std::string written = ReadFile(GetCacheFile(cache, key));
+					Check(written.length()>0 && written==ReadFile(GetCacheFile(other, key)), "disk: round trip gives the same file");
+				}
+				ScriptCacheStatistics stats = cache->GetStatistics();
+				Check(stats._diskHits==KScriptCount && stats._misses==0 && stats._diskErrors==0, "disk: statistics");
+
+				// Files that cannot be used are rejected, and the script is compiled (and written) again
+				std::string key = ScriptCache::GetKey(KScripts[1], true);
+				std::string path = GetCacheFile(cache, key);
+				std::string good = ReadFile(path);
+				std::string otherVersion = good;
+				otherVersion[4] = (char)(otherVersion[4] + 1); // The format version follows the magic number
+				std::string broken[] = {otherVersion, good.substr(0, good.length()/2), good + "trailing data"};
+				const char* names[] = {"disk: file of another format version is rejected", "disk: truncated file is rejected", "disk: file with trailing data is rejected"};
+
+				for(unsigned int a=0;a<sizeof(broken)/sizeof(broken[0]);a++) {
+					WriteFile(path, broken[a]);
+					ref<ScriptCache> rejecting = GC::Hold(new ScriptCache(directory));
+					Check(!rejecting->Get(key) && rejecting->GetStatistics()._diskErrors==1, names[a]);
+
+					ref<ScriptContext> recompiling = CreateContext(rejecting);
+					Check(Run(recompiling, recompiling->Compile(KScripts[1]))==L"5050", "disk: rejected script is compiled again");
+					ref<ScriptCache> loading = GC::Hold(new ScriptCache(directory));
+					ref<CompiledScript> loaded = loading->Get(key);
+					Check(loaded && loading->GetStatistics()._diskHits==1 && Run(uncached, loaded)==L"5050", "disk: rejected file is written again");
+				}
+
+				RemoveDirectory(directory);
+				RemoveDirectory(otherDirectory);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::script::test;
+	TestHits();
+	TestMisses();
+	TestDisk();
+	fprintf(stderr, "%d failures\n", _failures);
+	return (_failures==0) ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Measures the throughput of many short scripts executed at the same time on one ScriptContext, from 1 up to 8 threads.
+Each execution takes a VM from the pool of the context (ScriptContext::AcquireVM/ReleaseVM). For comparison, the same
+executions are also run 'serialized' (one at a time, behind a lock), which is how the context used to run scripts on its
+single VM. The results of all executions are checked. Usage: tjscriptcontextbench [executions per thread] */
+#include <TJScript/include/tjscript.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace tj::shared;
+using namespace tj::script;
+
+namespace tj {
+	namespace script {
+		namespace test {
+			struct BenchmarkScript {
+				const wchar_t* source;
+				const wchar_t* expected;
+			};
+
+			const static BenchmarkScript KScripts[] = {
+				{L"return 1+2;", L"3"},
+				{L"var x = 0; for(var k : new Range(0,100)) { x = x + k; } return x;", L"5050"},
+				{L"var s = 0; for(var k : new Range(0,10)) { if(k>5) { s = s + k; } } return s;", L"40"},
+				{L"counter = counter + 1; var d = delegate { return counter; }; return d.toString();", L"[delegate]"},
+			};
+			const static unsigned int KScriptCount = sizeof(KScripts)/sizeof(KScripts[0]);
+
+			class ExecutionThread: public Thread {
+				public:
+					ExecutionThread(ref<ScriptContext> context, const std::vector< ref<CompiledScript> >& scripts, int executions, CriticalSection* serialize):
+						_context(context), _scripts(scripts), _executions(executions), _serialize(serialize), _errors(0) {
+					}
+
+					virtual ~ExecutionThread() {
+					}
+
+					int GetErrors() const {
+						return _errors;
+					}
+
+				protected:
+					virtual void Run() {
+						for(int a=0;a<_executions;a++) {
+							unsigned int s = a % KScriptCount;
+							try {
+								ref<Scriptable> result;
+								if(_serialize!=0) {
+									ThreadLock lock(_serialize);
+									result = _context->Execute(_scripts[s]);
+								}
+								else {
+									result = _context->Execute(_scripts[s]);
+								}
+
+								if(ScriptContext::GetValue(result).ToString()!=KScripts[s].expected) {
+									++_errors;
+								}
+							}
+							catch(const Exception& e) {
+								printf("exception: %ls\n", e.GetMsg().c_str());
+								++_errors;
+							}
+						}
+					}
+
+					ref<ScriptContext> _context;
+					std::vector< ref<CompiledScript> > _scripts;
+					int _executions;
+					CriticalSection* _serialize;
+					int _errors;
+			};
+
+			static int Run(ref<ScriptContext> context, const std::vector< ref<CompiledScript> >& scripts, int threadCount, int executions, bool serialized) {
+				CriticalSection serialize;
+				std::vector< ref<ExecutionThread> > threads;
+				for(int a=0;a<threadCount;a++) {
+					threads.push_back(GC::Hold(new ExecutionThread(context, scripts, executions, serialized ? &serialize : 0)));
+				}
+
+				Timestamp start(true);
+				for(int a=0;a<threadCount;a++) {
+					threads[a]->Start();
+				}
+
+				int errors = 0;
+				for(int a=0;a<threadCount;a++) {
+					threads[a]->WaitForCompletion();
+					errors += threads[a]->GetErrors();
+				}
+				double ms = double(Timestamp(true).Difference(start).ToMilliSeconds());
+
+				int total = threadCount*executions;
+				printf("%s, %d thread(s): %d scripts in %.1f ms (%.0f scripts/s), %d errors\n", serialized ? "serialized" : "pooled", threadCount, total, ms, double(total)*1000.0/ms, errors);
+				return errors;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::script::test;
+	int executions = (argc > 1) ? atoi(argv[1]) : 2000;
+
+	ref<ScriptContext> context = GC::Hold(new ScriptContext(null));
+	ref<ScriptScope>(context->GetGlobal())->Set(L"counter", GC::Hold(new ScriptInt(0)));
+
+	std::vector< ref<CompiledScript> > scripts;
+	for(unsigned int a=0;a<KScriptCount;a++) {
+		scripts.push_back(context->Compile(KScripts[a].source));
+	}
+
+	int errors = 0;
+	for(int threads=1;threads<=8;threads*=2) {
+		errors += tj::script::test::Run(context, scripts, threads, executions, true);
+		errors += tj::script::test::Run(context, scripts, threads, executions, false);
+	}
+	return (errors==0) ? 0 : 1;
+}
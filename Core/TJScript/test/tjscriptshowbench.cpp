@@ -0,0 +1,92 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Benchmark of typical show scripts (loops over channels, fades, small helper functions, conditions and building
+labels), executed by the plain interpreter (ScriptContext::SetOptimize(false)) and in translated form, with fused
+instructions and threaded dispatch (SetOptimize(true)). Both forms must give the same result for every script.
+Usage: tjscriptshowbench [executions per script] */
+#include <TJScript/include/tjscript.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace tj::shared;
+using namespace tj::script;
+
+namespace tj {
+	namespace script {
+		namespace test {
+			struct ShowScript {
+				const char* name;
+				const wchar_t* source;
+			};
+
+			const static ShowScript KScripts[] = {
+				{"counter with wrap-around", L"var x = 0; var i = 0; for(var k : new Range(0,2000)) { x = x + 2 * 3; i++; if(x > 100) { x = x - 50; } } return x + i;"},
+				{"level ramp", L"var total = 0; var level = 0.5; for(var c : new Range(1,1000)) { level = level * 2 / 2; total += level + 1; } return total;"},
+				{"helper per channel", L"function f(a) { return a * 2; } var s = 0; for(var c : new Range(0,1000)) { s = s + f(a = c); } return s;"},
+				{"constant conditions", L"var x = 0; for(var k : new Range(0,2000)) { x = x + (1 + 2) * 3 - -1; if(true) { x++ } else { x-- } if(false) { x = 0; } if(1 > 2) { x = 1; } else { x += 1; } if(x > 5) { } } return x;"},
+				{"fade with limits", L"var v = 0.0; for(var k : new Range(0,5000)) { v = v + 0.25 * 4 / 2 - 0.25; if(v > 100.0 && v < 200.0) { v = v - 1; } } return v;"},
+				{"cue label", L"var n = 0; var t = true; for(var k : new Range(0,3000)) { n = n + 1; if(n == 10 || n == 20) { t = -t; } if(-n < -2990) { n = n - 1; } } var r = n; if(t) { r = r + 100000; } return \"\" + r + \"/\" + (7 / 2) + \"/\" + (7.0 / 2) + \"/\" + -n;"},
+				{"offset helper", L"function g(x) { return x * 2 + 1; } var s = 0; for(var c : new Range(0,1000)) { s = s + g(x = c) - 1; } return s;"},
+			};
+			const static unsigned int KScriptCount = sizeof(KScripts)/sizeof(KScripts[0]);
+
+			/** Executes the script a number of times; returns the time in ms and the result of the last execution **/
+			static double Run(ref<ScriptContext> context, ref<CompiledScript> script, int executions, std::wstring& result) {
+				ref<Scriptable> value;
+				Timestamp start(true);
+				for(int a=0;a<executions;a++) {
+					value = context->Execute(script);
+				}
+				double ms = double(Timestamp(true).Difference(start).ToMilliSeconds());
+				result = ScriptContext::GetValue(value).ToString();
+				return ms;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::script::test;
+	int executions = (argc > 1) ? atoi(argv[1]) : 50;
+
+	ref<ScriptContext> plain = GC::Hold(new ScriptContext(null));
+	plain->SetOptimize(false);
+	plain->SetCache(null);
+	ref<ScriptContext> translated = GC::Hold(new ScriptContext(null));
+	translated->SetOptimize(true);
+	translated->SetCache(null);
+
+	int errors = 0;
+	double plainTotal = 0.0, translatedTotal = 0.0;
+	for(unsigned int a=0;a<KScriptCount;a++) {
+		std::wstring plainResult, translatedResult;
+		double plainTime = Run(plain, plain->Compile(KScripts[a].source), executions, plainResult);
+		double translatedTime = Run(translated, translated->Compile(KScripts[a].source), executions, translatedResult);
+		plainTotal += plainTime;
+		translatedTotal += translatedTime;
+
+		bool same = (plainResult==translatedResult);
+		if(!same) {
+			++errors;
+		}
+		printf("%s: plain %.1f ms, translated %.1f ms (%.2fx), result %ls%s\n", KScripts[a].name, plainTime, translatedTime, plainTime/translatedTime, translatedResult.c_str(), same ? "" : ", DIFFERENT FROM PLAIN");
+		if(!same) {
+			printf("\tplain result: %ls\n", plainResult.c_str());
+		}
+	}
+
+	printf("all scripts (%d executions each): plain %.1f ms, translated %.1f ms (%.2fx), %d errors\n", executions, plainTotal, translatedTotal, plainTotal/translatedTotal, errors);
+	return (errors==0) ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Compares the arithmetic on tagged ScriptStackValues (ScriptStack::Calculate) with the arithmetic on boxed values that
+the op handlers used before (pop both operands, unbox them to Any, and push a new ScriptAnyValue for the result). The
+expression ((x + k) * 3 - k) / 2 is evaluated on the stack the way the VM does it, for integer and for double operands.
+The results of both paths are checked first. Usage: tjscriptstackbench [evaluations] */
+#include "../include/internal/tjscript.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace tj::shared;
+using namespace tj::script;
+
+namespace tj {
+	namespace script {
+		namespace test {
+			/** The handler of a binary op as it was before values were kept unboxed on the stack **/
+			static void CalculateAny(ScriptStack& stack, int op) {
+				ref<Scriptable> a = stack.Pop();
+				ref<Scriptable> b = stack.Pop();
+
+				if(a.IsCastableTo<ScriptAny>() && b.IsCastableTo<ScriptAny>()) {
+					Any aa = ref<ScriptAny>(a)->Unbox();
+					Any ab = ref<ScriptAny>(b)->Unbox();
+					strong<ScriptAnyValue> sav = Recycler<ScriptAnyValue>::Create();
+					switch(op) {
+						case Ops::OpAdd:
+							sav->SetValue(ab+aa);
+							break;
+
+						case Ops::OpSub:
+							sav->SetValue(ab-aa);
+							break;
+
+						case Ops::OpMul:
+							sav->SetValue(aa*ab);
+							break;
+
+						case Ops::OpDiv:
+							sav->SetValue(ab/aa);
+							break;
+					}
+					stack.Push(sav);
+				}
+				else {
+					stack.Push(ScriptConstants::Null);
+				}
+			}
+
+			/** The handler of a binary op as it is now: the tagged fast path, with the boxed path as fall-back **/
+			static void CalculateTagged(ScriptStack& stack, int op) {
+				if(!stack.Calculate(op)) {
+					CalculateAny(stack, op);
+				}
+			}
+
+			typedef void (*Handler)(ScriptStack&, int);
+
+			/** Evaluates ((x + k) * 3 - k) / 2 and pops (boxes) the result, like an assignment would **/
+			static inline ref<Scriptable> Evaluate(ScriptStack& stack, Handler handler, ref<Scriptable> x, ref<Scriptable> k, ref<Scriptable> three, ref<Scriptable> two) {
+				stack.Push(x);
+				stack.Push(k);
+				handler(stack, Ops::OpAdd);
+				stack.Push(three);
+				handler(stack, Ops::OpMul);
+				stack.Push(k);
+				handler(stack, Ops::OpSub);
+				stack.Push(two);
+				handler(stack, Ops::OpDiv);
+				return stack.Pop();
+			}
+
+			const static int KOperands = 1024;
+
+			static int Run(const char* name, const std::vector< ref<Scriptable> >& operands, ref<Scriptable> three, ref<Scriptable> two, int evaluations) {
+				ScriptStack stack;
+				int errors = 0;
+
+				// Both paths must give the same value of the same type
+				for(int a=0;a<KOperands;a++) {
+					ref<Scriptable> x = operands[a];
+					ref<Scriptable> k = operands[(a*7+3)%KOperands];
+					Any tagged = ScriptContext::GetValue(Evaluate(stack, CalculateTagged, x, k, three, two));
+					Any boxed = ScriptContext::GetValue(Evaluate(stack, CalculateAny, x, k, three, two));
+					if(tagged.GetType()!=boxed.GetType() || tagged.ToString()!=boxed.ToString()) {
+						if(errors < 10) {
+							printf("%s: operands %d and %d: tagged=%ls, boxed=%ls\n", name, a, (a*7+3)%KOperands, tagged.ToString().c_str(), boxed.ToString().c_str());
+						}
+						++errors;
+					}
+				}
+
+				double times[2];
+				Handler handlers[2] = {CalculateAny, CalculateTagged};
+				for(int h=0;h<2;h++) {
+					Timestamp start(true);
+					for(int a=0;a<evaluations;a++) {
+						Evaluate(stack, handlers[h], operands[a%KOperands], operands[(a*7+3)%KOperands], three, two);
+					}
+					times[h] = double(Timestamp(true).Difference(start).ToMilliSeconds());
+				}
+
+				printf("%s: %d evaluations, boxed %.1f ms (%.0f ns each), tagged %.1f ms (%.0f ns each), %.1fx, %d errors\n", name, evaluations,
+					times[0], times[0]*1000000.0/evaluations, times[1], times[1]*1000000.0/evaluations, times[0]/times[1], errors);
+				return errors;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::script::test;
+	int evaluations = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+	// Sets up the recycler for script values like the VM does
+	ref<ScriptContext> context = GC::Hold(new ScriptContext(null));
+
+	std::vector< ref<Scriptable> > integers, doubles;
+	for(int a=0;a<KOperands;a++) {
+		integers.push_back(GC::Hold(new ScriptAnyValue(Any(a-KOperands/2))));
+		doubles.push_back(GC::Hold(new ScriptAnyValue(Any(double(a-KOperands/2)*0.37))));
+	}
+	ref<Scriptable> three = GC::Hold(new ScriptAnyValue(Any(3)));
+	ref<Scriptable> two = GC::Hold(new ScriptAnyValue(Any(2)));
+
+	int errors = Run("integer", integers, three, two, evaluations);
+	errors += Run("double", doubles, three, two, evaluations);
+	return (errors==0) ? 0 : 1;
+}
@@ -22,7 +22,7 @@
 
 namespace tj {
 	namespace shared {
-		class EXPORTED Data: public virtual Object {
+		class EXPORTED Data: public virtual Object, public Pooled {
 			public:
 				virtual ~Data();
 				virtual Bytes GetSize() const = 0;
@@ -30,9 +30,12 @@ namespace tj {
 				virtual char* TakeOverBuffer(bool clearMine = true) = 0;
 		};
 
+		/** A DataReader normally reads from its own copy of the data. When an owner is given, it reads directly from the
+		given memory instead; the reader then keeps a reference to the owner, which should keep the memory alive. **/
 		class EXPORTED DataReader: public Data {
 			public:
 				DataReader(const char* code, Bytes size);
+				DataReader(ref<Object> owner, const char* code, Bytes size);
 				virtual ~DataReader();
 				virtual Bytes GetSize() const;
 				virtual const char* GetBuffer() const;
@@ -50,6 +53,7 @@ namespace tj {
 			protected:
 				char* _code;
 				Bytes _size;
+				ref<Object> _owner;
 		};
 
 		template<> EXPORTED String DataReader::Get(unsigned int& position);
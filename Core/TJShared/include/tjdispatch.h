@@ -47,7 +47,7 @@ namespace tj {
 				const static int KTaskRun = 0x2;
 				const static int KTaskFailed = 0x4;
 				const static int KTaskStalled = 0x8;
-				const static int KTaskRunning = 0x01;
+				const static int KTaskRunning = 0x10;
 		};
 
 		class EXPORTED Future: public Task {
@@ -62,8 +62,9 @@ namespace tj {
 				Future();
 				virtual void OnAfterRun();
 
-				
-				std::set< weak<Future> > _dependent;
+				/* Futures that depend on this future. These are strong references: a stalled future is kept alive by
+				the futures it waits for, and is requeued directly by the last one to run (see OnDependencyRan). */
+				std::vector< ref<Future> > _dependent;
 				volatile unsigned int _dependencies;
 				Event _completed;
 		};
@@ -83,6 +84,23 @@ namespace tj {
 			
 		};
 
+		struct EXPORTED DispatcherStatistics {
+			DispatcherStatistics();
+
+			unsigned int _threads;
+			unsigned int _busyThreads;
+			unsigned int _queued;			// Tasks waiting to be run (in the submission queue and in per-thread queues)
+			unsigned int _stalled;			// Tasks waiting for other tasks (i.e. futures waiting for their dependencies)
+			unsigned int _processed;		// Tasks dispatched since the dispatcher was created
+			unsigned int _steals;			// Tasks taken by a thread from the queue of another thread
+			unsigned int _wakeups;			// Number of times an idle thread was woken up
+		};
+
+		/** The dispatcher runs tasks on a pool of threads, using work stealing. Each thread has its own queue; tasks
+		dispatched from a dispatcher thread (such as futures that become runnable) are put in the queue of that thread,
+		so they are likely to run on the same thread. Tasks dispatched from other threads are put in a lock-free
+		submission queue, from which idle threads take them. When a thread runs out of work, it takes tasks from the
+		queues of other threads (oldest first). Threads that cannot find any work sleep until new work arrives. **/
 		class EXPORTED Dispatcher: public virtual Object {
 			friend class DispatchThread;
 
@@ -96,35 +114,83 @@ namespace tj {
 				static strong<Dispatcher> CurrentOrDefaultInstance();
 				virtual unsigned int GetProcessedItemsCount() const;
 				virtual unsigned int GetThreadCount() const;
+				virtual void GetStatistics(DispatcherStatistics& stats) const;
 				virtual void WaitForCompletion();
 
 			private:
+				/** Node in the submission queue. This is an intrusive multiple-producer, single-consumer queue: producers
+				only need a single atomic exchange to add a node, consumers take _submittedLock. **/
+				struct SubmittedTask {
+					SubmittedTask* volatile _next;
+					ref<Task> _task;
+				};
+
 				static ref<Dispatcher> GetCurrent();
 				virtual void DispatchTask(ref<Task> t);
-
-				CriticalSection _lock;
-				bool _accepting;
-				std::deque< ref<Task> > _queue;
+				void Submit(ref<Task> t);
+				ref<Task> TakeSubmitted(DispatchThread* thread);
+				ref<Task> Steal(DispatchThread* thread);
+				ref<Task> GetNextTask(DispatchThread* thread);
+				void WakeUp();
+				void StartThreadIfNeeded();
+
+				CriticalSection _lock; // locks creation and destruction of threads
+				volatile bool _accepting;
+				volatile bool _stopping;
+
+				// Submission queue
+				SubmittedTask* volatile _submittedHead;
+				SubmittedTask* _submittedTail;
+				SubmittedTask _submittedStub;
+				CriticalSection _submittedLock;
+
+				// Stalled tasks (tasks that could not run when they were dispatched)
+				CriticalSection _stalledLock;
 				std::set< ref<Task> > _stalled;
-				Semaphore _queuedTasks;
-				Event _taskFinished;
+
+				// Threads; _workers is only appended to, so other threads can read it without locking
 				std::set< ref<DispatchThread> > _threads;
+				std::vector<DispatchThread*> _workers;
+				volatile ReferenceCount _workerCount;
 				int _maxThreads;
-				volatile int _busyThreads;
-				volatile unsigned int _itemsProcessed;
 				const Thread::Priority _defaultPriority;
 
+				// Idle threads wait for _wakeUp
+				Semaphore _wakeUp;
+				volatile ReferenceCount _sleepingThreads;
+				Event _taskFinished;
+				volatile ReferenceCount _completionWaiters;
+
+				// Statistics
+				volatile ReferenceCount _busyThreads;
+				volatile ReferenceCount _queued;
+				volatile ReferenceCount _stalledCount;
+				volatile ReferenceCount _itemsProcessed;
+				volatile ReferenceCount _steals;
+				volatile ReferenceCount _wakeups;
+
 				static ThreadLocal _currentDispatcher;
+				const static int KMaxSubmittedBatch = 16;
 		};
 
 		class EXPORTED DispatchThread: public Thread {
+			friend class Dispatcher;
+
 			public:
-				DispatchThread(ref<Dispatcher> d);
+				DispatchThread(ref<Dispatcher> d, unsigned int index);
 				virtual ~DispatchThread();
 				virtual void Run();
 
 			private:
+				void Execute(ref<Task> task);
+
 				Dispatcher* _dispatcher;
+				unsigned int _index;
+				CriticalSection _queueLock;
+				std::deque< ref<Task> > _queue; // The owner pushes and pops at the back, other threads steal at the front
+				unsigned int _nextVictim;
+
+				static ThreadLocal _currentThread;
 		};
 	}
 }
@@ -0,0 +1,63 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #ifndef _TJPOOL_H
+#define _TJPOOL_H
+
+namespace tj {
+	namespace shared {
+		/** The Pool is an allocator for small objects (up to KMaximumSize bytes). Sizes are rounded up to a multiple of
+		KGranularity; each of these size classes has its own free list. Every thread keeps a small cache of free blocks
+		per size class, so that most allocations and frees do not need a lock. Blocks are carved out of larger slabs,
+		which are never returned to the system (the pool only grows to the peak number of objects in use). Larger
+		allocations are passed on to malloc/free.
+
+		The Pool is used for the control blocks (intern::Resource) of objects held by GC::Hold, and for classes that
+		derive from Pooled. **/
+		class EXPORTED Pool {
+			public:
+				static void* Allocate(size_t size);
+				static void Free(void* block, size_t size);
+
+				/** Returns the free blocks cached by the calling thread to the pool; called by Thread just before a 
+				thread ends. The caches of other threads are released through a thread-local cleanup function when they
+				end (not on Windows). The cache of the main thread is never released; like the cache of any thread, it
+				holds at most a few dozen blocks per size class. **/
+				static void ReleaseThreadCache();
+
+				static long GetAllocationCount();
+				static long GetFreeCount();
+				static long GetArenaSize();
+
+				const static size_t KGranularity = 16;
+				const static size_t KMaximumSize = 256;
+				const static unsigned int KSizeClasses = KMaximumSize / KGranularity;
+		};
+
+		/** Classes that derive from Pooled are allocated from the Pool. The block size is passed to operator delete,
+		so classes with a virtual destructor can be deleted through a pointer to their base class. **/
+		class EXPORTED Pooled {
+			public:
+				static inline void* operator new(size_t size) {
+					return Pool::Allocate(size);
+				}
+
+				static inline void operator delete(void* block, size_t size) {
+					Pool::Free(block, size);
+				}
+		};
+	}
+}
+
+#endif
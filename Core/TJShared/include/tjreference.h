@@ -16,6 +16,7 @@
 #define _REFERENCE_H
 
 #include "tjsharedinternal.h"
+#include "tjpool.h"
 #include <deque>
 
 #ifdef TJSHARED_MEMORY_TRACE
@@ -127,16 +128,33 @@ namespace tj {
 				intern::Resource* _resource;
 		};
 
-		namespace intern {			
-			class EXPORTED Resource {
+		namespace intern {
+			/** The Resource is the control block of an object held by the GC. Resources are allocated from the Pool. **/
+			class EXPORTED Resource: public Pooled {
 				friend class tj::shared::GC;
 
 				public:
-					Resource();
+					Resource(bool local = false);
 					virtual ~Resource(); // tjcore.cpp
 
+					/** Increments the reference count. Unless first is true (only used by GC when the object is created),
+					this fails and returns false when the object is no longer referenced. The first reference also adds
+					a weak reference, which is held by all strong references together and released together with the
+					last of them (see ref<T>::Release); this way, the resource cannot be deleted by the last weak
+					reference while the last strong reference is still being released on another thread. **/
 					inline bool AddReference(bool first = false) {
-						if(!first && _referenceCount==0) return false;
+						if(first) {
+							AddWeakReference();
+						}
+						else if(_referenceCount==0) {
+							return false;
+						}
+
+						if(_local) {
+							++_referenceCount;
+							return true;
+						}
+
 						#ifdef TJ_OS_WIN
 							_InterlockedIncrement(&_referenceCount);
 						#endif
@@ -146,33 +164,69 @@ namespace tj {
 						#endif
 
 						#ifdef TJ_OS_LINUX
-							//__sync_add_and_fetch(&_referenceCount, 1);
-							_referenceCount += 1;
+							__sync_add_and_fetch(&_referenceCount, 1);
 						#endif
 						
 						return true;
 					}
+
+					/** Increments the reference count only if it is not zero; used to turn a weak reference into a
+					strong one. Unlike AddReference, this cannot resurrect an object that is being deleted by another
+					thread. **/
+					inline bool TryAddReference() {
+						if(_local) {
+							return AddReference();
+						}
+
+						while(true) {
+							ReferenceCount old = _referenceCount;
+							if(old==0) {
+								return false;
+							}
+
+							#ifdef TJ_OS_WIN
+								if(_InterlockedCompareExchange(&_referenceCount, old+1, old)==old) return true;
+							#endif
+
+							#ifdef TJ_OS_MAC
+								if(OSAtomicCompareAndSwap32Barrier(old, old+1, &_referenceCount)) return true;
+							#endif
+
+							#ifdef TJ_OS_LINUX
+								if(__sync_bool_compare_and_swap(&_referenceCount, old, old+1)) return true;
+							#endif
+						}
+					}
 					
 					/** Decrements the reference count and returns true if this was 
-					the last reference (note that there could still be weak references!) **/
+					the last reference (note that there could still be weak references!). The decrement is a full
+					barrier, so all writes to the object are visible to the thread that deletes it. **/
 					inline bool DeleteReference() {
+						if(_local) {
+							return (--_referenceCount)==0;
+						}
+
 						#ifdef TJ_OS_WIN
 							ReferenceCount nv = _InterlockedDecrement(&_referenceCount);
 						#endif
 
 						#ifdef TJ_OS_MAC
-							ReferenceCount nv = OSAtomicAdd32(-1, &_referenceCount) ;
+							ReferenceCount nv = OSAtomicAdd32Barrier(-1, &_referenceCount);
 						#endif
 
 						#ifdef TJ_OS_LINUX
-							ReferenceCount nv = _referenceCount-1; 
-							_referenceCount -= 1;
+							ReferenceCount nv = __sync_sub_and_fetch(&_referenceCount, 1);
 						#endif
 						
 						return nv==0;
 					}
 					
 					inline void AddWeakReference() {
+						if(_local) {
+							++_weakReferenceCount;
+							return;
+						}
+
 						#ifdef TJ_OS_WIN
 							_InterlockedIncrement(&_weakReferenceCount);
 						#endif
@@ -182,35 +236,47 @@ namespace tj {
 						#endif
 
 						#ifdef TJ_OS_LINUX
-							//__sync_add_and_fetch(&_weakReferenceCount,1);
-							_weakReferenceCount += 1;
+							__sync_add_and_fetch(&_weakReferenceCount, 1);
 						#endif
 					}
 
 					/** Decrements the weak reference count and returns true if this was the last weak
-					reference (and there were no other 'real' references) **/
+					reference (and there were no other 'real' references). As long as there are strong references,
+					they hold a weak reference too, so the last weak reference is either released by ref<T>::Release
+					or after it. **/
 					inline bool DeleteWeakReference() {
-						#ifdef TJ_OS_WIN
-							ReferenceCount nv = _InterlockedDecrement(&_weakReferenceCount);
-						#endif
+						ReferenceCount nv;
+						if(_local) {
+							nv = --_weakReferenceCount;
+						}
+						else {
+							#ifdef TJ_OS_WIN
+								nv = _InterlockedDecrement(&_weakReferenceCount);
+							#endif
 
-						#ifdef TJ_OS_MAC
-							ReferenceCount nv = OSAtomicAdd32(-1, &_weakReferenceCount) ;
-						#endif
+							#ifdef TJ_OS_MAC
+								nv = OSAtomicAdd32Barrier(-1, &_weakReferenceCount);
+							#endif
 
-						#ifdef TJ_OS_LINUX
-							//ReferenceCount nv = __sync_sub_and_fetch(&_weakReferenceCount, 1);
-							ReferenceCount nv = _weakReferenceCount-1;
-							_weakReferenceCount -= 1;
-						#endif
+							#ifdef TJ_OS_LINUX
+								nv = __sync_sub_and_fetch(&_weakReferenceCount, 1);
+							#endif
+						}
 						
 						return (nv==0 && !IsReferenced());
 					}
+
+					/** Returns true if the reference counts of this resource are not updated atomically (see
+					GC::HoldLocal). **/
+					inline bool IsLocal() const {
+						return _local;
+					}
 					
 					inline bool IsReferenced() const {
 						return _referenceCount != 0;
 					}
 					
+					/** Note that this includes the weak reference held by the strong references **/
 					inline bool IsWeaklyReferenced() const {
 						return _weakReferenceCount != 0;
 					}
@@ -221,6 +287,7 @@ namespace tj {
 					volatile ReferenceCount _referenceCount;
 					volatile ReferenceCount _weakReferenceCount;
 					volatile static ReferenceCount _resourceCount;
+					const bool _local;
 			};
 			
 			class EXPORTED RecycleableResource: public Resource {
@@ -328,7 +395,7 @@ namespace tj {
 					_object = 0;
 				}
 				else {
-					if(wr._resource->AddReference()) {
+					if(wr._resource->TryAddReference()) {
 						// object still alive, we are referenced
 						_object = wr._object;
 						_resource = wr._resource;
@@ -620,35 +687,42 @@ namespace tj {
 		 when the memory management system detects that an object that is Recycleable can be deleted,
 		 it will not delete the object but instead add it to a list of objects to be re-used (if the 
 		 'recycle bin' is not yet filled with enough objects). **/
-		class EXPORTED Recycleable: public virtual Object {
+		class EXPORTED Recycleable: public virtual Object, public Pooled {
 			public:
 				virtual ~Recycleable();
 				virtual void OnRecycle();
 				virtual void OnReuse();
 		};
 		
+		/** A RecycleBin keeps at most GetMaximumSize() objects for re-use; by default, this is KDefaultMaximumSize. 
+		Types that are created and released at a high rate can use a larger bin (see Recycler<T>::SetMaximumSize). **/
 		class EXPORTED RecycleBin {
 			public:
-				RecycleBin();
+				RecycleBin(unsigned int maximumSize = KDefaultMaximumSize);
 				virtual ~RecycleBin();
 				virtual void Reuse(Recycleable* rc);
 				virtual Recycleable* Get();
+				void SetMaximumSize(unsigned int n);
+				unsigned int GetMaximumSize() const;
 				static unsigned int GetTrashObjectCount();
+				static long GetReuseCount();
+
+				const static unsigned int KDefaultMaximumSize = 5;
 			
 			private:
 				bool WantsToRecycle() const;
 			
-				const static unsigned int KRecycleBinMaximumSize = 5;
-				Recycleable* _bin[KRecycleBinMaximumSize];
-				unsigned int _added;
-				unsigned int _removed;
+				std::deque<Recycleable*> _bin;
+				unsigned int _maximumSize;
 				CriticalSection* _lock;
-				static unsigned int _totalObjectCount;
+				volatile static ReferenceCount _totalObjectCount;
+				volatile static ReferenceCount _reuseCount;
 		};
 		
 		class EXPORTED GC {
 			public:
 				template<typename T> static ref<T> Hold(T* x);
+				template<typename T> static ref<T> HoldLocal(T* x);
 				template<typename T> static ref<T> Hold(T* x, RecycleBin& rb);
 				template<typename T> static ref<T> HoldRecycled(T* x);
 			
@@ -698,6 +772,14 @@ namespace tj {
 					}
 					return GC::Hold(new T(), _bin);
 				}
+
+				static inline void SetMaximumSize(unsigned int n) {
+					_bin.SetMaximumSize(n);
+				}
+
+				static inline unsigned int GetMaximumSize() {
+					return _bin.GetMaximumSize();
+				}
 			
 			protected:
 				static RecycleBin _bin;
@@ -751,6 +833,23 @@ namespace tj {
 			return ref<T>(x, rs);
 		}
 		
+		/** Like Hold, but the reference counts of the object are not updated atomically, which makes copying and
+		releasing references to it a lot cheaper. Only use this for objects that are never referenced (strongly or
+		weakly) from more than one thread at a time, i.e. objects that never leave the thread that created them. **/
+		template<class T> inline ref<T> GC::HoldLocal(T* x) {
+			intern::Resource* rs = new intern::Resource(true);
+			if(rs==0) {
+				throw OutOfMemoryException();
+			}
+			SetObjectPointer(x, rs);
+			
+			#ifdef TJSHARED_MEMORY_TRACE
+				Log(typeid(x).name(),true);
+			#endif
+			
+			return ref<T>(x, rs);
+		}
+		
 		template<class T> inline ref<T> GC::Hold(T* x, RecycleBin& rb) {
 			/* assert(dynamic_cast<Recycleable*>(x)!=0); */
 			intern::RecycleableResource* rs = new intern::RecycleableResource(rb);
@@ -775,9 +874,11 @@ namespace tj {
 						GC::Log(typeid(_object).name(), false);
 					#endif
 					
-					/** Check if there are still weak references; if there are, just
-					 delete the object. If there are none, try to recycle the object **/
-					if(_resource->IsWeaklyReferenced()) {
+					/** Release the weak reference held by the strong references. If there are still other weak
+					 references, just delete the object; the last weak reference deletes the resource (possibly
+					 on another thread, so the resource cannot be used after this). If there are none, try to
+					 recycle the object **/
+					if(!_resource->DeleteWeakReference()) {
 						delete _object;
 					}
 					else {
@@ -49,12 +49,78 @@ namespace tj {
 					#endif
 					
 					#ifdef TJ_OS_LINUX
-						long oldValue = *target;
-						*target = value;
+						// __sync_lock_test_and_set is only an acquire barrier; InterlockedExchange is a full barrier
+						long oldValue = __sync_lock_test_and_set(target, value);
+						__sync_synchronize();
 						return oldValue;
-						// There is a #warning in tjthread.cpp to alert that this is not really atomic...
-						// Should use __sync_add_and_fetch or something like that on GCC4.2, but this is
-						// not currently supported on ARM
+					#endif
+				}
+
+				/** Atomically increments the value and returns the new value. This is a full memory barrier. **/
+				static inline ReferenceCount Increment(volatile ReferenceCount* target) {
+					#ifdef TJ_OS_WIN
+						return InterlockedIncrement(target);
+					#endif
+
+					#ifdef TJ_OS_MAC
+						return OSAtomicIncrement32Barrier(target);
+					#endif
+
+					#ifdef TJ_OS_LINUX
+						return __sync_add_and_fetch(target, 1);
+					#endif
+				}
+
+				/** Atomically decrements the value and returns the new value. This is a full memory barrier. **/
+				static inline ReferenceCount Decrement(volatile ReferenceCount* target) {
+					#ifdef TJ_OS_WIN
+						return InterlockedDecrement(target);
+					#endif
+
+					#ifdef TJ_OS_MAC
+						return OSAtomicDecrement32Barrier(target);
+					#endif
+
+					#ifdef TJ_OS_LINUX
+						return __sync_sub_and_fetch(target, 1);
+					#endif
+				}
+
+				/** Atomically replaces the pointer and returns the old value. This is a full memory barrier. **/
+				static inline void* ExchangePointer(void* volatile* target, void* value) {
+					#ifdef TJ_OS_WIN
+						return InterlockedExchangePointer(target, value);
+					#endif
+
+					#ifdef TJ_OS_MAC
+						while(true) {
+							void* oldValue = *target;
+							if(OSAtomicCompareAndSwapPtrBarrier(oldValue, value, target)) {
+								return oldValue;
+							}
+						}
+					#endif
+
+					#ifdef TJ_OS_LINUX
+						void* oldValue = __sync_lock_test_and_set(target, value);
+						__sync_synchronize();
+						return oldValue;
+					#endif
+				}
+
+				/** Full memory barrier: loads and stores before the fence will not be reordered with loads and
+				stores after it (by either the compiler or the processor). **/
+				static inline void Fence() {
+					#ifdef TJ_OS_WIN
+						MemoryBarrier();
+					#endif
+
+					#ifdef TJ_OS_MAC
+						OSMemoryBarrier();
+					#endif
+
+					#ifdef TJ_OS_LINUX
+						__sync_synchronize();
 					#endif
 				}
 		};
@@ -107,9 +173,14 @@ namespace tj {
 				CriticalSection* _cs;
 		};
 
+		/** Storage with a separate value for each thread. When a cleanup function is given, it is called with the value
+		of a thread (if it is not null) when that thread ends. This does not happen for the main thread, and on Windows, it
+		does not happen at all (threads started by Thread clean up what they need themselves). **/
 		class EXPORTED ThreadLocal {
 			public:
-				ThreadLocal();
+				typedef void (*Cleanup)(void* value);
+
+				ThreadLocal(Cleanup cleanup = 0);
 				~ThreadLocal();
 				void* GetValue() const;
 				void SetValue(void* v);
@@ -27,8 +27,13 @@ DataReader::DataReader(const char* code, Bytes size) {
 	_size = size;
 }
 
+DataReader::DataReader(ref<Object> owner, const char* code, Bytes size): _code(const_cast<char*>(code)), _size(size), _owner(owner) {
+}
+
 DataReader::~DataReader() {
-	delete[] _code;
+	if(!_owner) {
+		delete[] _code;
+	}
 	_size = 0;
 }
 
@@ -37,7 +42,7 @@ const char* DataReader::GetBuffer() const {
 }
 
 char* DataReader::TakeOverBuffer(bool clearMine) {
-	if(clearMine) {
+	if(clearMine && !_owner) {
 		char* buf = _code;
 		_size = 0;
 		_code = 0;
@@ -103,7 +103,7 @@ String Endpoint::GetName() const {
 }
 
 /* Resource */
-intern::Resource::Resource(): _referenceCount(0), _weakReferenceCount(0) {
+intern::Resource::Resource(bool local): _referenceCount(0), _weakReferenceCount(0), _local(local) {
 	#ifdef TJ_OS_WIN
 		InterlockedIncrement(&_resourceCount);
 	#endif
@@ -113,7 +113,7 @@ intern::Resource::Resource(): _referenceCount(0), _weakReferenceCount(0) {
 	#endif
 	
 	#ifdef TJ_OS_LINUX
-		_resourceCount++;
+		__sync_add_and_fetch(&_resourceCount, 1);
 	#endif
 }
 
@@ -127,7 +127,7 @@ intern::Resource::~Resource() {
 	#endif
 	
 	#ifdef TJ_OS_LINUX
-		_resourceCount--;
+		__sync_sub_and_fetch(&_resourceCount, 1);
 	#endif
 }
 
@@ -163,29 +163,54 @@ void Recycleable::OnReuse() {
 }
 
 /* RecycleBin */
-unsigned int RecycleBin::_totalObjectCount = 0;
+volatile ReferenceCount RecycleBin::_totalObjectCount = 0;
+volatile ReferenceCount RecycleBin::_reuseCount = 0;
 
 unsigned int RecycleBin::GetTrashObjectCount() {
-	return _totalObjectCount;
+	return (unsigned int)_totalObjectCount;
 }
 
-RecycleBin::RecycleBin(): _lock(new CriticalSection()), _added(0), _removed(0) {
-	for(unsigned int a=0; a<KRecycleBinMaximumSize; a++) {
-		_bin[a] = 0;
-	}
+long RecycleBin::GetReuseCount() {
+	return _reuseCount;
+}
+
+RecycleBin::RecycleBin(unsigned int maximumSize): _maximumSize(maximumSize), _lock(new CriticalSection()) {
 }
 
 RecycleBin::~RecycleBin() {
 	ThreadLock lock(_lock);
 	
-	for(unsigned int a=_removed; a<_added; a++) {
-		delete _bin[a % KRecycleBinMaximumSize]->_resource;
-		delete _bin[a % KRecycleBinMaximumSize];
+	std::deque<Recycleable*>::iterator it = _bin.begin();
+	while(it!=_bin.end()) {
+		Recycleable* rc = *it;
+		delete rc->_resource;
+		delete rc;
+		Atomic::Decrement(&_totalObjectCount);
+		++it;
 	}
+	_bin.clear();
 	
 	delete _lock;
 }
 
+void RecycleBin::SetMaximumSize(unsigned int n) {
+	ThreadLock lock(_lock);
+	_maximumSize = n;
+	
+	// Throw away objects that no longer fit in the bin
+	while(_bin.size() > _maximumSize) {
+		Recycleable* rc = _bin.back();
+		_bin.pop_back();
+		delete rc->_resource;
+		delete rc;
+		Atomic::Decrement(&_totalObjectCount);
+	}
+}
+
+unsigned int RecycleBin::GetMaximumSize() const {
+	return _maximumSize;
+}
+
 void RecycleBin::Reuse(Recycleable* rc) {
 	if(rc==0) {
 		throw NullPointerException();
@@ -206,9 +231,8 @@ void RecycleBin::Reuse(Recycleable* rc) {
 			return;
 		}
 		
-		_bin[_added % KRecycleBinMaximumSize] = rc;
-		++_added;
-		++_totalObjectCount;
+		_bin.push_back(rc);
+		Atomic::Increment(&_totalObjectCount);
 	}
 	else {
 		delete rc->_resource;
@@ -219,11 +243,12 @@ void RecycleBin::Reuse(Recycleable* rc) {
 Recycleable* RecycleBin::Get() {
 	{
 		ThreadLock lock(_lock);
-		if(_removed<_added) {
-			Recycleable* rc = _bin[_removed % KRecycleBinMaximumSize];
-			_bin[_removed % KRecycleBinMaximumSize] = 0;
-			++_removed;
-			--_totalObjectCount;
+		if(!_bin.empty()) {
+			// The most recently recycled object is most likely to still be in the cache
+			Recycleable* rc = _bin.back();
+			_bin.pop_back();
+			Atomic::Decrement(&_totalObjectCount);
+			Atomic::Increment(&_reuseCount);
 			return rc;
 		}
 	}
@@ -231,7 +256,7 @@ Recycleable* RecycleBin::Get() {
 }
 
 bool RecycleBin::WantsToRecycle() const {
-	return (_added-_removed) < KRecycleBinMaximumSize;
+	return _bin.size() < _maximumSize;
 }
 
 /* Serializable */
@@ -396,7 +421,7 @@ void Daemon::Run() {
 				else if(_lastSignal==SIGUSR1) {
 			#endif
 			std::wostringstream info;
-					info << L"GC: " << tj::shared::intern::Resource::GetResourceCount() << L" Threads: " << Thread::GetThreadCount() << L" Trash: " << RecycleBin::GetTrashObjectCount() << L" Locks: " << CriticalSection::GetCriticalSectionCount();
+					info << L"GC: " << tj::shared::intern::Resource::GetResourceCount() << L" Threads: " << Thread::GetThreadCount() << L" Trash: " << RecycleBin::GetTrashObjectCount() << L" Pool: " << Pool::GetAllocationCount() << L"/" << Pool::GetFreeCount() << L" Locks: " << CriticalSection::GetCriticalSectionCount();
 			Log::Write(L"TJShared/Daemon", info.str());
 		}
 		#endif
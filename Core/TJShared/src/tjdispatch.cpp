@@ -14,6 +14,11 @@
  
  #include "../include/tjdispatch.h"
 #include "../include/tjlog.h"
+
+#ifdef TJ_OS_POSIX
+	#include <unistd.h>
+#endif
+
 using namespace tj::shared;
 
 /** Task **/
@@ -88,17 +93,19 @@ void Future::DependsOn(strong<Future> of) {
 			// Dependency already satisfied
 		}
 		else {
-			ref<Future> thisFuture(this);
-			of->_dependent.insert(weak<Future>(thisFuture));
+			of->_dependent.push_back(ref<Future>(this));
 			++_dependencies;
 		}
 	}
 }
 
+/** Called by a dependency of this future after it ran (from a dispatcher thread). When this was the last dependency,
+the future is requeued in the dispatcher; it is put in the queue of the current thread, so it will usually run right
+after its last dependency, on the same thread. **/
 void Future::OnDependencyRan(strong<Future> f) {
 	ThreadLock lock(&_lock);
 	--_dependencies;
-	if(_dependencies==0) {
+	if(_dependencies==0 && IsStalled()) {
 		ref<Dispatcher> disp = Dispatcher::CurrentInstance();
 		if(disp) {
 			disp->Requeue(ref<Task>(this));
@@ -110,20 +117,22 @@ void Future::OnDependencyRan(strong<Future> f) {
 }
 
 void Future::OnAfterRun() {
+	std::vector< ref<Future> > dependent;
 	{
 		ThreadLock lock(&_lock);
-		std::set< weak<Future> >::iterator it = _dependent.begin();
-		while(it!=_dependent.end()) {
-			ref<Future> dep = *it;
-			if(dep) {
-				dep->OnDependencyRan(ref<Future>(this));
-			}
-			++it;
+		dependent.swap(_dependent);
+	}
+
+	// No need to retain the list of dependent futures anymore
+	std::vector< ref<Future> >::iterator it = dependent.begin();
+	while(it!=dependent.end()) {
+		ref<Future> dep = *it;
+		if(dep) {
+			dep->OnDependencyRan(ref<Future>(this));
 		}
+		++it;
 	}
 
-	// No need to retain this list anymore
-	_dependent.clear();
 	_completed.Signal();
 }
 
@@ -131,26 +140,71 @@ bool Future::CanRun() const {
 	return _dependencies==0;
 }
 
+/** DispatcherStatistics **/
+DispatcherStatistics::DispatcherStatistics(): _threads(0), _busyThreads(0), _queued(0), _stalled(0), _processed(0), _steals(0), _wakeups(0) {
+}
+
 /** Dispatcher **/
+namespace tj {
+	namespace shared {
+		namespace dispatch {
+			static int GetProcessorCount() {
+				#ifdef TJ_OS_WIN
+					SYSTEM_INFO info;
+					GetSystemInfo(&info);
+					return int(info.dwNumberOfProcessors);
+				#endif
+
+				#ifdef TJ_OS_POSIX
+					return int(sysconf(_SC_NPROCESSORS_ONLN));
+				#endif
+			}
+		}
+	}
+}
+
 ThreadLocal Dispatcher::_currentDispatcher;
 
-Dispatcher::Dispatcher(int maxThreads, Thread::Priority prio): _maxThreads(maxThreads), _busyThreads(0), _defaultPriority(prio), _itemsProcessed(0), _accepting(true) {
-	// TODO: if maxThreads=0, limit the maximum number of threads to the number of cores in the system * a load factor
+Dispatcher::Dispatcher(int maxThreads, Thread::Priority prio): _accepting(true), _stopping(false), _workerCount(0), _maxThreads(maxThreads), _defaultPriority(prio), _sleepingThreads(0), _completionWaiters(0), _busyThreads(0), _queued(0), _stalledCount(0), _itemsProcessed(0), _steals(0), _wakeups(0) {
 	if(maxThreads==0) {
-		_maxThreads = 2;
+		_maxThreads = Util::Max(2, dispatch::GetProcessorCount());
 	}
+	_workers.resize(_maxThreads, 0);
+
+	_submittedStub._next = 0;
+	_submittedHead = &_submittedStub;
+	_submittedTail = &_submittedStub;
 }
 
 Dispatcher::~Dispatcher() {
 	// The destruction of _threads will cause a WaitForCompletion on each of them; please call Stop/WaitForCompletion first!
+	ThreadLock lock(&_submittedLock);
+	SubmittedTask* node = _submittedTail;
+	while(node!=0) {
+		SubmittedTask* next = node->_next;
+		if(node!=&_submittedStub) {
+			delete node;
+		}
+		node = next;
+	}
 }
 
 unsigned int Dispatcher::GetProcessedItemsCount() const {
-	return _itemsProcessed;
+	return (unsigned int)_itemsProcessed;
 }
 
 unsigned int Dispatcher::GetThreadCount() const {
-	return _threads.size();
+	return (unsigned int)_workerCount;
+}
+
+void Dispatcher::GetStatistics(DispatcherStatistics& stats) const {
+	stats._threads = (unsigned int)_workerCount;
+	stats._busyThreads = (unsigned int)Util::Max((ReferenceCount)0, (ReferenceCount)_busyThreads);
+	stats._queued = (unsigned int)Util::Max((ReferenceCount)0, (ReferenceCount)_queued);
+	stats._stalled = (unsigned int)_stalledCount;
+	stats._processed = (unsigned int)_itemsProcessed;
+	stats._steals = (unsigned int)_steals;
+	stats._wakeups = (unsigned int)_wakeups;
 }
 
 strong<Dispatcher> Dispatcher::CurrentInstance() {
@@ -178,17 +232,14 @@ ref<Dispatcher> Dispatcher::GetCurrent() {
 }
 
 void Dispatcher::Stop() {
-	// Send quit messages (null tasks)
 	{
 		ThreadLock lock(&_lock);
 		_accepting = false;
-		// Dispatch the same quit task as many times as there are threads; this assumes
-		// that threads do not take any new task after receiving a quit task
-		std::set< ref<DispatchThread> >::iterator tit = _threads.begin();
-		while(tit!=_threads.end()) {
-			DispatchTask(null);
-			++tit;
-		}
+		_stopping = true;
+		Atomic::Fence();
+
+		// Threads check _stopping every time they are woken up, and will not take any new task after that
+		_wakeUp.Release(int(_workerCount));
 	}
 	
 	_threads.clear(); // ~DispatcherThread will wait for completion
@@ -201,10 +252,19 @@ void Dispatcher::Requeue(strong<Task> t) {
 	}
 	
 	// Remove from 'stalled' set
-	t->_flags &= (~Task::KTaskStalled);
-	std::set<ref<Task> >::iterator it = _stalled.find(ref<Task>(t));
-	if(it!=_stalled.end()) {
-		_stalled.erase(it);
+	bool found = false;
+	{
+		ThreadLock lock(&_stalledLock);
+		std::set<ref<Task> >::iterator it = _stalled.find(ref<Task>(t));
+		if(it!=_stalled.end()) {
+			_stalled.erase(it);
+			found = true;
+		}
+	}
+
+	if(found) {
+		t->_flags &= (~Task::KTaskStalled);
+		Atomic::Decrement(&_stalledCount);
 		Dispatch(t);
 	}
 	else {
@@ -213,149 +273,276 @@ void Dispatcher::Requeue(strong<Task> t) {
 }
 
 void Dispatcher::DispatchTask(ref<Task> t) {
-	if(t && t->IsEnqueued()) {
+	if(!t) {
+		return;
+	}
+
+	if(t->IsEnqueued()) {
 		Throw(L"Task is already enqueued in (another?) dispatcher!", ExceptionTypeError);
 	}
 
-	ThreadLock lock(&_lock);
-	if(t) {
+	Atomic::Increment(&_itemsProcessed);
+
+	{
 		ThreadLock taskLock(&(t->_lock));
-		++_itemsProcessed;
-		if(t->CanRun()) {
-			t->_flags |= Task::KTaskEnqueued;
-			_queue.push_back(t);
-			_queuedTasks.Release();
-		}
-		else {
+		if(!t->CanRun()) {
 			t->_flags |= Task::KTaskStalled;
+			ThreadLock lock(&_stalledLock);
 			_stalled.insert(t);
+			Atomic::Increment(&_stalledCount);
+			return;
 		}
-		
+		t->_flags |= Task::KTaskEnqueued;
+	}
+
+	// Tasks dispatched from one of our own threads go into the queue of that thread, others are submitted
+	DispatchThread* current = reinterpret_cast<DispatchThread*>(DispatchThread::_currentThread.GetValue());
+	if(current!=0 && current->_dispatcher==this) {
+		ThreadLock lock(&(current->_queueLock));
+		current->_queue.push_back(t);
 	}
 	else {
-		// A null task is always enqueued; it stops the executing dispatcher thread
-		_queue.push_front(t);
-		_queuedTasks.Release();
+		Submit(t);
 	}
+
+	Atomic::Increment(&_queued);
+	WakeUp();
 }
 
-void Dispatcher::WaitForCompletion() {
-	while(true) {
-		{
-			ThreadLock lock(&_lock);
-			if(_queue.size()==0) {
-				return;
+/** Adds a task to the submission queue. This does not lock and never blocks. **/
+void Dispatcher::Submit(ref<Task> t) {
+	SubmittedTask* node = new SubmittedTask();
+	node->_next = 0;
+	node->_task = t;
+
+	SubmittedTask* previous = reinterpret_cast<SubmittedTask*>(Atomic::ExchangePointer(reinterpret_cast<void* volatile*>(&_submittedHead), node));
+	previous->_next = node;
+}
+
+/** Takes the oldest task from the submission queue, and moves a few more tasks to the queue of the given thread
+(from which other threads can steal them). **/
+ref<Task> Dispatcher::TakeSubmitted(DispatchThread* thread) {
+	ref<Task> first;
+	ThreadLock lock(&_submittedLock);
+
+	for(int a=0;a<KMaxSubmittedBatch;a++) {
+		SubmittedTask* tail = _submittedTail;
+		SubmittedTask* next = tail->_next;
+
+		if(tail==&_submittedStub) {
+			if(next==0) {
+				break;
 			}
+			_submittedTail = next;
+			tail = next;
+			next = next->_next;
+		}
+
+		if(next==0) {
+			if(tail!=_submittedHead) {
+				break; // A producer is still adding a node; it will be available shortly
+			}
+
+			// Put the stub back, so the last node can be taken
+			_submittedStub._next = 0;
+			SubmittedTask* previous = reinterpret_cast<SubmittedTask*>(Atomic::ExchangePointer(reinterpret_cast<void* volatile*>(&_submittedHead), &_submittedStub));
+			previous->_next = &_submittedStub;
+			next = tail->_next;
+			if(next==0) {
+				break;
+			}
+		}
+
+		_submittedTail = next;
+		ref<Task> task = tail->_task;
+		delete tail;
+
+		if(!first) {
+			first = task;
+		}
+		else {
+			ThreadLock queueLock(&(thread->_queueLock));
+			thread->_queue.push_back(task);
 		}
-		
-		_taskFinished.Wait();
 	}
+
+	return first;
+}
+
+/** Takes the oldest task from the queue of another thread. **/
+ref<Task> Dispatcher::Steal(DispatchThread* thread) {
+	ReferenceCount count = _workerCount;
+	for(ReferenceCount a=0;a<count;a++) {
+		DispatchThread* victim = _workers[(thread->_nextVictim + a) % count];
+		if(victim!=0 && victim!=thread) {
+			ThreadLock lock(&(victim->_queueLock));
+			if(!victim->_queue.empty()) {
+				ref<Task> task = victim->_queue.front();
+				victim->_queue.pop_front();
+				thread->_nextVictim = (thread->_nextVictim + a) % count;
+				Atomic::Increment(&_steals);
+				return task;
+			}
+		}
+	}
+	return null;
 }
 
-void Dispatcher::Dispatch(strong<Task> t) {
-	ThreadLock lock(&_lock);
-	if(!_accepting) {
-		Throw(L"Dispatcher is stopping, and does not accept new tasks anymore!", ExceptionTypeError);
+/** Returns the next task for the given thread: the newest task in its own queue, then the oldest submitted task, and
+finally a task stolen from another thread. Returns null if there is no work. **/
+ref<Task> Dispatcher::GetNextTask(DispatchThread* thread) {
+	ref<Task> task;
+	{
+		ThreadLock lock(&(thread->_queueLock));
+		if(!thread->_queue.empty()) {
+			task = thread->_queue.back();
+			thread->_queue.pop_back();
+		}
 	}
-	
-	int numThreads = _threads.size();
-
-	/* If there are no threads yet, or the number of busy threads is equal to the number of 
-	available threads (i.e. all threads are busy) create a thread (if the total number of threads
-	is still below the maximum number of threads */
-	if((numThreads<1) || ((_busyThreads>=numThreads) && (int(_maxThreads)>numThreads))) {
-		// Create a new response thread
-		ref<DispatchThread> wrt = GC::Hold(new DispatchThread(this));
+
+	if(!task) {
+		task = TakeSubmitted(thread);
+	}
+
+	if(!task) {
+		task = Steal(thread);
+	}
+
+	if(task) {
+		Atomic::Decrement(&_queued);
+	}
+	return task;
+}
+
+/** Wakes up a sleeping thread, if there is one (and starts a new thread when all threads are busy). **/
+void Dispatcher::WakeUp() {
+	if(_sleepingThreads > 0) {
+		_wakeUp.Release();
+	}
+	else {
+		StartThreadIfNeeded();
+	}
+}
+
+/* If there are no threads yet, or the number of busy threads is equal to the number of available threads (i.e. all
+threads are busy) create a thread (if the total number of threads is still below the maximum number of threads) */
+void Dispatcher::StartThreadIfNeeded() {
+	if(_workerCount >= _maxThreads || (_workerCount > 0 && _busyThreads < _workerCount)) {
+		return;
+	}
+
+	ThreadLock lock(&_lock);
+	ReferenceCount numThreads = _workerCount;
+	if(!_stopping && numThreads < _maxThreads && (numThreads<1 || _busyThreads>=numThreads)) {
+		ref<DispatchThread> wrt = GC::Hold(new DispatchThread(this, (unsigned int)numThreads));
 		_threads.insert(wrt);
+		_workers[numThreads] = wrt.GetPointer();
+		Atomic::Increment(&_workerCount);
 		wrt->Start();
 		wrt->SetPriority(_defaultPriority);
 	}
+}
+
+/** Waits until there are no more queued tasks and no tasks running **/
+void Dispatcher::WaitForCompletion() {
+	Atomic::Increment(&_completionWaiters);
+	while(true) {
+		_taskFinished.Reset();
+
+		// Read _queued before _busyThreads: threads become busy before they take a task from a queue
+		ReferenceCount queued = _queued;
+		Atomic::Fence();
+		if(queued<=0 && _busyThreads<=0) {
+			break;
+		}
+		_taskFinished.Wait(100);
+	}
+	Atomic::Decrement(&_completionWaiters);
+}
+
+void Dispatcher::Dispatch(strong<Task> t) {
+	if(!_accepting) {
+		Throw(L"Dispatcher is stopping, and does not accept new tasks anymore!", ExceptionTypeError);
+	}
 	
 	DispatchTask(t);
 }
 
 /** DispatchThread **/
-DispatchThread::DispatchThread(ref<Dispatcher> d): _dispatcher(d.GetPointer()) {
+ThreadLocal DispatchThread::_currentThread;
+
+DispatchThread::DispatchThread(ref<Dispatcher> d, unsigned int index): _dispatcher(d.GetPointer()), _index(index), _nextVictim(index+1) {
 }
 
 DispatchThread::~DispatchThread() {
 	WaitForCompletion();
 }
 
+void DispatchThread::Execute(ref<Task> task) {
+	try {
+		{
+			ThreadLock taskLock(&(task->_lock));
+			if(!task->CanRun()) {
+				Throw(L"Task from queue, but cannot run!", ExceptionTypeError);
+			}
+			task->_flags &= (~Task::KTaskEnqueued);
+			task->_flags |= Task::KTaskRunning;
+		}
+		
+		Dispatcher::_currentDispatcher.SetValue(reinterpret_cast<void*>(_dispatcher));
+		task->Run();
+		
+		{
+			ThreadLock taskLock(&(task->_lock));
+			task->OnAfterRun();
+			Dispatcher::_currentDispatcher.SetValue(0);
+			task->_flags &= (~Task::KTaskRunning);
+			task->_flags |= Task::KTaskRun;
+		}
+	}
+	catch(const Exception& e) {
+		task->_flags |= Task::KTaskFailed;
+		Log::Write(L"TJShared/DispatcherThread", L"Error occurred when processing client request: "+e.GetMsg());
+	}
+	catch(...) {
+		task->_flags |= Task::KTaskFailed;
+		Log::Write(L"TJShared/DispatcherThread", L"Unknown error occurred when processing client request");
+	}
+}
+
 void DispatchThread::Run() {
 	#ifdef TJ_OS_WIN
 		CoInitializeEx(NULL, COINIT_MULTITHREADED);
 	#endif
 
-	while(true) {
-		Semaphore& queueSemaphore = _dispatcher->_queuedTasks;
-
-		// Wait for a task to appear in the queue; if there is a task, wake up and execute it
-		if(queueSemaphore.Wait()) {
-			ref<Task> task;
-
-			{
-				ThreadLock lock(&(_dispatcher->_lock));	
-				std::deque< ref<Task> >::iterator it = _dispatcher->_queue.begin();
-				if(it==_dispatcher->_queue.end()) {
-					continue;
-				}
-
-				task = *it;
-				_dispatcher->_queue.pop_front();
-				if(task) {
-					++(_dispatcher->_busyThreads);
-				}
-			}
+	_currentThread.SetValue(reinterpret_cast<void*>(this));
 
-			try {
-				if(task) {
-					{
-						ThreadLock taskLock(&(task->_lock));
-						if(!task->CanRun()) {
-							Throw(L"Task from queue, but cannot run!", ExceptionTypeError);
-						}
-						task->_flags &= (~Task::KTaskEnqueued);
-						task->_flags |= Task::KTaskRunning;
-					}
-					
-					Dispatcher::_currentDispatcher.SetValue(reinterpret_cast<void*>(_dispatcher));
-					task->Run();
-					
-					{
-						ThreadLock taskLock(&(task->_lock));
-						task->OnAfterRun();
-						Dispatcher::_currentDispatcher.SetValue(0);
-						task->_flags &= (~Task::KTaskRunning);
-						task->_flags |= Task::KTaskRun;
-						_dispatcher->_taskFinished.Signal();
-					}
-				}
-				else {
-					Log::Write(L"TJShared/DispatchThread", L"Bailing out");
-					return;
-				}
-			}
-			catch(const Exception& e) {
-				if(task) {
-					task->_flags |= Task::KTaskFailed;
-				}
-				Log::Write(L"TJShared/DispatcherThread", L"Error occurred when processing client request: "+e.GetMsg());
-			}
-			catch(...) {
-				if(task) {
-					task->_flags |= Task::KTaskFailed;
-				}
-				Log::Write(L"TJShared/DispatcherThread", L"Unknown error occurred when processing client request");
-			}
+	while(!_dispatcher->_stopping) {
+		// A thread counts as busy while it is looking for work, so WaitForCompletion does not miss a task that was just taken
+		Atomic::Increment(&(_dispatcher->_busyThreads));
+		ref<Task> task = _dispatcher->GetNextTask(this);
+		if(task) {
+			Execute(task);
+		}
+		Atomic::Decrement(&(_dispatcher->_busyThreads));
+
+		if(_dispatcher->_completionWaiters > 0) {
+			_dispatcher->_taskFinished.Signal();
+		}
 
-			{
-				ThreadLock lock(&(_dispatcher->_lock));	
-				--(_dispatcher->_busyThreads);
+		if(!task) {
+			/* Go to sleep. Register as sleeping first and then check again for work: a thread dispatching a task
+			increments _queued before it checks _sleepingThreads, so either it sees us sleeping, or we see its task. */
+			Atomic::Increment(&(_dispatcher->_sleepingThreads));
+			if(_dispatcher->_queued<=0 && !_dispatcher->_stopping) {
+				_dispatcher->_wakeUp.Wait();
+				Atomic::Increment(&(_dispatcher->_wakeups));
 			}
+			Atomic::Decrement(&(_dispatcher->_sleepingThreads));
 		}
 	}
 
+	_currentThread.SetValue(0);
 	Log::Write(L"TJShared/DispatchThread", L"Exiting");
 	
 	#ifdef TJ_OS_WIN
@@ -0,0 +1,258 @@
+/* This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+ 
+ #include "../include/tjshared.h"
+#include <stdlib.h>
+using namespace tj::shared;
+
+namespace tj {
+	namespace shared {
+		namespace pool {
+			struct FreeBlock {
+				FreeBlock* _next;
+			};
+
+			/** Free blocks owned by a single thread; only that thread touches _free and _count, and only that thread
+			writes the statistics counters. **/
+			struct ThreadCache {
+				FreeBlock* _free[Pool::KSizeClasses];
+				unsigned int _count[Pool::KSizeClasses];
+				long _allocations;
+				long _frees;
+				ThreadCache* _previous;
+				ThreadCache* _next;
+			};
+
+			static void ReleaseCache(void* cache);
+
+			/** Shared state of the pool. It is allocated on first use and never deleted, because objects may still be
+			released while static objects are being destroyed. **/
+			struct Central {
+				Central(): _cache(&ReleaseCache), _caches(0), _allocations(0), _frees(0), _arenaSize(0) {
+					for(unsigned int a=0;a<Pool::KSizeClasses;a++) {
+						_free[a] = 0;
+					}
+				}
+
+				CriticalSection _lock;
+				ThreadLocal _cache;	// Releases the cache of a thread when it ends, also for threads not started by Thread
+				FreeBlock* _free[Pool::KSizeClasses];
+				ThreadCache* _caches;
+				long _allocations;	// Counts of caches that were released
+				long _frees;
+				long _arenaSize;
+			};
+
+			const static unsigned int KSlabSize = 16*1024;
+			const static unsigned int KBatchSize = 32;			// Number of blocks moved between a thread cache and the central lists at once
+			const static unsigned int KCacheLimit = 2*KBatchSize;	// Maximum number of blocks per size class in a thread cache
+
+			static Central& GetCentral() {
+				static Central* central = new Central();
+				return *central;
+			}
+
+			// Makes sure the central state is created before main is entered (and before there are any other threads)
+			static Central& _central = GetCentral();
+
+			static inline unsigned int GetSizeClass(size_t size) {
+				return (size==0) ? 0 : (unsigned int)((size-1) / Pool::KGranularity);
+			}
+
+			static ThreadCache* GetThreadCache() {
+				Central& central = GetCentral();
+				ThreadCache* cache = reinterpret_cast<ThreadCache*>(central._cache.GetValue());
+				if(cache==0) {
+					cache = reinterpret_cast<ThreadCache*>(malloc(sizeof(ThreadCache)));
+					if(cache==0) {
+						throw OutOfMemoryException();
+					}
+
+					for(unsigned int a=0;a<Pool::KSizeClasses;a++) {
+						cache->_free[a] = 0;
+						cache->_count[a] = 0;
+					}
+					cache->_allocations = 0;
+					cache->_frees = 0;
+					cache->_previous = 0;
+
+					ThreadLock lock(&central._lock);
+					cache->_next = central._caches;
+					if(central._caches!=0) {
+						central._caches->_previous = cache;
+					}
+					central._caches = cache;
+					central._cache.SetValue(reinterpret_cast<void*>(cache));
+				}
+				return cache;
+			}
+
+			/** Moves up to KBatchSize blocks of the given size class from the central list to the cache, and carves a
+			new slab into blocks if the central list is empty. **/
+			static void Refill(ThreadCache* cache, unsigned int sizeClass) {
+				Central& central = GetCentral();
+				ThreadLock lock(&central._lock);
+
+				if(central._free[sizeClass]==0) {
+					size_t blockSize = (sizeClass+1) * Pool::KGranularity;
+					char* slab = reinterpret_cast<char*>(malloc(KSlabSize));
+					if(slab==0) {
+						throw OutOfMemoryException();
+					}
+					central._arenaSize += KSlabSize;
+
+					unsigned int blocks = (unsigned int)(KSlabSize / blockSize);
+					for(unsigned int a=0;a<blocks;a++) {
+						FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + a*blockSize);
+						block->_next = central._free[sizeClass];
+						central._free[sizeClass] = block;
+					}
+				}
+
+				for(unsigned int a=0;a<KBatchSize && central._free[sizeClass]!=0;a++) {
+					FreeBlock* block = central._free[sizeClass];
+					central._free[sizeClass] = block->_next;
+					block->_next = cache->_free[sizeClass];
+					cache->_free[sizeClass] = block;
+					++(cache->_count[sizeClass]);
+				}
+			}
+
+			/** Moves count blocks of the given size class from the cache back to the central list **/
+			static void Drain(ThreadCache* cache, unsigned int sizeClass, unsigned int count) {
+				Central& central = GetCentral();
+				ThreadLock lock(&central._lock);
+
+				for(unsigned int a=0;a<count && cache->_free[sizeClass]!=0;a++) {
+					FreeBlock* block = cache->_free[sizeClass];
+					cache->_free[sizeClass] = block->_next;
+					--(cache->_count[sizeClass]);
+					block->_next = central._free[sizeClass];
+					central._free[sizeClass] = block;
+				}
+			}
+
+			/** Returns all blocks in a thread cache to the central lists and adds its counters to the totals. This is
+			called when a thread ends, after which the cache is no longer the cache of that thread. **/
+			static void ReleaseCache(void* value) {
+				ThreadCache* cache = reinterpret_cast<ThreadCache*>(value);
+				for(unsigned int a=0;a<Pool::KSizeClasses;a++) {
+					Drain(cache, a, cache->_count[a]);
+				}
+
+				Central& central = GetCentral();
+				ThreadLock lock(&central._lock);
+				central._allocations += cache->_allocations;
+				central._frees += cache->_frees;
+				if(cache->_previous!=0) {
+					cache->_previous->_next = cache->_next;
+				}
+				else {
+					central._caches = cache->_next;
+				}
+
+				if(cache->_next!=0) {
+					cache->_next->_previous = cache->_previous;
+				}
+				free(cache);
+			}
+		}
+	}
+}
+
+void* Pool::Allocate(size_t size) {
+	pool::ThreadCache* cache = pool::GetThreadCache();
+	++(cache->_allocations);
+
+	if(size > KMaximumSize) {
+		void* block = malloc(size);
+		if(block==0) {
+			throw OutOfMemoryException();
+		}
+		return block;
+	}
+
+	unsigned int sizeClass = pool::GetSizeClass(size);
+	if(cache->_free[sizeClass]==0) {
+		pool::Refill(cache, sizeClass);
+	}
+
+	pool::FreeBlock* block = cache->_free[sizeClass];
+	cache->_free[sizeClass] = block->_next;
+	--(cache->_count[sizeClass]);
+	return reinterpret_cast<void*>(block);
+}
+
+void Pool::Free(void* p, size_t size) {
+	if(p==0) {
+		return;
+	}
+
+	pool::ThreadCache* cache = pool::GetThreadCache();
+	++(cache->_frees);
+
+	if(size > KMaximumSize) {
+		free(p);
+		return;
+	}
+
+	// Blocks freed by another thread than the one that allocated them simply end up in the cache of this thread
+	unsigned int sizeClass = pool::GetSizeClass(size);
+	pool::FreeBlock* block = reinterpret_cast<pool::FreeBlock*>(p);
+	block->_next = cache->_free[sizeClass];
+	cache->_free[sizeClass] = block;
+	++(cache->_count[sizeClass]);
+
+	if(cache->_count[sizeClass] > pool::KCacheLimit) {
+		pool::Drain(cache, sizeClass, pool::KBatchSize);
+	}
+}
+
+void Pool::ReleaseThreadCache() {
+	pool::Central& central = pool::GetCentral();
+	void* cache = central._cache.GetValue();
+	if(cache!=0) {
+		central._cache.SetValue(0);
+		pool::ReleaseCache(cache);
+	}
+}
+
+/** Returns the number of allocations made through the pool (including those passed on to malloc) since the program
+started. The counters of other threads are read without synchronization, so the result may be slightly behind. **/
+long Pool::GetAllocationCount() {
+	pool::Central& central = pool::GetCentral();
+	ThreadLock lock(&central._lock);
+	long count = central._allocations;
+	for(pool::ThreadCache* cache = central._caches; cache!=0; cache = cache->_next) {
+		count += cache->_allocations;
+	}
+	return count;
+}
+
+long Pool::GetFreeCount() {
+	pool::Central& central = pool::GetCentral();
+	ThreadLock lock(&central._lock);
+	long count = central._frees;
+	for(pool::ThreadCache* cache = central._caches; cache!=0; cache = cache->_next) {
+		count += cache->_frees;
+	}
+	return count;
+}
+
+/** Returns the number of bytes allocated for slabs **/
+long Pool::GetArenaSize() {
+	pool::Central& central = pool::GetCentral();
+	ThreadLock lock(&central._lock);
+	return central._arenaSize;
+}
@@ -53,6 +53,7 @@ namespace tj {
 					Log::Write(L"TJShared/Thread", L"Thread ended because an unknown exception was thrown");
 				}
 				
+				Pool::ReleaseThreadCache();
 				InterlockedDecrement(&Thread::_count);
 				return 0;
 			}
@@ -66,7 +67,7 @@ namespace tj {
 					#endif
 					
 					#ifdef TJ_OS_LINUX
-						Thread::_count++;
+						__sync_add_and_fetch(&Thread::_count, 1);
 					#endif
 					
 					Thread* tr = (Thread*)arg;
@@ -82,12 +83,14 @@ namespace tj {
 					Log::Write(L"TJShared/Thread", L"Thread ended because an unknown exception was thrown");
 				}
 				
+				Pool::ReleaseThreadCache();
+				
 				#ifdef TJ_OS_MAC
 					OSAtomicAdd32(-1, &Thread::_count);
 				#endif
 				
 				#ifdef TJ_OS_LINUX
-					Thread::_count--;
+					__sync_sub_and_fetch(&Thread::_count, 1);
 				#endif
 				
 				return NULL;
@@ -296,7 +299,10 @@ void Thread::WaitForCompletion() {
 			std::wstring emsg = wos.str();
 			Throw(emsg.c_str(), ExceptionTypeError);
 		}
-	#endif	
+
+		// A joined thread must not be detached (in the destructor) or joined again
+		_thread = 0;
+	#endif
 }
 
 void Thread::Terminate() {
@@ -408,8 +414,9 @@ void Thread::Sleep(double ms) {
 				gettimeofday(&now, NULL);
 				
 				struct timespec abstime;
-				abstime.tv_sec = now.tv_sec + (ms / 1000);
-				abstime.tv_nsec = (now.tv_usec + ((ms % 1000)*1000*1000));
+				long long nsec = (long long)(now.tv_usec)*1000LL + (long long)(ms % 1000)*1000LL*1000LL;
+				abstime.tv_sec = now.tv_sec + (ms / 1000) + (time_t)(nsec / 1000000000LL);
+				abstime.tv_nsec = (long)(nsec % 1000000000LL);
 				return sem_timedwait(&_sema, &abstime)==0; /* When timing out, returns ETIMEOUT */
 			}
 		}
@@ -502,11 +509,19 @@ void Thread::Sleep(double ms) {
 			gettimeofday(&now, NULL);
 			
 			struct timespec abstime;
-			abstime.tv_sec = now.tv_sec + (ms / 1000);
-			abstime.tv_nsec = (now.tv_usec + ((ms % 1000)*1000*1000));
-			int r = pthread_cond_timedwait(&_event, &_lock, &abstime); /* When timing out, pthread_cond_timedwait returns ETIMEOUT */
+			long long nsec = (long long)(now.tv_usec)*1000LL + (long long)(ms % 1000)*1000LL*1000LL;
+			abstime.tv_sec = now.tv_sec + (ms / 1000) + (time_t)(nsec / 1000000000LL);
+			abstime.tv_nsec = (long)(nsec % 1000000000LL);
+
+			while(_signalCount<=0) {
+				int r = pthread_cond_timedwait(&_event, &_lock, &abstime); /* When timing out, pthread_cond_timedwait returns ETIMEDOUT */
+				if(r!=0) {
+					break;
+				}
+			}
+
 			if(_signalCount>0) {
-				success = (r==0);
+				success = true;
 				--_signalCount;
 			}
 			else {
@@ -521,7 +536,7 @@ void Thread::Sleep(double ms) {
 
 /* ThreadLocal; Windows implementation uses TLS */
 #ifdef TJ_OS_WIN
-	ThreadLocal::ThreadLocal() {
+	ThreadLocal::ThreadLocal(Cleanup cleanup) {
 		_tls = TlsAlloc();
 		if(_tls==TLS_OUT_OF_INDEXES) {
 			Throw(L"Cannot create thread-local storage", ExceptionTypeSevere);
@@ -542,8 +557,8 @@ void Thread::Sleep(double ms) {
 #endif
 
 #ifdef TJ_USE_PTHREADS
-	ThreadLocal::ThreadLocal() {
-		pthread_key_create(&_tls, NULL);
+	ThreadLocal::ThreadLocal(Cleanup cleanup) {
+		pthread_key_create(&_tls, cleanup);
 	}
 
 	ThreadLocal::~ThreadLocal() {
@@ -29,6 +29,10 @@
 	#include <stdint.h>
 #endif
 
+#ifdef TJ_OS_MAC
+	#include <mach/mach_time.h>
+#endif
+
 #ifdef TJ_OS_WIN
 	#include <intsafe.h>
 #endif
@@ -339,9 +343,25 @@ Timestamp::Timestamp(bool now) {
 	}
 }
 
+/** Timestamps are taken from a monotonic clock, so they can be used for scheduling and measuring intervals, even
+when the wall clock is adjusted. They are not related to Date. **/
 void Timestamp::Now() {
-	#ifdef TJ_OS_POSIX
-		_time = Date::GetAbsoluteDate();
+	#ifdef TJ_OS_MAC
+		static mach_timebase_info_data_t timebase = {0, 0};
+		if(timebase.denom==0) {
+			mach_timebase_info(&timebase);
+		}
+		_time = ((long double)mach_absolute_time() * (long double)timebase.numer / (long double)timebase.denom) / 1.0E9;
+	#endif
+
+	#ifdef TJ_OS_LINUX
+		struct timespec ts;
+		if(clock_gettime(CLOCK_MONOTONIC, &ts)==0) {
+			_time = (long double)ts.tv_sec + (1.0E-9 * (long double)ts.tv_nsec);
+		}
+		else {
+			_time = Date::GetAbsoluteDate();
+		}
 	#endif
 
 	#ifdef TJ_OS_WIN
@@ -0,0 +1,162 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Measures the throughput of the Dispatcher with 1 up to 8 threads for:
+- submitted: millions of tiny tasks dispatched from the main thread (the submission queue);
+- local: the same number of tasks dispatched by a task running on the dispatcher (per-thread queues and stealing);
+- futures: layered DAGs of futures, where each future depends on two futures of the layer before it. All futures are
+  dispatched before their dependencies, so every future except the first layer stalls and is requeued.
+All tasks are counted, so a lost or repeated task shows up as an error. Output goes to stderr (Log::Write uses wide output
+on stdout). Usage: tjdispatchbench [tasks] [layers] [width] */
+#include <TJShared/include/tjshared.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace tj::shared;
+
+namespace tj {
+	namespace shared {
+		namespace test {
+			class TinyTask: public Task {
+				public:
+					TinyTask(volatile ReferenceCount* counter): _counter(counter) {
+					}
+
+					virtual ~TinyTask() {
+					}
+
+					virtual void Run() {
+						Atomic::Increment(_counter);
+					}
+
+				private:
+					volatile ReferenceCount* _counter;
+			};
+
+			class TinyFuture: public Future {
+				public:
+					TinyFuture(volatile ReferenceCount* counter): _counter(counter) {
+					}
+
+					virtual ~TinyFuture() {
+					}
+
+					virtual void Run() {
+						Atomic::Increment(_counter);
+					}
+
+				private:
+					volatile ReferenceCount* _counter;
+			};
+
+			/** Dispatches all tasks from a dispatcher thread **/
+			class SpawningTask: public Task {
+				public:
+					SpawningTask(int count, volatile ReferenceCount* counter): _count(count), _counter(counter) {
+					}
+
+					virtual ~SpawningTask() {
+					}
+
+					virtual void Run() {
+						strong<Dispatcher> dispatcher = Dispatcher::CurrentInstance();
+						for(int a=0;a<_count;a++) {
+							dispatcher->Dispatch(ref<Task>(GC::Hold(new TinyTask(_counter))));
+						}
+					}
+
+				private:
+					int _count;
+					volatile ReferenceCount* _counter;
+			};
+
+			static int Report(const char* name, int threads, int expected, volatile ReferenceCount& counter, const Timestamp& start, ref<Dispatcher> d) {
+				double ms = double(Timestamp(true).Difference(start).ToMilliSeconds());
+				DispatcherStatistics stats;
+				d->GetStatistics(stats);
+				int errors = (counter==expected) ? 0 : 1;
+				fprintf(stderr, "%s, %d thread(s): %d tasks in %.1f ms (%.0f tasks/s, %.0f ns each), %u steals, %u wake-ups%s\n", name, threads, expected, ms,
+					double(expected)*1000.0/ms, ms*1000000.0/expected, stats._steals, stats._wakeups, errors ? ", WRONG COUNT" : "");
+				return errors;
+			}
+
+			static int RunSubmitted(int threads, int tasks) {
+				ref<Dispatcher> d = GC::Hold(new Dispatcher(threads));
+				volatile ReferenceCount counter = 0;
+				Timestamp start(true);
+				for(int a=0;a<tasks;a++) {
+					d->Dispatch(ref<Task>(GC::Hold(new TinyTask(&counter))));
+				}
+				d->WaitForCompletion();
+				int errors = Report("submitted", threads, tasks, counter, start, d);
+				d->Stop();
+				return errors;
+			}
+
+			static int RunLocal(int threads, int tasks) {
+				ref<Dispatcher> d = GC::Hold(new Dispatcher(threads));
+				volatile ReferenceCount counter = 0;
+				Timestamp start(true);
+				d->Dispatch(ref<Task>(GC::Hold(new SpawningTask(tasks, &counter))));
+				d->WaitForCompletion();
+				int errors = Report("local", threads, tasks, counter, start, d);
+				d->Stop();
+				return errors;
+			}
+
+			static int RunFutures(int threads, int layers, int width) {
+				ref<Dispatcher> d = GC::Hold(new Dispatcher(threads));
+				volatile ReferenceCount counter = 0;
+
+				// Building the graph is not measured
+				std::vector< ref<TinyFuture> > futures;
+				futures.reserve(layers*width);
+				for(int l=0;l<layers;l++) {
+					for(int w=0;w<width;w++) {
+						ref<TinyFuture> f = GC::Hold(new TinyFuture(&counter));
+						if(l > 0) {
+							f->DependsOn(ref<Future>(futures[(l-1)*width + w]));
+							f->DependsOn(ref<Future>(futures[(l-1)*width + (w+1)%width]));
+						}
+						futures.push_back(f);
+					}
+				}
+
+				Timestamp start(true);
+				for(int a=layers*width-1;a>=0;a--) {
+					d->Dispatch(ref<Task>(futures[a]));
+				}
+				d->WaitForCompletion();
+				int errors = Report("futures", threads, layers*width, counter, start, d);
+				d->Stop();
+				return errors;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::shared::test;
+	int tasks = (argc > 1) ? atoi(argv[1]) : 1000000;
+	int layers = (argc > 2) ? atoi(argv[2]) : 100;
+	int width = (argc > 3) ? atoi(argv[3]) : 1000;
+
+	int errors = 0;
+	for(int threads=1;threads<=8;threads*=2) {
+		errors += RunSubmitted(threads, tasks);
+		errors += RunLocal(threads, tasks);
+		errors += RunFutures(threads, layers, width);
+	}
+	return (errors==0) ? 0 : 1;
+}
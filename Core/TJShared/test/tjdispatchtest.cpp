@@ -0,0 +1,350 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Tests the work-stealing Dispatcher:
+- Stealing: a task fills the queue of its own thread and then blocks that thread; the other threads must steal the tasks.
+- Futures: futures that are dispatched before their dependencies stall, and are requeued when the last dependency ran;
+  no future may run before any of its dependencies. Requeueing a task that is not stalled is an error.
+- Completion: WaitForCompletion also waits for tasks that are dispatched by running tasks.
+- Submission: many foreign threads dispatch at the same time (through the lock-free submission queue); every task must
+  run exactly once.
+- Wake-up: a task dispatched when all threads are asleep must be picked up (no lost wake-ups).
+The results are written to stderr, because the log of the dispatch threads makes stdout wide-oriented.
+Usage: tjdispatchtest */
+#include <TJShared/include/tjshared.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace tj::shared;
+
+namespace tj {
+	namespace shared {
+		namespace test {
+			const static int KThreads = 4;
+			static int _failures = 0;
+
+			static void Check(bool ok, const char* what) {
+				if(!ok) {
+					fprintf(stderr, "failed: %s\n", what);
+					++_failures;
+				}
+			}
+
+			static void Wait(int ms) {
+				Event wait;
+				wait.Wait(ms);
+			}
+
+			/** Counts how often it was run; signals an event when the shared counter reaches a target **/
+			class CountingTask: public Task {
+				public:
+					CountingTask(volatile ReferenceCount* counter, ReferenceCount target = -1, Event* reached = 0): _counter(counter), _target(target), _reached(reached), _runs(0) {
+					}
+
+					virtual ~CountingTask() {
+					}
+
+					virtual void Run() {
+						Atomic::Increment(&_runs);
+						if(Atomic::Increment(&_counter[0])==_target && _reached!=0) {
+							_reached->Signal();
+						}
+					}
+
+					volatile ReferenceCount* _counter;
+					ReferenceCount _target;
+					Event* _reached;
+					volatile ReferenceCount _runs;
+			};
+
+			/** Puts many tasks in the queue of its own thread, then keeps that thread busy until they have all run **/
+			class SpawningTask: public Task {
+				public:
+					SpawningTask(int count): _count(count), _counter(0), _allRan(false) {
+					}
+
+					virtual ~SpawningTask() {
+					}
+
+					virtual void Run() {
+						strong<Dispatcher> dispatcher = Dispatcher::CurrentInstance();
+						for(int a=0;a<_count;a++) {
+							dispatcher->Dispatch(ref<Task>(GC::Hold(new CountingTask(&_counter, _count, &_reached))));
+						}
+						_allRan = _reached.Wait(10000);
+					}
+
+					int _count;
+					volatile ReferenceCount _counter;
+					Event _reached;
+					bool _allRan;
+			};
+
+			static void TestStealing() {
+				const int n = 1000;
+				ref<Dispatcher> d = GC::Hold(new Dispatcher(KThreads));
+				ref<SpawningTask> spawner = GC::Hold(new SpawningTask(n));
+				d->Dispatch(ref<Task>(spawner));
+				d->WaitForCompletion();
+
+				DispatcherStatistics stats;
+				d->GetStatistics(stats);
+				fprintf(stderr, "stealing: %d tasks, %u threads, %u steals\n", (int)spawner->_counter, stats._threads, stats._steals);
+				Check(spawner->_allRan, "stealing: tasks in the queue of a blocked thread ran");
+				Check(spawner->_counter==n, "stealing: all tasks ran");
+				Check(stats._steals >= (unsigned int)n, "stealing: all tasks were stolen");
+				Check(stats._threads > 1, "stealing: more threads were started");
+				d->Stop();
+			}
+
+			/** Writes its index to a shared log when it runs **/
+			class RecordingFuture: public Future {
+				public:
+					RecordingFuture(int index, std::vector<int>* log, CriticalSection* logLock): _index(index), _log(log), _logLock(logLock) {
+					}
+
+					virtual ~RecordingFuture() {
+					}
+
+					virtual void Run() {
+						ThreadLock lock(_logLock);
+						_log->push_back(_index);
+					}
+
+					int _index;
+					std::vector<int>* _log;
+					CriticalSection* _logLock;
+			};
+
+			static void TestFutures() {
+				ref<Dispatcher> d = GC::Hold(new Dispatcher(KThreads));
+				std::vector<int> log;
+				CriticalSection logLock;
+
+				/* A diamond (0 -> 1,2 -> 3) followed by a chain 3 -> 4 -> ... -> 19, and a future (20) that depends on
+				all others. dependencies[a] lists the futures that future a depends on. */
+				const int n = 21;
+				std::vector< ref<RecordingFuture> > futures;
+				std::vector< std::vector<int> > dependencies(n);
+				for(int a=0;a<n;a++) {
+					futures.push_back(GC::Hold(new RecordingFuture(a, &log, &logLock)));
+				}
+				dependencies[1].push_back(0);
+				dependencies[2].push_back(0);
+				dependencies[3].push_back(1);
+				dependencies[3].push_back(2);
+				for(int a=4;a<n-1;a++) {
+					dependencies[a].push_back(a-1);
+				}
+				for(int a=0;a<n-1;a++) {
+					dependencies[n-1].push_back(a);
+				}
+				for(int a=0;a<n;a++) {
+					for(unsigned int b=0;b<dependencies[a].size();b++) {
+						futures[a]->DependsOn(ref<Future>(futures[dependencies[a][b]]));
+					}
+				}
+
+				// Everything except the root stalls
+				for(int a=n-1;a>0;a--) {
+					d->Dispatch(ref<Task>(futures[a]));
+				}
+				DispatcherStatistics stats;
+				d->GetStatistics(stats);
+				Check(stats._stalled==(unsigned int)(n-1), "futures: futures with dependencies stall");
+				Check(futures[3]->IsStalled() && !futures[3]->IsRun(), "futures: a stalled future does not run");
+
+				bool threw = false;
+				try {
+					d->Requeue(ref<Task>(futures[0]));
+				}
+				catch(const Exception&) {
+					threw = true;
+				}
+				Check(threw, "futures: requeueing a task that is not stalled is an error");
+
+				d->Dispatch(ref<Task>(futures[0]));
+				Check(futures[0]->WaitForCompletion(Time(5000)), "futures: the root completes");
+				d->WaitForCompletion();
+				Check(futures[n-1]->IsRun() && !futures[n-1]->IsStalled(), "futures: the last future was requeued and ran");
+
+				// Every future ran once, after all of its dependencies
+				std::vector<int> position(n, -1);
+				for(unsigned int a=0;a<log.size();a++) {
+					Check(position[log[a]]==-1, "futures: a future ran only once");
+					position[log[a]] = (int)a;
+				}
+				Check(log.size()==(unsigned int)n, "futures: all futures ran");
+				for(int a=0;a<n;a++) {
+					for(unsigned int b=0;b<dependencies[a].size();b++) {
+						Check(position[dependencies[a][b]] < position[a], "futures: a future runs after its dependencies");
+					}
+				}
+
+				d->GetStatistics(stats);
+				Check(stats._stalled==0, "futures: no futures are still stalled");
+
+				// A future that depends on a future that already ran can run immediately
+				ref<RecordingFuture> late = GC::Hold(new RecordingFuture(n, &log, &logLock));
+				late->DependsOn(ref<Future>(futures[n-1]));
+				Check(late->CanRun(), "futures: a dependency that already ran is satisfied");
+				d->Dispatch(ref<Task>(late));
+				Check(late->WaitForCompletion(Time(5000)), "futures: a future without open dependencies runs");
+				d->WaitForCompletion();
+				d->Stop();
+			}
+
+			/** Sleeps for a while, then dispatches a number of children that do the same, until the depth is zero **/
+			class TreeTask: public Task {
+				public:
+					TreeTask(int depth, volatile ReferenceCount* counter): _depth(depth), _counter(counter) {
+					}
+
+					virtual ~TreeTask() {
+					}
+
+					virtual void Run() {
+						Wait(1);
+						Atomic::Increment(_counter);
+						if(_depth > 0) {
+							strong<Dispatcher> dispatcher = Dispatcher::CurrentInstance();
+							for(int a=0;a<3;a++) {
+								dispatcher->Dispatch(ref<Task>(GC::Hold(new TreeTask(_depth-1, _counter))));
+							}
+						}
+					}
+
+					int _depth;
+					volatile ReferenceCount* _counter;
+			};
+
+			static void TestCompletion() {
+				ref<Dispatcher> d = GC::Hold(new Dispatcher(KThreads));
+				volatile ReferenceCount counter = 0;
+				d->Dispatch(ref<Task>(GC::Hold(new TreeTask(4, &counter))));
+				d->WaitForCompletion();
+
+				// 1 + 3 + 9 + 27 + 81 tasks
+				DispatcherStatistics stats;
+				d->GetStatistics(stats);
+				fprintf(stderr, "completion: %d tasks, %u steals\n", (int)counter, stats._steals);
+				Check(counter==121, "completion: WaitForCompletion waits for tasks dispatched by tasks");
+				Check(stats._queued==0 && stats._busyThreads==0, "completion: nothing queued or running afterwards");
+				d->Stop();
+			}
+
+			/** Dispatches tasks from a thread that is not a dispatcher thread **/
+			class ProducerThread: public Thread {
+				public:
+					ProducerThread(ref<Dispatcher> d, int count, volatile ReferenceCount* counter): _dispatcher(d), _count(count), _counter(counter) {
+					}
+
+					virtual ~ProducerThread() {
+					}
+
+					virtual void Run() {
+						for(int a=0;a<_count;a++) {
+							ref<CountingTask> task = GC::Hold(new CountingTask(_counter));
+							_tasks.push_back(task);
+							_dispatcher->Dispatch(ref<Task>(task));
+						}
+					}
+
+					ref<Dispatcher> _dispatcher;
+					int _count;
+					volatile ReferenceCount* _counter;
+					std::vector< ref<CountingTask> > _tasks;
+			};
+
+			static void TestSubmission() {
+				const int producers = 8;
+				const int n = 20000;
+				ref<Dispatcher> d = GC::Hold(new Dispatcher(KThreads));
+				volatile ReferenceCount counter = 0;
+
+				std::vector< ref<ProducerThread> > threads;
+				for(int a=0;a<producers;a++) {
+					threads.push_back(GC::Hold(new ProducerThread(d, n, &counter)));
+				}
+				for(int a=0;a<producers;a++) {
+					threads[a]->Start();
+				}
+				for(int a=0;a<producers;a++) {
+					threads[a]->WaitForCompletion();
+				}
+				d->WaitForCompletion();
+
+				int wrong = 0;
+				for(int a=0;a<producers;a++) {
+					for(int b=0;b<n;b++) {
+						ref<CountingTask> task = threads[a]->_tasks[b];
+						if(task->_runs!=1 || !task->IsRun() || task->IsEnqueued()) {
+							++wrong;
+						}
+					}
+				}
+
+				DispatcherStatistics stats;
+				d->GetStatistics(stats);
+				fprintf(stderr, "submission: %d producers, %d tasks, %d ran, %d not run exactly once, %u processed\n", producers, producers*n, (int)counter, wrong, stats._processed);
+				Check(counter==producers*n, "submission: all submitted tasks ran");
+				Check(wrong==0, "submission: every task ran exactly once");
+				Check(stats._processed==(unsigned int)(producers*n), "submission: every task was counted once");
+				d->Stop();
+			}
+
+			static void TestWakeUp() {
+				const int n = 50;
+				ref<Dispatcher> d = GC::Hold(new Dispatcher(KThreads));
+				volatile ReferenceCount counter = 0;
+				int missed = 0;
+
+				// Start all threads, then let them go to sleep before every dispatch
+				for(int a=0;a<KThreads*4;a++) {
+					d->Dispatch(ref<Task>(GC::Hold(new CountingTask(&counter))));
+				}
+				d->WaitForCompletion();
+
+				for(int a=0;a<n;a++) {
+					Wait(10);
+					Event ran;
+					ReferenceCount target = counter + 1;
+					d->Dispatch(ref<Task>(GC::Hold(new CountingTask(&counter, target, &ran))));
+					if(!ran.Wait(5000)) {
+						++missed;
+					}
+				}
+				d->WaitForCompletion();
+
+				DispatcherStatistics stats;
+				d->GetStatistics(stats);
+				fprintf(stderr, "wake-up: %d tasks dispatched to sleeping threads, %d missed, %u wake-ups\n", n, missed, stats._wakeups);
+				Check(missed==0, "wake-up: a sleeping thread picks up a new task");
+				Check(stats._wakeups >= (unsigned int)n, "wake-up: threads were woken up for the new tasks");
+				d->Stop();
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::shared::test;
+	TestStealing();
+	TestFutures();
+	TestCompletion();
+	TestSubmission();
+	TestWakeUp();
+	fprintf(stderr, "%d failures\n", _failures);
+	return (_failures==0) ? 0 : 1;
+}
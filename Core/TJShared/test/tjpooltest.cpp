@@ -0,0 +1,293 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Unit test of the size-class Pool:
+- Classes: blocks of every size up to KMaximumSize are aligned, do not overlap, and are reused after they are freed.
+- Cross-thread: blocks allocated on one thread and freed on another go back to the pool; after many rounds, the arena
+  has not grown beyond the first round.
+- Foreign threads: threads that were not started by Thread (plain pthreads) release their cache when they end.
+- Large: sizes over the largest class are passed on to malloc (also for Pooled classes deleted through their base).
+Usage: tjpooltest */
+#include <TJShared/include/tjshared.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <set>
+
+using namespace tj::shared;
+
+namespace tj {
+	namespace shared {
+		namespace test {
+			static int _failures = 0;
+
+			static void Check(bool ok, const char* what) {
+				if(!ok) {
+					printf("failed: %s\n", what);
+					++_failures;
+				}
+			}
+
+			static void TestClasses() {
+				std::vector<char*> blocks;
+				std::vector<size_t> sizes;
+				for(size_t size=1;size<=Pool::KMaximumSize;size++) {
+					for(int a=0;a<4;a++) {
+						char* block = reinterpret_cast<char*>(Pool::Allocate(size));
+						memset(block, int(size & 0xFF), size);
+						blocks.push_back(block);
+						sizes.push_back(size);
+					}
+				}
+
+				// Every block still holds its own pattern (so no two blocks overlap) and is aligned to the granularity
+				bool intact = true, aligned = true;
+				std::set<char*> distinct;
+				for(unsigned int a=0;a<blocks.size();a++) {
+					distinct.insert(blocks[a]);
+					aligned = aligned && ((size_t)blocks[a] % Pool::KGranularity)==0;
+					for(size_t b=0;b<sizes[a];b++) {
+						if(blocks[a][b]!=char(sizes[a] & 0xFF)) {
+							intact = false;
+						}
+					}
+				}
+				Check(distinct.size()==blocks.size(), "classes: all blocks are distinct");
+				Check(intact, "classes: blocks do not overlap");
+				Check(aligned, "classes: blocks are aligned to the granularity");
+
+				for(unsigned int a=0;a<blocks.size();a++) {
+					Pool::Free(blocks[a], sizes[a]);
+				}
+
+				// The most recently freed block of a size class is handed out first, also for a different size in that class
+				void* first = Pool::Allocate(40);
+				Pool::Free(first, 40);
+				void* second = Pool::Allocate(33);
+				Check(first==second, "classes: a freed block is reused within its size class");
+				Pool::Free(second, 33);
+
+				long arena = Pool::GetArenaSize();
+				for(int a=0;a<10000;a++) {
+					Pool::Free(Pool::Allocate(64), 64);
+				}
+				Check(Pool::GetArenaSize()==arena, "classes: allocating and freeing does not grow the arena");
+			}
+
+			/** Allocates blocks and hands them to the other side of a queue **/
+			class AllocatingThread: public Thread {
+				public:
+					AllocatingThread(int count, size_t size, std::vector<void*>& out, CriticalSection& lock): _count(count), _size(size), _out(out), _lock(lock) {
+					}
+
+					virtual ~AllocatingThread() {
+					}
+
+				protected:
+					virtual void Run() {
+						for(int a=0;a<_count;a++) {
+							void* block = Pool::Allocate(_size);
+							memset(block, 0x5A, _size);
+							ThreadLock lock(&_lock);
+							_out.push_back(block);
+						}
+					}
+
+					int _count;
+					size_t _size;
+					std::vector<void*>& _out;
+					CriticalSection& _lock;
+			};
+
+			/** Frees the blocks allocated by an AllocatingThread, after checking their contents **/
+			class FreeingThread: public Thread {
+				public:
+					FreeingThread(int count, size_t size, std::vector<void*>& in, CriticalSection& lock): _count(count), _size(size), _in(in), _lock(lock), _corrupt(0) {
+					}
+
+					virtual ~FreeingThread() {
+					}
+
+					int GetCorruptCount() const {
+						return _corrupt;
+					}
+
+				protected:
+					virtual void Run() {
+						int freed = 0;
+						while(freed < _count) {
+							void* block = 0;
+							{
+								ThreadLock lock(&_lock);
+								if(!_in.empty()) {
+									block = _in.back();
+									_in.pop_back();
+								}
+							}
+
+							if(block==0) {
+								Thread::Sleep(0.1);
+								continue;
+							}
+
+							for(size_t a=0;a<_size;a++) {
+								if(reinterpret_cast<unsigned char*>(block)[a]!=0x5A) {
+									++_corrupt;
+									break;
+								}
+							}
+							Pool::Free(block, _size);
+							++freed;
+						}
+					}
+
+					int _count;
+					size_t _size;
+					std::vector<void*>& _in;
+					CriticalSection& _lock;
+					int _corrupt;
+			};
+
+			static void TestCrossThread() {
+				const int n = 10000;
+				const size_t size = 48;
+				const int rounds = 10;
+				long allocations = Pool::GetAllocationCount();
+				long frees = Pool::GetFreeCount();
+				long arenaAfterFirst = 0;
+				int corrupt = 0;
+
+				for(int r=0;r<rounds;r++) {
+					std::vector<void*> queue;
+					CriticalSection lock;
+					ref<AllocatingThread> producer = GC::Hold(new AllocatingThread(n, size, queue, lock));
+					ref<FreeingThread> consumer = GC::Hold(new FreeingThread(n, size, queue, lock));
+					producer->Start();
+					consumer->Start();
+					producer->WaitForCompletion();
+					consumer->WaitForCompletion();
+					corrupt += consumer->GetCorruptCount();
+					if(r==0) {
+						arenaAfterFirst = Pool::GetArenaSize();
+					}
+				}
+
+				// GC::Hold and the threads themselves also use the pool, so only a lower bound is known for the counts
+				long allocated = Pool::GetAllocationCount() - allocations;
+				long freed = Pool::GetFreeCount() - frees;
+				printf("cross-thread: %d rounds of %d blocks, %ld allocations, %ld frees, arena %ld bytes after the first round, %ld after the last\n", rounds, n, allocated, freed, arenaAfterFirst, Pool::GetArenaSize());
+				Check(corrupt==0, "cross-thread: blocks arrive intact on the freeing thread");
+				Check(allocated >= rounds*n && freed >= rounds*n, "cross-thread: all allocations and frees are counted");
+				Check(Pool::GetArenaSize()==arenaAfterFirst, "cross-thread: blocks freed on another thread are reused");
+			}
+
+			/** Body of a plain pthread: allocates a full slab of the largest size class and frees it again, so that all
+			blocks end up in the cache of this thread **/
+			static void* ForeignThread(void* arg) {
+				const unsigned int blocks = 64;
+				void* allocated[blocks];
+				for(unsigned int a=0;a<blocks;a++) {
+					allocated[a] = Pool::Allocate(Pool::KMaximumSize);
+				}
+				for(unsigned int a=0;a<blocks;a++) {
+					Pool::Free(allocated[a], Pool::KMaximumSize);
+				}
+				return 0;
+			}
+
+			static void TestForeignThreads() {
+				const int threads = 20;
+				long arena = 0;
+				for(int a=0;a<threads;a++) {
+					pthread_t thread;
+					pthread_create(&thread, 0, ForeignThread, 0);
+					pthread_join(thread, 0);
+					if(a==0) {
+						arena = Pool::GetArenaSize();
+					}
+				}
+				printf("foreign threads: arena %ld bytes after the first thread, %ld after %d threads\n", arena, Pool::GetArenaSize(), threads);
+				Check(Pool::GetArenaSize()==arena, "foreign threads: the cache of a thread not started by Thread is released when it ends");
+			}
+
+			class LargePooled: public Pooled {
+				public:
+					virtual ~LargePooled() {
+					}
+
+					char _data[Pool::KMaximumSize];
+			};
+
+			class LargerPooled: public LargePooled {
+				public:
+					virtual ~LargerPooled() {
+					}
+
+					char _more[Pool::KMaximumSize*4];
+			};
+
+			class SmallPooled: public Pooled {
+				public:
+					virtual ~SmallPooled() {
+					}
+
+					int _value;
+			};
+
+			static void TestLarge() {
+				// Makes sure the size class of SmallPooled has free blocks, so that only large blocks could grow the arena
+				delete new SmallPooled();
+				long arena = Pool::GetArenaSize();
+				long allocations = Pool::GetAllocationCount();
+				long frees = Pool::GetFreeCount();
+
+				const size_t sizes[] = {Pool::KMaximumSize+1, 1024, 64*1024, 1024*1024};
+				const unsigned int count = sizeof(sizes)/sizeof(sizes[0]);
+				bool intact = true;
+				for(unsigned int a=0;a<count;a++) {
+					unsigned char* block = reinterpret_cast<unsigned char*>(Pool::Allocate(sizes[a]));
+					memset(block, 0xA5, sizes[a]);
+					intact = intact && block[0]==0xA5 && block[sizes[a]-1]==0xA5;
+					Pool::Free(block, sizes[a]);
+				}
+
+				// Deleted through the base class, so operator delete gets the size of the derived class
+				for(int a=0;a<100;a++) {
+					LargePooled* larger = new LargerPooled();
+					delete larger;
+					LargePooled* large = new LargePooled();
+					delete large;
+					SmallPooled* small = new SmallPooled();
+					delete small;
+				}
+
+				printf("large: arena %ld bytes before, %ld after\n", arena, Pool::GetArenaSize());
+				Check(intact, "large: blocks over the largest size class are usable");
+				Check(Pool::GetArenaSize()==arena, "large: blocks over the largest size class do not use the arena");
+				Check(Pool::GetAllocationCount()-allocations==long(count+300) && Pool::GetFreeCount()-frees==long(count+300), "large: allocations passed on to malloc are counted");
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::shared::test;
+	TestClasses();
+	TestCrossThread();
+	TestForeignThreads();
+	TestLarge();
+	printf("%d failures\n", _failures);
+	return (_failures==0) ? 0 : 1;
+}
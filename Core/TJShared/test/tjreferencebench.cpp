@@ -0,0 +1,118 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Measures the cost of reference counting with 1 up to 8 threads. Each iteration copies a strong reference, makes a
+weak reference from it and turns that back into a strong reference (three increments and three decrements):
+- contended: all threads use references to the same object, so they all update the same (atomic) counts;
+- private: every thread uses its own object, so the counts are atomic but not shared between threads;
+- local: every thread uses its own object held by GC::HoldLocal, so the counts are not atomic.
+Afterwards, all resources must have been deleted. Usage: tjreferencebench [iterations per thread] */
+#include <TJShared/include/tjshared.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace tj::shared;
+
+namespace tj {
+	namespace shared {
+		namespace test {
+			class Counted: public virtual Object {
+				public:
+					virtual ~Counted() {
+					}
+			};
+
+			enum Mode {
+				ModeContended = 0,
+				ModePrivate,
+				ModeLocal,
+			};
+
+			const static char* KModeNames[] = {"contended", "private", "local"};
+
+			class CountingThread: public Thread {
+				public:
+					CountingThread(ref<Counted> shared, Mode mode, int iterations): _shared(shared), _mode(mode), _iterations(iterations) {
+					}
+
+					virtual ~CountingThread() {
+					}
+
+				protected:
+					virtual void Run() {
+						ref<Counted> object;
+						switch(_mode) {
+							case ModeContended:
+								object = _shared;
+								break;
+
+							case ModePrivate:
+								object = GC::Hold(new Counted());
+								break;
+
+							case ModeLocal:
+								object = GC::HoldLocal(new Counted());
+								break;
+						}
+
+						for(int a=0;a<_iterations;a++) {
+							ref<Counted> copy = object;
+							weak<Counted> w(copy);
+							ref<Counted> promoted = w;
+						}
+					}
+
+					ref<Counted> _shared;
+					Mode _mode;
+					int _iterations;
+			};
+
+			static void Run(Mode mode, int threads, int iterations) {
+				ref<Counted> shared = GC::Hold(new Counted());
+				std::vector< ref<CountingThread> > workers;
+				for(int a=0;a<threads;a++) {
+					workers.push_back(GC::Hold(new CountingThread(shared, mode, iterations)));
+				}
+
+				Timestamp start(true);
+				for(int a=0;a<threads;a++) {
+					workers[a]->Start();
+				}
+				for(int a=0;a<threads;a++) {
+					workers[a]->WaitForCompletion();
+				}
+				double ms = double(Timestamp(true).Difference(start).ToMilliSeconds());
+
+				double operations = double(threads) * double(iterations) * 6.0;
+				printf("%s, %d thread(s): %.0f count updates in %.1f ms (%.1f M/s, %.1f ns each)\n", KModeNames[mode], threads, operations, ms, operations/ms/1000.0, ms*1000000.0/operations);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::shared::test;
+	int iterations = (argc > 1) ? atoi(argv[1]) : 2000000;
+	long resources = intern::Resource::GetResourceCount();
+
+	for(int mode=ModeContended;mode<=ModeLocal;mode++) {
+		for(int threads=1;threads<=8;threads*=2) {
+			Run(Mode(mode), threads, iterations);
+		}
+	}
+
+	long left = intern::Resource::GetResourceCount() - resources;
+	printf("%ld resources left\n", left);
+	return (left==0) ? 0 : 1;
+}
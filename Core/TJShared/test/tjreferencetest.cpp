@@ -0,0 +1,312 @@
+/* This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Tests reference counting when the last strong reference to an object is released on one thread while another thread
+holds weak references to it:
+- Promote: the other thread turns its weak references into strong ones (Resource::TryAddReference). It must either get
+  null or an object that is still alive, and every object must be deleted exactly once.
+- Weak release: the other thread drops its weak references at the same time as the last strong reference is released,
+  so that the resource must be deleted exactly once by whichever of the two comes last.
+- Recycled objects (Recycler) go through the same races; an object is only recycled when no weak references remain.
+- Local: every thread creates objects with GC::HoldLocal and races weak and strong references to them on that thread,
+  while the other threads do the same; the (atomic) resource count must come back to where it was.
+Usage: tjreferencetest [rounds] */
+#include <TJShared/include/tjshared.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace tj::shared;
+
+namespace tj {
+	namespace shared {
+		namespace test {
+			const static int KObjects = 2000;
+			const static unsigned int KAlive = 0xA11FE;
+			const static unsigned int KDead = 0xDEAD;
+			static int _failures = 0;
+			static volatile ReferenceCount _constructed = 0;
+			static volatile ReferenceCount _destroyed = 0;
+
+			static void Check(bool ok, const char* what) {
+				if(!ok) {
+					printf("failed: %s\n", what);
+					++_failures;
+				}
+			}
+
+			class Victim: public virtual Object {
+				public:
+					Victim(): _state(KAlive) {
+						Atomic::Increment(&_constructed);
+					}
+
+					virtual ~Victim() {
+						if(_state!=KAlive) {
+							printf("failed: object deleted twice\n");
+							++_failures;
+						}
+						_state = KDead;
+						Atomic::Increment(&_destroyed);
+					}
+
+					volatile unsigned int _state;
+			};
+
+			class RecycledVictim: public Recycleable {
+				public:
+					RecycledVictim(): _state(KAlive) {
+						Atomic::Increment(&_constructed);
+					}
+
+					virtual ~RecycledVictim() {
+						_state = KDead;
+						Atomic::Increment(&_destroyed);
+					}
+
+					virtual void OnRecycle() {
+						_state = KDead;
+					}
+
+					virtual void OnReuse() {
+						_state = KAlive;
+					}
+
+					volatile unsigned int _state;
+			};
+
+			/** Both threads wait for each other before they start, so that their loops overlap as much as possible **/
+			class Barrier {
+				public:
+					Barrier(): _arrived(0) {
+					}
+
+					void Arrive() {
+						if(Atomic::Increment(&_arrived)==2) {
+							_start.Signal();
+						}
+						else {
+							_start.Wait();
+						}
+					}
+
+				private:
+					volatile ReferenceCount _arrived;
+					Event _start;
+			};
+
+			/** Releases the last strong references to a list of objects, from first to last **/
+			template<typename T> class Releaser: public Thread {
+				public:
+					Releaser(std::vector< ref<T> >& strong, Barrier& barrier): _strong(strong), _barrier(barrier) {
+					}
+
+					virtual ~Releaser() {
+					}
+
+				protected:
+					virtual void Run() {
+						_barrier.Arrive();
+						for(unsigned int a=0;a<_strong.size();a++) {
+							_strong[a] = null;
+						}
+					}
+
+					std::vector< ref<T> >& _strong;
+					Barrier& _barrier;
+			};
+
+			/** Promotes (optionally) and releases weak references to a list of objects, from last to first **/
+			template<typename T> class WeakUser: public Thread {
+				public:
+					WeakUser(std::vector< weak<T> >& weaks, Barrier& barrier, bool promote): _weak(weaks), _barrier(barrier), _promote(promote), _promoted(0), _dead(0) {
+					}
+
+					virtual ~WeakUser() {
+					}
+
+					int GetPromotedCount() const {
+						return _promoted;
+					}
+
+					int GetDeadCount() const {
+						return _dead;
+					}
+
+				protected:
+					virtual void Run() {
+						_barrier.Arrive();
+						for(int a=int(_weak.size())-1;a>=0;a--) {
+							if(_promote) {
+								ref<T> object = _weak[a];
+								if(object) {
+									++_promoted;
+									if(object->_state!=KAlive) {
+										++_dead;
+									}
+								}
+							}
+							_weak[a] = weak<T>();
+						}
+					}
+
+					std::vector< weak<T> >& _weak;
+					Barrier& _barrier;
+					bool _promote;
+					int _promoted;
+					int _dead;
+			};
+
+			template<typename T> static ref<T> Create();
+
+			template<> ref<Victim> Create() {
+				return GC::Hold(new Victim());
+			}
+
+			template<> ref<RecycledVictim> Create() {
+				return Recycler<RecycledVictim>::Create();
+			}
+
+			template<typename T> static void RunRace(const char* name, int rounds, bool promote) {
+				long resources = intern::Resource::GetResourceCount();
+				ReferenceCount live = _constructed - _destroyed;
+				long trash = long(RecycleBin::GetTrashObjectCount());
+				int promoted = 0, dead = 0;
+
+				for(int r=0;r<rounds;r++) {
+					std::vector< ref<T> > strong(KObjects);
+					std::vector< weak<T> > weaks(KObjects);
+					for(int a=0;a<KObjects;a++) {
+						strong[a] = Create<T>();
+						weaks[a] = weak<T>(strong[a]);
+					}
+
+					Barrier barrier;
+					ref< Releaser<T> > releaser = GC::Hold(new Releaser<T>(strong, barrier));
+					ref< WeakUser<T> > user = GC::Hold(new WeakUser<T>(weaks, barrier, promote));
+					releaser->Start();
+					user->Start();
+					releaser->WaitForCompletion();
+					user->WaitForCompletion();
+					promoted += user->GetPromotedCount();
+					dead += user->GetDeadCount();
+				}
+
+				// Objects in a recycle bin keep their resource
+				long kept = long(RecycleBin::GetTrashObjectCount()) - trash;
+				printf("%s: %d rounds of %d objects, %d promoted, %ld objects and %ld resources left, %ld kept for recycling\n", name, rounds, KObjects, promoted, (long)(_constructed - _destroyed - live), intern::Resource::GetResourceCount() - resources, kept);
+				Check(dead==0, "a promoted weak reference always points to a live object");
+				Check(long(_constructed - _destroyed - live)==kept, "every object is deleted exactly once");
+				Check(intern::Resource::GetResourceCount()-resources==kept, "every resource is deleted exactly once");
+			}
+
+			/** Creates, copies, weakly references and releases local objects on its own thread **/
+			class LocalUser: public Thread {
+				public:
+					LocalUser(int count): _count(count), _wrong(0) {
+					}
+
+					virtual ~LocalUser() {
+					}
+
+					int GetWrongCount() const {
+						return _wrong;
+					}
+
+				protected:
+					virtual void Run() {
+						for(int a=0;a<_count;a++) {
+							ref<Victim> object = GC::HoldLocal(new Victim());
+							if(!object->_resource->IsLocal()) {
+								++_wrong;
+							}
+
+							weak<Victim> w(object);
+							ref<Victim> copy = w;
+							if(copy!=object || !w.IsValid()) {
+								++_wrong;
+							}
+
+							// Release the last strong reference while the weak reference remains
+							copy = null;
+							object = null;
+							ref<Victim> promoted = w;
+							if(promoted || w.IsValid()) {
+								++_wrong;
+							}
+						}
+					}
+
+					int _count;
+					int _wrong;
+			};
+
+			static void TestLocal(int rounds) {
+				long resources = intern::Resource::GetResourceCount();
+				ReferenceCount live = _constructed - _destroyed;
+				const int threads = 4;
+				std::vector< ref<LocalUser> > users;
+				for(int a=0;a<threads;a++) {
+					users.push_back(GC::Hold(new LocalUser(rounds*KObjects)));
+				}
+				for(int a=0;a<threads;a++) {
+					users[a]->Start();
+				}
+
+				int wrong = 0;
+				for(int a=0;a<threads;a++) {
+					users[a]->WaitForCompletion();
+					wrong += users[a]->GetWrongCount();
+				}
+				users.clear();
+
+				printf("local: %d threads with %d objects each, %d wrong, %ld objects and %ld resources left\n", threads, rounds*KObjects, wrong, (long)(_constructed - _destroyed - live), intern::Resource::GetResourceCount() - resources);
+				Check(wrong==0, "local: weak references to local objects behave like those to shared objects");
+				Check(_constructed - _destroyed==live, "local: every local object is deleted");
+				Check(intern::Resource::GetResourceCount()==resources, "local: every local resource is deleted");
+			}
+
+			/** An object is recycled only when there are no weak references left to it **/
+			static void TestRecycling() {
+				ref<RecycledVictim> object = Recycler<RecycledVictim>::Create();
+				weak<RecycledVictim> w(object);
+				ReferenceCount destroyed = _destroyed;
+				object = null;
+				Check(_destroyed==destroyed+1, "recycling: an object with weak references is deleted, not recycled");
+				Check(!ref<RecycledVictim>(w), "recycling: a weak reference to a deleted object is null");
+				w = weak<RecycledVictim>();
+
+				long reused = RecycleBin::GetReuseCount();
+				object = Recycler<RecycledVictim>::Create();
+				RecycledVictim* pointer = object.GetPointer();
+				object = null;
+				object = Recycler<RecycledVictim>::Create();
+				Check(object.GetPointer()==pointer && RecycleBin::GetReuseCount()==reused+1, "recycling: an object without weak references is recycled");
+				Check(object->_state==KAlive, "recycling: a recycled object is reused");
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tj::shared::test;
+	int rounds = (argc > 1) ? atoi(argv[1]) : 50;
+	TestRecycling();
+	RunRace<Victim>("promote", rounds, true);
+	RunRace<Victim>("weak release", rounds, false);
+	RunRace<RecycledVictim>("recycled promote", rounds, true);
+	RunRace<RecycledVictim>("recycled weak release", rounds, false);
+	TestLocal(rounds);
+	printf("%d failures\n", _failures);
+	return (_failures==0) ? 0 : 1;
+}
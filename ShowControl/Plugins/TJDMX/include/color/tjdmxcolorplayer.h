@@ -37,6 +37,7 @@ namespace tj {
 					ref<DMXColorTrack> _track;
 					bool _output;
 					ref<DMXMacro> _macros[_ColorChannelLast];
+					FaderBatch<float> _faders; // Hue, saturation and value
 			};
 		}
 	}
@@ -35,6 +35,7 @@ class DMXPlayer: public Player {
 		ref<DMXMacro> _macro;
 		ref<Stream> _stream;
 		ref<Playback> _pb;
+		FaderBatch<float> _fader;
 		bool _outputEnabled;
 		unsigned char _sentValue;
 };
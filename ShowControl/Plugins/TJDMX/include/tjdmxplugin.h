@@ -40,6 +40,8 @@ class DMXPlugin: public OutputPlugin {
 		virtual void GetRequiredFeatures(std::list<std::wstring>& fs) const;
 
 		virtual ref<DMXMacro> CreateMacro(std::wstring address, DMXSource source);
+		void Set(ref<DMXMacro> macro, float value);
+		void Submit(const DMXBatch& changes);
 		virtual int GetChannelResult(int channel);
 		strong<DMXController> GetController();
 		virtual ref<Pane> GetSettingsWindow(ref<PropertyGridProxy> pg);
@@ -59,7 +61,14 @@ class DMXPlugin: public OutputPlugin {
 	protected:
 		CriticalSection _tlLock;
 		void SortTrackList();
+		void ApplyPending();
 		std::vector< weak<DMXPatchable> > _tracks;
+
+		// Changes submitted by players, waiting to be applied to the controller (see Submit)
+		CriticalSection _batchLock;
+		CriticalSection _applyLock;
+		DMXBatch _pending;
+		DMXBatch _applying;
 };
 
 strong<DMXController> GetController();
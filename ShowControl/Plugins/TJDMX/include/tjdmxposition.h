@@ -122,6 +122,7 @@ class DMXPositionPlayer: public Player {
 		ref<DMXPositionTrack> _track;
 		DMXPositionMacro _macro;
 		ref<Stream> _stream;
+		FaderBatch<float> _faders; // Pan and tilt
 };
 
 #endif
\ No newline at end of file
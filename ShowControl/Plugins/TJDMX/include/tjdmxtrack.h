@@ -20,6 +20,7 @@ class DMXTrack: public Track, public DMXPatchable {
 	friend class DMXTrackRange; 
 	friend class DMXTrackScriptable;
 	friend class DMXLiveWnd;
+	friend class DMXPlayer;
 
 	public:
 		DMXTrack(ref<DMXPlugin> plug);
@@ -18,6 +18,9 @@
 using namespace tj::dmx::color;
 
 DMXColorPlayer::DMXColorPlayer(ref<DMXColorTrack> track): _track(track), _output(false) {
+	_faders.Add(track->GetFaderById(DMXColorTrack::KFaderHue));
+	_faders.Add(track->GetFaderById(DMXColorTrack::KFaderSaturation));
+	_faders.Add(track->GetFaderById(DMXColorTrack::KFaderValue));
 }
 
 DMXColorPlayer::~DMXColorPlayer() {
@@ -45,25 +48,31 @@ void DMXColorPlayer::Pause(Time pos) {
 
 void DMXColorPlayer::Tick(Time t) {
 	if(_output) {
-		HSVColor color(_track->GetFaderById(DMXColorTrack::KFaderHue)->GetValueAt(t), _track->GetFaderById(DMXColorTrack::KFaderSaturation)->GetValueAt(t), _track->GetFaderById(DMXColorTrack::KFaderValue)->GetValueAt(t));
+		float hsv[3];
+		_faders.Sample(t, hsv);
+		HSVColor color(hsv[0], hsv[1], hsv[2]);
 		_track->_lastColor = color;
 		RGBColor rgbColor = ColorSpaces::HSVToRGB(color._h, color._s, color._v);
 		CMYKColor cmykColor = ColorSpaces::RGBToCMYK(rgbColor._r, rgbColor._g, rgbColor._b);
 
+		DMXBatch changes;
+
 		// RGB
-		if(_macros[ColorChannelRed]) _macros[ColorChannelRed]->Set(float(rgbColor._r));
-		if(_macros[ColorChannelGreen]) _macros[ColorChannelGreen]->Set(float(rgbColor._g));
-		if(_macros[ColorChannelBlue]) _macros[ColorChannelBlue]->Set(float(rgbColor._b));
+		changes.Set(_macros[ColorChannelRed], float(rgbColor._r));
+		changes.Set(_macros[ColorChannelGreen], float(rgbColor._g));
+		changes.Set(_macros[ColorChannelBlue], float(rgbColor._b));
 
 		// CMY
-		if(_macros[ColorChannelCyan]) _macros[ColorChannelCyan]->Set(float(cmykColor._c));
-		if(_macros[ColorChannelMagenta]) _macros[ColorChannelMagenta]->Set(float(cmykColor._m));
-		if(_macros[ColorChannelYellow]) _macros[ColorChannelYellow]->Set(float(cmykColor._y));
+		changes.Set(_macros[ColorChannelCyan], float(cmykColor._c));
+		changes.Set(_macros[ColorChannelMagenta], float(cmykColor._m));
+		changes.Set(_macros[ColorChannelYellow], float(cmykColor._y));
 
 		// HSV
-		if(_macros[ColorChannelHue]) _macros[ColorChannelHue]->Set(float(color._h));
-		if(_macros[ColorChannelSaturation]) _macros[ColorChannelSaturation]->Set(float(color._s));
-		if(_macros[ColorChannelValue]) _macros[ColorChannelValue]->Set(float(color._v));
+		changes.Set(_macros[ColorChannelHue], float(color._h));
+		changes.Set(_macros[ColorChannelSaturation], float(color._s));
+		changes.Set(_macros[ColorChannelValue], float(color._v));
+
+		_track->_plugin->Submit(changes);
 	}
 }
 
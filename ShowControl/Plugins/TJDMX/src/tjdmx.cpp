@@ -43,6 +43,46 @@ ref<DMXMacro> DMXPlugin::CreateMacro(std::wstring address, DMXSource source) {
 	return GetController()->CreateMacro(address, source);
 }
 
+/** Sets the value of a macro on behalf of a player; see Submit. **/
+void DMXPlugin::Set(ref<DMXMacro> macro, float value) {
+	if(macro) {
+		{
+			ThreadLock lock(&_batchLock);
+			_pending.Set(macro, value);
+		}
+		ApplyPending();
+	}
+}
+
+/** Players tick on their own threads, so there is no single engine tick in which all DMX changes can be collected.
+Instead, changes are queued, and each submitting thread then applies everything that is queued at that moment. Threads
+that submit while another thread is applying wait for it, and the first of them applies all changes queued in the mean
+time; the others find their changes already applied. When many players tick at the same time, this takes the controller
+lock and wakes up the mixer only a few times, instead of once for every player. **/
+void DMXPlugin::Submit(const DMXBatch& changes) {
+	{
+		ThreadLock lock(&_batchLock);
+		_pending.Append(changes);
+	}
+	ApplyPending();
+}
+
+/** Applies the changes that are pending, if any. Each call applies at most one batch, so a thread never applies the
+changes of other threads more than once; when it returns, the changes it submitted before the call have been applied. **/
+void DMXPlugin::ApplyPending() {
+	ThreadLock applyLock(&_applyLock);
+	{
+		ThreadLock lock(&_batchLock);
+		if(_pending.IsEmpty()) {
+			return;
+		}
+		_applying.Clear();
+		_applying.Swap(_pending);
+	}
+
+	GetController()->Apply(_applying);
+}
+
 ref<Pane> DMXPlugin::GetSettingsWindow(ref<PropertyGridProxy> pg) {
 	return GC::Hold(new Pane(TL(dmx_settings), GC::Hold(new DMXSettingsWnd(this, pg)), false, true, 0));
 }
@@ -18,6 +18,7 @@
 DMXPlayer::DMXPlayer(ref<DMXTrack> track, ref<Stream> str) {
 	assert(track);
 	_track = track;
+	_fader.Add(track->_data);
 	_sentValue = 123;
 	_stream = str;
 }
@@ -31,7 +32,8 @@ ref<Track> DMXPlayer::GetTrack() {
 
 void DMXPlayer::Stop() {
 	if(_macro && _track->GetResetOnStop()) {
-		_macro->Set(0);
+		// Go through the plug-in, so this change cannot be overtaken by a change that is still pending
+		_track->GetDMXPlugin()->Set(_macro, 0.0f);
 		_macro = 0;
 	}
 	_pb = null;
@@ -49,7 +51,9 @@ void DMXPlayer::Start(Time pos, ref<Playback> pb, float speed) {
 
 void DMXPlayer::Tick(Time currentPosition) {
 	if(_outputEnabled && _macro) {
-		_macro->Set(_track->GetValueAt(currentPosition));
+		float value = 0.0f;
+		_fader.Sample(currentPosition, &value);
+		_track->GetDMXPlugin()->Set(_macro, value);
 	}
 }
 
@@ -149,12 +149,12 @@ void DMXPositionEditorWnd::Paint(tj::shared::graphics::Graphics& g, strong<Theme
 	float tr = float(ts.GetHeight());
 
 	// iterators from begin
-	std::map<Time, float>::iterator panit = pan->GetPoints()->lower_bound(range.Start());
-	std::map<Time, float>::iterator tiltit = tilt->GetPoints()->lower_bound(range.Start());
+	std::map<Time, float>::const_iterator panit = pan->GetPoints()->lower_bound(range.Start());
+	std::map<Time, float>::const_iterator tiltit = tilt->GetPoints()->lower_bound(range.Start());
 
 	// end
-	std::map<Time, float>::iterator panend = pan->GetPoints()->upper_bound(range.End());
-	std::map<Time, float>::iterator tiltend = tilt->GetPoints()->upper_bound(range.End());
+	std::map<Time, float>::const_iterator panend = pan->GetPoints()->upper_bound(range.End());
+	std::map<Time, float>::const_iterator tiltend = tilt->GetPoints()->upper_bound(range.End());
 
 	if(!(panit==panend || tiltend==tiltit)) {
 		Time current = range.Start();
@@ -20,6 +20,8 @@ DMXPositionPlayer::DMXPositionPlayer(ref<DMXPositionTrack> track, ref<Stream> st
 	_track = track;
 	_output = false;
 	_stream = str;
+	_faders.Add(track->GetFaderById(DMXPositionTrack::KFaderPan));
+	_faders.Add(track->GetFaderById(DMXPositionTrack::KFaderTilt));
 }
 
 DMXPositionPlayer::~DMXPositionPlayer() {
@@ -38,8 +40,13 @@ void DMXPositionPlayer::Start(Time pos, ref<Playback> pb, float speed) {
 
 void DMXPositionPlayer::Tick(Time t) {
 	if(_output) {
-		if(_macro._pan) _macro._pan->Set(_track->GetFaderById(DMXPositionTrack::KFaderPan)->GetValueAt(t));
-		if(_macro._tilt) _macro._tilt->Set(_track->GetFaderById(DMXPositionTrack::KFaderTilt)->GetValueAt(t));
+		float values[2];
+		_faders.Sample(t, values);
+
+		DMXBatch changes;
+		if(_macro._pan) changes.Set(_macro._pan, values[0]);
+		if(_macro._tilt) changes.Set(_macro._tilt, values[1]);
+		_track->_plugin->Submit(changes);
 	}
 }
 
@@ -48,7 +48,7 @@ namespace tj {
 						pixelOffset = (float)h;
 					}
 
-					std::map<Time, T>* map = _fade->GetPoints();
+					const std::map<Time, T>* map = _fade->GetPoints();
 					float pixelHeight = float(_fade->GetDefaultValue())* pixelsPerValue + pixelOffset;
 
 					std::map<Time, T>::const_iterator it = map->begin();
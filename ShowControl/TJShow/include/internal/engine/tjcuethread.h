@@ -41,6 +41,7 @@ namespace tj {
 					ref<CueList> _list;
 					weak<Controller> _controller;
 					Time _last;
+					CueCursor _cursor;
 			};
 		}
 	}
@@ -17,20 +17,22 @@
 #define _TJPOOLENGINE_H
 
 #include "tjengine.h"
+#include "tjpoolscheduler.h"
 
 namespace tj {
 	namespace show {
 		namespace engine {
 			/** The pooled playback engine is an engine that uses worker threads that are 'pooled' between players (as opposed to
 			the multithreaded playback engine, in which each thread is assigned to exactly one player). The pooled engine works with a
-			queue, in which 'pool messages' are placed. Pool threads pick these messages up and execute them. If a message requires scheduling
-			(that is, tick messages), the thread sets a timer and waits for both the timer and for new queue messages. Whenever a new message is
-			received that does not require scheduling, the message is executed by the thread (the assumption here is that executing a message
-			takes little time and the scheduled event is far in the future anyway). If the newly received message does require scheduling,
-			the 'future time' of the message is compared to the 'fuure time' of the scheduled message. When the new message has to be executed
-			before the scheduled message, the scheduled message is 'unscheduled' and placed back in the queue. The new message is then processed by
-			the thread. When the new message has to happen 'later' than the already scheduled message, the thread doesn't pop it from the queue,
-			and releases the queue sempahore once more (after which it will Sleep for minTickLength, to prevent 'spinning'). 
+			queue, in which 'pool messages' are placed. Pool threads pick these messages up and execute them right away. After a player
+			has been ticked, its next tick is not queued but placed in the scheduler, which holds the next tick of every player, ordered
+			by the time at which it is due. When ticks become due, the pool thread that notices this moves all of them to the queue at
+			once, takes its share of them and wakes up the other pool threads to process the rest. Ticks that are due within half of
+			minTickLength are fired together with the ticks that are due now (they are 'coalesced'); players are still ticked with the
+			time they asked for.
+
+			Actions that affect all players (jumping, pausing, changing the speed) clear the scheduler and increase the 'generation' of
+			the engine. Messages from an earlier generation that are still being executed will not schedule a new tick.
 			
 			The pooled thread is actually single-threaded when only one pool thread is created.
 			**/
@@ -61,23 +63,22 @@ namespace tj {
 				ref<Player> player;
 				ref<Playback> playback;
 				float speed;
+				unsigned int generation;
 
-				inline PoolMessage(): action(PoolActionNothing), time(-1), speed(0.0f) {
-				}
-
-				inline bool NeedsScheduling() const {
-					// PoolActionTick messages need to be scheduled
-					return (action == PoolActionTick);
+				inline PoolMessage(): action(PoolActionNothing), time(-1), speed(0.0f), generation(0) {
 				}
 			};
 
 			struct PoolStatistics {
 				PoolStatistics();
 				void Reset();
+				void AddTick(int lateness, int lateThreshold);
 
 				int totalTickCount;
-				int totalDeviation;
-				int lateTickCount;
+				int totalDeviation;		// Sum of the lateness of all ticks (ms)
+				int maximumDeviation;	// Largest lateness of a tick (ms)
+				int lateTickCount;		// Number of ticks that were later than the threshold (twice the minimum tick length)
+				int coalescedTickCount;	// Number of ticks that were fired together with an earlier tick
 			};
 
 			class PoolThread;
@@ -96,12 +97,16 @@ namespace tj {
 					virtual void SetTickingSpeed(float c, const Time& startTime, const Timestamp& startTicks);
 
 					virtual void AddPlayer(strong<Player> tr, strong<TrackWrapper> tw);
+					virtual void GetStatistics(PoolStatistics& stats);
 
 				protected:
 					// Work queue management
 					virtual void QueueActionForAllPlayers(PoolAction pa, const Timebase& tb, const Time& time, ref<Playback> pb, float c);
 					virtual void SetTicking(bool t);
 					virtual void OnWorkQueued(unsigned int numItems);
+					virtual void CancelScheduled();
+					virtual void Schedule(const PoolMessage& pm, const Time& current);
+					virtual void TakeWork(std::vector<PoolMessage>& work, int& waitTime);
 
 					// Worker thread management
 					virtual void SpawnPoolThreads();
@@ -114,11 +119,13 @@ namespace tj {
 					ref<Playback> _pb;
 					std::set< ref<Player> > _players;
 					std::deque<PoolMessage> _queue;
+					PoolScheduler<PoolMessage> _scheduler;
+					unsigned int _generation;
 					std::set< ref<PoolThread> > _workers;
 					Semaphore _queueSemaphore;
-					Event _cancelAllScheduled;
 					bool _isTicking;
-					PoolStatistics _stats;
+					PoolStatistics _stats;		// Statistics since the last evaluation
+					PoolStatistics _totalStats;	// Statistics since playback was started
 
 					// Constants for thread scheduling
 					const static float KThresholdWithinRange;	// The percentage of ticks we want to be 'on time' (within the [0,minTickLength] interval
@@ -0,0 +1,136 @@
+/* TJShow (C) Tommy van der Vorst, Pixelspark, 2005-2017.
+ *
+ * This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef _TJPOOLSCHEDULER_H
+#define _TJPOOLSCHEDULER_H
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+namespace tj {
+	namespace show {
+		namespace engine {
+			/** The PoolScheduler holds scheduled pool messages in a binary heap, ordered by the time at which they are due. Due
+			times are in milliseconds since the scheduler was created (see GetNow). Messages that are due at the same time are returned
+			in the order in which they were added. The scheduler itself is not thread-safe; PoolEngine only uses it while holding its lock.
+			It only depends on TJShared, so that it can be tested without the rest of TJShow (see test/tjpoolschedulertest.cpp). **/
+			template<typename M> class PoolScheduler {
+				public:
+					PoolScheduler();
+					~PoolScheduler();
+
+					/** Returns true when the added message is now the first message that is due **/
+					bool Add(const M& pm, long double due);
+
+					/** Moves all messages that are due at or before 'until' to the queue, and returns the number of messages moved **/
+					unsigned int PopDue(long double until, std::deque<M>& queue);
+
+					/** When the first message is due at or before now+window, moves all messages that are due at or before now to
+					the queue, followed by the messages that are due within the window (these are 'coalesced': fired early, together
+					with the others). Returns the number of messages moved; coalesced is set to the number of messages that were not
+					yet due. **/
+					unsigned int PopDueCoalesced(long double now, long double window, std::deque<M>& queue, unsigned int& coalesced);
+
+					long double GetNextDue() const;		// Returns -1 when nothing is scheduled
+					long double GetNow() const;
+					unsigned int GetSize() const;
+					void Clear();
+
+				protected:
+					struct Entry {
+						long double due;
+						unsigned int sequence;
+						M message;
+					};
+
+					/** The heap functions from <algorithm> put the 'largest' element on top; this comparator makes that the entry
+					that is due first (or, if two entries are due at the same time, the entry that was added first). **/
+					struct EntryComparator {
+						inline bool operator()(const Entry& a, const Entry& b) const {
+							if(a.due!=b.due) {
+								return a.due > b.due;
+							}
+							return a.sequence > b.sequence;
+						}
+					};
+
+					std::vector<Entry> _entries;
+					tj::shared::Timestamp _epoch;
+					unsigned int _sequence;
+			};
+
+			template<typename M> PoolScheduler<M>::PoolScheduler(): _epoch(true), _sequence(0) {
+			}
+
+			template<typename M> PoolScheduler<M>::~PoolScheduler() {
+			}
+
+			template<typename M> bool PoolScheduler<M>::Add(const M& pm, long double due) {
+				Entry entry;
+				entry.due = due;
+				entry.sequence = _sequence++;
+				entry.message = pm;
+				_entries.push_back(entry);
+				std::push_heap(_entries.begin(), _entries.end(), EntryComparator());
+				return _entries.front().sequence==entry.sequence;
+			}
+
+			template<typename M> unsigned int PoolScheduler<M>::PopDue(long double until, std::deque<M>& queue) {
+				unsigned int count = 0;
+				while(_entries.size()>0 && _entries.front().due <= until) {
+					std::pop_heap(_entries.begin(), _entries.end(), EntryComparator());
+					queue.push_back(_entries.back().message);
+					_entries.pop_back();
+					++count;
+				}
+				return count;
+			}
+
+			template<typename M> unsigned int PoolScheduler<M>::PopDueCoalesced(long double now, long double window, std::deque<M>& queue, unsigned int& coalesced) {
+				coalesced = 0;
+				long double next = GetNextDue();
+				if(next<0.0 || next>now+window) {
+					return 0;
+				}
+
+				unsigned int due = PopDue(now, queue);
+				coalesced = PopDue(now+window, queue);
+				return due + coalesced;
+			}
+
+			template<typename M> long double PoolScheduler<M>::GetNextDue() const {
+				if(_entries.size()>0) {
+					return _entries.front().due;
+				}
+				return -1.0;
+			}
+
+			template<typename M> long double PoolScheduler<M>::GetNow() const {
+				return tj::shared::Timestamp(true).Difference(_epoch).ToMilliSeconds();
+			}
+
+			template<typename M> unsigned int PoolScheduler<M>::GetSize() const {
+				return (unsigned int)_entries.size();
+			}
+
+			template<typename M> void PoolScheduler<M>::Clear() {
+				_entries.clear();
+			}
+		}
+	}
+}
+
+#endif
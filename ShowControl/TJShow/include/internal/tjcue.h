@@ -71,6 +71,7 @@ namespace tj {
 				virtual void Save(TiXmlElement* parent);
 				virtual void Load(TiXmlElement* you);
 				virtual ref<tj::shared::PropertySet> GetProperties();
+				virtual void OnPropertyChanged(void* member);
 				virtual void Move(Time t, int h);
 				virtual std::wstring GetTooltipText();
 				virtual ref<tj::shared::Crumb> CreateCrumb();
@@ -99,6 +100,7 @@ namespace tj {
 				static void SetPlaybackStateToAction(ref<Instance> c, Action a);
 				bool DoLeaveAction(ref<Instance> c);
 				bool DoAcquireCapacity(ref<Instance> c);
+				void OnChanged(); // Tells the cue list that the time or action of this cue has changed
 
 				Time _t;
 				bool _private;
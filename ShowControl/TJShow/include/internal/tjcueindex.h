@@ -0,0 +1,265 @@
+/* TJShow (C) Tommy van der Vorst, Pixelspark, 2005-2017.
+ *
+ * This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef _TJCUEINDEX_H
+#define _TJCUEINDEX_H
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace tj {
+	namespace show {
+		/** A CueCursor remembers where in a cue list the previous call to CueList::GetCuesBetween ended. A thread
+		that plays back a cue list sequentially keeps a cursor, so the list does not need to be searched on every tick. **/
+		struct CueCursor {
+			inline CueCursor(): _position(0) {
+			}
+
+			unsigned int _position;
+		};
+
+		/** The CueIndex keeps the cues of a CueList sorted by time, together with an index of the cue times, so that cues
+		can be looked up using a binary search. Cues at the same time are kept in the order in which they were added. For
+		each cue action, an index of the cues with that action is built when needed. C is the cue class; it needs GetTime,
+		GetAction and an Action type with an ActionNone value. The index does no locking of its own (CueList holds its lock
+		while using it) and only needs TJShared, which is what allows test/tjcuelisttest.cpp to build it on its own. **/
+		template<typename C> class CueIndex {
+			public:
+				typedef typename C::Action Action;
+				typedef typename std::vector< tj::shared::ref<C> >::iterator Iterator;
+
+				CueIndex();
+				~CueIndex();
+
+				void Add(tj::shared::ref<C> c);
+				void Remove(tj::shared::ref<C> c);
+				void RemoveBetween(const tj::shared::Time& a, const tj::shared::Time& b);
+				void Clear();
+
+				/** Called when the time or action of a cue has changed. When the cue is still in the right place, only
+				the time index is updated; otherwise, the cue is moved to its new place in the list. **/
+				void OnChanged(tj::shared::ref<C> c);
+
+				tj::shared::ref<C> GetCueAt(const tj::shared::Time& t) const;
+				tj::shared::ref<C> GetNextCue(const tj::shared::Time& t, Action filter);
+				tj::shared::ref<C> GetPreviousCue(const tj::shared::Time& t) const;
+
+				/** Adds all cues with start < t <= end to matches. If the cursor still points to the first cue after start
+				(which is the case when the previous call ended at start and the list did not change in between), the list
+				is not searched. **/
+				void GetCuesBetween(const tj::shared::Time& start, const tj::shared::Time& end, std::list< tj::shared::ref<C> >& matches, CueCursor& cursor) const;
+
+				unsigned int GetCount() const;
+				Iterator GetBegin();
+				Iterator GetEnd();
+
+			protected:
+				void UpdateActionIndex();
+				unsigned int GetFirstCueAt(const tj::shared::Time& t) const;
+				unsigned int GetFirstCueAfter(const tj::shared::Time& t) const;
+				unsigned int GetFirstPositionAfter(const std::vector<unsigned int>& positions, const tj::shared::Time& t) const;
+
+				std::vector< tj::shared::ref<C> > _cues;
+				std::vector<tj::shared::Time> _times;	// _times[i]==_cues[i]->GetTime()
+				std::map< Action, std::vector<unsigned int> > _actionIndex;
+				bool _actionIndexValid;
+		};
+
+		template<typename C> CueIndex<C>::CueIndex(): _actionIndexValid(false) {
+		}
+
+		template<typename C> CueIndex<C>::~CueIndex() {
+		}
+
+		/** Returns the index of the first cue at or after t (or the number of cues if there is none). **/
+		template<typename C> unsigned int CueIndex<C>::GetFirstCueAt(const tj::shared::Time& t) const {
+			return (unsigned int)(std::lower_bound(_times.begin(), _times.end(), t) - _times.begin());
+		}
+
+		/** Returns the index of the first cue after t (or the number of cues if there is none). **/
+		template<typename C> unsigned int CueIndex<C>::GetFirstCueAfter(const tj::shared::Time& t) const {
+			return (unsigned int)(std::upper_bound(_times.begin(), _times.end(), t) - _times.begin());
+		}
+
+		/** Returns the index of the first entry in positions that refers to a cue later than t. The positions have to be
+		in ascending order (and therefore, the times they refer to as well). **/
+		template<typename C> unsigned int CueIndex<C>::GetFirstPositionAfter(const std::vector<unsigned int>& positions, const tj::shared::Time& t) const {
+			unsigned int low = 0;
+			unsigned int high = (unsigned int)positions.size();
+			while(low<high) {
+				unsigned int middle = low + (high-low)/2;
+				if(_times.at(positions.at(middle)) <= t) {
+					low = middle + 1;
+				}
+				else {
+					high = middle;
+				}
+			}
+			return low;
+		}
+
+		template<typename C> void CueIndex<C>::Add(tj::shared::ref<C> c) {
+			tj::shared::Time t = c->GetTime();
+
+			// Insert after cues at the same time, so cues are kept in the order they were added
+			unsigned int position = GetFirstCueAfter(t);
+			_cues.insert(_cues.begin()+position, c);
+			_times.insert(_times.begin()+position, t);
+			_actionIndexValid = false;
+		}
+
+		template<typename C> void CueIndex<C>::Remove(tj::shared::ref<C> c) {
+			unsigned int count = (unsigned int)_cues.size();
+			tj::shared::Time t = c->GetTime();
+			unsigned int position = GetFirstCueAt(t);
+			while(position<count && _times.at(position)==t && _cues.at(position)!=c) {
+				++position;
+			}
+
+			if(position>=count || _cues.at(position)!=c) {
+				// Not at the indexed time; the cue is probably not in this list, but search the whole list to be sure
+				position = (unsigned int)(std::find(_cues.begin(), _cues.end(), c) - _cues.begin());
+			}
+
+			if(position<count) {
+				_cues.erase(_cues.begin()+position);
+				_times.erase(_times.begin()+position);
+				_actionIndexValid = false;
+			}
+		}
+
+		template<typename C> void CueIndex<C>::RemoveBetween(const tj::shared::Time& a, const tj::shared::Time& b) {
+			unsigned int first = GetFirstCueAt(a);
+			unsigned int last = GetFirstCueAfter(b);
+			if(first<last) {
+				_cues.erase(_cues.begin()+first, _cues.begin()+last);
+				_times.erase(_times.begin()+first, _times.begin()+last);
+				_actionIndexValid = false;
+			}
+		}
+
+		template<typename C> void CueIndex<C>::Clear() {
+			_cues.clear();
+			_times.clear();
+			_actionIndexValid = false;
+		}
+
+		template<typename C> void CueIndex<C>::OnChanged(tj::shared::ref<C> c) {
+			typename std::vector< tj::shared::ref<C> >::iterator it = std::find(_cues.begin(), _cues.end(), c);
+			if(it==_cues.end()) {
+				return;
+			}
+
+			unsigned int position = (unsigned int)(it - _cues.begin());
+			unsigned int count = (unsigned int)_cues.size();
+			tj::shared::Time t = c->GetTime();
+			_actionIndexValid = false;
+
+			if((position==0 || _times.at(position-1) <= t) && (position+1>=count || t <= _times.at(position+1))) {
+				_times[position] = t;
+			}
+			else {
+				_cues.erase(_cues.begin()+position);
+				_times.erase(_times.begin()+position);
+				Add(c);
+			}
+		}
+
+		/** Builds the lists of positions of cues for each action. This is done when the index is needed by GetNextCue,
+		and is not kept up to date on each change, since most changes happen while editing and most queries during
+		playback. **/
+		template<typename C> void CueIndex<C>::UpdateActionIndex() {
+			if(_actionIndexValid) {
+				return;
+			}
+
+			_actionIndex.clear();
+			unsigned int count = (unsigned int)_cues.size();
+			for(unsigned int a=0;a<count;a++) {
+				_actionIndex[_cues.at(a)->GetAction()].push_back(a);
+			}
+			_actionIndexValid = true;
+		}
+
+		template<typename C> tj::shared::ref<C> CueIndex<C>::GetCueAt(const tj::shared::Time& t) const {
+			unsigned int position = GetFirstCueAt(t);
+			if(position<_times.size() && _times.at(position)==t) {
+				return _cues.at(position);
+			}
+			return 0;
+		}
+
+		template<typename C> tj::shared::ref<C> CueIndex<C>::GetNextCue(const tj::shared::Time& t, Action filter) {
+			if(filter==C::ActionNone) {
+				unsigned int position = GetFirstCueAfter(t);
+				if(position<_cues.size()) {
+					return _cues.at(position);
+				}
+				return 0;
+			}
+
+			UpdateActionIndex();
+			typename std::map< Action, std::vector<unsigned int> >::const_iterator it = _actionIndex.find(filter);
+			if(it!=_actionIndex.end()) {
+				const std::vector<unsigned int>& positions = it->second;
+				unsigned int first = GetFirstPositionAfter(positions, t);
+				if(first<positions.size()) {
+					return _cues.at(positions.at(first));
+				}
+			}
+			return 0;
+		}
+
+		template<typename C> tj::shared::ref<C> CueIndex<C>::GetPreviousCue(const tj::shared::Time& t) const {
+			unsigned int position = GetFirstCueAt(t);
+			if(position==0) {
+				return 0;
+			}
+
+			// Return the first of the cues at the latest time before t
+			return _cues.at(GetFirstCueAt(_times.at(position-1)));
+		}
+
+		template<typename C> void CueIndex<C>::GetCuesBetween(const tj::shared::Time& start, const tj::shared::Time& end, std::list< tj::shared::ref<C> >& matches, CueCursor& cursor) const {
+			unsigned int count = (unsigned int)_times.size();
+			unsigned int position = cursor._position;
+			if(position>count || (position>0 && _times.at(position-1) > start) || (position<count && _times.at(position) <= start)) {
+				position = GetFirstCueAfter(start);
+			}
+
+			while(position<count && _times.at(position) <= end) {
+				matches.push_back(_cues.at(position));
+				++position;
+			}
+			cursor._position = position;
+		}
+
+		template<typename C> unsigned int CueIndex<C>::GetCount() const {
+			return (unsigned int)_cues.size();
+		}
+
+		template<typename C> typename CueIndex<C>::Iterator CueIndex<C>::GetBegin() {
+			return _cues.begin();
+		}
+
+		template<typename C> typename CueIndex<C>::Iterator CueIndex<C>::GetEnd() {
+			return _cues.end();
+		}
+	}
+}
+
+#endif
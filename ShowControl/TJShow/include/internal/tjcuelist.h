@@ -16,10 +16,14 @@
 #ifndef _TJCUELIST_H
 #define _TJCUELIST_H
 
+#include "tjcueindex.h"
+
 namespace tj {
 	namespace show {
 		class Controller; 
 
+		/** The cues in a CueList are always sorted by time, so that cues can be looked up using a binary search (see
+		CueIndex). The index is updated when cues are added or removed and when a cue is moved (Cue calls OnCueChanged). **/
 		class CueList: public virtual Object, public Serializable {
 			friend class Controller;
 			friend class Cue;
@@ -46,13 +50,16 @@ namespace tj {
 				virtual ref<Cue> GetCueByName(const std::wstring& cs);
 				virtual ref<Cue> GetCueByID(const CueIdentifier& id);
 				virtual void GetCuesBetween(Time start, Time end, std::list< ref<Cue> >& cues);
+				virtual void GetCuesBetween(Time start, Time end, std::list< ref<Cue> >& cues, CueCursor& cursor);
 				virtual void Clone();
 
 				// TODO: can we remove this? As far as I know, only Cue::DoAction is using this, and can do it in another way
 				virtual void SetStaticInstance(ref<Instance> ctrl);
 
 			protected:
-				std::vector< ref<Cue> > _cues;
+				virtual void OnCueChanged(ref<Cue> c);
+
+				CueIndex<Cue> _cues;
 				CriticalSection _lock;
 				weak<Instance> _controller;
 		};
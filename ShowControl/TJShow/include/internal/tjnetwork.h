@@ -104,6 +104,11 @@ namespace tj {
 				void ReportError(Features involved, ExceptionType type, const std::wstring& message);
 				void SendInput(const tj::np::PatchIdentifier& patch, const tj::np::InputID& path, float value);
 				void SendUpdate(ref<Message> msg, bool reliable = false);
+
+				/** The engines open a ShowSocket::Batch on the socket while ticking players, so that the updates they send are
+				sent together. Returns null when the network is not connected. **/
+				ref<ShowSocket> GetSocket();
+
 				ref<network::FindResourceTransaction> SendFindResource(const std::wstring& rid);
 
 				/** Returns a set of all channels that clients in this network accept (multiple clients
@@ -114,6 +119,7 @@ namespace tj {
 				int GetBytesReceived() const;
 				unsigned int GetActiveTransactionCount() const;
 				unsigned int GetWaitingPacketsCount() const;
+				void GetReliableStatistics(ReliableStatistics& stats) const;
 				ref<Client> GetClientByInstanceID(InstanceID instance);
 				void GetCachedClients(std::vector< ref<Client> >& lst);
 				ref<tj::np::Authorizer> GetAuthorizer();
@@ -142,7 +148,6 @@ namespace tj {
 				Listenable<Notification> EventDemoted;
 
 			protected:
-				ref<ShowSocket> GetSocket();
 				Features GetFeatures() const;
 				void DoAnnounce(); // this does the real work
 				std::wstring CreateResourceURL(const std::wstring& url);
@@ -19,11 +19,14 @@
 namespace tj {
 	namespace show {
 		template<typename T> class FaderPainter;
+		template<typename T> class FaderSampler;
+		template<typename T> class FaderSnapshot;
 
 		/** Fader<T> represents a fading value over time. You can add or remove points from it,
 		and Player's can 'play' a fadeable value using FaderPlayer<T>. **/
 		template<typename T> class Fader: public tj::shared::Serializable {
 			friend class FaderPainter<T>;
+			friend class FaderSampler<T>;
 
 			public:
 				Fader(const T& defaultValue, const T& minimumValue, const T& maximumValue);
@@ -45,91 +48,139 @@ namespace tj {
 				bool DoesPointExist(const Time& t);
 				Time GetNextEvent(const Time& t);
 				Time GetNextPoint(const Time& t);
-				std::map<Time, T>* GetPoints();
+				void RemoveAllPoints();
 				void RemoveItemsBetween(const Time& start, const Time& end);
 				void CopyTo(tj::shared::ref< Fader<T> > fd, const Time& start, const Time& end, const Time& to);
 				tj::shared::Range<Time> GetRange();
 				void InterpolateLeft(const Time& left, float r, const Time& right);
 				void InterpolateRight(const Time& left, float r, const Time& right);
 
+				/** Bulk edits: AddPoints adds points like AddPoint (with fade=true) does, ReplacePoints removes all
+				existing points first. Points sorted by time are added in amortized constant time each. **/
+				void AddPoints(const std::vector<Time>& times, const std::vector<T>& values);
+				void ReplacePoints(const std::vector<Time>& times, const std::vector<T>& values);
+
+				/** Returns a flat copy of the points that does not change when the fader is edited (the fader makes a
+				new snapshot after it was changed). Snapshots can be used by players on other threads. **/
+				tj::shared::ref< FaderSnapshot<T> > GetSnapshot();
+
+				/** The version is changed whenever the points are (or may have been) changed; see FaderSampler **/
+				inline unsigned int GetVersion() const { return _version; }
+
+				/** Read-only access to the points, for painters and editors (which run on the thread that edits the
+				fader). Changes are only made through the methods above, so that the version is kept up to date. **/
+				inline const std::map<Time, T>* GetPoints() const { return &_points; }
+
 			protected:
+				typedef typename std::map<Time, T>::const_iterator PointIterator;
+				T GetValueBefore(const Time& t, PointIterator next) const;
+				inline void Changed() { ++_version; }
+
 				T _default;
 				T _max;
 				T _min;
 				std::map<Time, T> _points;
+				unsigned int _version;
+
+				/* Held while the points are changed and while a snapshot is made of them; reading the points on the
+				editing thread does not need it, since only that thread changes them */
+				tj::shared::CriticalSection _snapshotLock;
+				tj::shared::ref< FaderSnapshot<T> > _snapshot;
+				unsigned int _snapshotVersion;
 		};
 
-		template<typename T> class FaderProperty: public tj::shared::LinkProperty {
+		/** FaderSnapshot is a flat, sorted copy of the points of a fader: the times and values are stored in separate
+		arrays, so that looking up the value at a time touches only a few cache lines. Snapshots are not changed after
+		they are created. **/
+		template<typename T> class FaderSnapshot: public virtual tj::shared::Object {
 			public:
-				FaderProperty(ref< Fader<T> > fader, const std::wstring& name, const std::wstring& text, const std::wstring& iconRid=L""): LinkProperty(name, text, iconRid), _fader(fader) {
+				FaderSnapshot(const std::map<Time, T>& points, const T& defaultValue, unsigned int version);
+				virtual ~FaderSnapshot();
+				T GetValueAt(const Time& t) const;
+				unsigned int GetSize() const;
+				unsigned int GetVersion() const;
+
+				/** Returns the index of the first point after t, or GetSize() if there is none. If a hint is given (the
+				result of an earlier call for an earlier time), the search starts there. **/
+				unsigned int Find(int t) const;
+				unsigned int Find(int t, unsigned int hint) const;
+
+				/** Returns the points between which the value at a time is interpolated, given the index of the first
+				point after that time (see Fader<T>::GetValueAt) **/
+				void GetSegment(unsigned int next, int& t0, T& v0, int& t1, T& v1) const;
+
+				static inline T Interpolate(int t, int t0, const T& v0, int t1, const T& v1) {
+					T dV = v1-v0;
+					if(t1==t0) return v0;
+					float percent = float(t-t0) / float(t1-t0);
+					return T(float(v0) + percent*float(dV));
 				}
 
-				virtual ~FaderProperty() {
-				}
+				const static int KEndTime = 999999999; // Time of the 'next point' when there is none after t
+				const static unsigned int KMaximumSteps = 8; // Maximum number of points Find skips before it searches
 
-				virtual void OnClicked() {
-					class FaderPropertyData: public tj::shared::Inspectable {
-						public:
-							std::wstring _data;
-							
-							virtual ref<PropertySet> GetProperties() {
-								ref<PropertySet> ps = GC::Hold(new PropertySet());
-								ref<TextProperty> tp = GC::Hold(new TextProperty(TL(fader_data_label), this, &_data, 300));
-								tp->SetExpanded(true);
-								ps->Add(tp);
-								return ps;
-							}
-					};
-
-					ref<FaderPropertyData> fpd = GC::Hold(new FaderPropertyData());
-
-					if(_fader) {
-						// Serialize fader data to text
-						std::wostringstream wos;
-						std::map<Time, T>* pts = _fader->GetPoints();
-						std::map<Time, T>::const_iterator it = pts->begin();
-						while(it!=pts->end()) {
-							wos << it->first.ToInt() << L"=" << it->second << L"\r\n";
-							++it;
-						}
-
-						fpd->_data = wos.str();
-
-						ref<PropertyDialogWnd> pdw = GC::Hold(new PropertyDialogWnd(TL(fader_data), TL(fader_data_question)));
-						pdw->GetPropertyGrid()->Inspect(fpd);
-						pdw->SetSize(400,450);
-						if(pdw->DoModal(GetWindow())) {
-							pts->clear();
-							std::wistringstream wis(fpd->_data);
-							while(!wis.eof()) {
-								int time = -1;
-								T value;
-								wchar_t separator;
-								wis >> time >> separator >> value;
-								if(time>=0) {
-									_fader->AddPoint(Time(time), value);
-								}
-							}
-						}
-					}
-				}
+			protected:
+				std::vector<int> _times;
+				std::vector<T> _values;
+				T _default;
+				unsigned int _version;
+		};
+
+		/** FaderBatch samples a number of faders at the same time. It first finds the two points around the time for
+		each fader (in the fader's snapshot, starting from where the previous call ended), and then interpolates all
+		values in a single loop that the compiler can vectorize. The results are the same as those of GetValueAt. **/
+		template<typename T> class FaderBatch {
+			public:
+				FaderBatch();
+				unsigned int Add(tj::shared::ref< Fader<T> > fader);
+				unsigned int GetSize() const;
+				void Sample(const Time& t, T* values);
 
 			protected:
-				ref< Fader<T> > _fader;
+				std::vector< tj::shared::ref< Fader<T> > > _faders;
+				std::vector< tj::shared::ref< FaderSnapshot<T> > > _snapshots;
+				std::vector<unsigned int> _next;
+				std::vector<int> _t0;
+				std::vector<int> _t1;
+				std::vector<T> _v0;
+				std::vector<T> _v1;
+				int _last;
+		};
+
+		/** FaderSampler samples a fader at a time that mostly increases (such as the current time during playback, or
+		each pixel column when painting). It remembers its position in the fader, so that each call takes amortized
+		constant time, instead of the O(log n) lookup that Fader<T>::GetValueAt performs. When the fader is changed,
+		or the time jumps backwards or far ahead, the sampler looks up its position again. **/
+		template<typename T> class FaderSampler {
+			public:
+				FaderSampler();
+				FaderSampler(tj::shared::ref< Fader<T> > fader);
+				void SetFader(tj::shared::ref< Fader<T> > fader);
+				void Reset();
+				T GetValueAt(const Time& t);
+
+				const static unsigned int KMaximumSteps = 8; // Maximum number of points to skip before looking up the position again
+
+			protected:
+				tj::shared::ref< Fader<T> > _fader;
+				typename Fader<T>::PointIterator _next;	// First point after _last
+				Time _last;
+				unsigned int _version;
+				bool _valid;
 		};
 
 		template<typename T> tj::shared::Range<Time> Fader<T>::GetRange() {
 			tj::shared::Range<Time> range(0,0);
-			std::map<Time,T>::iterator b = _points.begin();
+			typename std::map<Time,T>::iterator b = _points.begin();
 			if(b!=_points.end()) range.SetStart(b->first);
 
-			std::map<Time,T>::reverse_iterator e = _points.rbegin();
+			typename std::map<Time,T>::reverse_iterator e = _points.rbegin();
 			if(e!=_points.rend()) range.SetEnd(e->first);
 
 			return range;
 		}
 
-		template<typename T> Fader<T>::Fader(const T& defaultValue, const T& minimumValue, const T& maximumValue): _default(defaultValue), _max(maximumValue), _min(minimumValue) {
+		template<typename T> Fader<T>::Fader(const T& defaultValue, const T& minimumValue, const T& maximumValue): _default(defaultValue), _max(maximumValue), _min(minimumValue), _version(0), _snapshotVersion(0) {
 		}
 
 		template<typename T> Fader<T>::~Fader() {
@@ -140,12 +191,14 @@ namespace tj {
 		}
 
 		template<typename T> void Fader<T>::SetDefaultValue(const T& x) {
+			tj::shared::ThreadLock lock(&_snapshotLock);
 			_default = x;
+			Changed();
 		}
 
 		template<typename T> void Fader<T>::CopyTo(tj::shared::ref< Fader<T> > other, const Time& start, const Time& end, const Time& t) {
-			std::map<Time, T>::iterator low = _points.lower_bound(start);
-			std::map<Time, T>::iterator hi = _points.upper_bound(end);
+			typename std::map<Time, T>::iterator low = _points.lower_bound(start);
+			typename std::map<Time, T>::iterator hi = _points.upper_bound(end);
 
 			if(low==_points.end()) return;
 
@@ -166,99 +219,134 @@ namespace tj {
 		}
 
 		template<typename T> void Fader<T>::RemovePoint(const Time& t) {
-			std::map<Time, T>::iterator it = _points.find(t);
+			tj::shared::ThreadLock lock(&_snapshotLock);
+			typename std::map<Time, T>::iterator it = _points.find(t);
 			if(it!=_points.end()) {
 				_points.erase(it);
+				Changed();
 			}
 		}
 
 		template<typename T> T Fader<T>::GetValueAt(const Time& t) {
-			std::map<Time,T>::iterator it = _points.begin();
+			return GetValueBefore(t, _points.upper_bound(t));
+		}
+
+		/** Returns the value at time t, given the first point after t (or end). The value is interpolated between the
+		last point at or before t (or the default value at time 0) and the next point (or the default value at
+		FaderSnapshot<T>::KEndTime). Points before time 0 are not used as the previous point. **/
+		template<typename T> T Fader<T>::GetValueBefore(const Time& t, PointIterator next) const {
 			Time nearSmallerT = 0;
 			T nearSmallerV = _default;
-			Time nearBiggerT = 999999999;
+			Time nearBiggerT = FaderSnapshot<T>::KEndTime;
 			T nearBiggerV = _default;
-			while(it!=_points.end()) {
-				T value = it->second;
-				Time time = it->first;
 
-				if(time<=t && time>=nearSmallerT) {
-					nearSmallerT = time;
-					nearSmallerV = value;
-				}
-				else if(time>t && time<nearBiggerT) {
-					nearBiggerT = time;
-					nearBiggerV = value;
-				}
-				++it;
+			if(next!=_points.end() && next->first<Time(FaderSnapshot<T>::KEndTime)) {
+				nearBiggerT = next->first;
+				nearBiggerV = next->second;
 			}
 
-			T dV = nearBiggerV-nearSmallerV;
-			Time dT = nearBiggerT - nearSmallerT;
-			if(dT==Time(0)) return nearSmallerV;
-			float percent = float(t-nearSmallerT) / float(nearBiggerT-nearSmallerT);
+			if(next!=_points.begin()) {
+				PointIterator previous = next;
+				--previous;
+				if(previous->first>=Time(0)) {
+					nearSmallerT = previous->first;
+					nearSmallerV = previous->second;
+				}
+			}
 
-			return T(float(nearSmallerV) + percent*float(dV));
+			return FaderSnapshot<T>::Interpolate(t.ToInt(), nearSmallerT.ToInt(), nearSmallerV, nearBiggerT.ToInt(), nearBiggerV);
 		}
 
 
-		template<typename T> void Fader<T>::AddPoint(const Time& t, const T& value, bool fade=true) {
+		template<typename T> void Fader<T>::AddPoint(const Time& t, const T& value, bool fade) {
 			if(value>_max||value<_min) return;
+			tj::shared::ThreadLock lock(&_snapshotLock);
 			if(!fade) {
 				_points.insert(std::pair<Time, T>(t-Time(1), GetValueAt(t)));
 			}
 			_points.insert(std::pair<Time,T>(t, value));
+			Changed();
 		}
 
 
 		template<typename T> void Fader<T>::SetPoint(const Time& t, const T& value) {
 			if(value>_max||value<_min) return;
+			tj::shared::ThreadLock lock(&_snapshotLock);
 			_points[t] = value;
+			Changed();
 		}
 
-		template<typename T> std::map<Time, T>* Fader<T>::GetPoints() {
-			return &_points;
+		template<typename T> void Fader<T>::AddPoints(const std::vector<Time>& times, const std::vector<T>& values) {
+			tj::shared::ThreadLock lock(&_snapshotLock);
+			typename std::map<Time, T>::iterator hint = _points.end();
+			for(unsigned int a=0;a<times.size() && a<values.size();a++) {
+				const T& value = values[a];
+				if(value>_max||value<_min) continue;
+				hint = _points.insert(hint, std::pair<Time, T>(times[a], value));
+			}
+			Changed();
+		}
+
+		template<typename T> void Fader<T>::ReplacePoints(const std::vector<Time>& times, const std::vector<T>& values) {
+			tj::shared::ThreadLock lock(&_snapshotLock);
+			_points.clear();
+			AddPoints(times, values);
+		}
+
+		template<typename T> tj::shared::ref< FaderSnapshot<T> > Fader<T>::GetSnapshot() {
+			tj::shared::ThreadLock lock(&_snapshotLock);
+			if(!_snapshot || _snapshotVersion!=_version) {
+				_snapshotVersion = _version;
+				_snapshot = tj::shared::GC::Hold(new FaderSnapshot<T>(_points, _default, _snapshotVersion));
+			}
+			return _snapshot;
+		}
+
+		template<typename T> void Fader<T>::RemoveAllPoints() {
+			tj::shared::ThreadLock lock(&_snapshotLock);
+			_points.clear();
+			Changed();
 		}
 
 		template<typename T> void Fader<T>::RemoveItemsBetween(const Time& start, const Time& end) {
-			std::map<Time, T>::iterator low = _points.lower_bound(start);
-			std::map<Time, T>::iterator hi = _points.upper_bound(end);
+			tj::shared::ThreadLock lock(&_snapshotLock);
+			typename std::map<Time, T>::iterator low = _points.lower_bound(start);
+			typename std::map<Time, T>::iterator hi = _points.upper_bound(end);
 			_points.erase(low, hi);
+			Changed();
 		}
 
+		/** Returns the time of the point closest to t (the earlier one if two points are equally close), or -1 if
+		there are no points **/
 		template<typename T> Time Fader<T>::GetNearest(const Time& t) {
-			Time nearest = -1;
+			if(_points.empty()) {
+				return Time(-1);
+			}
 
-			std::map<Time, T>::iterator it = _points.begin();
-			while(it!=_points.end()) {
-				std::pair<Time, T> data = *it;
-				if(nearest==Time(-1) || (abs(int(t-data.first)))<abs(int(t-nearest))) {
-					nearest = data.first;
-				}
-				++it;
+			PointIterator after = _points.lower_bound(t);
+			if(after==_points.end()) {
+				return _points.rbegin()->first;
+			}
+			else if(after==_points.begin()) {
+				return after->first;
 			}
 
-			return nearest;
+			PointIterator before = after;
+			--before;
+			if(abs(int(t-after->first)) < abs(int(t-before->first))) {
+				return after->first;
+			}
+			return before->first;
 		}
 
 		template<typename T> Time Fader<T>::GetNextEvent(const Time& t) {
-			Time nearest = Time(-1);
-
-			std::map<Time, T>::iterator it = _points.begin();
-			while(it!=_points.end()) {
-				std::pair<Time, T> data = *it;
-				if(data.first>t) {
-					if(nearest==Time(-1) || (abs(int(t-data.first)))<abs(int(t-nearest))) {
-						nearest = data.first;
-					}
-				}
-				++it;
+			PointIterator next = _points.upper_bound(t);
+			if(next==_points.end()) {
+				return Time(-1);
 			}
 
-			if(nearest==Time(-1)) return nearest;
-
-			T nearestValue = GetValueAt(nearest);
-			if(nearestValue != GetValueAt(t)) {
+			Time nearest = next->first;
+			if(GetValueBefore(nearest, _points.upper_bound(nearest)) != GetValueBefore(t, next)) {
 				return t+Time(1);
 			}
 
@@ -266,30 +354,21 @@ namespace tj {
 		}
 
 		template<typename T> Time Fader<T>::GetNextPoint(const Time& t) {
-			Time nearest = Time(-1);
-
-			std::map<Time, T>::iterator it = _points.begin();
-			while(it!=_points.end()) {
-				std::pair<Time, T> data = *it;
-				if(data.first>t) {
-					if(nearest==Time(-1) || (abs(int(t-data.first)))<abs(int(t-nearest))) {
-						nearest = data.first;
-					}
-				}
-				++it;
+			PointIterator next = _points.upper_bound(t);
+			if(next==_points.end()) {
+				return Time(-1);
 			}
-
-			return nearest;
+			return next->first;
 		}
 
 		template<typename T> void Fader<T>::Save(TiXmlElement* parent) {
 			TiXmlElement f("fader");
-			f.SetAttribute("default", StringifyMbs(_default));
-			std::map<Time, T>::iterator it = _points.begin();
+			f.SetAttribute("default", tj::shared::StringifyMbs(_default));
+			typename std::map<Time, T>::iterator it = _points.begin();
 			while(it!=_points.end()) {
 				TiXmlElement point("point");
-				point.SetAttribute("time", StringifyMbs(it->first));
-				point.SetAttribute("value", StringifyMbs(it->second));
+				point.SetAttribute("time", tj::shared::StringifyMbs(it->first));
+				point.SetAttribute("value", tj::shared::StringifyMbs(it->second));
 				f.InsertEndChild(point);
 				++it;
 			}
@@ -297,22 +376,31 @@ namespace tj {
 		}
 
 		template<typename T> void Fader<T>::Load(TiXmlElement* you) {
-			StringTo<T>(you->Attribute("default"), _default);
+			{
+				tj::shared::ThreadLock lock(&_snapshotLock);
+				tj::shared::StringTo<T>(you->Attribute("default"), _default);
+				Changed();
+			}
 			
+			std::vector<Time> times;
+			std::vector<T> values;
 			TiXmlElement* point = you->FirstChildElement("point");
 			while(point!=0) {
-				Time time = StringTo<Time>(point->Attribute("time"),-1);
-				T value = StringTo<T>(point->Attribute("value"), _default);
+				Time time = tj::shared::StringTo<Time>(point->Attribute("time"),-1);
+				T value = tj::shared::StringTo<T>(point->Attribute("value"), _default);
 				if(time>=Time(0)) {
-					AddPoint(time,value);
+					times.push_back(time);
+					values.push_back(value);
 				}
 				point = point->NextSiblingElement("point");
 			}
+			AddPoints(times, values);
 		}
 
 		template<typename T> void Fader<T>::InterpolateLeft(const Time& left, float r, const Time& right) {
-			std::map<Time, T>::iterator it = _points.lower_bound(left);
-			std::map<Time, T>::iterator end = _points.upper_bound(right);
+			tj::shared::ThreadLock lock(&_snapshotLock);
+			typename std::map<Time, T>::iterator it = _points.lower_bound(left);
+			typename std::map<Time, T>::iterator end = _points.upper_bound(right);
 
 			std::map< Time, T> temp;
 
@@ -325,11 +413,13 @@ namespace tj {
 
 			_points.erase(_points.lower_bound(left),end);
 			_points.insert(temp.begin(), temp.end());
+			Changed();
 		}
 
 		template<typename T> void Fader<T>::InterpolateRight(const Time& left, float r, const Time& right) {
-			std::map<Time, T>::iterator it = _points.lower_bound(left);
-			std::map<Time, T>::iterator end = _points.upper_bound(right);
+			tj::shared::ThreadLock lock(&_snapshotLock);
+			typename std::map<Time, T>::iterator it = _points.lower_bound(left);
+			typename std::map<Time, T>::iterator end = _points.upper_bound(right);
 
 			std::map< Time, T> temp;
 
@@ -342,6 +432,163 @@ namespace tj {
 
 			_points.erase(_points.lower_bound(left),end);
 			_points.insert(temp.begin(), temp.end());
+			Changed();
+		}
+
+		/* FaderSampler */
+		template<typename T> FaderSampler<T>::FaderSampler(): _version(0), _valid(false) {
+		}
+
+		template<typename T> FaderSampler<T>::FaderSampler(tj::shared::ref< Fader<T> > fader): _fader(fader), _version(0), _valid(false) {
+		}
+
+		template<typename T> void FaderSampler<T>::SetFader(tj::shared::ref< Fader<T> > fader) {
+			_fader = fader;
+			_valid = false;
+		}
+
+		template<typename T> void FaderSampler<T>::Reset() {
+			_valid = false;
+		}
+
+		template<typename T> T FaderSampler<T>::GetValueAt(const Time& t) {
+			const std::map<Time, T>& points = _fader->_points;
+
+			if(_valid && _version==_fader->_version && t>=_last) {
+				// Move forward to the first point after t
+				unsigned int steps = 0;
+				while(_next!=points.end() && _next->first<=t) {
+					if(++steps > KMaximumSteps) {
+						_valid = false;
+						break;
+					}
+					++_next;
+				}
+			}
+			else {
+				_valid = false;
+			}
+
+			if(!_valid) {
+				_next = points.upper_bound(t);
+				_version = _fader->_version;
+				_valid = true;
+			}
+
+			_last = t;
+			return _fader->GetValueBefore(t, _next);
+		}
+
+		/* FaderSnapshot */
+		template<typename T> FaderSnapshot<T>::FaderSnapshot(const std::map<Time, T>& points, const T& defaultValue, unsigned int version): _default(defaultValue), _version(version) {
+			_times.reserve(points.size());
+			_values.reserve(points.size());
+			typename std::map<Time, T>::const_iterator it = points.begin();
+			while(it!=points.end()) {
+				_times.push_back(it->first.ToInt());
+				_values.push_back(it->second);
+				++it;
+			}
+		}
+
+		template<typename T> FaderSnapshot<T>::~FaderSnapshot() {
+		}
+
+		template<typename T> unsigned int FaderSnapshot<T>::GetSize() const {
+			return (unsigned int)_times.size();
+		}
+
+		template<typename T> unsigned int FaderSnapshot<T>::GetVersion() const {
+			return _version;
+		}
+
+		template<typename T> unsigned int FaderSnapshot<T>::Find(int t) const {
+			return (unsigned int)(std::upper_bound(_times.begin(), _times.end(), t) - _times.begin());
+		}
+
+		template<typename T> unsigned int FaderSnapshot<T>::Find(int t, unsigned int hint) const {
+			unsigned int size = (unsigned int)_times.size();
+			if(hint>size || (hint>0 && _times[hint-1]>t)) {
+				return Find(t);
+			}
+
+			for(unsigned int steps=0;hint<size && _times[hint]<=t;steps++) {
+				if(steps>=KMaximumSteps) {
+					return Find(t);
+				}
+				++hint;
+			}
+			return hint;
+		}
+
+		template<typename T> void FaderSnapshot<T>::GetSegment(unsigned int next, int& t0, T& v0, int& t1, T& v1) const {
+			t0 = 0;
+			v0 = _default;
+			t1 = KEndTime;
+			v1 = _default;
+
+			if(next<_times.size() && _times[next]<KEndTime) {
+				t1 = _times[next];
+				v1 = _values[next];
+			}
+
+			if(next>0 && _times[next-1]>=0) {
+				t0 = _times[next-1];
+				v0 = _values[next-1];
+			}
+		}
+
+		template<typename T> T FaderSnapshot<T>::GetValueAt(const Time& t) const {
+			int t0, t1;
+			T v0, v1;
+			GetSegment(Find(t.ToInt()), t0, v0, t1, v1);
+			return Interpolate(t.ToInt(), t0, v0, t1, v1);
+		}
+
+		/* FaderBatch */
+		template<typename T> FaderBatch<T>::FaderBatch(): _last(0) {
+		}
+
+		template<typename T> unsigned int FaderBatch<T>::Add(tj::shared::ref< Fader<T> > fader) {
+			_faders.push_back(fader);
+			_snapshots.push_back(fader->GetSnapshot());
+			_next.push_back(0);
+			_t0.push_back(0);
+			_t1.push_back(0);
+			_v0.push_back(T());
+			_v1.push_back(T());
+			return (unsigned int)(_faders.size()-1);
+		}
+
+		template<typename T> unsigned int FaderBatch<T>::GetSize() const {
+			return (unsigned int)_faders.size();
+		}
+
+		template<typename T> void FaderBatch<T>::Sample(const Time& time, T* values) {
+			const int t = time.ToInt();
+			const unsigned int n = (unsigned int)_faders.size();
+
+			// Find the points around t for each fader
+			for(unsigned int a=0;a<n;a++) {
+				if(_snapshots[a]->GetVersion()!=_faders[a]->GetVersion()) {
+					_snapshots[a] = _faders[a]->GetSnapshot();
+					_next[a] = _snapshots[a]->Find(t);
+				}
+				else {
+					_next[a] = (t>=_last) ? _snapshots[a]->Find(t, _next[a]) : _snapshots[a]->Find(t);
+				}
+				_snapshots[a]->GetSegment(_next[a], _t0[a], _v0[a], _t1[a], _v1[a]);
+			}
+			_last = t;
+
+			// Interpolate
+			const int* t0 = n>0 ? &(_t0[0]) : 0;
+			const int* t1 = n>0 ? &(_t1[0]) : 0;
+			const T* v0 = n>0 ? &(_v0[0]) : 0;
+			const T* v1 = n>0 ? &(_v1[0]) : 0;
+			for(unsigned int a=0;a<n;a++) {
+				values[a] = FaderSnapshot<T>::Interpolate(t, t0[a], v0[a], t1[a], v1[a]);
+			}
 		}
 	}
 }
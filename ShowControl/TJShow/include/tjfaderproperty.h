@@ -0,0 +1,87 @@
+/* TJShow (C) Tommy van der Vorst, Pixelspark, 2005-2017.
+ * 
+ * This file is part of TJShow. TJShow is free software: you 
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later 
+ * version.
+ * 
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef _TJFADERPROPERTY_H
+#define _TJFADERPROPERTY_H
+
+namespace tj {
+	namespace show {
+		/** FaderProperty shows the points of a fader as text in a dialog, and replaces the points with the edited
+		text. It is kept apart from tjfader.h, so that the fader itself does not depend on TJSharedUI. **/
+		template<typename T> class FaderProperty: public tj::shared::LinkProperty {
+			public:
+				FaderProperty(ref< Fader<T> > fader, const std::wstring& name, const std::wstring& text, const std::wstring& iconRid=L""): LinkProperty(name, text, iconRid), _fader(fader) {
+				}
+
+				virtual ~FaderProperty() {
+				}
+
+				virtual void OnClicked() {
+					class FaderPropertyData: public tj::shared::Inspectable {
+						public:
+							std::wstring _data;
+							
+							virtual ref<PropertySet> GetProperties() {
+								ref<PropertySet> ps = GC::Hold(new PropertySet());
+								ref<TextProperty> tp = GC::Hold(new TextProperty(TL(fader_data_label), this, &_data, 300));
+								tp->SetExpanded(true);
+								ps->Add(tp);
+								return ps;
+							}
+					};
+
+					ref<FaderPropertyData> fpd = GC::Hold(new FaderPropertyData());
+
+					if(_fader) {
+						// Serialize fader data to text
+						std::wostringstream wos;
+						const std::map<Time, T>* pts = _fader->GetPoints();
+						typename std::map<Time, T>::const_iterator it = pts->begin();
+						while(it!=pts->end()) {
+							wos << it->first.ToInt() << L"=" << it->second << L"\r\n";
+							++it;
+						}
+
+						fpd->_data = wos.str();
+
+						ref<PropertyDialogWnd> pdw = GC::Hold(new PropertyDialogWnd(TL(fader_data), TL(fader_data_question)));
+						pdw->GetPropertyGrid()->Inspect(fpd);
+						pdw->SetSize(400,450);
+						if(pdw->DoModal(GetWindow())) {
+							std::vector<Time> times;
+							std::vector<T> values;
+							std::wistringstream wis(fpd->_data);
+							while(!wis.eof()) {
+								int time = -1;
+								T value;
+								wchar_t separator;
+								wis >> time >> separator >> value;
+								if(time>=0) {
+									times.push_back(Time(time));
+									values.push_back(value);
+								}
+							}
+							_fader->ReplacePoints(times, values);
+						}
+					}
+				}
+
+			protected:
+				ref< Fader<T> > _fader;
+		};
+	}
+}
+
+#endif
@@ -29,6 +29,7 @@ even if someone includes one of our header files in their own project. **/
 #include <TJSharedUI/include/tjsharedui.h>
 #include <TJNP/include/tjprotocol.h>
 #include <TJNP/include/tjstream.h>
+#include <algorithm>
 
 using tj::shared::ref;
 using tj::shared::weak;
@@ -36,6 +37,7 @@ using tj::shared::strong;
 using tj::shared::Time;
 
 #include "tjfader.h"
+#include "tjfaderproperty.h"
 #include "tjpatching.h"
 #include "tjtalkback.h"
 #include "tjplayback.h"
@@ -35,7 +35,7 @@ void CueThread::OnTick(Time c) {
 	ref<Controller> controller = _controller;
 	if(controller) {
 		std::list< ref<Cue> > cues;
-		_list->GetCuesBetween(_last, c, cues); // GetCuesBetween is end-inclusive: start < t <= end
+		_list->GetCuesBetween(_last, c, cues, _cursor); // GetCuesBetween is end-inclusive: start < t <= end
 		std::list< ref<Cue> >::iterator it = cues.begin();
 
 		bool continueLinearProcessing = true;
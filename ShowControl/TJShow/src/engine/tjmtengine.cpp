@@ -180,6 +180,9 @@ void PlayerThread::OnResume(Time t) {
 }
 
 void PlayerThread::OnTick(Time current) {
+	// Updates sent by players that are ticked at the same time are sent over the network together
+	ShowSocket::Batch batch(Application::Instance()->GetNetwork()->GetSocket());
+
 	try {
 		_tickCount++;
 		_track->SetLastTickTime((unsigned int)GetTickCount());
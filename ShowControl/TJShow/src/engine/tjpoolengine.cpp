@@ -16,6 +16,7 @@
 #include "../../include/internal/tjshow.h"
 #include "../../include/internal/engine/tjengine.h"
 #include "../../include/internal/engine/tjpoolengine.h"
+#include <math.h>
 
 using namespace tj::shared;
 using namespace tj::show;
@@ -38,30 +39,20 @@ namespace tj {
 					virtual void Run();
 
 				protected:
-					void ProcessPoolMessage(PoolMessage& msg);
-					void SchedulePoolMessage(PoolMessage& pm, const Timebase& base, const Time& t);
 					void ExecutePoolMessage(PoolMessage& msg);
 					Time GetTime(const Timebase& base, float speed);
 					weak<PoolEngine> _pool;
-
-					// Timer
-					HANDLE _timer;
-					bool _hasScheduledWork;
-					PoolMessage _scheduled;
 					int _minTickLength;
 			};
 		}
 	}
 }
 
-PoolThread::PoolThread(ref<PoolEngine> pool): _pool(pool), _hasScheduledWork(false) {
-	_timer = CreateWaitableTimer(NULL, FALSE, NULL);
+PoolThread::PoolThread(ref<PoolEngine> pool): _pool(pool) {
 	_minTickLength = pool->_minTickLength;
 }
 
 PoolThread::~PoolThread() {
-	CancelWaitableTimer(_timer);
-	CloseHandle(_timer);
 	Log::Write(L"TJShow/PoolEngine", L"~PoolThread");
 }
 
@@ -70,65 +61,6 @@ Time PoolThread::GetTime(const Timebase& base, float speed) {
 	return base.time + Time(int(now.Difference(base.ticks).ToMilliSeconds()*speed));
 }
 
-void PoolThread::SchedulePoolMessage(PoolMessage& pm, const Timebase& base, const Time& t) {
-	if(_hasScheduledWork) {
-		Throw(L"Cannot schedule next event when there is still an event scheduled!", ExceptionTypeError);
-	}
-
-	Timestamp now(true);
-	Time current = GetTime(base,pm.speed);
-	Time preferredNextTick = t;
-
-	if(preferredNextTick<Time(0)) {
-		return;
-	}
-
-	if(preferredNextTick > current) {
-		// If the next event is closer than the min tick length, make sure it is not
-		Time diff = preferredNextTick - current;
-		if(int(diff)<=_minTickLength) {
-			preferredNextTick = current + Time(_minTickLength);
-		}
-
-		/** Playback speed: when c=0.5, Time(1000) takes 2000 ms in reality
-		when c=2.0, Time(1000) takes 500ms in reality **/
-		Time delay(int(float(int(preferredNextTick-current))/pm.speed));
-
-		LARGE_INTEGER dueTime;
-		memset(&dueTime, 0, sizeof(LARGE_INTEGER));
-		dueTime.QuadPart = -LONGLONG(int(delay))*LONGLONG(10000) + 5000;
-		if(preferredNextTick<=current) {
-			dueTime.QuadPart  = LONGLONG(-1*10000);
-		}
-		if(SetWaitableTimer(_timer, &dueTime, 0, NULL, NULL, 0)==FALSE) {
-			Log::Write(L"TJShow/PoolEngine", L"SetWaitableTimer failed in SchedulePoolMessage");
-		}
-		else {
-			_scheduled = pm;
-			_hasScheduledWork = true;
-		}
-	}
-	else {
-		ExecutePoolMessage(pm);
-	}
-}
-
-void PoolThread::ProcessPoolMessage(PoolMessage& msg) {
-	ref<Player> player = msg.player;
-
-	if(player) {
-		if(msg.action==PoolActionTick) {
-			SchedulePoolMessage(msg, msg.timeBase, msg.time);
-		}
-		else {
-			ExecutePoolMessage(msg);
-		}
-	}
-	else {
-		Log::Write(L"TJShow/PoolEngine", L"Message has no player!");
-	}
-}
-
 void PoolThread::ExecutePoolMessage(PoolMessage& msg) {
 	//Log::Write(L"TJShow/PoolEngine", L"Tick p="+StringifyHex(msg.player.GetPointer())+L" at t="+Stringify(msg.time.ToInt())+L" a="+Stringify(msg.action));
 	if(!msg.player) {
@@ -145,10 +77,10 @@ void PoolThread::ExecutePoolMessage(PoolMessage& msg) {
 	ref<PoolEngine> pe = _pool;
 	if(!pe) {
 		Log::Write(L"TJShow/PoolEngine", L"Cannot execute pool message when there is no pool!");
+		return;
 	}
 
 	// Execute the pool message
-	bool shouldCancelScheduled = false;
 	bool shouldReschedule = false;
 
 	if(msg.action==PoolActionStop) {
@@ -160,7 +92,6 @@ void PoolThread::ExecutePoolMessage(PoolMessage& msg) {
 	}
 	else if(msg.action==PoolActionPause) {
 		msg.player->Pause(t);
-		shouldCancelScheduled = true;
 	}
 	else if(msg.action==PoolActionUnpause) {
 		msg.player->Jump(t, false);
@@ -168,18 +99,14 @@ void PoolThread::ExecutePoolMessage(PoolMessage& msg) {
 	}
 	else if(msg.action==PoolActionSetSpeed) {
 		msg.player->SetPlaybackSpeed(t, msg.speed);
-		shouldCancelScheduled = true;
 		shouldReschedule = true;
 	}
 	else if(msg.action==PoolActionJumpPlaying) {
 		msg.player->Jump(t, false);
-		shouldCancelScheduled = true;
 		shouldReschedule = true;
 	}
 	else if(msg.action==PoolActionJumpPaused) {
 		msg.player->Jump(t, true);
-		shouldCancelScheduled = true;
-		shouldReschedule = false;
 	}
 	else if(msg.action==PoolActionTick) {
 		if(pe->_isTicking) {
@@ -188,133 +115,71 @@ void PoolThread::ExecutePoolMessage(PoolMessage& msg) {
 		shouldReschedule = true;
 	}
 
-	// Re-schedule and/or cancel scheduled messages
-	if((!pe->_isTicking || shouldCancelScheduled) && _hasScheduledWork) {
-		CancelWaitableTimer(_timer);
-		_hasScheduledWork = false;
-	}
-
+	// Ask the player when it wants to be ticked next (outside the lock, since this may take a while)
+	Time tn = -1;
 	if(shouldReschedule && pe->_isTicking) {
-		ref<PoolEngine> pe = _pool;
-		if(pe) {
-			Time tn = msg.player->GetNextEvent(t);
-			if(tn>=Time(0)) {
-				PoolMessage pm = msg;
-				pm.action = PoolActionTick;
-				pm.time = tn;
-				ThreadLock lock(&(pe->_lock));
-				pe->_queue.push_back(pm);
-				pe->_queueSemaphore.Release(1);
-			}
-		}
+		tn = msg.player->GetNextEvent(t);
 	}
 
-	// Update statistics
+	// Schedule the next tick and update statistics
 	int lateness = t.ToInt() - msg.time.ToInt();
-	pe->_stats.totalTickCount++;
-	pe->_stats.totalDeviation += lateness;
-	if(lateness > 2*_minTickLength) {
-		pe->_stats.lateTickCount++;
+	bool shouldEvaluate = false;
+	{
+		ThreadLock lock(&(pe->_lock));
+		if(tn>=Time(0)) {
+			PoolMessage pm = msg;
+			pm.action = PoolActionTick;
+			pm.time = tn;
+			pe->Schedule(pm, GetTime(msg.timeBase, msg.speed));
+		}
+
+		pe->_stats.AddTick(lateness, 2*_minTickLength);
+		pe->_totalStats.AddTick(lateness, 2*_minTickLength);
+		shouldEvaluate = (pe->_stats.totalTickCount >= PoolEngine::KEvaluationIntervalTicks);
 	}
 
 	// If it is time to evaluate our timing, tell the PoolEngine to do so (in this thread!)
-	if(pe->_stats.totalTickCount >= PoolEngine::KEvaluationIntervalTicks) {
+	if(shouldEvaluate) {
 		pe->EvaluatePoolStatistics();
 	}
 }
 
 void PoolThread::Run() {
 	try {
-		HANDLE waitObjects[3];
+		std::vector<PoolMessage> work;
+		Timestamp lastWork(true);
 
 		while(true) {
 			ref<PoolEngine> pe = _pool;
 			if(pe) {
-				 waitObjects[0] = pe->_cancelAllScheduled.GetHandle();
-				 waitObjects[1] = _timer;
-				 waitObjects[2] = pe->_queueSemaphore.GetHandle();
-				
-
-				// See if there is any work to do
-				{
-					int status = WaitForMultipleObjects(3, waitObjects, FALSE, _hasScheduledWork ? INFINITE  : PoolEngine::KPoolThreadTimeout);
-					if(status==WAIT_OBJECT_0+2) {
-						bool haveWork = false;
-						bool needsSleep = false;
-						PoolMessage message;
-						
-						{
-							ThreadLock lock(&(pe->_lock));
-							if(pe->_queue.size()>=1) {
-								message = (*pe->_queue.begin());
-
-								if(message.NeedsScheduling() && _hasScheduledWork) {
-									if(_scheduled.time > message.time) {
-										// The new message has to 'happen' before our scheduled message, and needs scheduling; thus,
-										// un-schedule and requeue the old message before processing the new one
-										CancelWaitableTimer(_timer);
-										_hasScheduledWork = false;
-										pe->_queue.pop_front();
-										pe->_queue.push_back(_scheduled);
-										haveWork = true;
-									}
-									else {
-										// Can't take this message; put it on the back of the queue
-										haveWork = false;
-										pe->_queue.push_back(message);
-										pe->_queue.pop_front();
-									}
-
-									// In both cases, the queue has a new message it needs to process; signal event
-									// To make sure we do not keep 'spinning', sleep here for at least _minTickLength
-									// to allow other threads to pick up the new message if we do not have any work to
-									// process.
-									pe->_queueSemaphore.Release(1);
-									if(!haveWork && pe->_queue.size()==1) {
-										needsSleep = true;
-									}
-								}
-								else {
-									pe->_queue.pop_front();
-									haveWork = true;
-								}
-							}
-							else {
-								// Another thread was a little faster picking up the work, and there is no work left
-							}
-						}
-
-						// Execute the work
-						if(haveWork) {
-							ProcessPoolMessage(message);
+				int waitTime = 0;
+				pe->TakeWork(work, waitTime);
+
+				if(work.size()>0) {
+					// Updates sent by the players in this batch of work are sent over the network together
+					{
+						ShowSocket::Batch batch(Application::Instance()->GetNetwork()->GetSocket());
+						std::vector<PoolMessage>::iterator it = work.begin();
+						while(it!=work.end()) {
+							ExecutePoolMessage(*it);
+							++it;
 						}
-						else {
-							if(needsSleep) {
-								Sleep(_minTickLength);
-							}
-						}
-					}
-					else if(status==WAIT_OBJECT_0+1) {
-						// Our timer rang, execute scheduled message
-						if(_hasScheduledWork) {
-							ExecutePoolMessage(_scheduled);
-							_hasScheduledWork = false;
-						}
-						else {
-							Log::Write(L"TJShow/PoolEngine", L"Timer rang, but thread has no work scheduled");
-						}
-					}
-					else if(status==WAIT_OBJECT_0 && _hasScheduledWork) {
-						CancelWaitableTimer(_timer);
-						_hasScheduledWork = false;
 					}
-					else if(status==WAIT_TIMEOUT) {
-						if(!_hasScheduledWork) {
-							if(pe->RemoveIdleThread(this)) {
-								return;
-							}
+
+					work.clear();
+					lastWork.Now();
+				}
+				else {
+					// Scheduled ticks are kept by the pool, so an idle thread can always be removed
+					if(Timestamp(true).Difference(lastWork).ToMilliSeconds() >= (long double)PoolEngine::KPoolThreadTimeout) {
+						if(pe->RemoveIdleThread(this)) {
+							return;
 						}
+						lastWork.Now();
 					}
+
+					// Wait until new work is queued or the next scheduled tick is due
+					pe->_queueSemaphore.Wait(Time(waitTime));
 				}
 			}
 			else {
@@ -340,7 +205,7 @@ void PoolThread::Run() {
 }
 
 /** PoolEngine **/
-PoolEngine::PoolEngine(const Time& minTickLength): _speed(1.0f), _isTicking(false), _minTickLength(minTickLength.ToInt()) {
+PoolEngine::PoolEngine(const Time& minTickLength): _speed(1.0f), _isTicking(false), _minTickLength(minTickLength.ToInt()), _generation(0) {
 }
 
 PoolEngine::~PoolEngine() {
@@ -350,13 +215,79 @@ PoolEngine::~PoolEngine() {
 void PoolEngine::SetTicking(bool t) {
 	ThreadLock lock(&_lock);
 	_isTicking = t;
-	if(t) {
-		_cancelAllScheduled.Reset();
+	CancelScheduled();
+	_stats.Reset();
+}
+
+/** Removes all scheduled ticks. Messages that were taken from the queue before this call (and are still being executed)
+belong to an earlier generation, and will therefore not schedule a new tick either. **/
+void PoolEngine::CancelScheduled() {
+	ThreadLock lock(&_lock);
+	_scheduler.Clear();
+	++_generation;
+}
+
+/** Schedules a tick message. The tick will not happen earlier than _minTickLength after the current time (so players
+that want to be ticked very often cannot keep the pool threads busy). **/
+void PoolEngine::Schedule(const PoolMessage& pm, const Time& current) {
+	ThreadLock lock(&_lock);
+	if(!_isTicking || pm.generation!=_generation || pm.speed<=0.0f) {
+		return;
+	}
+
+	long double now = _scheduler.GetNow();
+	long double due = now;
+	if(pm.time > current) {
+		/** Playback speed: when c=0.5, Time(1000) takes 2000 ms in reality
+		when c=2.0, Time(1000) takes 500ms in reality **/
+		int delay = Util::Max(int(pm.time - current), _minTickLength);
+		due = now + (long double)delay / (long double)pm.speed;
+	}
+
+	if(_scheduler.Add(pm, due)) {
+		// This tick is due before all others; wake up a thread so it can adjust the time it waits
+		_queueSemaphore.Release(1);
+	}
+}
+
+/** Called by pool threads to get work. Scheduled ticks that are due are moved to the queue first (together with the
+ticks that are due within half of _minTickLength). The thread then takes its share of the queue, and the other threads
+are woken up to process the rest. When there is no work, waitTime is set to the number of milliseconds until the next
+tick is due (or KPoolThreadTimeout when nothing is scheduled). **/
+void PoolEngine::TakeWork(std::vector<PoolMessage>& work, int& waitTime) {
+	ThreadLock lock(&_lock);
+	long double now = _scheduler.GetNow();
+	long double window = (long double)_minTickLength / 2.0;
+
+	unsigned int coalesced = 0;
+	if(_scheduler.PopDueCoalesced(now, window, _queue, coalesced)>0) {
+		_stats.coalescedTickCount += int(coalesced);
+		_totalStats.coalescedTickCount += int(coalesced);
+	}
+
+	if(_queue.size()>0) {
+		int threads = Util::Max(int(_workers.size()), 1);
+		int share = (int(_queue.size()) + threads - 1) / threads;
+		for(int a=0;a<share;a++) {
+			work.push_back(_queue.front());
+			_queue.pop_front();
+		}
+
+		int wake = Util::Min(int(_queue.size()), threads-1);
+		if(wake>0) {
+			_queueSemaphore.Release(wake);
+		}
+		waitTime = 0;
 	}
 	else {
-		_cancelAllScheduled.Signal();
+		long double next = _scheduler.GetNextDue();
+		if(next<0.0) {
+			waitTime = KPoolThreadTimeout;
+		}
+		else {
+			waitTime = Util::Min(KPoolThreadTimeout, Util::Max(1, int(ceil(double(next - window - now)))));
+		}
 	}
-	_stats.Reset();
 }
 
 bool PoolEngine::RemoveIdleThread(ref<PoolThread> pt) {
@@ -402,7 +333,7 @@ void PoolEngine::EvaluatePoolStatistics() {
 			float averageLateness = float(_stats.totalDeviation)/float(_stats.totalTickCount);
 
 			if(Zones::IsDebug()) {
-				Log::Write(L"TJShow/PoolEngine", L"Pool statistics: % really late="+Stringify(outsideTwiceRange)+L" average lateness="+Stringify(averageLateness)+L" n="+Stringify(currentThreadCount)+L" qn="+Stringify(_queue.size()));
+				Log::Write(L"TJShow/PoolEngine", L"Pool statistics: % really late="+Stringify(outsideTwiceRange)+L" average lateness="+Stringify(averageLateness)+L" n="+Stringify(currentThreadCount)+L" qn="+Stringify(_queue.size())+L" sn="+Stringify(_scheduler.GetSize()));
 			}
 
 			if(outsideTwiceRange > (1.0f-KThresholdWithinRange) || (averageLateness * KThresholdWithinRange) > (2*_minTickLength)) {
@@ -428,11 +359,15 @@ void PoolEngine::EvaluatePoolStatistics() {
 
 void PoolEngine::OnWorkQueued(unsigned int numItems) {
 	if(numItems>0) {
+		int wake = 0;
 		{
 			ThreadLock lock(&_lock);
 			SpawnPoolThreads();
+			wake = Util::Min(int(numItems), int(_workers.size()));
 		}
-		_queueSemaphore.Release(numItems);
+
+		// Threads take more than one message at a time, so there is no need to wake up more threads than there are
+		_queueSemaphore.Release(wake);
 	}
 }
 
@@ -451,8 +386,12 @@ void PoolEngine::AddPlayer(strong<Player> tr, strong<TrackWrapper> tw) {
 	_players.insert(tr);
 }
 
+void PoolEngine::GetStatistics(PoolStatistics& stats) {
+	ThreadLock lock(&_lock);
+	stats = _totalStats;
+}
+
 void PoolEngine::QueueActionForAllPlayers(PoolAction pa, const Timebase& tb, const Time& time, ref<Playback> pb, float c) {
-	_cancelAllScheduled.Reset();
 	unsigned int messagesQueued = 0;
 
 	PoolMessage pm;
@@ -464,6 +403,7 @@ void PoolEngine::QueueActionForAllPlayers(PoolAction pa, const Timebase& tb, con
 
 	{
 		ThreadLock lock(&_lock);
+		pm.generation = _generation;
 		std::set< ref<Player> >::iterator it = _players.begin();
 		while(it!=_players.end()) {
 			ref<Player> player = *it;
@@ -493,6 +433,7 @@ void PoolEngine::StartTicking(const Time& startTime, const Timestamp& startTicks
 	tb.time = startTime;
 	_speed = c;
 	SetTicking(true);
+	_totalStats.Reset();
 	QueueActionForAllPlayers(PoolActionTick, tb, startTime, pb, c);
 }
 
@@ -521,7 +462,7 @@ void PoolEngine::StopTicking() {
 void PoolEngine::Jump(const Time& time, const Timestamp& startTicks, bool paused) {
 	ThreadLock lock(&_lock);
 	_queue.clear();
-	_cancelAllScheduled.Signal();
+	CancelScheduled();
 
 	Timebase tb;
 	tb.ticks = startTicks;
@@ -532,7 +473,7 @@ void PoolEngine::Jump(const Time& time, const Timestamp& startTicks, bool paused
 void PoolEngine::SetTickingSpeed(float c, const Time& startTime, const Timestamp& startTicks) {
 	ThreadLock lock(&_lock);
 	_queue.clear();
-	_cancelAllScheduled.Reset();
+	CancelScheduled();
 	Timebase tb;
 	tb.ticks = startTicks;
 	tb.time = startTime;
@@ -549,4 +490,15 @@ void PoolStatistics::Reset() {
 	totalTickCount = 0;
 	lateTickCount = 0;
 	totalDeviation = 0;
+	maximumDeviation = 0;
+	coalescedTickCount = 0;
+}
+
+void PoolStatistics::AddTick(int lateness, int lateThreshold) {
+	totalTickCount++;
+	totalDeviation += lateness;
+	maximumDeviation = Util::Max(maximumDeviation, lateness);
+	if(lateness > lateThreshold) {
+		lateTickCount++;
+	}
 }
\ No newline at end of file
@@ -187,6 +187,20 @@ void Cue::MoveRelative(Item::Direction dir) {
 			_t = _t+Time(1);
 			break;
 	}
+	OnChanged();
+}
+
+void Cue::OnChanged() {
+	ref<CueList> list = _cueList;
+	if(list) {
+		list->OnCueChanged(this);
+	}
+}
+
+void Cue::OnPropertyChanged(void* member) {
+	if(member==&_t || member==&_action) {
+		OnChanged();
+	}
 }
 
 Cue::~Cue() {
@@ -213,6 +227,7 @@ std::wstring Cue::GetTooltipText() {
 
 void Cue::SetTime(Time t) {
 	_t = t;
+	OnChanged();
 }
 
 bool Cue::IsPrivate() const {
@@ -253,6 +268,7 @@ void Cue::SetColor(const RGBColor& c) {
 
 void Cue::Move(Time t, int h) {
 	_t = t;
+	OnChanged();
 }
 
 void Cue::SetPlaybackStateToAction(ref<Instance> controller, Action ca) {
@@ -23,36 +23,15 @@ CueList::CueList(ref<Instance> controller) {
 CueList::~CueList() {
 }
 
-namespace tj {
-	namespace show {
-		struct CueSorter {
-			 bool operator()(ref<Cue>& start,ref<Cue>& end) {
-				  return start->GetTime() < end->GetTime();
-			 }
-		};
-	}
-}
-
 void CueList::RemoveCuesBetween(Time a, Time b) {
 	ThreadLock lock(&_lock);
-	std::vector< ref<Cue> >::iterator it = _cues.begin();
-	while(it!=_cues.end()) {
-		ref<Cue> cue = *it;
-		Time ct = cue->GetTime();
-		if(ct <= b && ct >= a) {
-			_cues.erase(it);
-			_cues.begin();
-		}
-		else {
-			++it;
-		}
-	}
+	_cues.RemoveBetween(a, b);
 }
 
 void CueList::Clone() {
 	ThreadLock lock(&_lock);
-	std::vector< ref<Cue> >::iterator it = _cues.begin();
-	while(it!=_cues.end()) {
+	std::vector< ref<Cue> >::iterator it = _cues.GetBegin();
+	while(it!=_cues.GetEnd()) {
 		ref<Cue> cue = *it;
 		cue->Clone();
 		++it;
@@ -61,8 +40,8 @@ void CueList::Clone() {
 
 void CueList::Save(TiXmlElement* parent) {
 	TiXmlElement cues("cues");
-	std::vector< ref<Cue> >::iterator itc = _cues.begin();
-	while(itc!=_cues.end()) {
+	std::vector< ref<Cue> >::iterator itc = _cues.GetBegin();
+	while(itc!=_cues.GetEnd()) {
 		ref<Cue> cue = *itc;
 		TiXmlElement cueElement("cue");
 		cue->Save(&cueElement);
@@ -89,118 +68,69 @@ void CueList::SetStaticInstance(ref<Instance> ctrl) {
 }
 
 std::vector< ref<Cue> >::iterator CueList::GetCuesBegin() {
-	return _cues.begin();
+	return _cues.GetBegin();
 }
 
 std::vector< ref<Cue> >::iterator CueList::GetCuesEnd() {
-	return _cues.end();
+	return _cues.GetEnd();
 }
 
 void CueList::AddCue(ref<Cue> c) {
 	ThreadLock lock(&_lock);
-	_cues.push_back(c);
-	std::sort(_cues.begin(), _cues.end(), CueSorter());
+	_cues.Add(c);
 }
 
 void CueList::RemoveCue(ref<Cue> c) {
 	ThreadLock lock(&_lock);
-	std::vector< ref<Cue> >::iterator it = _cues.begin();
-	while(it!=_cues.end()) {
-		if(*it==c) {
-			it = _cues.erase(it);
-			break;
-		}
-		++it;
-	}
+	_cues.Remove(c);
+}
+
+/** Called by Cue when its time or action has changed **/
+void CueList::OnCueChanged(ref<Cue> c) {
+	ThreadLock lock(&_lock);
+	_cues.OnChanged(c);
 }
 
 void CueList::RemoveAllCues() {
 	ThreadLock lock(&_lock);
-	_cues.clear();
+	_cues.Clear();
 }
 
 ref<Cue> CueList::GetCueAt(Time t) {
-	std::vector<ref<Cue> >::iterator it = _cues.begin();
-	while(it!=_cues.end()) {
-		ref<Cue> c = *it;
-		if(c->GetTime()==t) {
-			return c;
-		}
-		++it;
-	}
-	return 0;
+	ThreadLock lock(&_lock);
+	return _cues.GetCueAt(t);
 }
 
 ref<Cue> CueList::GetNextCue(const Time& t, Cue::Action filter) {
-	ref<Cue> match = 0;
-	std::vector<ref<Cue> >::iterator it = _cues.begin();
-	while(it!=_cues.end()) {
-		ref<Cue> cue = *it;
-		if(cue->GetTime()>t && (filter==Cue::ActionNone || cue->GetAction()==filter) ) {
-			if(!match) {
-				match = cue;
-			}
-			else {
-				Time mdiff = match->GetTime() - t;
-				Time cdiff = cue->GetTime() - t;
-				if(cdiff < mdiff) {
-					match = cue;
-				}
-			}
-		}
-		
-		++it;
-	}
+	ThreadLock lock(&_lock);
+	return _cues.GetNextCue(t, filter);
+}
 
-	return match;
+void CueList::GetCuesBetween(Time start, Time end, std::list< ref<Cue> >& matches) {
+	CueCursor cursor;
+	GetCuesBetween(start, end, matches, cursor);
 }
 
-void CueList::GetCuesBetween(Time start, Time end, std::list< ref<Cue> >& matches) {	
-	std::vector< ref<Cue> >::iterator it = _cues.begin();
-	while(it!=_cues.end()) {
-		ref<Cue> cue = *it;
-		Time ctime = cue->GetTime();
-		if(ctime>start && ctime <= end) {
-			matches.push_back(cue);
-		}
-		
-		++it;
-	}
+void CueList::GetCuesBetween(Time start, Time end, std::list< ref<Cue> >& matches, CueCursor& cursor) {
+	ThreadLock lock(&_lock);
+	_cues.GetCuesBetween(start, end, matches, cursor);
 }
 
 unsigned int CueList::GetCueCount() const {
-	return (unsigned int)_cues.size();
+	return _cues.GetCount();
 }
 
 ref<Cue> CueList::GetPreviousCue(Time t) {
-	ref<Cue> match = 0;
-	std::vector<ref<Cue> >::iterator it = _cues.begin();
-	while(it!=_cues.end()) {
-		ref<Cue> cue = *it;
-		if(cue->GetTime()<t) {
-			if(!match) {
-				match = cue;
-			}
-			else {
-				Time mdiff = match->GetTime() - t;
-				Time cdiff = cue->GetTime() - t;
-				if(cdiff > mdiff) {
-					match = cue;
-				}
-			}
-		}
-		++it;
-	}
-
-	return match;
+	ThreadLock lock(&_lock);
+	return _cues.GetPreviousCue(t);
 }
 
 ref<Cue> CueList::GetCueByName(const std::wstring& pname) {
 	std::wstring name;
 	std::transform(pname.begin(), pname.end(), name.begin(), tolower);
 
-	std::vector< ref<Cue> >::iterator it = _cues.begin();
-	while(it!=_cues.end()) {
+	std::vector< ref<Cue> >::iterator it = _cues.GetBegin();
+	while(it!=_cues.GetEnd()) {
 		ref<Cue> cue = *it;
 		std::wstring cname = cue->GetName();
 		std::transform(cname.begin(), cname.end(), cname.begin(), tolower);
@@ -214,8 +144,8 @@ ref<Cue> CueList::GetCueByName(const std::wstring& pname) {
 }
 
 ref<Cue> CueList::GetCueByID(const CueIdentifier& id) {
-	std::vector< ref<Cue> >::iterator it = _cues.begin();
-	while(it!=_cues.end()) {
+	std::vector< ref<Cue> >::iterator it = _cues.GetBegin();
+	while(it!=_cues.GetEnd()) {
 		ref<Cue> cue = *it;
 		if(cue->GetID()==id) return cue;
 		++it;
@@ -226,5 +156,5 @@ ref<Cue> CueList::GetCueByID(const CueIdentifier& id) {
 
 void CueList::Clear() {
 	ThreadLock lock(&_lock);
-	_cues.clear();
-}
\ No newline at end of file
+	_cues.Clear();
+}
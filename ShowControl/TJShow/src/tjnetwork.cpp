@@ -762,6 +762,12 @@ unsigned int Network::GetWaitingPacketsCount() const {
 	return 0;
 }
 
+void Network::GetReliableStatistics(ReliableStatistics& stats) const {
+	if(_socket) {
+		_socket->GetReliableStatistics(stats);
+	}
+}
+
 void Network::OnReceiveSetAddress(int instance, const std::wstring& address, in_addr from) {
 	if(_instance==instance && _role!=RoleMaster) {
 		// meant for us
@@ -158,9 +158,9 @@ bool ScriptQuery::Set(Field field, ref<Scriptable> value) {
 }
 
 ref<Scriptable> ScriptQuery::SBind(ref<ParameterList> p) {
-	std::map<std::wstring,ref<Scriptable> >::iterator it = p->_vars.begin();
+	std::map<ScriptSymbol, ref<Scriptable> >::iterator it = p->_vars.begin();
 	while(it!=p->_vars.end()) {
-		Set(it->first, it->second);
+		Set(ScriptSymbols::GetName(it->first), it->second);
 		++it;
 	}
 	return ScriptConstants::Null;
@@ -142,7 +142,7 @@ void StatsPlayer::Stop() {
 }
 
 void StatsPlayer::Start(Time pos,ref<Playback> pb, float speed) {
-	_track->_drift->GetPoints()->clear();
+	_track->_drift->RemoveAllPoints();
 	_nextTick = Time(-1);
 	_track->_driftSum = 0;
 	_track->_driftCount = 0;
@@ -142,6 +142,10 @@ void InfoAction::Execute() {
 	ref<Network> nw = _app->GetNetwork();
 	if(nw) {
 		Log::Write(TL(application_name), std::wstring(L"TNP Sent:")+ Util::GetSizeString(nw->GetBytesSent()) + L" Recvd:" + Util::GetSizeString(nw->GetBytesReceived())+L" Running Txs:"+Stringify(nw->GetActiveTransactionCount())+std::wstring(L" Waiting for redelivery: ")+Stringify(nw->GetWaitingPacketsCount()));
+
+		ReliableStatistics rs;
+		nw->GetReliableStatistics(rs);
+		Log::Write(TL(application_name), L"TNP Reliable sent:"+Stringify(rs._sent)+L" Retransmitted:"+Stringify(rs._retransmitted)+L" Rate-limited:"+Stringify(rs._retransmitsDropped)+L" Missing:"+Stringify(rs._missing)+L" Recovered:"+Stringify(rs._recovered)+L" Lost:"+Stringify(rs._lost));
 	}
 
 	ref<tj::np::WebServer> fs = _app->GetFileServer();
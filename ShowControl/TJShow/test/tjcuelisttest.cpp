@@ -0,0 +1,372 @@
+/* TJShow (C) Tommy van der Vorst, Pixelspark, 2005-2017.
+ *
+ * This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Compares the lookups of the sorted cue index used by CueList (GetCueAt, GetNextCue with and without an action filter,
+GetPreviousCue and GetCuesBetween with a cursor per playing thread) with the original implementations, which scanned all
+cues, on random cue lists. The lists are edited between lookups: cues are added, removed and moved across other cues, and
+many cues share the same time. Then measures the lookups on a list with 10.000 cues. */
+#include <TJShared/include/tjshared.h>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+using tj::shared::ref;
+using tj::shared::weak;
+using tj::shared::strong;
+using tj::shared::Time;
+
+#include "../include/internal/tjcueindex.h"
+
+using namespace tj::shared;
+using namespace tj::show;
+
+namespace tj {
+	namespace show {
+		namespace test {
+			/** Stands in for Cue, which cannot be built without the rest of TJShow **/
+			class MockCue: public virtual Object {
+				public:
+					enum Action {
+						ActionNone=0,
+						ActionStop,
+						ActionStart,
+						ActionPause,
+					};
+
+					MockCue(Time t, Action a): _t(t), _action(a) {
+					}
+
+					virtual ~MockCue() {
+					}
+
+					Time GetTime() const {
+						return _t;
+					}
+
+					Action GetAction() const {
+						return _action;
+					}
+
+					Time _t;
+					Action _action;
+			};
+
+			typedef std::vector< ref<MockCue> > CueVector;
+
+			/** The lookups of CueList as they were before the cues were indexed; they are applied to the cues in the
+			order in which the index keeps them (the original list was also sorted, see CueList::AddCue) **/
+			class LinearCueList {
+				public:
+					LinearCueList(const CueVector& cues): _cues(cues) {
+					}
+
+					ref<MockCue> GetCueAt(Time t) const {
+						CueVector::const_iterator it = _cues.begin();
+						while(it!=_cues.end()) {
+							ref<MockCue> c = *it;
+							if(c->GetTime()==t) {
+								return c;
+							}
+							++it;
+						}
+						return 0;
+					}
+
+					ref<MockCue> GetNextCue(const Time& t, MockCue::Action filter) const {
+						ref<MockCue> match = 0;
+						CueVector::const_iterator it = _cues.begin();
+						while(it!=_cues.end()) {
+							ref<MockCue> cue = *it;
+							if(cue->GetTime()>t && (filter==MockCue::ActionNone || cue->GetAction()==filter) ) {
+								if(!match) {
+									match = cue;
+								}
+								else {
+									Time mdiff = match->GetTime() - t;
+									Time cdiff = cue->GetTime() - t;
+									if(cdiff < mdiff) {
+										match = cue;
+									}
+								}
+							}
+							++it;
+						}
+						return match;
+					}
+
+					void GetCuesBetween(Time start, Time end, std::list< ref<MockCue> >& matches) const {
+						CueVector::const_iterator it = _cues.begin();
+						while(it!=_cues.end()) {
+							ref<MockCue> cue = *it;
+							Time ctime = cue->GetTime();
+							if(ctime>start && ctime <= end) {
+								matches.push_back(cue);
+							}
+							++it;
+						}
+					}
+
+					ref<MockCue> GetPreviousCue(Time t) const {
+						ref<MockCue> match = 0;
+						CueVector::const_iterator it = _cues.begin();
+						while(it!=_cues.end()) {
+							ref<MockCue> cue = *it;
+							if(cue->GetTime()<t) {
+								if(!match) {
+									match = cue;
+								}
+								else {
+									Time mdiff = match->GetTime() - t;
+									Time cdiff = cue->GetTime() - t;
+									if(cdiff > mdiff) {
+										match = cue;
+									}
+								}
+							}
+							++it;
+						}
+						return match;
+					}
+
+				protected:
+					const CueVector& _cues;
+			};
+
+			/** A thread that plays back the list, like CueThread: it asks for the cues between the previous and the
+			current tick, keeping a cursor **/
+			struct MockPlayback {
+				MockPlayback(): _last(0) {
+				}
+
+				Time _last;
+				CueCursor _cursor;
+			};
+
+			const static int KLists = 250;
+			const static int KEdits = 100;
+			const static int KPlaybacks = 3;
+
+			static int _failures = 0;
+
+			static void Check(bool ok, const char* what, int list, int t) {
+				if(!ok) {
+					if(_failures < 20) {
+						printf("list %d: %s differs at t=%d\n", list, what, t);
+					}
+					++_failures;
+				}
+			}
+
+			static MockCue::Action RandomAction() {
+				return MockCue::Action(rand()%4);
+			}
+
+			/** Returns a random time; half of the times are the time of an existing cue, so that many cues share a time **/
+			static Time RandomTime(const CueVector& cues, int maximumTime) {
+				if(cues.size()>0 && rand()%2==0) {
+					return cues.at(rand()%cues.size())->GetTime();
+				}
+				return Time(rand()%maximumTime);
+			}
+
+			/** Checks that the index is sorted and holds exactly the cues in the model (in any order) **/
+			static void CheckContents(const CueVector& indexed, const CueVector& model, int list) {
+				bool sorted = true;
+				for(unsigned int a=1;a<indexed.size();a++) {
+					sorted = sorted && !(indexed.at(a)->GetTime() < indexed.at(a-1)->GetTime());
+				}
+				Check(sorted, "order", list, -1);
+
+				CueVector left(indexed.begin(), indexed.end());
+				CueVector right(model.begin(), model.end());
+				std::sort(left.begin(), left.end());
+				std::sort(right.begin(), right.end());
+				Check(left==right, "contents", list, -1);
+			}
+
+			static void CheckLookups(CueIndex<MockCue>& index, const LinearCueList& linear, int list, const std::vector<int>& times) {
+				for(unsigned int a=0;a<times.size();a++) {
+					Time t(times[a]);
+					Check(index.GetCueAt(t)==linear.GetCueAt(t), "GetCueAt", list, times[a]);
+					Check(index.GetPreviousCue(t)==linear.GetPreviousCue(t), "GetPreviousCue", list, times[a]);
+					for(int action=MockCue::ActionNone;action<=MockCue::ActionPause;action++) {
+						Check(index.GetNextCue(t, MockCue::Action(action))==linear.GetNextCue(t, MockCue::Action(action)), "GetNextCue", list, times[a]);
+					}
+
+					Time end(times[a] + rand()%500);
+					std::list< ref<MockCue> > indexed, expected;
+					CueCursor cursor;
+					index.GetCuesBetween(t, end, indexed, cursor);
+					linear.GetCuesBetween(t, end, expected);
+					Check(indexed==expected, "GetCuesBetween", list, times[a]);
+				}
+			}
+
+			/** Applies a random edit to both the index and the model **/
+			static void Edit(CueIndex<MockCue>& index, CueVector& model, int maximumTime) {
+				int what = rand()%10;
+				if(model.size()==0 || what<3) {
+					ref<MockCue> cue = GC::Hold(new MockCue(RandomTime(model, maximumTime), RandomAction()));
+					index.Add(cue);
+					model.push_back(cue);
+				}
+				else if(what<6) {
+					// Move a cue, usually across other cues and often to the time of another cue
+					ref<MockCue> cue = model.at(rand()%model.size());
+					cue->_t = RandomTime(model, maximumTime);
+					index.OnChanged(cue);
+				}
+				else if(what<7) {
+					ref<MockCue> cue = model.at(rand()%model.size());
+					cue->_action = RandomAction();
+					index.OnChanged(cue);
+				}
+				else if(what<9) {
+					unsigned int position = rand()%model.size();
+					index.Remove(model.at(position));
+					model.erase(model.begin()+position);
+
+					// Removing a cue that is not in the list does nothing
+					index.Remove(GC::Hold(new MockCue(RandomTime(model, maximumTime), RandomAction())));
+				}
+				else {
+					Time a(rand()%maximumTime);
+					Time b = a + Time(rand()%(maximumTime/10+1));
+					index.RemoveBetween(a, b);
+					CueVector left;
+					for(unsigned int c=0;c<model.size();c++) {
+						Time t = model.at(c)->GetTime();
+						if(t<a || t>b) {
+							left.push_back(model.at(c));
+						}
+					}
+					model = left;
+				}
+			}
+
+			static void TestLookups() {
+				for(int l=0;l<KLists;l++) {
+					// Some lists only use a few distinct times, so that many cues are at the same time
+					int maximumTime = (rand()%3==0) ? 50 : 10000;
+					CueIndex<MockCue> index;
+					CueVector model;
+					int count = rand()%200;
+					for(int a=0;a<count;a++) {
+						ref<MockCue> cue = GC::Hold(new MockCue(RandomTime(model, maximumTime), RandomAction()));
+						index.Add(cue);
+						model.push_back(cue);
+					}
+
+					std::vector<MockPlayback> playbacks(KPlaybacks);
+					for(int e=0;e<KEdits;e++) {
+						CueVector indexed(index.GetBegin(), index.GetEnd());
+						LinearCueList linear(indexed);
+						CheckContents(indexed, model, l);
+
+						// Query times: random times, and the times of some cues and their neighbours
+						std::vector<int> times;
+						for(int a=0;a<5;a++) {
+							times.push_back(rand()%(maximumTime+100));
+						}
+						for(int a=0;a<5 && indexed.size()>0;a++) {
+							int t = indexed.at(rand()%indexed.size())->GetTime().ToInt();
+							times.push_back(t);
+							times.push_back(t+1);
+							times.push_back(Util::Max(t-1, 0));
+						}
+						CheckLookups(index, linear, l, times);
+
+						// Each playback moves ahead by a random step, with an occasional jump back
+						for(int p=0;p<KPlaybacks;p++) {
+							MockPlayback& playback = playbacks[p];
+							int now = playback._last.ToInt() + ((rand()%20==0) ? -(rand()%(maximumTime/2+1)) : rand()%(maximumTime/20+1));
+							now = Util::Max(now, 0);
+							std::list< ref<MockCue> > indexedCues, expectedCues;
+							index.GetCuesBetween(playback._last, Time(now), indexedCues, playback._cursor);
+							linear.GetCuesBetween(playback._last, Time(now), expectedCues);
+							Check(indexedCues==expectedCues, "GetCuesBetween with a cursor", l, now);
+							playback._last = Time(now);
+						}
+
+						Edit(index, model, maximumTime);
+					}
+				}
+
+				printf("lookups: %d lists, %d edits each, %d failures\n", KLists, KEdits, _failures);
+			}
+
+			static void Benchmark() {
+				const static int KCues = 10000;
+				const static int KLinearLookups = 500;
+				const static int KLookups = 1000000;
+
+				CueIndex<MockCue> index;
+				Timestamp start(true);
+				for(int a=0;a<KCues;a++) {
+					index.Add(GC::Hold(new MockCue(Time(rand()%(KCues*10)), RandomAction())));
+				}
+				printf("benchmark: adding %d cues took %.1f ms\n", KCues, double(Timestamp(true).Difference(start).ToMilliSeconds()));
+
+				CueVector indexed(index.GetBegin(), index.GetEnd());
+				LinearCueList linear(indexed);
+				int maximumTime = KCues*10;
+				int sum = 0;
+
+				start = Timestamp(true);
+				for(int a=0;a<KLinearLookups;a++) {
+					sum += linear.GetNextCue(Time(rand()%maximumTime), MockCue::ActionStart) ? 1 : 0;
+				}
+				double linearTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLinearLookups;
+
+				start = Timestamp(true);
+				for(int a=0;a<KLookups;a++) {
+					sum += index.GetNextCue(Time(rand()%maximumTime), MockCue::ActionStart) ? 1 : 0;
+				}
+				double indexedTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLookups;
+
+				// Playback: one tick every millisecond
+				start = Timestamp(true);
+				for(int a=0;a<KLinearLookups;a++) {
+					std::list< ref<MockCue> > cues;
+					linear.GetCuesBetween(Time(a), Time(a+1), cues);
+					sum += (int)cues.size();
+				}
+				double linearTickTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLinearLookups;
+
+				CueCursor cursor;
+				start = Timestamp(true);
+				for(int a=0;a<KLookups;a++) {
+					std::list< ref<MockCue> > cues;
+					index.GetCuesBetween(Time(a%maximumTime), Time(a%maximumTime+1), cues, cursor);
+					sum += (int)cues.size();
+				}
+				double cursorTickTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLookups;
+
+				printf("benchmark (%d cues, microseconds per call):\n", KCues);
+				printf("  GetNextCue (action filter): linear %.3f, indexed %.3f (%.0fx)\n", linearTime, indexedTime, linearTime/indexedTime);
+				printf("  GetCuesBetween (sequential ticks): linear %.3f, with cursor %.3f (%.0fx)\n", linearTickTime, cursorTickTime, linearTickTime/cursorTickTime);
+				printf("  (checksum %d)\n", sum);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+	tj::show::test::TestLookups();
+	tj::show::test::Benchmark();
+	return (tj::show::test::_failures==0) ? 0 : 1;
+}
@@ -0,0 +1,290 @@
+/* TJShow (C) Tommy van der Vorst, Pixelspark, 2005-2017.
+ *
+ * This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Compares the ordered lookups in Fader<T> (GetValueAt, GetNearest, GetNextEvent, GetNextPoint), FaderSampler and
+FaderSnapshot with the original implementations, which scanned all points, on random faders. Then measures the
+lookups on a fader with 100.000 points. */
+#include <TJShared/include/tjshared.h>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+using tj::shared::ref;
+using tj::shared::weak;
+using tj::shared::strong;
+using tj::shared::Time;
+
+#include "../include/tjfader.h"
+
+using namespace tj::shared;
+using namespace tj::show;
+
+namespace tj {
+	namespace show {
+		namespace test {
+			/** The lookups of Fader<T> as they were before they used the ordering of the point map **/
+			template<typename T> class LinearFader {
+				public:
+					LinearFader(const std::map<Time, T>& points, const T& defaultValue): _points(points), _default(defaultValue) {
+					}
+
+					T GetValueAt(const Time& t) const {
+						typename std::map<Time,T>::const_iterator it = _points.begin();
+						Time nearSmallerT = 0;
+						T nearSmallerV = _default;
+						Time nearBiggerT = 999999999;
+						T nearBiggerV = _default;
+						while(it!=_points.end()) {
+							T value = it->second;
+							Time time = it->first;
+
+							if(time<=t && time>=nearSmallerT) {
+								nearSmallerT = time;
+								nearSmallerV = value;
+							}
+							else if(time>t && time<nearBiggerT) {
+								nearBiggerT = time;
+								nearBiggerV = value;
+							}
+							++it;
+						}
+
+						T dV = nearBiggerV-nearSmallerV;
+						Time dT = nearBiggerT - nearSmallerT;
+						if(dT==Time(0)) return nearSmallerV;
+						float percent = float(t-nearSmallerT) / float(nearBiggerT-nearSmallerT);
+
+						return T(float(nearSmallerV) + percent*float(dV));
+					}
+
+					Time GetNearest(const Time& t) const {
+						Time nearest = -1;
+
+						typename std::map<Time, T>::const_iterator it = _points.begin();
+						while(it!=_points.end()) {
+							std::pair<Time, T> data = *it;
+							if(nearest==Time(-1) || (abs(int(t-data.first)))<abs(int(t-nearest))) {
+								nearest = data.first;
+							}
+							++it;
+						}
+
+						return nearest;
+					}
+
+					Time GetNextEvent(const Time& t) const {
+						Time nearest = GetNextPoint(t);
+						if(nearest==Time(-1)) return nearest;
+
+						T nearestValue = GetValueAt(nearest);
+						if(nearestValue != GetValueAt(t)) {
+							return t+Time(1);
+						}
+
+						return nearest;
+					}
+
+					Time GetNextPoint(const Time& t) const {
+						Time nearest = Time(-1);
+
+						typename std::map<Time, T>::const_iterator it = _points.begin();
+						while(it!=_points.end()) {
+							std::pair<Time, T> data = *it;
+							if(data.first>t) {
+								if(nearest==Time(-1) || (abs(int(t-data.first)))<abs(int(t-nearest))) {
+									nearest = data.first;
+								}
+							}
+							++it;
+						}
+
+						return nearest;
+					}
+
+				protected:
+					const std::map<Time, T>& _points;
+					T _default;
+			};
+
+			const static int KFaders = 2000;
+			const static int KMaximumTime = 10000;
+
+			static int _failures = 0;
+
+			static void Check(bool ok, const char* what, int fader, int t) {
+				if(!ok) {
+					if(_failures < 20) {
+						printf("fader %d: %s differs at t=%d\n", fader, what, t);
+					}
+					++_failures;
+				}
+			}
+
+			static float RandomValue() {
+				return float(rand()%1001) / 1000.0f;
+			}
+
+			/** Creates a fader with a random number of points. Some faders only use a few distinct values, so that
+			they have flat segments (where GetNextEvent skips to the next point). **/
+			static ref< Fader<float> > CreateRandomFader() {
+				ref< Fader<float> > fader = GC::Hold(new Fader<float>(RandomValue(), 0.0f, 1.0f));
+				int count = rand()%64;
+				bool flat = (rand()%2)==0;
+				for(int a=0;a<count;a++) {
+					float value = flat ? float(rand()%3) / 2.0f : RandomValue();
+					fader->SetPoint(Time(rand()%KMaximumTime), value);
+				}
+
+				// Points close to each other and at the start
+				if(rand()%2==0) {
+					Time t = Time(rand()%KMaximumTime);
+					fader->SetPoint(t, RandomValue());
+					fader->SetPoint(t+Time(1), RandomValue());
+				}
+				if(rand()%4==0) {
+					fader->SetPoint(Time(0), RandomValue());
+				}
+				return fader;
+			}
+
+			static void TestLookups() {
+				for(int f=0;f<KFaders;f++) {
+					ref< Fader<float> > fader = CreateRandomFader();
+					LinearFader<float> linear(*(fader->GetPoints()), fader->GetDefaultValue());
+
+					// Query times: random times, every point and its neighbours, and times beyond the last point
+					std::vector<int> times;
+					for(int a=0;a<200;a++) {
+						times.push_back(rand()%(KMaximumTime+1000));
+					}
+
+					std::map<Time, float>::const_iterator it = fader->GetPoints()->begin();
+					while(it!=fader->GetPoints()->end()) {
+						int t = it->first.ToInt();
+						times.push_back(t);
+						times.push_back(t+1);
+						if(t>0) {
+							times.push_back(t-1);
+						}
+						++it;
+					}
+
+					for(unsigned int a=0;a<times.size();a++) {
+						Time t(times[a]);
+						Check(fader->GetValueAt(t)==linear.GetValueAt(t), "GetValueAt", f, times[a]);
+						Check(fader->GetNearest(t)==linear.GetNearest(t), "GetNearest", f, times[a]);
+						Check(fader->GetNextEvent(t)==linear.GetNextEvent(t), "GetNextEvent", f, times[a]);
+						Check(fader->GetNextPoint(t)==linear.GetNextPoint(t), "GetNextPoint", f, times[a]);
+						Check(fader->GetSnapshot()->GetValueAt(t)==linear.GetValueAt(t), "FaderSnapshot::GetValueAt", f, times[a]);
+					}
+
+					// The sampler is used with increasing times, with an occasional jump back
+					FaderSampler<float> sampler(fader);
+					int t = 0;
+					while(t < KMaximumTime+1000) {
+						Check(sampler.GetValueAt(Time(t))==linear.GetValueAt(Time(t)), "FaderSampler::GetValueAt", f, t);
+						t += (rand()%50==0) ? -(rand()%500) : (rand()%200);
+						t = Util::Max(t, 0);
+					}
+				}
+
+				printf("lookups: %d faders, %d failures\n", KFaders, _failures);
+			}
+
+			static void Benchmark() {
+				const static int KPoints = 100000;
+				const static int KLinearLookups = 500;
+				const static int KLookups = 1000000;
+
+				ref< Fader<float> > fader = GC::Hold(new Fader<float>(0.0f, 0.0f, 1.0f));
+				std::vector<Time> times;
+				std::vector<float> values;
+				for(int a=0;a<KPoints;a++) {
+					times.push_back(Time(a*10));
+					values.push_back(RandomValue());
+				}
+
+				Timestamp start(true);
+				fader->AddPoints(times, values);
+				printf("benchmark: adding %d points took %.1f ms\n", KPoints, double(Timestamp(true).Difference(start).ToMilliSeconds()));
+
+				LinearFader<float> linear(*(fader->GetPoints()), fader->GetDefaultValue());
+				int maximumTime = KPoints*10;
+				float sum = 0.0f;
+
+				start = Timestamp(true);
+				for(int a=0;a<KLinearLookups;a++) {
+					sum += linear.GetValueAt(Time(rand()%maximumTime));
+				}
+				double linearTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLinearLookups;
+
+				start = Timestamp(true);
+				for(int a=0;a<KLookups;a++) {
+					sum += fader->GetValueAt(Time(rand()%maximumTime));
+				}
+				double orderedTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLookups;
+
+				start = Timestamp(true);
+				for(int a=0;a<KLinearLookups;a++) {
+					sum += float(linear.GetNextEvent(Time(rand()%maximumTime)).ToInt());
+				}
+				double linearEventTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLinearLookups;
+
+				start = Timestamp(true);
+				for(int a=0;a<KLookups;a++) {
+					sum += float(fader->GetNextEvent(Time(rand()%maximumTime)).ToInt());
+				}
+				double orderedEventTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLookups;
+
+				start = Timestamp(true);
+				for(int a=0;a<KLookups;a++) {
+					sum += float(fader->GetNearest(Time(rand()%maximumTime)).ToInt());
+				}
+				double orderedNearestTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLookups;
+
+				// Playback: one sample every millisecond
+				FaderSampler<float> sampler(fader);
+				start = Timestamp(true);
+				for(int a=0;a<KLookups;a++) {
+					sum += sampler.GetValueAt(Time(a));
+				}
+				double samplerTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLookups;
+
+				ref< FaderSnapshot<float> > snapshot = fader->GetSnapshot();
+				start = Timestamp(true);
+				for(int a=0;a<KLookups;a++) {
+					sum += snapshot->GetValueAt(Time(rand()%maximumTime));
+				}
+				double snapshotTime = Timestamp(true).Difference(start).ToMilliSeconds() * 1000.0 / KLookups;
+
+				printf("benchmark (%d points, microseconds per call):\n", KPoints);
+				printf("  GetValueAt: linear %.3f, ordered %.3f (%.0fx)\n", linearTime, orderedTime, linearTime/orderedTime);
+				printf("  GetNextEvent: linear %.3f, ordered %.3f (%.0fx)\n", linearEventTime, orderedEventTime, linearEventTime/orderedEventTime);
+				printf("  GetNearest: ordered %.3f\n", orderedNearestTime);
+				printf("  FaderSampler::GetValueAt (sequential): %.3f\n", samplerTime);
+				printf("  FaderSnapshot::GetValueAt: %.3f\n", snapshotTime);
+				printf("  (checksum %f)\n", sum);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+	tj::show::test::TestLookups();
+	tj::show::test::Benchmark();
+	return (tj::show::test::_failures==0) ? 0 : 1;
+}
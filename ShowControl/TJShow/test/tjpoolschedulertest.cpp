@@ -0,0 +1,278 @@
+/* TJShow (C) Tommy van der Vorst, Pixelspark, 2005-2017.
+ *
+ * This file is part of TJShow. TJShow is free software: you
+ * can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TJShow is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TJShow.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Tests the ordering and coalescing of PoolScheduler (as used by PoolEngine), and then runs a headless benchmark in which
+10.000 mock players are ticked through the scheduler: once as fast as possible (in simulated time) and once in real time,
+the way a pool thread does it (see PoolEngine::Schedule and PoolEngine::TakeWork). Usage: tjpoolschedulertest [players] [seconds] */
+#include <TJShared/include/tjshared.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using tj::shared::ref;
+using tj::shared::weak;
+using tj::shared::strong;
+using tj::shared::Time;
+
+#include "../include/internal/engine/tjpoolscheduler.h"
+
+using namespace tj::shared;
+using namespace tj::show::engine;
+
+namespace tj {
+	namespace show {
+		namespace test {
+			struct MockMessage {
+				inline MockMessage(): player(-1), time(-1) {
+				}
+
+				inline MockMessage(int p, const Time& t): player(p), time(t) {
+				}
+
+				int player;
+				Time time;
+			};
+
+			/** A mock player asks to be ticked every 'period' milliseconds **/
+			struct MockPlayer {
+				inline MockPlayer(): period(0), ticks(0) {
+				}
+
+				int period;
+				int ticks;
+			};
+
+			static int _failures = 0;
+
+			static void Check(bool ok, const char* what) {
+				if(!ok) {
+					printf("failed: %s\n", what);
+					++_failures;
+				}
+			}
+
+			static void TestOrdering() {
+				PoolScheduler<MockMessage> scheduler;
+				std::deque<MockMessage> queue;
+				Check(scheduler.GetNextDue() < 0.0, "empty scheduler has no next due time");
+				Check(scheduler.PopDue(1000.0, queue)==0 && queue.empty(), "empty scheduler pops nothing");
+
+				// Add returns true only when the new message is due before all others; ties go to the message added first
+				Check(scheduler.Add(MockMessage(0, 30), 30.0), "first message is first");
+				Check(scheduler.Add(MockMessage(1, 10), 10.0), "earlier message is first");
+				Check(!scheduler.Add(MockMessage(2, 20), 20.0), "later message is not first");
+				Check(!scheduler.Add(MockMessage(3, 10), 10.0), "message due at the same time is not first");
+				Check(!scheduler.Add(MockMessage(4, 30), 30.0), "message due at the same time as the last is not first");
+				Check(scheduler.Add(MockMessage(5, 5), 5.0), "earliest message is first");
+				Check(scheduler.GetSize()==6 && scheduler.GetNextDue()==5.0, "size and next due time");
+
+				Check(scheduler.PopDue(25.0, queue)==4, "messages due at or before 25 are popped");
+				int expected[] = {5, 1, 3, 2, 0, 4};
+				Check(queue.size()==4, "queue has four messages");
+				for(unsigned int a=0;a<queue.size() && a<4;a++) {
+					Check(queue[a].player==expected[a], "messages are popped in order of due time, then order of adding");
+				}
+				Check(scheduler.GetSize()==2 && scheduler.GetNextDue()==30.0, "messages that are not due stay");
+
+				queue.clear();
+				Check(scheduler.PopDue(30.0, queue)==2, "messages due exactly at 'until' are popped");
+				Check(queue.size()==2 && queue[0].player==expected[4] && queue[1].player==expected[5], "ties are popped in order of adding");
+				Check(scheduler.GetSize()==0 && scheduler.GetNextDue() < 0.0, "scheduler is empty");
+
+				// Random due times with many ties; players are numbered in order of adding
+				const static int KMessages = 10000;
+				std::vector<int> dues(KMessages);
+				for(int a=0;a<KMessages;a++) {
+					dues[a] = rand()%100;
+					scheduler.Add(MockMessage(a, 0), (long double)dues[a]);
+				}
+				queue.clear();
+				scheduler.PopDue(1000.0, queue);
+				Check(queue.size()==KMessages, "all random messages are popped");
+
+				bool ordered = true;
+				for(unsigned int a=1;a<queue.size();a++) {
+					int p = queue[a-1].player;
+					int q = queue[a].player;
+					if(dues[p] > dues[q] || (dues[p]==dues[q] && p > q)) {
+						ordered = false;
+					}
+				}
+				Check(ordered, "random messages are popped in order of due time, then order of adding");
+
+				// Clear removes everything
+				scheduler.Add(MockMessage(0, 0), 1.0);
+				scheduler.Clear();
+				Check(scheduler.GetSize()==0 && scheduler.GetNextDue() < 0.0, "Clear empties the scheduler");
+			}
+
+			static void TestCoalescing() {
+				PoolScheduler<MockMessage> scheduler;
+				std::deque<MockMessage> queue;
+				unsigned int coalesced = 99;
+
+				Check(scheduler.PopDueCoalesced(100.0, 2.5, queue, coalesced)==0 && coalesced==0, "empty scheduler coalesces nothing");
+
+				// Nothing is popped when the first message is not due within the window
+				scheduler.Add(MockMessage(0, 103), 103.0);
+				scheduler.Add(MockMessage(1, 200), 200.0);
+				Check(scheduler.PopDueCoalesced(100.0, 2.5, queue, coalesced)==0 && coalesced==0 && queue.empty(), "no message due within the window");
+
+				// Messages due at most 'window' after now are fired together with the messages that are due
+				scheduler.Add(MockMessage(2, 101), 101.0);
+				scheduler.Add(MockMessage(3, 100), 100.0);
+				scheduler.Add(MockMessage(4, 102), 102.5);
+				scheduler.Add(MockMessage(5, 95), 95.0);
+				Check(scheduler.PopDueCoalesced(100.0, 2.5, queue, coalesced)==4, "due and coalesced messages are popped");
+				Check(coalesced==2, "messages that were not yet due are counted as coalesced");
+				int expected[] = {5, 3, 2, 4};
+				Check(queue.size()==4, "queue has the due and coalesced messages");
+				for(unsigned int a=0;a<queue.size() && a<4;a++) {
+					Check(queue[a].player==expected[a], "due messages come before coalesced messages, in order of due time");
+				}
+				Check(scheduler.GetSize()==2 && scheduler.GetNextDue()==103.0, "messages after the window stay");
+
+				// Only coalesced messages (the first one is due within the window, but none is due yet)
+				queue.clear();
+				Check(scheduler.PopDueCoalesced(101.0, 2.5, queue, coalesced)==1 && coalesced==1 && queue[0].player==0, "message due within the window is fired early");
+			}
+
+			const static int KMinimumTickLength = 5;
+
+			/** Schedules the next tick of a player like PoolEngine::Schedule does: not earlier than the minimum tick length
+			after the current time **/
+			static void Reschedule(PoolScheduler<MockMessage>& scheduler, std::vector<MockPlayer>& players, const MockMessage& msg, long double now) {
+				// Like PoolThread::ExecutePoolMessage: a player that is ticked early is ticked with the time it asked for
+				Time current = Time(int(now));
+				Time t = (msg.time > current) ? msg.time : current;
+				Time next = t + Time(players[msg.player].period);
+				int delay = Util::Max(int(next - current), KMinimumTickLength);
+				scheduler.Add(MockMessage(msg.player, next), now + (long double)delay);
+			}
+
+			static void CreatePlayers(std::vector<MockPlayer>& players, int count) {
+				players.resize(count);
+				for(int a=0;a<count;a++) {
+					players[a].period = 10 + rand()%91;
+					players[a].ticks = 0;
+				}
+			}
+
+			/** Ticks the players in simulated time (the clock jumps to the next due tick), which measures the cost of the
+			scheduler itself **/
+			static void BenchmarkSimulated(int playerCount, int seconds) {
+				std::vector<MockPlayer> players;
+				CreatePlayers(players, playerCount);
+				PoolScheduler<MockMessage> scheduler;
+				for(int a=0;a<playerCount;a++) {
+					scheduler.Add(MockMessage(a, 0), 0.0);
+				}
+
+				std::deque<MockMessage> queue;
+				long double window = (long double)KMinimumTickLength / 2.0;
+				long double end = (long double)seconds * 1000.0;
+				long double now = 0.0;
+				unsigned int ticks = 0, coalesced = 0, batches = 0;
+
+				Timestamp start(true);
+				while(now >= 0.0 && now < end) {
+					unsigned int c = 0;
+					scheduler.PopDueCoalesced(now, window, queue, c);
+					coalesced += c;
+					++batches;
+
+					while(!queue.empty()) {
+						MockMessage msg = queue.front();
+						queue.pop_front();
+						++(players[msg.player].ticks);
+						++ticks;
+						Reschedule(scheduler, players, msg, now);
+					}
+					now = scheduler.GetNextDue();
+				}
+				double wall = double(Timestamp(true).Difference(start).ToMilliSeconds());
+
+				printf("simulated: %d players, %d s: %u ticks in %u batches (%.1f%% coalesced), %.0f ms wall time, %.0f ns per tick\n",
+					playerCount, seconds, ticks, batches, 100.0*double(coalesced)/double(ticks), wall, wall*1000000.0/double(ticks));
+			}
+
+			/** Ticks the players in real time on one thread, which waits for the next due tick like a pool thread does **/
+			static void BenchmarkRealTime(int playerCount, int seconds) {
+				std::vector<MockPlayer> players;
+				CreatePlayers(players, playerCount);
+				double ideal = 0.0;
+				for(int a=0;a<playerCount;a++) {
+					ideal += 1000.0 / double(players[a].period);
+				}
+
+				PoolScheduler<MockMessage> scheduler;
+				long double now = scheduler.GetNow();
+				for(int a=0;a<playerCount;a++) {
+					scheduler.Add(MockMessage(a, Time(int(now))), now);
+				}
+
+				Semaphore wait;
+				std::deque<MockMessage> queue;
+				long double window = (long double)KMinimumTickLength / 2.0;
+				long double end = now + (long double)seconds * 1000.0;
+				unsigned int ticks = 0, coalesced = 0, late = 0;
+				double totalLateness = 0.0, maximumLateness = 0.0;
+
+				while((now = scheduler.GetNow()) < end) {
+					unsigned int c = 0;
+					if(scheduler.PopDueCoalesced(now, window, queue, c)==0) {
+						int waitTime = Util::Max(1, int(double(scheduler.GetNextDue() - window - now)));
+						wait.Wait(Time(waitTime));
+						continue;
+					}
+					coalesced += c;
+
+					while(!queue.empty()) {
+						MockMessage msg = queue.front();
+						queue.pop_front();
+						long double tickTime = scheduler.GetNow();
+						double lateness = Util::Max(0.0, double(tickTime - (long double)msg.time.ToInt()));
+						totalLateness += lateness;
+						maximumLateness = Util::Max(maximumLateness, lateness);
+						if(lateness > double(2*KMinimumTickLength)) {
+							++late;
+						}
+
+						++(players[msg.player].ticks);
+						++ticks;
+						Reschedule(scheduler, players, msg, tickTime);
+					}
+				}
+
+				printf("real time: %d players, %d s: %.0f ticks/s (ideal %.0f), average lateness %.2f ms, maximum %.1f ms, %.2f%% late, %.1f%% coalesced\n",
+					playerCount, seconds, double(ticks)/double(seconds), ideal, totalLateness/double(ticks), maximumLateness, 100.0*double(late)/double(ticks), 100.0*double(coalesced)/double(ticks));
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	int players = (argc > 1) ? atoi(argv[1]) : 10000;
+	int seconds = (argc > 2) ? atoi(argv[2]) : 3;
+	srand(1);
+
+	tj::show::test::TestOrdering();
+	tj::show::test::TestCoalescing();
+	printf("ordering and coalescing: %d failures\n", tj::show::test::_failures);
+
+	tj::show::test::BenchmarkSimulated(players, seconds*10);
+	tj::show::test::BenchmarkRealTime(players, seconds);
+	return (tj::show::test::_failures==0) ? 0 : 1;
+}